@@ -0,0 +1,270 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#include "stdafx.h"
+#include "Autotuner.h"
+#include <algorithm>
+#include <map>
+#include <tuple>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+static const uint32_t GrainSizes[] = { 64, 128, 256, 512, 1024 };
+static const uint32_t Unrolls[] = { 4, 8, 16 };
+static const uint32_t TileSizes[] = { 0, 256, 1024, 4096 };
+
+static const int MaxSweeps = 3;
+
+static void CpuId(uint32_t leaf, uint32_t subLeaf, uint32_t registers[4])
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuidex(info, static_cast<int>(leaf), static_cast<int>(subLeaf));
+    for (int ii = 0; ii < 4; ii++)
+        registers[ii] = static_cast<uint32_t>(info[ii]);
+#else
+    __cpuid_count(leaf, subLeaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+}
+
+static uint64_t ReadXCR0()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    uint32_t low, high;
+    __asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+    return (static_cast<uint64_t>(high) << 32) | low;
+#endif
+}
+
+//
+// The same checks the ISPC dispatcher makes: the instruction set, and the OS saving its register state.
+//
+static const char* GetIspcTarget()
+{
+    uint32_t registers[4];
+    CpuId(0, 0, registers);
+    const uint32_t maxLeaf = registers[0];
+
+    CpuId(1, 0, registers);
+    const bool sse4 = (registers[2] & (1u << 19)) != 0;
+    const bool osxsave = (registers[2] & (1u << 27)) != 0;
+    const uint64_t xcr0 = osxsave ? ReadXCR0() : 0;
+    const bool osAvx = (xcr0 & 0x6) == 0x6;
+    const bool osAvx512 = (xcr0 & 0xE6) == 0xE6;
+
+    uint32_t leaf7[4] = {};
+    if (maxLeaf >= 7)
+        CpuId(7, 0, leaf7);
+
+    const bool avx2 = (leaf7[1] & (1u << 5)) != 0;
+    const uint32_t skxMask = (1u << 16) | (1u << 17) | (1u << 28) | (1u << 30) | (1u << 31);  // F, DQ, CD, BW, VL
+
+    if (osAvx512 && (leaf7[1] & skxMask) == skxMask)
+        return "avx512skx";
+    if (osAvx && avx2)
+        return "avx2";
+    if (sse4)
+        return "sse4";
+    return "sse2";
+}
+
+Autotuner::KernelConfig Autotuner::GetDefaultConfig(int hardwareThreads)
+{
+    KernelConfig config;
+    config.grainSize = 256;
+    config.unroll = 8;
+    config.tileSize = 0;
+    config.threads = hardwareThreads;
+    return config;
+}
+
+std::string Autotuner::GetHostKey()
+{
+    uint32_t registers[4];
+    std::string brand;
+
+    CpuId(0x80000000, 0, registers);
+    if (registers[0] >= 0x80000004)
+    {
+        char text[49] = {};
+        for (uint32_t leaf = 0; leaf < 3; leaf++)
+            CpuId(0x80000002 + leaf, 0, reinterpret_cast<uint32_t*>(text + 16 * leaf));
+
+        brand = text;
+        size_t first = brand.find_first_not_of(' ');
+        size_t last = brand.find_last_not_of(' ');
+        brand = (first == std::string::npos) ? std::string() : brand.substr(first, last - first + 1);
+    }
+
+    if (brand.empty())
+        brand = "Unknown CPU";
+
+    return brand + " / " + GetIspcTarget();
+}
+
+//
+// Cache lines are "<host key>\t<particle count>\t<grain> <unroll> <tile> <threads>".
+//
+bool Autotuner::LoadConfig(const wchar_t* pPath, uint32_t particleCount, KernelConfig* pConfig)
+{
+    FILE* pFile = nullptr;
+    if (_wfopen_s(&pFile, pPath, L"rt") != 0 || !pFile)
+        return false;
+
+    const std::string hostKey = GetHostKey();
+    bool found = false;
+    char line[512];
+
+    while (!found && fgets(line, sizeof(line), pFile))
+    {
+        char* pTab = strchr(line, '\t');
+        if (!pTab || std::string(line, pTab) != hostKey)
+            continue;
+
+        unsigned int count, grainSize, unroll, tileSize;
+        int threads;
+        if (sscanf_s(pTab + 1, "%u\t%u %u %u %d", &count, &grainSize, &unroll, &tileSize, &threads) != 5 || count != particleCount)
+            continue;
+
+        if (grainSize == 0 || (unroll != 4 && unroll != 8 && unroll != 16) || threads <= 0)
+            continue;
+
+        pConfig->grainSize = grainSize;
+        pConfig->unroll = unroll;
+        pConfig->tileSize = tileSize;
+        pConfig->threads = threads;
+        found = true;
+    }
+
+    fclose(pFile);
+    return found;
+}
+
+bool Autotuner::SaveConfig(const wchar_t* pPath, uint32_t particleCount, const KernelConfig& config)
+{
+    const std::string hostKey = GetHostKey();
+
+    char entry[512];
+    sprintf_s(entry, "%s\t%u\t%u %u %u %d\n", hostKey.c_str(), particleCount, config.grainSize, config.unroll, config.tileSize, config.threads);
+
+    // Keep the entries of other hosts and particle counts.
+    std::vector<std::string> lines;
+    FILE* pFile = nullptr;
+    if (_wfopen_s(&pFile, pPath, L"rt") == 0 && pFile)
+    {
+        char line[512];
+        while (fgets(line, sizeof(line), pFile))
+        {
+            char* pTab = strchr(line, '\t');
+            unsigned int count = 0;
+            if (pTab && std::string(line, pTab) == hostKey && sscanf_s(pTab + 1, "%u", &count) == 1 && count == particleCount)
+                continue;
+            lines.push_back(line);
+        }
+        fclose(pFile);
+    }
+    lines.push_back(entry);
+
+    if (_wfopen_s(&pFile, pPath, L"wt") != 0 || !pFile)
+        return false;
+
+    for (const std::string& line : lines)
+        fputs(line.c_str(), pFile);
+
+    fclose(pFile);
+    return true;
+}
+
+Autotuner::KernelConfig Autotuner::Tune(int hardwareThreads, const MeasureFunction& measure)
+{
+    std::vector<int> threadCounts;
+    for (int divisor : { 4, 2 })
+    {
+        if (hardwareThreads / divisor >= 1)
+            threadCounts.push_back(hardwareThreads / divisor);
+    }
+    threadCounts.push_back(hardwareThreads);
+    threadCounts.push_back(hardwareThreads * 2);
+    threadCounts.erase(std::unique(threadCounts.begin(), threadCounts.end()), threadCounts.end());
+
+    typedef std::tuple<uint32_t, uint32_t, uint32_t, int> Key;
+    std::map<Key, double> times;
+
+    auto timeOf = [&](const KernelConfig& config)
+    {
+        Key key(config.grainSize, config.unroll, config.tileSize, config.threads);
+        auto it = times.find(key);
+        if (it != times.end())
+            return it->second;
+
+        double seconds = measure(config);
+        times[key] = seconds;
+        return seconds;
+    };
+
+    KernelConfig best = GetDefaultConfig(hardwareThreads);
+    double bestTime = timeOf(best);
+
+    //
+    // Sweep one parameter at a time over its values with the others held at the best so far.
+    //
+    for (int sweep = 0; sweep < MaxSweeps; sweep++)
+    {
+        const KernelConfig start = best;
+
+        auto sweepValues = [&](auto member, const auto& values)
+        {
+            for (auto value : values)
+            {
+                KernelConfig config = best;
+                config.*member = value;
+
+                double seconds = timeOf(config);
+                if (seconds < bestTime)
+                {
+                    best = config;
+                    bestTime = seconds;
+                }
+            }
+        };
+
+        sweepValues(&KernelConfig::threads, threadCounts);
+        sweepValues(&KernelConfig::grainSize, GrainSizes);
+        sweepValues(&KernelConfig::unroll, Unrolls);
+        sweepValues(&KernelConfig::tileSize, TileSizes);
+
+        if (memcmp(&start, &best, sizeof(KernelConfig)) == 0)
+            break;
+    }
+
+    return best;
+}
@@ -0,0 +1,67 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#pragma once
+
+#include <functional>
+#include <string>
+
+//
+// Autotuner for the CPU direct sum.
+//
+// A configuration is the work item (grain) size of the parallel loop, the inner loop unroll and read
+// particle tile size of the ISPC kernel, and the thread count. Tune() runs a coordinate search over a
+// fixed grid: starting from the defaults it sweeps one parameter at a time, keeps the fastest value and
+// repeats until a sweep changes nothing. Every configuration is measured once.
+//
+// Results are cached in a text file, one line per host and particle count. The host key is the CPU brand
+// string and the widest ISPC target the CPU and OS support, so a cache file shared between machines keeps
+// their results apart.
+//
+class Autotuner
+{
+public:
+    struct KernelConfig
+    {
+        uint32_t grainSize;     // Particles per work item of the direct sum.
+        uint32_t unroll;        // Inner loop unroll of the ISPC kernel: 4, 8 or 16.
+        uint32_t tileSize;      // Read particles per tile of the ISPC kernel, 0 for a single tile.
+        int threads;
+    };
+
+    // Step time of a configuration in seconds.
+    typedef std::function<double(const KernelConfig&)> MeasureFunction;
+
+    // The values the sample used before tuning: 256 particle work items, 8-way unroll, no tiling, all threads.
+    static KernelConfig GetDefaultConfig(int hardwareThreads);
+
+    static std::string GetHostKey();
+
+    static bool LoadConfig(const wchar_t* pPath, uint32_t particleCount, KernelConfig* pConfig);
+    static bool SaveConfig(const wchar_t* pPath, uint32_t particleCount, const KernelConfig& config);
+
+    static KernelConfig Tune(int hardwareThreads, const MeasureFunction& measure);
+};
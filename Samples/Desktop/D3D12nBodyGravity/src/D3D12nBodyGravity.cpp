@@ -26,7 +26,9 @@
 
 #include "stdafx.h"
 #include "D3D12nBodyGravity.h"
+#include "Profiler.h"
 #include <sstream>
+#include <chrono>
 
 // Concurrency
 #include <ppl.h>
@@ -39,7 +41,9 @@
 // change and 0 will be returned.
 #define InterlockedGetValue(object) InterlockedCompareExchange(object, 0, 0)
 
-const float D3D12nBodyGravity::ParticleSpread = 400.0f;
+const float D3D12nBodyGravity::ParticleMeshBoxSize = 1600.0f;
+const float D3D12nBodyGravity::ParticleSpriteRadius = 10.0f * 1.41421356f;   // g_fParticleRad of ParticleDraw.hlsl to the sprite corners.
+const double D3D12nBodyGravity::RankVerifyTolerance = 1e-3;
 
 D3D12nBodyGravity::D3D12nBodyGravity(UINT width, UINT height, std::wstring name) :
     DXSample(width, height, name),
@@ -48,13 +52,55 @@ D3D12nBodyGravity::D3D12nBodyGravity(UINT width, UINT height, std::wstring name)
     m_scissorRect(0, 0, static_cast<LONG>(width), static_cast<LONG>(height)),
     m_rtvDescriptorSize(0),
     m_srvUavDescriptorSize(0),
+    m_pRenderRecordUploadData{},
+    m_bPackedRenderStream(true),
+    m_bFrustumCulling(false),
+    m_renderRecordCount{},
+    m_pImpostorUploadData{},
+    m_impostorCount{},
     m_pConstantBufferGSData(nullptr),
     m_renderContextFenceValue(0),
     m_computeContextFenceValue(0),
     m_srvIndex{},
     m_frameFenceValues{},
     m_bReset(false),
-    m_processingType(e_CPU_Vector)
+    m_bReportFastMultipole(false),
+    m_bVerifyDeterminism(false),
+    m_stepsPerFrame(1),
+    m_benchmarkSteps(0),
+    m_ensembleSystems(0),
+    m_ensembleParticles(0),
+    m_ensembleSteps(100),
+    m_renderFrames(0),
+    m_renderWidth(1920),
+    m_renderHeight(1080),
+    m_outOfCoreSteps(3),
+    m_outOfCoreBlockSize(OutOfCoreSolver::DefaultBlockSize),
+    m_outOfCoreTileSize(OutOfCoreSolver::DefaultTileSize),
+    m_planetesimalCount(0),
+    m_planetesimalSteps(200),
+    m_planetesimalRadius(Planetesimals::GetDefaultParameters().bodyRadius),
+    m_sphGasCount(0),
+    m_sphSteps(100),
+    m_sphSoundSpeed(SphGas::GetDefaultParameters().initialSoundSpeed),
+    m_ringRanks(0),
+    m_ringTransport(RingTransport::e_Tcp),
+    m_ringSteps(10),
+    m_ringRank(-1),
+    m_ringSession(0),
+    m_ringThreads(1),
+    m_ringRuns(0),
+    m_bVerifyRanks(false),
+    m_bRankVerify(false),
+    m_domainRanks(0),
+    m_domainThreshold(1.2f),
+    m_bDomainRank(false),
+    m_bAutotune(false),
+    m_directSumLoop(e_AutoLoop),
+    m_pSimdKernel(SimdKernel::FindKernel(SimdKernel::e_Float, 0, 8)),
+    m_particleCount(DefaultParticleCount),
+    m_processingType(e_CPU_Vector),
+    m_timedProcessingType(e_CPU_Vector)
     {
     }
 
@@ -67,6 +113,132 @@ void D3D12nBodyGravity::OnInit()
     m_camera.Init({ 0.0f, 0.0f, 1500.0f });
     m_camera.SetMoveSpeed(250.0f);
 
+    m_particleMesh.Initialize(ParticleMeshGridSize, ParticleMeshBoxSize);
+
+    //
+    // Only the out of core solver keeps its particles outside D3D12 buffer sized memory.
+    //
+    const UINT maxParticleCount = m_outOfCorePath.empty() ? MaxParticleCount : MaxOutOfCoreParticleCount;
+    if (m_particleCount > maxParticleCount)
+    {
+        std::wstringstream message;
+        message << m_particleCount << L" particles do not fit in one D3D12 buffer, using " << maxParticleCount << L"\n";
+        OutputDebugStringW(message.str().c_str());
+        m_particleCount = maxParticleCount;
+    }
+
+    //
+    // Initial conditions from a file replace the generated models, the file sets the particle count.
+    //
+    if (!m_particleFilePath.empty())
+    {
+        std::wstringstream message;
+        if (m_particleFile.Open(m_particleFilePath.c_str(), m_hardwareThreads))
+        {
+            // The CPU kernels need a multiple of 8, drop the remainder, and the particles must fit in the mode's limit.
+            uint64_t count = m_particleFile.GetParticleCount();
+            if (count > maxParticleCount)
+                count = maxParticleCount;
+            m_particleCount = static_cast<UINT>(count) & ~7u;
+
+            message << m_particleFilePath << L": " << m_particleFile.GetParticleCount() << L" particles, using " << m_particleCount << L"\n";
+            if (m_particleCount == 0)
+                m_particleFile.Close();
+        }
+        else
+        {
+            message << m_particleFilePath << L": " << m_particleFile.GetError() << L"\n";
+        }
+        OutputDebugStringW(message.str().c_str());
+
+        if (!m_particleFile.IsOpen())
+            m_particleCount = DefaultParticleCount;
+    }
+
+    //
+    // The direct sum configuration comes from -autotune, else from this host's entry in the tuning cache,
+    // else the defaults.
+    //
+    m_kernelConfig = Autotuner::GetDefaultConfig(m_hardwareThreads);
+    const std::wstring tuningCachePath = GetAssetFullPath(L"nBodyGravityTuning.txt");
+
+    if (m_bAutotune)
+    {
+        RunAutotune(tuningCachePath);
+    }
+    else if (Autotuner::LoadConfig(tuningCachePath.c_str(), m_particleCount, &m_kernelConfig))
+    {
+        std::wstringstream message;
+        message << L"Tuned kernel configuration for " << m_particleCount << L" particles: work items of " << m_kernelConfig.grainSize
+                << L", unroll " << m_kernelConfig.unroll << L", tile " << m_kernelConfig.tileSize << L", " << m_kernelConfig.threads << L" threads\n";
+        OutputDebugStringW(message.str().c_str());
+    }
+
+    //
+    // Regression check mode: run the CPU paths at several thread counts and exit with the result.
+    //
+    if (m_bVerifyDeterminism)
+    {
+        ExitProcess(VerifyDeterminism() ? 0 : 1);
+    }
+
+    if (m_benchmarkSteps > 0)
+    {
+        RunBenchmark();
+        ExitProcess(0);
+    }
+
+    if (m_ensembleSystems > 0)
+    {
+        ExitProcess(RunEnsemble() ? 0 : 1);
+    }
+
+    if (m_renderFrames > 0)
+    {
+        RunRender();
+        ExitProcess(0);
+    }
+
+    if (!m_outOfCorePath.empty())
+    {
+        RunOutOfCore();
+        ExitProcess(0);
+    }
+
+    if (m_planetesimalCount > 0)
+    {
+        RunPlanetesimals();
+        ExitProcess(0);
+    }
+
+    if (m_sphGasCount > 0)
+    {
+        RunSph();
+        ExitProcess(0);
+    }
+
+    if (m_bVerifyRanks)
+    {
+        ExitProcess(VerifyRanks() ? 0 : 1);
+    }
+
+    if (m_ringRank >= 0)
+    {
+        ExitProcess((m_bDomainRank ? RunDomainRank() : RunRingRank()) ? 0 : 1);
+    }
+
+    if (m_domainRanks > 0)
+    {
+        RunDomain();
+        ExitProcess(0);
+    }
+
+    if (m_ringRanks > 0)
+    {
+        RunRing();
+        ExitProcess(0);
+    }
+
     LoadPipeline();
     LoadAssets();
     CreateComputeContexts();
@@ -253,6 +425,8 @@ void D3D12nBodyGravity::LoadAssets()
     // Create the pipeline states, which includes compiling and loading shaders.
     {
         ComPtr<ID3DBlob> vertexShader;
+        ComPtr<ID3DBlob> vertexShaderPacked;
+        ComPtr<ID3DBlob> vertexShaderImpostor;
         ComPtr<ID3DBlob> geometryShader;
         ComPtr<ID3DBlob> pixelShader;
         ComPtr<ID3DBlob> computeShader;
@@ -266,6 +440,8 @@ void D3D12nBodyGravity::LoadAssets()
 
         // Load and compile shaders.
         ThrowIfFailed(D3DCompileFromFile(GetAssetFullPath(L"ParticleDraw.hlsl").c_str(), nullptr, nullptr, "VSParticleDraw", "vs_5_0", compileFlags, 0, &vertexShader, nullptr));
+        ThrowIfFailed(D3DCompileFromFile(GetAssetFullPath(L"ParticleDraw.hlsl").c_str(), nullptr, nullptr, "VSParticleDrawPacked", "vs_5_0", compileFlags, 0, &vertexShaderPacked, nullptr));
+        ThrowIfFailed(D3DCompileFromFile(GetAssetFullPath(L"ParticleDraw.hlsl").c_str(), nullptr, nullptr, "VSImpostorDraw", "vs_5_0", compileFlags, 0, &vertexShaderImpostor, nullptr));
         ThrowIfFailed(D3DCompileFromFile(GetAssetFullPath(L"ParticleDraw.hlsl").c_str(), nullptr, nullptr, "GSParticleDraw", "gs_5_0", compileFlags, 0, &geometryShader, nullptr));
         ThrowIfFailed(D3DCompileFromFile(GetAssetFullPath(L"ParticleDraw.hlsl").c_str(), nullptr, nullptr, "PSParticleDraw", "ps_5_0", compileFlags, 0, &pixelShader, nullptr));
         ThrowIfFailed(D3DCompileFromFile(GetAssetFullPath(L"NBodyGravityCS.hlsl").c_str(), nullptr, nullptr, "CSMain", "cs_5_0", compileFlags, 0, &computeShader, nullptr));
@@ -307,6 +483,16 @@ void D3D12nBodyGravity::LoadAssets()
         ThrowIfFailed(m_device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&m_pipelineState)));
         NAME_D3D12_OBJECT(m_pipelineState);
 
+        // The same with the vertex shader that reads the packed render records.
+        psoDesc.VS = CD3DX12_SHADER_BYTECODE(vertexShaderPacked.Get());
+        ThrowIfFailed(m_device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&m_pipelineStatePacked)));
+        NAME_D3D12_OBJECT(m_pipelineStatePacked);
+
+        // And with the one that reads the level of detail impostors.
+        psoDesc.VS = CD3DX12_SHADER_BYTECODE(vertexShaderImpostor.Get());
+        ThrowIfFailed(m_device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&m_pipelineStateImpostor)));
+        NAME_D3D12_OBJECT(m_pipelineStateImpostor);
+
         // Describe and create the compute pipeline state object (PSO).
         D3D12_COMPUTE_PIPELINE_STATE_DESC computePsoDesc = {};
         computePsoDesc.pRootSignature = m_computeRootSignature.Get();
@@ -352,8 +538,8 @@ void D3D12nBodyGravity::LoadAssets()
         NAME_D3D12_OBJECT(m_constantBufferCS);
 
         ConstantBufferCS constantBufferCS = {};
-        constantBufferCS.param[0] = ParticleCount;
-        constantBufferCS.param[1] = int(ceil(ParticleCount / 128.0f));
+        constantBufferCS.param[0] = m_particleCount;
+        constantBufferCS.param[1] = int(ceil(m_particleCount / 128.0f));
         constantBufferCS.paramf[0] = 0.1f;
         constantBufferCS.paramf[1] = 1.0f;
 
@@ -410,12 +596,12 @@ void D3D12nBodyGravity::LoadAssets()
 void D3D12nBodyGravity::CreateVertexBuffer()
 {
     std::vector<ParticleVertex> vertices;
-    vertices.resize(ParticleCount);
-    for (UINT i = 0; i < ParticleCount; i++)
+    vertices.resize(m_particleCount);
+    for (UINT i = 0; i < m_particleCount; i++)
     {
         vertices[i].color = XMFLOAT4(1.0f, 1.0f, 8.0f, 1.0f);
     }
-    const UINT bufferSize = ParticleCount * sizeof(ParticleVertex);
+    const UINT64 bufferSize = static_cast<UINT64>(m_particleCount) * sizeof(ParticleVertex);
 
     ThrowIfFailed(m_device->CreateCommittedResource(
         &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
@@ -437,7 +623,7 @@ void D3D12nBodyGravity::CreateVertexBuffer()
 
     D3D12_SUBRESOURCE_DATA vertexData = {};
     vertexData.pData = reinterpret_cast<UINT8*>(&vertices[0]);
-    vertexData.RowPitch = bufferSize;
+    vertexData.RowPitch = static_cast<LONG_PTR>(bufferSize);
     vertexData.SlicePitch = vertexData.RowPitch;
 
     UpdateSubresources<1>(m_commandList.Get(), m_vertexBuffer.Get(), m_vertexBufferUpload.Get(), 0, 0, 1, &vertexData);
@@ -448,40 +634,27 @@ void D3D12nBodyGravity::CreateVertexBuffer()
     m_vertexBufferView.StrideInBytes = sizeof(ParticleVertex);
 }
 
-// Random percent value, from -1 to 1.
-float D3D12nBodyGravity::RandomPercent()
-{
-    float ret = static_cast<float>((rand() % 10000) - 5000);
-    return ret / 5000.0f;
-}
-
-void D3D12nBodyGravity::LoadParticles(_Out_writes_(numParticles) Particle* pParticles, const XMFLOAT3& center, const XMFLOAT4& velocity, float spread, UINT numParticles)
+// Fill m_particleCount particles with the initial state of the simulation.
+void D3D12nBodyGravity::LoadInitialParticles(_Out_writes_(m_particleCount) Particle* pParticles, int threads)
 {
-    srand(0);
-    for (UINT i = 0; i < numParticles; i++)
+    if (m_particleFile.IsOpen())
     {
-        XMFLOAT3 delta(spread, spread, spread);
+        if (m_particleFile.Load((ispc::Particle *)pParticles, m_particleCount, threads))
+            return;
 
-        while (XMVectorGetX(XMVector3LengthSq(XMLoadFloat3(&delta))) > spread * spread)
-        {
-            delta.x = RandomPercent() * spread;
-            delta.y = RandomPercent() * spread;
-            delta.z = RandomPercent() * spread;
-        }
-
-        pParticles[i].position.x = center.x + delta.x;
-        pParticles[i].position.y = center.y + delta.y;
-        pParticles[i].position.z = center.z + delta.z;
-        pParticles[i].position.w = 10000.0f * 10000.0f;
-
-        pParticles[i].velocity = velocity;
+        std::wstringstream message;
+        message << m_particleFilePath << L": " << m_particleFile.GetError() << L", using generated initial conditions\n";
+        OutputDebugStringW(message.str().c_str());
+        m_particleFile.Close();
     }
+
+    m_initialConditions.Generate((ispc::Particle *)pParticles, m_particleCount, threads);
 }
 
 // Create the position and velocity buffer shader resources.
 void D3D12nBodyGravity::CreateParticleBuffers()
 {
-    const UINT dataSize = ParticleCount * sizeof(Particle);
+    const UINT64 dataSize = static_cast<UINT64>(m_particleCount) * sizeof(Particle);
 
     D3D12_HEAP_PROPERTIES defaultHeapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
     D3D12_HEAP_PROPERTIES uploadHeapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
@@ -489,13 +662,11 @@ void D3D12nBodyGravity::CreateParticleBuffers()
     D3D12_RESOURCE_DESC uploadBufferDesc = CD3DX12_RESOURCE_DESC::Buffer(dataSize);
 
     // Initialize the data in the buffers.
-    m_particlesISPC0.resize(ParticleCount);
-    m_particlesISPC1.resize(ParticleCount);
+    m_particlesISPC0.resize(m_particleCount);
+    m_particlesISPC1.resize(m_particleCount);
 
-    // Split the particles into two groups.
-    float centerSpread = ParticleSpread * 0.50f;
-    LoadParticles(&m_particlesISPC0[0], XMFLOAT3(centerSpread, 0, 0), XMFLOAT4(0, 0, -20, 1 / 100000000.0f), ParticleSpread, ParticleCount / 2);
-    LoadParticles(&m_particlesISPC0[ParticleCount / 2], XMFLOAT3(-centerSpread, 0, 0), XMFLOAT4(0, 0, 20, 1 / 100000000.0f), ParticleSpread, ParticleCount / 2);
+    LoadInitialParticles(&m_particlesISPC0[0], m_hardwareThreads);
+    m_mixedPrecision.Load((ispc::Particle *)&m_particlesISPC0[0], m_particleCount, m_hardwareThreads);
 
         // Create two buffers in the GPU, each with a copy of the particles data.
         // The compute shader will update one of them while the rendering thread 
@@ -538,7 +709,7 @@ void D3D12nBodyGravity::CreateParticleBuffers()
 
         D3D12_SUBRESOURCE_DATA particleData = {};
     particleData.pData = reinterpret_cast<UINT8*>(&m_particlesISPC0[0]);
-        particleData.RowPitch = dataSize;
+        particleData.RowPitch = static_cast<LONG_PTR>(dataSize);
         particleData.SlicePitch = particleData.RowPitch;
 
     UpdateSubresources<1>(m_commandList.Get(), m_particleBuffer0.Get(), m_particleBuffer0Upload.Get(), 0, 0, 1, &particleData);
@@ -551,7 +722,7 @@ void D3D12nBodyGravity::CreateParticleBuffers()
         srvDesc.Format = DXGI_FORMAT_UNKNOWN;
         srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
         srvDesc.Buffer.FirstElement = 0;
-        srvDesc.Buffer.NumElements = ParticleCount;
+        srvDesc.Buffer.NumElements = m_particleCount;
         srvDesc.Buffer.StructureByteStride = sizeof(Particle);
         srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
 
@@ -564,7 +735,7 @@ void D3D12nBodyGravity::CreateParticleBuffers()
         uavDesc.Format = DXGI_FORMAT_UNKNOWN;
         uavDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
         uavDesc.Buffer.FirstElement = 0;
-        uavDesc.Buffer.NumElements = ParticleCount;
+        uavDesc.Buffer.NumElements = m_particleCount;
         uavDesc.Buffer.StructureByteStride = sizeof(Particle);
         uavDesc.Buffer.CounterOffsetInBytes = 0;
         uavDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_NONE;
@@ -573,6 +744,91 @@ void D3D12nBodyGravity::CreateParticleBuffers()
     CD3DX12_CPU_DESCRIPTOR_HANDLE uavHandle1(m_srvUavHeap->GetCPUDescriptorHandleForHeapStart(), UavParticlePosVelo1, m_srvUavDescriptorSize);
     m_device->CreateUnorderedAccessView(m_particleBuffer0.Get(), nullptr, &uavDesc, uavHandle0);
     m_device->CreateUnorderedAccessView(m_particleBuffer1.Get(), nullptr, &uavDesc, uavHandle1);
+
+    //
+    // Render record buffers for the CPU paths. A CPU frame always writes the buffer it then draws, so they
+    // need no initial contents. The upload buffers stay mapped; like the particle upload buffers, each is
+    // only rewritten once the frame that last copied from it has completed.
+    //
+    // A record is smaller than a particle, so the record buffers fit wherever MaxParticleCount particles do.
+    static_assert(sizeof(ispc::RenderRecord) <= sizeof(Particle), "render records must not outgrow the particles");
+    const UINT64 recordSize = static_cast<UINT64>(m_particleCount) * sizeof(ispc::RenderRecord);
+    D3D12_RESOURCE_DESC recordBufferDesc = CD3DX12_RESOURCE_DESC::Buffer(recordSize);
+
+    ComPtr<ID3D12Resource>* recordBuffers[] = { &m_renderRecordBuffer0, &m_renderRecordBuffer1 };
+    ComPtr<ID3D12Resource>* recordUploadBuffers[] = { &m_renderRecordBuffer0Upload, &m_renderRecordBuffer1Upload };
+    for (int ii = 0; ii < 2; ii++)
+    {
+        ThrowIfFailed(m_device->CreateCommittedResource(
+            &defaultHeapProperties,
+            D3D12_HEAP_FLAG_NONE,
+            &recordBufferDesc,
+            D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+            nullptr,
+            IID_PPV_ARGS(recordBuffers[ii]->ReleaseAndGetAddressOf())));
+
+        ThrowIfFailed(m_device->CreateCommittedResource(
+            &uploadHeapProperties,
+            D3D12_HEAP_FLAG_NONE,
+            &recordBufferDesc,
+            D3D12_RESOURCE_STATE_GENERIC_READ,
+            nullptr,
+            IID_PPV_ARGS(recordUploadBuffers[ii]->ReleaseAndGetAddressOf())));
+
+        CD3DX12_RANGE readRange(0, 0);		// We do not intend to read from this resource on the CPU.
+        ThrowIfFailed((*recordUploadBuffers[ii])->Map(0, &readRange, reinterpret_cast<void**>(&m_pRenderRecordUploadData[ii])));
+    }
+
+    NAME_D3D12_OBJECT(m_renderRecordBuffer0);
+    NAME_D3D12_OBJECT(m_renderRecordBuffer1);
+
+    D3D12_SHADER_RESOURCE_VIEW_DESC recordSrvDesc = srvDesc;
+    recordSrvDesc.Buffer.StructureByteStride = sizeof(ispc::RenderRecord);
+
+    CD3DX12_CPU_DESCRIPTOR_HANDLE recordSrvHandle0(m_srvUavHeap->GetCPUDescriptorHandleForHeapStart(), SrvRenderRecords0, m_srvUavDescriptorSize);
+    CD3DX12_CPU_DESCRIPTOR_HANDLE recordSrvHandle1(m_srvUavHeap->GetCPUDescriptorHandleForHeapStart(), SrvRenderRecords1, m_srvUavDescriptorSize);
+    m_device->CreateShaderResourceView(m_renderRecordBuffer0.Get(), &recordSrvDesc, recordSrvHandle0);
+    m_device->CreateShaderResourceView(m_renderRecordBuffer1.Get(), &recordSrvDesc, recordSrvHandle1);
+
+    // The impostor buffers, the same way; one impostor per grid cell at most.
+    const UINT impostorSize = LevelOfDetail::MaxImpostors * sizeof(LevelOfDetail::Impostor);
+    D3D12_RESOURCE_DESC impostorBufferDesc = CD3DX12_RESOURCE_DESC::Buffer(impostorSize);
+
+    ComPtr<ID3D12Resource>* impostorBuffers[] = { &m_impostorBuffer0, &m_impostorBuffer1 };
+    ComPtr<ID3D12Resource>* impostorUploadBuffers[] = { &m_impostorBuffer0Upload, &m_impostorBuffer1Upload };
+    for (int ii = 0; ii < 2; ii++)
+    {
+        ThrowIfFailed(m_device->CreateCommittedResource(
+            &defaultHeapProperties,
+            D3D12_HEAP_FLAG_NONE,
+            &impostorBufferDesc,
+            D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+            nullptr,
+            IID_PPV_ARGS(impostorBuffers[ii]->ReleaseAndGetAddressOf())));
+
+        ThrowIfFailed(m_device->CreateCommittedResource(
+            &uploadHeapProperties,
+            D3D12_HEAP_FLAG_NONE,
+            &impostorBufferDesc,
+            D3D12_RESOURCE_STATE_GENERIC_READ,
+            nullptr,
+            IID_PPV_ARGS(impostorUploadBuffers[ii]->ReleaseAndGetAddressOf())));
+
+        CD3DX12_RANGE readRange(0, 0);		// We do not intend to read from this resource on the CPU.
+        ThrowIfFailed((*impostorUploadBuffers[ii])->Map(0, &readRange, reinterpret_cast<void**>(&m_pImpostorUploadData[ii])));
+    }
+
+    NAME_D3D12_OBJECT(m_impostorBuffer0);
+    NAME_D3D12_OBJECT(m_impostorBuffer1);
+
+    D3D12_SHADER_RESOURCE_VIEW_DESC impostorSrvDesc = srvDesc;
+    impostorSrvDesc.Buffer.NumElements = LevelOfDetail::MaxImpostors;
+    impostorSrvDesc.Buffer.StructureByteStride = sizeof(LevelOfDetail::Impostor);
+
+    CD3DX12_CPU_DESCRIPTOR_HANDLE impostorSrvHandle0(m_srvUavHeap->GetCPUDescriptorHandleForHeapStart(), SrvImpostors0, m_srvUavDescriptorSize);
+    CD3DX12_CPU_DESCRIPTOR_HANDLE impostorSrvHandle1(m_srvUavHeap->GetCPUDescriptorHandleForHeapStart(), SrvImpostors1, m_srvUavDescriptorSize);
+    m_device->CreateShaderResourceView(m_impostorBuffer0.Get(), &impostorSrvDesc, impostorSrvHandle0);
+    m_device->CreateShaderResourceView(m_impostorBuffer1.Get(), &impostorSrvDesc, impostorSrvHandle1);
     }
 
 //
@@ -580,20 +836,20 @@ void D3D12nBodyGravity::CreateParticleBuffers()
 //
 void D3D12nBodyGravity::ReloadParticleBuffers()
 {
-    const UINT dataSize = ParticleCount * sizeof(Particle);
+    PROFILE_SCOPE("Reload particles");
+
+    const UINT64 dataSize = static_cast<UINT64>(m_particleCount) * sizeof(Particle);
 
     // Reset the main command allocator/list
     ThrowIfFailed(m_commandAllocators[m_frameIndex]->Reset());
     ThrowIfFailed(m_commandList->Reset(m_commandAllocators[m_frameIndex].Get(), m_pipelineState.Get()));
 
-    // Split the particles into two groups.
-    float centerSpread = ParticleSpread * 0.50f;
-    LoadParticles(&m_particlesISPC0[0], XMFLOAT3(centerSpread, 0, 0), XMFLOAT4(0, 0, -20, 1 / 100000000.0f), ParticleSpread, ParticleCount / 2);
-    LoadParticles(&m_particlesISPC0[ParticleCount / 2], XMFLOAT3(-centerSpread, 0, 0), XMFLOAT4(0, 0, 20, 1 / 100000000.0f), ParticleSpread, ParticleCount / 2);
+    LoadInitialParticles(&m_particlesISPC0[0], m_hardwareThreads);
+    m_mixedPrecision.Load((ispc::Particle *)&m_particlesISPC0[0], m_particleCount, m_hardwareThreads);
 
     D3D12_SUBRESOURCE_DATA particleData = {};
     particleData.pData = reinterpret_cast<UINT8*>(&m_particlesISPC0[0]);
-    particleData.RowPitch = dataSize;
+    particleData.RowPitch = static_cast<LONG_PTR>(dataSize);
     particleData.SlicePitch = particleData.RowPitch;
 
     // upload
@@ -612,6 +868,17 @@ void D3D12nBodyGravity::ReloadParticleBuffers()
 
     // reset the srvIndex;
     m_srvIndex = 0;
+
+    // The energy reference and the level of detail grid belong to the old particles.
+    m_diagnostics.Reset();
+    m_levelOfDetail.Reset();
+
+    // Keep the timings of each compute type apart, and keep the reload itself out of them.
+    ReportFrameTimes();
+    m_frameTimes.Reset();
+    m_stepTimes.Reset();
+    m_timedProcessingType = m_processingType;
+    m_timer.ResetElapsedTime();
 }
 
 void D3D12nBodyGravity::CreateComputeContexts()
@@ -631,7 +898,10 @@ void D3D12nBodyGravity::CreateComputeContexts()
 void D3D12nBodyGravity::OnUpdate()
 {
     // Wait for the previous Present to complete.
-    WaitForSingleObjectEx(m_swapChainEvent, 100, FALSE);
+    {
+        PROFILE_SCOPE("Wait for swap chain");
+        WaitForSingleObjectEx(m_swapChainEvent, 100, FALSE);
+    }
 
     static double old_second = -2;
     static double elapsed_seconds = 0.0;
@@ -653,10 +923,23 @@ void D3D12nBodyGravity::OnUpdate()
         switch (m_processingType)
         {
         case e_CPU_Vector:
-            title << "(CPU ISPC Compute Kernel, " << m_hardwareThreads << " threads) : ";
+            title << "(CPU ISPC Compute Kernel, " << (UseInnerLoopKernel() ? "inner" : "outer") << " loop, " << GetStepThreads(m_processingType) << " threads) : ";
             break;
         case e_CPU_Scalar:
-            title << "(CPU Scalar C++ Code, " << m_hardwareThreads << " threads) : ";
+            title << "(CPU Scalar C++ Code, " << GetStepThreads(m_processingType) << " threads) : ";
+            break;
+        case e_CPU_ParticleMesh:
+            title << "(CPU ISPC Particle-Mesh, " << ParticleMeshGridSize << "^3 periodic grid, " << GetStepThreads(m_processingType) << " threads) : ";
+            break;
+        case e_CPU_FastMultipole:
+            title << "(CPU ISPC Fast Multipole, order " << m_fastMultipole.GetOrder() << ", " << GetStepThreads(m_processingType) << " threads) : ";
+            break;
+        case e_CPU_MixedPrecision:
+            title << "(CPU ISPC Mixed Precision, " << GetStepThreads(m_processingType) << " threads) : ";
+            break;
+        case e_CPU_Simd:
+            title << "(CPU C++ SIMD, " << (m_pSimdKernel->precision == SimdKernel::e_Double ? "double" : "float") << " x" << m_pSimdKernel->width
+                  << ", unroll " << m_pSimdKernel->unroll << ", " << GetStepThreads(m_processingType) << " threads) : ";
             break;
         case e_GPU:
             title << "(GPU Async Compute) : ";
@@ -668,7 +951,22 @@ void D3D12nBodyGravity::OnUpdate()
         // the application runs slower than 1fps, the reported frame times
         // will be incorrect.
         //
-        title << ms << " ms, " << fps << " fps.  [press SPACE to change compute type]";
+        title << ms << " ms, " << fps << " fps, p99 " << m_frameTimes.GetPercentile(99.0) * 1e-6 << " ms, max " << m_frameTimes.GetMax() * 1e-6 << " ms, " << (m_particleFile.IsOpen() ? L"from file" : InitialConditions::GetModelName(m_initialConditions.GetModel())) << ".  [press SPACE to change compute type, I to change initial conditions]";
+
+        if (m_stepsPerFrame > 1 && m_processingType != e_GPU)
+            title << "  " << m_stepsPerFrame << " steps per frame.";
+
+        if (m_bPackedRenderStream && m_bFrustumCulling && m_processingType != e_GPU)
+            title << "  " << (100.0 * m_renderRecordCount[m_srvIndex]) / m_particleCount << "% in view.";
+
+        if (m_bPackedRenderStream && m_levelOfDetail.IsEnabled() && m_processingType != e_GPU)
+            title << "  " << m_renderRecordCount[m_srvIndex] << " particles and " << m_impostorCount[m_srvIndex] << " impostors drawn.";
+
+        if (m_diagnostics.HasResult() && m_processingType != e_GPU)
+        {
+            const Diagnostics::Result& result = m_diagnostics.GetLastResult();
+            title << "  Diagnostics every " << m_diagnostics.GetInterval() << " steps: " << result.milliseconds << " ms, dE/E0 " << result.relativeEnergyDrift;
+        }
 
         SetCustomWindowText(title.str().c_str());
 
@@ -678,12 +976,21 @@ void D3D12nBodyGravity::OnUpdate()
     }
 
     m_timer.Tick(NULL);
+    if (m_timer.GetFrameCount() > 1)
+        m_frameTimes.Record(m_timer.GetLastDeltaNanoseconds());
+
     m_camera.Update(static_cast<float>(m_timer.GetElapsedSeconds()));
 
     ConstantBufferGS constantBufferGS = {};
-    XMStoreFloat4x4(&constantBufferGS.worldViewProjection, XMMatrixMultiply(m_camera.GetViewMatrix(), m_camera.GetProjectionMatrix(0.8f, m_aspectRatio, 1.0f, 5000.0f)));
+    const XMMATRIX projection = m_camera.GetProjectionMatrix(0.8f, m_aspectRatio, 1.0f, 5000.0f);
+    XMStoreFloat4x4(&constantBufferGS.worldViewProjection, XMMatrixMultiply(m_camera.GetViewMatrix(), projection));
+    m_frustumCuller.SetFrustum(constantBufferGS.worldViewProjection, ParticleSpriteRadius);
     XMStoreFloat4x4(&constantBufferGS.inverseView, XMMatrixInverse(nullptr, m_camera.GetViewMatrix()));
 
+    // The inverse view's last row is the camera position.
+    const XMFLOAT4X4& inverseView = constantBufferGS.inverseView;
+    m_levelOfDetail.SetCamera(XMFLOAT3(inverseView._41, inverseView._42, inverseView._43), XMVectorGetY(projection.r[1]) * 0.5f * m_height);
+
     UINT8* destination = m_pConstantBufferGSData + sizeof(ConstantBufferGS) * m_frameIndex;
     memcpy(destination, &constantBufferGS, sizeof(ConstantBufferGS));
 }
@@ -709,6 +1016,10 @@ void D3D12nBodyGravity::OnRender()
     {
     case e_CPU_Scalar:
     case e_CPU_Vector:
+    case e_CPU_ParticleMesh:
+    case e_CPU_FastMultipole:
+    case e_CPU_MixedPrecision:
+    case e_CPU_Simd:
         SimulateCPU();
         break;
     case e_GPU:
@@ -752,7 +1063,10 @@ void D3D12nBodyGravity::OnRender()
 
     // Present the frame.
     // Ignore VSync
-    ThrowIfFailed(m_swapChain->Present(0, 0));
+    {
+        PROFILE_SCOPE("Present");
+        ThrowIfFailed(m_swapChain->Present(0, 0));
+    }
 
     MoveToNextFrame();
 }
@@ -760,6 +1074,8 @@ void D3D12nBodyGravity::OnRender()
 // Fill the command list with all the render commands and dependent state.
 void D3D12nBodyGravity::PopulateCommandList()
 {
+    PROFILE_SCOPE("Record render commands");
+
     // Command list allocators can only be reset when the associated
     // command lists have finished execution on the GPU; apps should use
     // fences to determine GPU execution progress.
@@ -793,8 +1109,14 @@ void D3D12nBodyGravity::PopulateCommandList()
     const float clearColor[] = { 0.0f, 0.0f, 0.1f, 0.0f };
     m_commandList->ClearRenderTargetView(rtvHandle, clearColor, 0, nullptr);
 
-    // Render the particles.
-    const UINT srvIndex = m_srvIndex == 0 ? SrvParticlePosVelo0 : SrvParticlePosVelo1;
+    // Render the particles. The CPU paths upload packed render records unless asked for the full particles.
+    const bool packed = m_bPackedRenderStream && m_processingType != e_GPU;
+    UINT srvIndex = m_srvIndex == 0 ? SrvParticlePosVelo0 : SrvParticlePosVelo1;
+    if (packed)
+    {
+        m_commandList->SetPipelineState(m_pipelineStatePacked.Get());
+        srvIndex = m_srvIndex == 0 ? SrvRenderRecords0 : SrvRenderRecords1;
+    }
 
         CD3DX12_VIEWPORT viewport(
         0.0f, 
@@ -808,8 +1130,21 @@ void D3D12nBodyGravity::PopulateCommandList()
         m_commandList->SetGraphicsRootDescriptorTable(GraphicsRootSRVTable, srvHandle);
 
     PIXBeginEvent(m_commandList.Get(), 0, L"Draw particles");
-        m_commandList->DrawInstanced(ParticleCount, 1, 0, 0);
+        m_commandList->DrawInstanced(packed ? m_renderRecordCount[m_srvIndex] : m_particleCount, 1, 0, 0);
+        PIXEndEvent(m_commandList.Get());
+
+    // Then the impostors of the far particles.
+    if (packed && m_impostorCount[m_srvIndex] > 0)
+    {
+        m_commandList->SetPipelineState(m_pipelineStateImpostor.Get());
+
+        CD3DX12_GPU_DESCRIPTOR_HANDLE impostorSrvHandle(m_srvUavHeap->GetGPUDescriptorHandleForHeapStart(), m_srvIndex == 0 ? SrvImpostors0 : SrvImpostors1, m_srvUavDescriptorSize);
+        m_commandList->SetGraphicsRootDescriptorTable(GraphicsRootSRVTable, impostorSrvHandle);
+
+        PIXBeginEvent(m_commandList.Get(), 0, L"Draw impostors");
+        m_commandList->DrawInstanced(m_impostorCount[m_srvIndex], 1, 0, 0);
         PIXEndEvent(m_commandList.Get());
+    }
     
 
     m_commandList->RSSetViewports(1, &m_viewport);
@@ -825,6 +1160,8 @@ void D3D12nBodyGravity::PopulateCommandList()
 //
 void D3D12nBodyGravity::SimulateGPU()
 {
+    PROFILE_SCOPE("Record compute commands");
+
     ID3D12GraphicsCommandList* pCommandList = m_computeCommandList.Get();
 
     UINT srvIndex;
@@ -858,7 +1195,7 @@ void D3D12nBodyGravity::SimulateGPU()
     pCommandList->SetComputeRootDescriptorTable(ComputeRootSRVTable, srvHandle);
     pCommandList->SetComputeRootDescriptorTable(ComputeRootUAVTable, uavHandle);
 
-    pCommandList->Dispatch(static_cast<int>(ceil(ParticleCount / 128.0f)), 1, 1);
+    pCommandList->Dispatch(static_cast<int>(ceil(m_particleCount / 128.0f)), 1, 1);
 
     pCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(pUavResource, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE));
 }
@@ -868,12 +1205,14 @@ void D3D12nBodyGravity::SimulateGPU()
 //
 void D3D12nBodyGravity::SimulateCPU()
 {
+    PROFILE_SCOPE("Simulate CPU");
+
     //
     // ISPC and the Scalar code both assume the particle count divides by 8.
     // This is because 1 of the loops is unrolled. 
     // Simpler to keep this constraint than worry about mopping up excess particles.
     //
-    assert((ParticleCount % 8) == 0);
+    assert((m_particleCount % 8) == 0);
 
     ID3D12GraphicsCommandList* pCommandList = m_computeCommandList.Get();
 
@@ -883,6 +1222,12 @@ void D3D12nBodyGravity::SimulateCPU()
     std::vector<Particle> * pWriteParticles;
     ID3D12Resource *pUavResource;
     ID3D12Resource *pUploadResource;
+    ID3D12Resource *pRecordResource;
+    ID3D12Resource *pRecordUploadResource;
+    ispc::RenderRecord *pRenderRecords;
+    ID3D12Resource *pImpostorResource;
+    ID3D12Resource *pImpostorUploadResource;
+    UINT recordIndex;
     if (m_srvIndex == 0)
     {
         srvIndex = SrvParticlePosVelo0;
@@ -891,6 +1236,12 @@ void D3D12nBodyGravity::SimulateCPU()
         pWriteParticles = &(m_particlesISPC1);
         pUavResource = m_particleBuffer1.Get();
         pUploadResource = m_particleBuffer1Upload.Get();
+        pRecordResource = m_renderRecordBuffer1.Get();
+        pRecordUploadResource = m_renderRecordBuffer1Upload.Get();
+        pRenderRecords = m_pRenderRecordUploadData[1];
+        pImpostorResource = m_impostorBuffer1.Get();
+        pImpostorUploadResource = m_impostorBuffer1Upload.Get();
+        recordIndex = 1;
     }
     else
     {
@@ -900,160 +1251,1282 @@ void D3D12nBodyGravity::SimulateCPU()
         pWriteParticles = &(m_particlesISPC0);
         pUavResource = m_particleBuffer0.Get();
         pUploadResource = m_particleBuffer0Upload.Get();
+        pRecordResource = m_renderRecordBuffer0.Get();
+        pRecordUploadResource = m_renderRecordBuffer0Upload.Get();
+        pRenderRecords = m_pRenderRecordUploadData[0];
+        pImpostorResource = m_impostorBuffer0.Get();
+        pImpostorUploadResource = m_impostorBuffer0Upload.Get();
+        recordIndex = 0;
     }
 
-    int parallelParticleCount = ParticleCount / m_hardwareThreads;
     ispc::Particle * pRead = (ispc::Particle *)&(*pReadParticles)[0];
-    ispc::Particle * pWrite = (ispc::Particle *)&(*pWriteParticles)[0];
+
+    if (m_processingType == e_CPU_FastMultipole && m_bReportFastMultipole)
+    {
+        ReportFastMultipoleAccuracy(pRead);
+        m_bReportFastMultipole = false;
+    }
 
     // 
     // Keep a copy of the particle data in system memory, double buffered to work on.
     // Process this data and upload to the render buffer once finished.
     //
-    concurrency::parallel_for<uint32_t>(0, m_hardwareThreads, [&](uint32_t parallelThreadID)
+    // With several steps per frame the two buffers ping-pong in system memory. Swapping the vectors
+    // (their storage, not the particles) before each later step makes the last result the next input and
+    // leaves the final state in *pWriteParticles, the buffer that is uploaded.
+    //
+    const StepClock& clock = m_timer.GetClock();
+    for (UINT step = 0; step < m_stepsPerFrame; step++)
     {
-        switch (m_processingType)
-        {
-        case e_CPU_Scalar:
-            ProcessParticles(parallelThreadID * parallelParticleCount, parallelParticleCount, pReadParticles, pWriteParticles);
-            break;
-        case e_CPU_Vector:
-            ispc::ProcessParticles(parallelThreadID * parallelParticleCount, parallelParticleCount, pRead, pWrite, ParticleCount);
-            break;
-        }
-    });
+        if (step > 0)
+            pReadParticles->swap(*pWriteParticles);
+
+        // Only the last step of the frame writes render records, and only when they are not culled or
+        // merged into impostors afterwards. Culling and the level of detail are off by default, so the
+        // default frame takes its records from the step.
+        const bool lastStep = (step + 1 == m_stepsPerFrame);
+        const bool storeRecords = lastStep && m_bPackedRenderStream && !m_bFrustumCulling && !m_levelOfDetail.IsEnabled();
+
+        uint64_t stepBegin = clock.Now();
+        StepParticlesCPU(m_processingType, pReadParticles, pWriteParticles, GetStepThreads(m_processingType), storeRecords ? pRenderRecords : nullptr);
+        m_stepTimes.Record(clock.ToNanoseconds(clock.Now() - stepBegin));
+
+        ReportDiagnostics((const ispc::Particle *)&(*pWriteParticles)[0]);
+    }
 
     //
-    // Upload to the render buffer
+    // Upload to the render buffer. The render records go straight into the mapped upload buffer, from the
+    // last step or, with culling on, from the culler for the particles in view only, so only the copy of
+    // the records written to the default heap is left. With the level of detail on, it writes the near
+    // particles' records (culled or not) and the far ones' impostors instead.
     //
+    if (m_bPackedRenderStream)
+    {
+        const ispc::Particle* pWrite = (const ispc::Particle *)&(*pWriteParticles)[0];
+        UINT recordCount = m_particleCount;
+        UINT impostorCount = 0;
+        if (m_levelOfDetail.IsEnabled())
+            m_levelOfDetail.Build(pWrite, m_particleCount, m_hardwareThreads, m_bFrustumCulling ? &m_frustumCuller : nullptr,
+                                  pRenderRecords, &recordCount, m_pImpostorUploadData[recordIndex], &impostorCount);
+        else if (m_bFrustumCulling)
+            recordCount = m_frustumCuller.Cull(pWrite, m_particleCount, m_hardwareThreads, pRenderRecords);
+        m_renderRecordCount[recordIndex] = recordCount;
+        m_impostorCount[recordIndex] = impostorCount;
+
+        if (recordCount > 0)
+        {
+            PROFILE_SCOPE("Upload render records");
+            pCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(pRecordResource, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_DEST));
+            pCommandList->CopyBufferRegion(pRecordResource, 0, pRecordUploadResource, 0, recordCount * sizeof(ispc::RenderRecord));
+            pCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(pRecordResource, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE));
+        }
+
+        if (impostorCount > 0)
+        {
+            PROFILE_SCOPE("Upload impostors");
+            pCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(pImpostorResource, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_DEST));
+            pCommandList->CopyBufferRegion(pImpostorResource, 0, pImpostorUploadResource, 0, impostorCount * sizeof(LevelOfDetail::Impostor));
+            pCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(pImpostorResource, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE));
+        }
+        return;
+    }
+
     D3D12_SUBRESOURCE_DATA particleData = {};
     particleData.pData = reinterpret_cast<UINT8*>(&(*pWriteParticles)[0]);
-    particleData.RowPitch = ParticleCount * sizeof(Particle);
+    particleData.RowPitch = static_cast<LONG_PTR>(static_cast<UINT64>(m_particleCount) * sizeof(Particle));
     particleData.SlicePitch = particleData.RowPitch;
 
+    PROFILE_SCOPE("Upload particles");
     pCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(pUavResource, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_DEST));
     UpdateSubresources<1>(pCommandList, pUavResource, pUploadResource, 0, 0, 1, &particleData);
     pCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(pUavResource, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE));
 
 }
 
-// 
-// Fast Recip Sqrt
 //
-// https://en.wikipedia.org/wiki/Fast_inverse_square_root
+// Conservation diagnostics on the state after a step, when due.
 //
-__inline float Q_rsqrt(float number)
-{
-    long i;
-    float x2, y;
-    const float threehalfs = 1.5F;
-
-    x2 = number * 0.5F;
-    y = number;
-    i = *(long *)&y;                       // evil floating point bit level hacking
-    i = 0x5f3759df - (i >> 1);
-    y = *(float *)&i;
-    y = y * (threehalfs - (x2 * y * y));   // 1st iteration
-    //	y  = y * ( threehalfs - ( x2 * y * y ) );   // 2nd iteration, this can be removed
-    return y;
-}
-
-__inline void bodyBodyInteraction(
-    XMFLOAT3 &accel, 
-    XMFLOAT4 thatPos, 
-    XMFLOAT4 thisPos)
+void D3D12nBodyGravity::ReportDiagnostics(const ispc::Particle* pParticles)
 {
-    const float softeningSquared = 0.0000015625f;
-    const float g_fParticleMass = 66.73f;
-        
-    XMFLOAT3 r;
-    r.x = thatPos.x - thisPos.x;
-    r.y = thatPos.y - thisPos.y;
-    r.z = thatPos.z - thisPos.z;
-
-    float distSqr = (r.x * r.x) + (r.y * r.y) + (r.z * r.z);
-    distSqr += softeningSquared;
-
-    float invDist = Q_rsqrt(distSqr);
-    float invDistCube = invDist * invDist * invDist;
-
-    float s = g_fParticleMass * invDistCube;
+    // The mesh solver feels the periodic mesh potential, not the open sum over pairs.
+    m_diagnostics.SetParticleMesh((m_processingType == e_CPU_ParticleMesh) ? &m_particleMesh : nullptr);
 
-    accel.x += r.x * s;
-    accel.y += r.y * s;
-    accel.z += r.z * s;
+    if (m_diagnostics.Update(pParticles, m_particleCount, m_hardwareThreads))
+    {
+        const Diagnostics::Result& result = m_diagnostics.GetLastResult();
+
+        std::wstringstream line;
+        line << L"Step " << result.step << L": E " << result.totalEnergy << L" (K " << result.kineticEnergy << L", U " << result.potentialEnergy
+             << L"), dE/E0 " << result.relativeEnergyDrift
+             << L", P (" << result.momentum[0] << L", " << result.momentum[1] << L", " << result.momentum[2]
+             << L"), L (" << result.angularMomentum[0] << L", " << result.angularMomentum[1] << L", " << result.angularMomentum[2]
+             << L"), COM (" << result.centerOfMass[0] << L", " << result.centerOfMass[1] << L", " << result.centerOfMass[2]
+             << L"), " << result.milliseconds << L" ms\n";
+        OutputDebugStringW(line.str().c_str());
+    }
 }
 
 //
-// Run the full simulation in C/C++ scalar code
+// Advance the CPU simulation by one step with the given number of threads.
 //
-void D3D12nBodyGravity::ProcessParticles(uint32_t particleStart, uint32_t particleCount, std::vector<Particle> * pReadParticles, std::vector<Particle> * pWriteParticles)
+// The direct sum paths split the particles into fixed blocks of the configured work item size and give
+// each thread a contiguous range of blocks, so every particle is updated whatever the thread count and the
+// result of each particle depends on neither the thread count nor the kernel configuration. The other solvers size their own parallel stages.
+//
+// With pRenderRecords set the step also writes the half precision render record of every particle. The
+// ISPC direct sum kernels store them with the particles, the other paths pack them in a pass afterwards.
+//
+void D3D12nBodyGravity::StepParticlesCPU(ProcessingType processingType, std::vector<Particle> * pReadParticles, std::vector<Particle> * pWriteParticles, int threads,
+    ispc::RenderRecord * pRenderRecords)
 {
-    const float timeStepDelta = 0.1f;
-    const float g_fG = 6.67300e-11f * 10000.0f;
-    const float g_fParticleMass = g_fG * 10000.0f * 10000.0f;
+    PROFILE_SCOPE("Step particles");
 
-    uint32_t particleEnd = particleStart + particleCount;
-    if (particleEnd > static_cast<uint32_t>(ParticleCount))
-        particleEnd = ParticleCount;
+    ispc::Particle * pRead = (ispc::Particle *)&(*pReadParticles)[0];
+    ispc::Particle * pWrite = (ispc::Particle *)&(*pWriteParticles)[0];
 
-    for (uint32_t ii = particleStart; ii < particleEnd; ii++)
+    switch (processingType)
     {
-        XMFLOAT3 accel = { 0.0f, 0.0f, 0.0f };
-        XMFLOAT4 pos = (*pReadParticles)[ii].position;
+    case e_CPU_ParticleMesh:
+        //
+        // The particle-mesh solver needs every particle on the mesh before any force is known,
+        // so it runs its own parallel stages over the whole system rather than a slice per thread.
+        //
+        m_particleMesh.Step(pRead, pWrite, m_particleCount, threads);
+        break;
 
-        // Better performance by not unrolling this loop
-        for (uint32_t jj = 0; jj < static_cast<uint32_t>(ParticleCount); jj ++)
+    case e_CPU_FastMultipole:
+        m_fastMultipole.Step(pRead, pWrite, m_particleCount, threads);
+        break;
+
+    case e_CPU_MixedPrecision:
+        //
+        // The double precision state lives in m_mixedPrecision, the particle buffers only receive a
+        // float copy for rendering.
+        //
+        m_mixedPrecision.Step(pWrite, threads);
+        break;
+
+    case e_CPU_Vector:
+    case e_CPU_Scalar:
+    case e_CPU_Simd:
+    {
+        // The ISPC direct sum of a small system runs the inner loop kernel, the rest the outer loop kernels.
+        if (processingType == e_CPU_Vector && UseInnerLoopKernel())
         {
-            bodyBodyInteraction(accel, (*pReadParticles)[jj + 0].position, pos);
+            // One even share of the particles per thread, the inner loop kernel has no gangs to fill.
+            concurrency::parallel_for<int>(0, threads, [&](int parallelThreadID)
+            {
+                PROFILE_SCOPE("Direct sum worker");
+
+                uint32_t particleStart = static_cast<uint32_t>((static_cast<uint64_t>(m_particleCount) * parallelThreadID) / threads);
+                uint32_t particleEnd = static_cast<uint32_t>((static_cast<uint64_t>(m_particleCount) * (parallelThreadID + 1)) / threads);
+
+                PerfCounterScope counters;
+                if (particleStart < particleEnd)
+                    ispc::ProcessParticlesInner(particleStart, particleEnd - particleStart, pRead, pWrite, m_particleCount, pRenderRecords);
+            });
+            return;
         }
 
-        XMFLOAT4 vel = (*pReadParticles)[ii].velocity;
+        const Autotuner::KernelConfig& config = m_kernelConfig;
+        const uint32_t blockCount = (m_particleCount + config.grainSize - 1) / config.grainSize;
+        if (processingType == e_CPU_Vector)
+            ReservePartialAccels(threads, config.grainSize);
 
-        // Update the velocity and position of current particle using the 
-        // acceleration computed above.
-        vel.x += accel.x * timeStepDelta;
-        vel.y += accel.y * timeStepDelta;
-        vel.z += accel.z * timeStepDelta;
-        vel.w = 1.0f / Q_rsqrt((accel.x * accel.x) + (accel.y * accel.y) + (accel.z * accel.z));
+        concurrency::parallel_for<int>(0, threads, [&](int parallelThreadID)
+        {
+            PROFILE_SCOPE("Direct sum worker");
+
+            uint32_t blockStart = (blockCount * parallelThreadID) / threads;
+            uint32_t blockEnd = (blockCount * (parallelThreadID + 1)) / threads;
+
+            for (uint32_t block = blockStart; block < blockEnd; block++)
+            {
+                uint32_t particleStart = block * config.grainSize;
+                uint32_t particleCount = (m_particleCount - particleStart < config.grainSize) ? m_particleCount - particleStart : config.grainSize;
+
+                PerfCounterScope counters;
+                if (processingType == e_CPU_Scalar)
+                    ProcessParticles(particleStart, particleCount, pReadParticles, pWriteParticles);
+                else if (processingType == e_CPU_Simd)
+                    m_pSimdKernel->pFunction(particleStart, particleCount, pRead, pWrite, m_particleCount);
+                else
+                    ispc::ProcessParticles(particleStart, particleCount, pRead, pWrite, m_particleCount, config.unroll, config.tileSize,
+                                           &m_partialAccels[parallelThreadID][0], pRenderRecords);
+            }
+        });
+
+        if (processingType == e_CPU_Vector)
+            return;
+        break;
+    }
 
-        pos.x += vel.x * timeStepDelta;
-        pos.y += vel.y * timeStepDelta;
-        pos.z += vel.z * timeStepDelta;
+    default:
+        break;
+    }
 
-        (*pWriteParticles)[ii].position = pos;
-        (*pWriteParticles)[ii].velocity = vel;
+    if (pRenderRecords)
+    {
+        concurrency::parallel_for<int>(0, threads, [&](int parallelThreadID)
+        {
+            PROFILE_SCOPE("Pack render records");
+
+            uint32_t particleStart = static_cast<uint32_t>((static_cast<uint64_t>(m_particleCount) * parallelThreadID) / threads);
+            uint32_t particleEnd = static_cast<uint32_t>((static_cast<uint64_t>(m_particleCount) * (parallelThreadID + 1)) / threads);
+
+            if (particleStart < particleEnd)
+                ispc::PackRenderRecords(pWrite, particleStart, particleEnd, pRenderRecords);
+        });
     }
 }
 
-void D3D12nBodyGravity::OnDestroy()
-{
+//
+// Threads to step the given path with. The autotuner only times the ISPC direct sum, so its thread count
+// is not applied to the other solvers.
+//
+int D3D12nBodyGravity::GetStepThreads(ProcessingType processingType) const
+{
+    return (processingType == e_CPU_Vector) ? m_kernelConfig.threads : m_hardwareThreads;
+}
+
+//
+// Make sure each of the first 'threads' workers has partial acceleration scratch for 'count' particles.
+// Called before the parallel loop; the buffers only grow, so after the first step this allocates nothing.
+//
+void D3D12nBodyGravity::ReservePartialAccels(int threads, uint32_t count)
+{
+    if (m_partialAccels.size() < static_cast<size_t>(threads))
+        m_partialAccels.resize(threads);
+
+    for (int thread = 0; thread < threads; thread++)
+    {
+        if (m_partialAccels[thread].size() < count)
+            m_partialAccels[thread].resize(count);
+    }
+}
+
+//
+// Pick the ISPC direct sum kernel. The choice depends on the particle count only, not on the thread
+// count or on the ISPC target, so -verifydeterminism and the autotuner compare one kernel against itself
+// and every machine runs the same kernel for the same system.
+//
+bool D3D12nBodyGravity::UseInnerLoopKernel() const
+{
+    if (m_directSumLoop != e_AutoLoop)
+        return m_directSumLoop == e_InnerLoop;
+
+    return m_particleCount < InnerLoopMaxParticles;
+}
+
+//
+// Self check for -verifydeterminism: run every CPU path for a few steps at 1, 4 and 64 threads from the
+// same initial particles and require bitwise identical particles and diagnostics. Only the thread count
+// varies, every run uses the ISPC target the dispatcher picked for this machine. The out of core solver
+// must also match the in memory ring kernels it is built on. Results go to the debug output; returns false
+// if any path differs.
+//
+bool D3D12nBodyGravity::VerifyDeterminism()
+{
+    static const int threadCounts[] = { 1, 4, 64 };
+    static const int stepCount = 4;
+    static const ProcessingType processingTypes[] = { e_CPU_Vector, e_CPU_Scalar, e_CPU_ParticleMesh, e_CPU_FastMultipole, e_CPU_MixedPrecision, e_CPU_Simd };
+    static const wchar_t* processingNames[] = { L"ISPC direct sum", L"scalar direct sum", L"particle-mesh", L"fast multipole", L"mixed precision", L"C++ SIMD direct sum" };
+
+    std::vector<Particle> initial(m_particleCount);
+    LoadInitialParticles(&initial[0], threadCounts[0]);
+
+    bool passed = true;
+
+    {
+        std::wstringstream line;
+        bool identical = true;
+
+        line << L"initial conditions: " << threadCounts[0];
+
+        for (size_t run = 1; run < _countof(threadCounts); run++)
+        {
+            std::vector<Particle> particles(m_particleCount);
+            LoadInitialParticles(&particles[0], threadCounts[run]);
+
+            bool same = memcmp(&particles[0], &initial[0], m_particleCount * sizeof(Particle)) == 0;
+            line << L", " << threadCounts[run] << (same ? L"" : L" (differs)");
+            identical = identical && same;
+        }
+
+        line << L" threads: " << (identical ? L"identical" : L"FAILED") << L"\n";
+        OutputDebugStringW(line.str().c_str());
+        passed = passed && identical;
+    }
+
+    for (size_t type = 0; type < _countof(processingTypes); type++)
+    {
+        std::vector<Particle> reference;
+        Diagnostics::Result referenceDiagnostics = {};
+        std::wstringstream line;
+        bool identical = true;
+
+        line << processingNames[type] << L":";
+
+        for (size_t run = 0; run < _countof(threadCounts); run++)
+        {
+            const int threads = threadCounts[run];
+
+            std::vector<Particle> read = initial;
+            std::vector<Particle> write = initial;
+            if (processingTypes[type] == e_CPU_MixedPrecision)
+                m_mixedPrecision.Load((ispc::Particle *)&read[0], m_particleCount, threads);
+
+            for (int step = 0; step < stepCount; step++)
+            {
+                StepParticlesCPU(processingTypes[type], &read, &write, threads);
+                std::swap(read, write);
+            }
+
+            Diagnostics diagnostics;
+            diagnostics.SetParticleMesh((processingTypes[type] == e_CPU_ParticleMesh) ? &m_particleMesh : nullptr);
+            Diagnostics::Result result = diagnostics.Compute((ispc::Particle *)&read[0], m_particleCount, threads);
+
+            if (run == 0)
+            {
+                reference = read;
+                referenceDiagnostics = result;
+                line << L" " << threads;
+                continue;
+            }
+
+            bool same = memcmp(&read[0], &reference[0], m_particleCount * sizeof(Particle)) == 0 &&
+                memcmp(&result.kineticEnergy, &referenceDiagnostics.kineticEnergy, sizeof(double)) == 0 &&
+                memcmp(&result.potentialEnergy, &referenceDiagnostics.potentialEnergy, sizeof(double)) == 0 &&
+                memcmp(result.momentum, referenceDiagnostics.momentum, sizeof(result.momentum)) == 0 &&
+                memcmp(result.angularMomentum, referenceDiagnostics.angularMomentum, sizeof(result.angularMomentum)) == 0 &&
+                memcmp(result.centerOfMass, referenceDiagnostics.centerOfMass, sizeof(result.centerOfMass)) == 0;
+
+            line << L", " << threads << (same ? L"" : L" (differs)");
+            identical = identical && same;
+        }
+
+        line << L" threads: " << (identical ? L"identical" : L"FAILED") << L"\n";
+        OutputDebugStringW(line.str().c_str());
+        passed = passed && identical;
+    }
+
+    //
+    // Frustum culling of the initial particles from a close-up camera. The compacted list must be the same
+    // for every thread count, in particle order, and agree with the scalar test except for particles
+    // within BoundaryTolerance of a plane, where the ISPC rounding may differ.
+    //
+    {
+        static const float BoundaryTolerance = 0.01f;
+
+        XMFLOAT4X4 viewProjection;
+        XMStoreFloat4x4(&viewProjection, XMMatrixMultiply(XMMatrixLookToRH(XMVectorSet(100.0f, 50.0f, 300.0f, 0.0f), XMVectorSet(0.0f, 0.0f, -1.0f, 0.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)),
+            XMMatrixPerspectiveFovRH(0.8f, 1.0f, 1.0f, 5000.0f)));
+
+        FrustumCuller culler;
+        culler.SetFrustum(viewProjection, ParticleSpriteRadius);
+
+        std::vector<ispc::RenderRecord> referenceRecords;
+        std::vector<uint32_t> referenceIndices;
+        uint32_t referenceCount = 0;
+        std::wstringstream line;
+        bool identical = true;
+
+        for (size_t run = 0; run < _countof(threadCounts); run++)
+        {
+            const int threads = threadCounts[run];
+
+            std::vector<ispc::RenderRecord> records(m_particleCount);
+            std::vector<uint32_t> indices(m_particleCount);
+            uint32_t count = culler.Cull((const ispc::Particle *)&initial[0], m_particleCount, threads, &records[0], &indices[0]);
+
+            if (run == 0)
+            {
+                bool matches = true;
+                uint32_t next = 0;
+                for (uint32_t ii = 0; ii < m_particleCount; ii++)
+                {
+                    const bool kept = next < count && indices[next] == ii;
+                    if (kept)
+                        next++;
+
+                    const float distance = culler.GetDistance(*(const ispc::Particle *)&initial[ii]);
+                    if (distance > BoundaryTolerance || distance < -BoundaryTolerance)
+                        matches = matches && (kept == (distance >= 0.0f));
+                }
+                matches = matches && (next == count);
+
+                referenceRecords = records;
+                referenceIndices = indices;
+                referenceCount = count;
+                line << L"frustum culling: " << count << L" of " << m_particleCount << L" particles in view" << (matches ? L"" : L" (differs from the scalar test)")
+                     << L", " << threads;
+                identical = identical && matches;
+                continue;
+            }
+
+            bool same = count == referenceCount &&
+                memcmp(&records[0], &referenceRecords[0], count * sizeof(ispc::RenderRecord)) == 0 &&
+                memcmp(&indices[0], &referenceIndices[0], count * sizeof(uint32_t)) == 0;
+
+            line << L", " << threads << (same ? L"" : L" (differs)");
+            identical = identical && same;
+        }
+
+        line << L" threads: " << (identical ? L"identical" : L"FAILED") << L"\n";
+        OutputDebugStringW(line.str().c_str());
+        passed = passed && identical;
+    }
+
+    //
+    // The out of core direct sum in four blocks and three tiles, neither dividing the particles evenly,
+    // against the in memory ring kernels summing the same tiles. The tiles' pulls add up in the same order
+    // either way, so the particles must be bitwise identical. The state files go to the temporary directory.
+    //
+    {
+        const uint32_t blockSize = (m_particleCount + 3) / 4;
+        const uint32_t tileSize = (m_particleCount + 2) / 3;
+        const uint32_t tiles = (m_particleCount + tileSize - 1) / tileSize;
+
+        std::vector<Particle> reference = initial;
+        std::vector<ispc::Vec4> positions(m_particleCount);
+        std::vector<ispc::Vec3> accelerations(m_particleCount);
+        ispc::Particle* pReference = (ispc::Particle *)&reference[0];
+        for (int step = 0; step < stepCount; step++)
+        {
+            concurrency::parallel_for<int>(0, m_hardwareThreads, [&](int thread)
+            {
+                uint32_t start, end;
+                RingSolver::GetSlice(m_particleCount, thread, m_hardwareThreads, &start, &end);
+                if (start < end)
+                    ispc::RingGatherPositions(pReference, start, end, &positions[start]);
+            });
+
+            concurrency::parallel_for<int>(0, m_hardwareThreads, [&](int thread)
+            {
+                uint32_t start, end;
+                RingSolver::GetSlice(m_particleCount, thread, m_hardwareThreads, &start, &end);
+                if (start >= end)
+                    return;
+
+                const ispc::Vec3 zero = {};
+                std::fill(accelerations.begin() + start, accelerations.begin() + end, zero);
+                for (uint32_t tile = 0; tile < tiles; tile++)
+                {
+                    const uint32_t tileStart = tile * tileSize;
+                    const uint32_t tileCount = (m_particleCount - tileStart < tileSize) ? m_particleCount - tileStart : tileSize;
+                    ispc::RingAccumulate(pReference, start, end, &positions[tileStart], tileCount, &accelerations[start]);
+                }
+                ispc::RingIntegrate(pReference, start, end, &accelerations[start]);
+            });
+        }
+
+        wchar_t tempPath[MAX_PATH];
+        GetTempPathW(MAX_PATH, tempPath);
+
+        std::wstringstream line;
+        bool identical = true;
+
+        line << L"out of core, blocks of " << blockSize << L", tiles of " << tileSize << L", against the in memory ring kernels:";
+
+        for (size_t run = 0; run < _countof(threadCounts); run++)
+        {
+            const int threads = threadCounts[run];
+
+            OutOfCoreSolver solver;
+            bool same = solver.Create(tempPath, m_particleCount, blockSize, tileSize);
+            if (same)
+            {
+                memcpy(solver.GetParticles(), &initial[0], m_particleCount * sizeof(Particle));
+                for (int step = 0; step < stepCount && same; step++)
+                    same = solver.Step(threads);
+                same = same && memcmp(solver.GetParticles(), &reference[0], m_particleCount * sizeof(Particle)) == 0;
+            }
+            solver.Close(true);
+
+            line << ((run == 0) ? L" " : L", ") << threads << (same ? L"" : L" (differs)");
+            identical = identical && same;
+        }
+
+        line << L" threads: " << (identical ? L"identical" : L"FAILED") << L"\n";
+        OutputDebugStringW(line.str().c_str());
+        passed = passed && identical;
+    }
+
+    return passed;
+}
+
+//
+// Measure the fast multipole solver at every expansion order on the current particles and write the
+// error/time trade-off, with the ISPC direct sum for comparison, to the debug output.
+//
+void D3D12nBodyGravity::ReportFastMultipoleAccuracy(const ispc::Particle* pParticles)
+{
+    std::vector<FastMultipole::AccuracyResult> results = m_fastMultipole.MeasureAccuracy(pParticles, m_particleCount, m_hardwareThreads, 1000);
+
+    std::vector<Particle> read(m_particleCount);
+    std::vector<Particle> scratch(m_particleCount);
+    memcpy(&read[0], pParticles, m_particleCount * sizeof(Particle));
+
+    auto begin = std::chrono::high_resolution_clock::now();
+    StepParticlesCPU(e_CPU_Vector, &read, &scratch, m_hardwareThreads);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    std::wstringstream report;
+    report << L"Fast multipole, " << m_particleCount << L" particles, opening angle " << m_fastMultipole.GetOpeningAngle() << L"\n";
+    report << L"  direct sum (ISPC): " << std::chrono::duration<double, std::milli>(end - begin).count() << L" ms\n";
+    for (const FastMultipole::AccuracyResult& result : results)
+    {
+        report << L"  order " << result.order << L": " << result.milliseconds << L" ms, rms error " << result.rmsError << L", max error " << result.maxError << L"\n";
+    }
+
+    OutputDebugStringW(report.str().c_str());
+}
+
+// 
+// Fast Recip Sqrt
+//
+// https://en.wikipedia.org/wiki/Fast_inverse_square_root
+//
+__inline float Q_rsqrt(float number)
+{
+    long i;
+    float x2, y;
+    const float threehalfs = 1.5F;
+
+    x2 = number * 0.5F;
+    y = number;
+    i = *(long *)&y;                       // evil floating point bit level hacking
+    i = 0x5f3759df - (i >> 1);
+    y = *(float *)&i;
+    y = y * (threehalfs - (x2 * y * y));   // 1st iteration
+    //	y  = y * ( threehalfs - ( x2 * y * y ) );   // 2nd iteration, this can be removed
+    return y;
+}
+
+__inline void bodyBodyInteraction(
+    XMFLOAT3 &accel, 
+    XMFLOAT4 thatPos, 
+    XMFLOAT4 thisPos)
+{
+    const float softeningSquared = 0.0000015625f;
+    const float g_fParticleMass = 66.73f;
+        
+    XMFLOAT3 r;
+    r.x = thatPos.x - thisPos.x;
+    r.y = thatPos.y - thisPos.y;
+    r.z = thatPos.z - thisPos.z;
+
+    float distSqr = (r.x * r.x) + (r.y * r.y) + (r.z * r.z);
+    distSqr += softeningSquared;
+
+    float invDist = Q_rsqrt(distSqr);
+    float invDistCube = invDist * invDist * invDist;
+
+    float s = g_fParticleMass * invDistCube;
+
+    accel.x += r.x * s;
+    accel.y += r.y * s;
+    accel.z += r.z * s;
+}
+
+//
+// Run the full simulation in C/C++ scalar code
+//
+void D3D12nBodyGravity::ProcessParticles(uint32_t particleStart, uint32_t particleCount, std::vector<Particle> * pReadParticles, std::vector<Particle> * pWriteParticles)
+{
+    const float timeStepDelta = 0.1f;
+    const float g_fG = 6.67300e-11f * 10000.0f;
+    const float g_fParticleMass = g_fG * 10000.0f * 10000.0f;
+
+    uint32_t particleEnd = particleStart + particleCount;
+    if (particleEnd > static_cast<uint32_t>(m_particleCount))
+        particleEnd = m_particleCount;
+
+    for (uint32_t ii = particleStart; ii < particleEnd; ii++)
+    {
+        XMFLOAT3 accel = { 0.0f, 0.0f, 0.0f };
+        XMFLOAT4 pos = (*pReadParticles)[ii].position;
+
+        // Better performance by not unrolling this loop
+        for (uint32_t jj = 0; jj < static_cast<uint32_t>(m_particleCount); jj ++)
+        {
+            bodyBodyInteraction(accel, (*pReadParticles)[jj + 0].position, pos);
+        }
+
+        XMFLOAT4 vel = (*pReadParticles)[ii].velocity;
+
+        // Update the velocity and position of current particle using the 
+        // acceleration computed above.
+        vel.x += accel.x * timeStepDelta;
+        vel.y += accel.y * timeStepDelta;
+        vel.z += accel.z * timeStepDelta;
+        vel.w = 1.0f / Q_rsqrt((accel.x * accel.x) + (accel.y * accel.y) + (accel.z * accel.z));
+
+        pos.x += vel.x * timeStepDelta;
+        pos.y += vel.y * timeStepDelta;
+        pos.z += vel.z * timeStepDelta;
+
+        (*pWriteParticles)[ii].position = pos;
+        (*pWriteParticles)[ii].velocity = vel;
+    }
+}
+
+void D3D12nBodyGravity::OnDestroy()
+{
     // Ensure that the GPU is no longer referencing resources that are about to be
     // cleaned up by the destructor.
     WaitForRenderContext();
 
-    // Close handles to fence events and threads.
-    CloseHandle(m_renderContextFenceEvent);
+    ReportFrameTimes();
+
+    // Close handles to fence events and threads.
+    CloseHandle(m_renderContextFenceEvent);
+}
+
+void D3D12nBodyGravity::OnKeyDown(UINT8 key)
+{
+    m_camera.OnKeyDown(key);
+
+    switch (key)
+    {
+    case VK_SPACE:
+        // toggle the modes
+        m_bReset = true;
+        m_processingType = (ProcessingType)(((int)m_processingType + 1) % e_MAX_ProcessingType);
+        break;
+    case VK_OEM_PLUS:
+    case VK_ADD:
+        m_fastMultipole.SetOrder(m_fastMultipole.GetOrder() + 1);
+        break;
+    case VK_OEM_MINUS:
+    case VK_SUBTRACT:
+        m_fastMultipole.SetOrder(m_fastMultipole.GetOrder() - 1);
+        break;
+    case 'M':
+        m_bReportFastMultipole = true;
+        break;
+    case 'I':
+        // The first press after loading a file switches to the generated models.
+        m_bReset = true;
+        if (m_particleFile.IsOpen())
+            m_particleFile.Close();
+        else
+            m_initialConditions.SetModel((InitialConditions::Model)(((int)m_initialConditions.GetModel() + 1) % InitialConditions::e_MAX_Model));
+        break;
+    case 'P':
+        Profiler::SetEnabled(!Profiler::IsEnabled());
+        break;
+    case 'T':
+        WriteProfilerTrace();
+        break;
+    case 'H':
+        ReportFrameTimes();
+        break;
+    case 'C':
+        m_bFrustumCulling = !m_bFrustumCulling;
+        break;
+    case 'L':
+        m_levelOfDetail.SetEnabled(!m_levelOfDetail.IsEnabled());
+        break;
+    case VK_PRIOR:
+        m_stepsPerFrame = (m_stepsPerFrame * 2 <= MaxStepsPerFrame) ? m_stepsPerFrame * 2 : MaxStepsPerFrame;
+        break;
+    case VK_NEXT:
+        m_stepsPerFrame = (m_stepsPerFrame > 1) ? m_stepsPerFrame / 2 : 1;
+        break;
+    }
+
+}
+
+void D3D12nBodyGravity::OnKeyUp(UINT8 key)
+{
+    m_camera.OnKeyUp(key);
+}
+
+void D3D12nBodyGravity::ParseCommandLineArgs(WCHAR* argv[], int argc)
+{
+    DXSample::ParseCommandLineArgs(argv, argc);
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if ((_wcsicmp(argv[i], L"-diagnostics") == 0 || _wcsicmp(argv[i], L"/diagnostics") == 0) && i + 1 < argc)
+        {
+            m_diagnostics.SetInterval(_wtoi(argv[++i]));
+        }
+        else if ((_wcsicmp(argv[i], L"-stepsperframe") == 0 || _wcsicmp(argv[i], L"/stepsperframe") == 0) && i + 1 < argc)
+        {
+            int steps = _wtoi(argv[++i]);
+            if (steps > 0)
+                m_stepsPerFrame = (static_cast<UINT>(steps) < MaxStepsPerFrame) ? static_cast<UINT>(steps) : MaxStepsPerFrame;
+        }
+        else if ((_wcsicmp(argv[i], L"-renderstream") == 0 || _wcsicmp(argv[i], L"/renderstream") == 0) && i + 1 < argc)
+        {
+            // "full" uploads the whole particles to render the CPU paths, "half" (the default) the packed records.
+            m_bPackedRenderStream = (_wcsicmp(argv[++i], L"full") != 0);
+        }
+        else if ((_wcsicmp(argv[i], L"-cull") == 0 || _wcsicmp(argv[i], L"/cull") == 0) && i + 1 < argc)
+        {
+            // Off by default, so the direct sum kernels can store the render records themselves.
+            m_bFrustumCulling = (_wcsicmp(argv[++i], L"off") != 0);
+        }
+        else if ((_wcsicmp(argv[i], L"-lod") == 0 || _wcsicmp(argv[i], L"/lod") == 0) && i + 1 < argc)
+        {
+            // Screen size in pixels under which grid cells of far particles become impostors, which turns the
+            // level of detail on; 0 turns it off and keeps the default threshold for L.
+            m_levelOfDetail.SetThreshold(static_cast<float>(_wtof(argv[++i])));
+        }
+        else if (_wcsicmp(argv[i], L"-verifydeterminism") == 0 || _wcsicmp(argv[i], L"/verifydeterminism") == 0)
+        {
+            m_bVerifyDeterminism = true;
+        }
+        else if ((_wcsicmp(argv[i], L"-simd") == 0 || _wcsicmp(argv[i], L"/simd") == 0) && i + 3 < argc)
+        {
+            SimdKernel::Precision precision = (_wcsicmp(argv[i + 1], L"double") == 0) ? SimdKernel::e_Double : SimdKernel::e_Float;
+            const SimdKernel::KernelEntry* pKernel = SimdKernel::FindKernel(precision, _wtoi(argv[i + 2]), _wtoi(argv[i + 3]));
+            i += 3;
+
+            // Keep the default when that instantiation was not built.
+            if (pKernel)
+                m_pSimdKernel = pKernel;
+        }
+        else if ((_wcsicmp(argv[i], L"-loop") == 0 || _wcsicmp(argv[i], L"/loop") == 0) && i + 1 < argc)
+        {
+            ++i;
+            if (_wcsicmp(argv[i], L"outer") == 0)
+                m_directSumLoop = e_OuterLoop;
+            else if (_wcsicmp(argv[i], L"inner") == 0)
+                m_directSumLoop = e_InnerLoop;
+            else if (_wcsicmp(argv[i], L"auto") == 0)
+                m_directSumLoop = e_AutoLoop;
+        }
+        else if (_wcsicmp(argv[i], L"-autotune") == 0 || _wcsicmp(argv[i], L"/autotune") == 0)
+        {
+            m_bAutotune = true;
+        }
+        else if ((_wcsicmp(argv[i], L"-benchmark") == 0 || _wcsicmp(argv[i], L"/benchmark") == 0) && i + 1 < argc)
+        {
+            int steps = _wtoi(argv[++i]);
+            m_benchmarkSteps = (steps > 0) ? static_cast<UINT>(steps) : 0;
+        }
+        else if ((_wcsicmp(argv[i], L"-ensemble") == 0 || _wcsicmp(argv[i], L"/ensemble") == 0) && i + 2 < argc)
+        {
+            int systems = _wtoi(argv[++i]);
+            int particles = _wtoi(argv[++i]);
+            m_ensembleSystems = (systems > 0 && particles > 0) ? static_cast<UINT>(systems) : 0;
+            m_ensembleParticles = (particles > 0) ? static_cast<UINT>(particles) : 0;
+
+            // The step count is optional.
+            int steps = (i + 1 < argc) ? _wtoi(argv[i + 1]) : 0;
+            if (steps > 0)
+            {
+                m_ensembleSteps = static_cast<UINT>(steps);
+                ++i;
+            }
+        }
+        else if ((_wcsicmp(argv[i], L"-render") == 0 || _wcsicmp(argv[i], L"/render") == 0) && i + 2 < argc)
+        {
+            m_renderPath = argv[++i];
+            int frames = _wtoi(argv[++i]);
+            m_renderFrames = (frames > 0) ? static_cast<UINT>(frames) : 0;
+        }
+        else if ((_wcsicmp(argv[i], L"-rendersize") == 0 || _wcsicmp(argv[i], L"/rendersize") == 0) && i + 2 < argc)
+        {
+            int width = _wtoi(argv[++i]);
+            int height = _wtoi(argv[++i]);
+            if (width > 0 && height > 0)
+            {
+                m_renderWidth = static_cast<UINT>(width);
+                m_renderHeight = static_cast<UINT>(height);
+            }
+        }
+        else if ((_wcsicmp(argv[i], L"-outofcore") == 0 || _wcsicmp(argv[i], L"/outofcore") == 0) && i + 1 < argc)
+        {
+            m_outOfCorePath = argv[++i];
+
+            // The step count is optional.
+            if (i + 1 < argc && _wtoi(argv[i + 1]) > 0)
+                m_outOfCoreSteps = static_cast<UINT>(_wtoi(argv[++i]));
+        }
+        else if ((_wcsicmp(argv[i], L"-outofcoreblock") == 0 || _wcsicmp(argv[i], L"/outofcoreblock") == 0) && i + 1 < argc)
+        {
+            int blockSize = _wtoi(argv[++i]);
+            if (blockSize > 0)
+                m_outOfCoreBlockSize = static_cast<UINT>(blockSize);
+        }
+        else if ((_wcsicmp(argv[i], L"-outofcoretile") == 0 || _wcsicmp(argv[i], L"/outofcoretile") == 0) && i + 1 < argc)
+        {
+            int tileSize = _wtoi(argv[++i]);
+            if (tileSize > 0)
+                m_outOfCoreTileSize = static_cast<UINT>(tileSize);
+        }
+        else if ((_wcsicmp(argv[i], L"-planetesimals") == 0 || _wcsicmp(argv[i], L"/planetesimals") == 0) && i + 1 < argc)
+        {
+            int bodies = _wtoi(argv[++i]);
+            if (bodies > 0)
+                m_planetesimalCount = static_cast<UINT>(bodies);
+
+            // The step count is optional.
+            if (i + 1 < argc && _wtoi(argv[i + 1]) > 0)
+                m_planetesimalSteps = static_cast<UINT>(_wtoi(argv[++i]));
+        }
+        else if ((_wcsicmp(argv[i], L"-planetesimalradius") == 0 || _wcsicmp(argv[i], L"/planetesimalradius") == 0) && i + 1 < argc)
+        {
+            float radius = static_cast<float>(_wtof(argv[++i]));
+            if (radius > 0.0f)
+                m_planetesimalRadius = radius;
+        }
+        else if ((_wcsicmp(argv[i], L"-sph") == 0 || _wcsicmp(argv[i], L"/sph") == 0) && i + 1 < argc)
+        {
+            int gas = _wtoi(argv[++i]);
+            if (gas > 0)
+                m_sphGasCount = static_cast<UINT>(gas);
+
+            // The step count is optional.
+            if (i + 1 < argc && _wtoi(argv[i + 1]) > 0)
+                m_sphSteps = static_cast<UINT>(_wtoi(argv[++i]));
+        }
+        else if ((_wcsicmp(argv[i], L"-sphsoundspeed") == 0 || _wcsicmp(argv[i], L"/sphsoundspeed") == 0) && i + 1 < argc)
+        {
+            float soundSpeed = static_cast<float>(_wtof(argv[++i]));
+            if (soundSpeed > 0.0f)
+                m_sphSoundSpeed = soundSpeed;
+        }
+        else if ((_wcsicmp(argv[i], L"-ring") == 0 || _wcsicmp(argv[i], L"/ring") == 0) && i + 1 < argc)
+        {
+            int ranks = _wtoi(argv[++i]);
+            m_ringRanks = (ranks > 0) ? ((static_cast<UINT>(ranks) < MaxRingRanks) ? static_cast<UINT>(ranks) : MaxRingRanks) : 0;
+
+            // The transport is optional.
+            if (i + 1 < argc && RingTransport::ParseType(argv[i + 1], &m_ringTransport))
+                ++i;
+        }
+        else if ((_wcsicmp(argv[i], L"-ringsteps") == 0 || _wcsicmp(argv[i], L"/ringsteps") == 0) && i + 1 < argc)
+        {
+            int steps = _wtoi(argv[++i]);
+            if (steps > 0)
+                m_ringSteps = static_cast<UINT>(steps);
+        }
+        else if ((_wcsicmp(argv[i], L"-ringrank") == 0 || _wcsicmp(argv[i], L"/ringrank") == 0) && i + 5 < argc)
+        {
+            m_ringRank = _wtoi(argv[++i]);
+            m_ringRanks = static_cast<UINT>(_wtoi(argv[++i]));
+            RingTransport::ParseType(argv[++i], &m_ringTransport);
+            m_ringSession = static_cast<UINT>(_wtoi(argv[++i]));
+            m_ringThreads = _wtoi(argv[++i]);
+            if (m_ringRanks == 0 || m_ringRank >= static_cast<int>(m_ringRanks) || m_ringThreads < 1)
+                m_ringRank = -1;
+        }
+        else if (_wcsicmp(argv[i], L"-verifyranks") == 0 || _wcsicmp(argv[i], L"/verifyranks") == 0)
+        {
+            m_bVerifyRanks = true;
+
+            // The transport is optional.
+            if (i + 1 < argc && RingTransport::ParseType(argv[i + 1], &m_ringTransport))
+                ++i;
+        }
+        else if (_wcsicmp(argv[i], L"-rankverify") == 0 || _wcsicmp(argv[i], L"/rankverify") == 0)
+        {
+            m_bRankVerify = true;
+        }
+        else if ((_wcsicmp(argv[i], L"-domain") == 0 || _wcsicmp(argv[i], L"/domain") == 0) && i + 1 < argc)
+        {
+            int ranks = _wtoi(argv[++i]);
+            m_domainRanks = (ranks > 0) ? ((static_cast<UINT>(ranks) < MaxRingRanks) ? static_cast<UINT>(ranks) : MaxRingRanks) : 0;
+
+            // The transport is optional.
+            if (i + 1 < argc && RingTransport::ParseType(argv[i + 1], &m_ringTransport))
+                ++i;
+        }
+        else if ((_wcsicmp(argv[i], L"-domainthreshold") == 0 || _wcsicmp(argv[i], L"/domainthreshold") == 0) && i + 1 < argc)
+        {
+            float threshold = static_cast<float>(_wtof(argv[++i]));
+            if (threshold > 1.0f)
+                m_domainThreshold = threshold;
+        }
+        else if ((_wcsicmp(argv[i], L"-domainrank") == 0 || _wcsicmp(argv[i], L"/domainrank") == 0) && i + 1 < argc)
+        {
+            m_bDomainRank = true;
+            m_domainThreshold = static_cast<float>(_wtof(argv[++i]));
+        }
+        else if (_wcsicmp(argv[i], L"-profile") == 0 || _wcsicmp(argv[i], L"/profile") == 0)
+        {
+            Profiler::SetEnabled(true);
+        }
+        else if ((_wcsicmp(argv[i], L"-clock") == 0 || _wcsicmp(argv[i], L"/clock") == 0) && i + 1 < argc)
+        {
+            ++i;
+            if (_wcsicmp(argv[i], L"tsc") == 0)
+                m_timer.SetClockSource(StepClock::e_TimeStampCounter);
+            else if (_wcsicmp(argv[i], L"steady") == 0)
+                m_timer.SetClockSource(StepClock::e_SteadyClock);
+        }
+        else if ((_wcsicmp(argv[i], L"-particles") == 0 || _wcsicmp(argv[i], L"/particles") == 0) && i + 1 < argc)
+        {
+            // The CPU kernels need a multiple of 8, round up. OnInit() clamps the count to the mode's limit.
+            long long count = _wtoi64(argv[++i]);
+            if (count > 0)
+                m_particleCount = (count < MaxOutOfCoreParticleCount) ? static_cast<UINT>((count + 7) & ~7ll) : MaxOutOfCoreParticleCount;
+        }
+        else if ((_wcsicmp(argv[i], L"-initialconditions") == 0 || _wcsicmp(argv[i], L"/initialconditions") == 0) && i + 1 < argc)
+        {
+            InitialConditions::Model model;
+            if (InitialConditions::ParseModel(argv[++i], &model))
+                m_initialConditions.SetModel(model);
+        }
+        else if ((_wcsicmp(argv[i], L"-load") == 0 || _wcsicmp(argv[i], L"/load") == 0) && i + 1 < argc)
+        {
+            m_particleFilePath = argv[++i];
+        }
+        else if ((_wcsicmp(argv[i], L"-orbit") == 0 || _wcsicmp(argv[i], L"/orbit") == 0) && i + 2 < argc)
+        {
+            InitialConditions::Orbit orbit = m_initialConditions.GetOrbit();
+            orbit.pericenter = static_cast<float>(_wtof(argv[++i]));
+            orbit.eccentricity = static_cast<float>(_wtof(argv[++i]));
+            m_initialConditions.SetOrbit(orbit);
+        }
+        else if ((_wcsicmp(argv[i], L"-massratio") == 0 || _wcsicmp(argv[i], L"/massratio") == 0) && i + 1 < argc)
+        {
+            InitialConditions::Orbit orbit = m_initialConditions.GetOrbit();
+            orbit.massRatio = static_cast<float>(_wtof(argv[++i]));
+            m_initialConditions.SetOrbit(orbit);
+        }
+        else if ((_wcsicmp(argv[i], L"-inclination") == 0 || _wcsicmp(argv[i], L"/inclination") == 0) && i + 2 < argc)
+        {
+            InitialConditions::Orbit orbit = m_initialConditions.GetOrbit();
+            orbit.inclination[0] = static_cast<float>(_wtof(argv[++i]));
+            orbit.inclination[1] = static_cast<float>(_wtof(argv[++i]));
+            m_initialConditions.SetOrbit(orbit);
+        }
+    }
+}
+
+//
+// Benchmark mode: time every CPU path for m_benchmarkSteps steps at the configured thread count.
+//
+// The thread cycle counters wrap the direct sum kernels (scalar, C++ SIMD, ISPC and mixed precision), one
+// scope per ProcessParticles call, and are summed over the threads. The particle-mesh and fast multipole
+// solvers are timed only.
+//
+void D3D12nBodyGravity::RunBenchmark()
+{
+    static const ProcessingType processingTypes[] = { e_CPU_Scalar, e_CPU_Simd, e_CPU_Vector, e_CPU_MixedPrecision, e_CPU_ParticleMesh, e_CPU_FastMultipole };
+    static const wchar_t* processingNames[] = { L"scalar direct sum", L"C++ SIMD direct sum", L"ISPC direct sum", L"mixed precision", L"particle-mesh", L"fast multipole" };
+
+    const bool countersAvailable = PerfCounters::Initialize();
+    const StepClock& clock = m_timer.GetClock();
+
+    {
+        std::wstringstream line;
+        line << L"Benchmark: " << m_particleCount << L" particles, " << m_hardwareThreads << L" threads (" << GetStepThreads(e_CPU_Vector)
+             << L" for the ISPC direct sum), " << m_benchmarkSteps << L" steps, "
+             << (countersAvailable ? L"hardware counters on" : L"hardware counters unavailable, timings only") << L"\n";
+        OutputDebugStringW(line.str().c_str());
+    }
+
+    std::vector<Particle> initial(m_particleCount);
+    LoadInitialParticles(&initial[0], m_hardwareThreads);
+
+    for (size_t type = 0; type < _countof(processingTypes); type++)
+    {
+        const ProcessingType processingType = processingTypes[type];
+
+        std::vector<Particle> read = initial;
+        std::vector<Particle> write = initial;
+        if (processingType == e_CPU_MixedPrecision)
+            m_mixedPrecision.Load((ispc::Particle *)&read[0], m_particleCount, m_hardwareThreads);
+
+        // One untimed step to warm the caches and let the solvers size their buffers.
+        StepParticlesCPU(processingType, &read, &write, GetStepThreads(processingType));
+        std::swap(read, write);
+
+        TimeHistogram stepTimes;
+        PerfCounters::Reset();
+        PerfCounters::SetEnabled(true);
+
+        for (UINT step = 0; step < m_benchmarkSteps; step++)
+        {
+            uint64_t begin = clock.Now();
+            StepParticlesCPU(processingType, &read, &write, GetStepThreads(processingType));
+            stepTimes.Record(clock.ToNanoseconds(clock.Now() - begin));
+            std::swap(read, write);
+        }
+
+        PerfCounters::SetEnabled(false);
+        const PerfCounters::Totals totals = PerfCounters::Collect();
+
+        const bool directSum = processingType == e_CPU_Scalar || processingType == e_CPU_Simd || processingType == e_CPU_Vector || processingType == e_CPU_MixedPrecision;
+        const double seconds = stepTimes.GetMean() * static_cast<double>(stepTimes.GetCount()) * 1e-9;
+        const double interactions = static_cast<double>(m_particleCount) * static_cast<double>(m_particleCount) * static_cast<double>(m_benchmarkSteps);
+
+        std::wstringstream line;
+        line << processingNames[type];
+        if (processingType == e_CPU_Vector)
+            line << (UseInnerLoopKernel() ? L" (inner loop)" : L" (outer loop)");
+        line << L": mean " << stepTimes.GetMean() * 1e-6 << L" ms, p50 " << stepTimes.GetPercentile(50.0) * 1e-6
+             << L" ms, p99 " << stepTimes.GetPercentile(99.0) * 1e-6 << L" ms, max " << stepTimes.GetMax() * 1e-6 << L" ms";
+
+        if (directSum)
+        {
+            line << L", " << interactions / seconds * 1e-9 << L" G interactions/s";
+
+            // The cycles the worker threads ran in the kernels, and the clock rate they ran at.
+            if (countersAvailable)
+            {
+                line << L", cycles/interaction ";
+                if (totals.IsValid(PerfCounters::e_Cycles))
+                    line << totals.Get(PerfCounters::e_Cycles) / interactions << L", " << totals.Get(PerfCounters::e_Cycles) / (seconds * GetStepThreads(processingType)) * 1e-9 << L" GHz per thread";
+                else
+                    line << L"n/a";
+            }
+        }
+
+        line << L"\n";
+        OutputDebugStringW(line.str().c_str());
+    }
+}
+
+//
+// Ensemble mode: step m_ensembleSystems Plummer spheres of m_ensembleParticles particles each for
+// m_ensembleSteps steps, with the time step and softening spread over the ensemble as in a parameter study.
+//
+// The batch is timed with the systems on SIMD lanes, on threads and split by size, and against one
+// parallel launch of the ISPC direct sum per system and step, which is what looping over the systems
+// with the single system solver does. The baseline uses that kernel's fixed time step and softening, so
+// it is only timed; the batched modes must agree bit for bit. Returns false if they do not.
+//
+bool D3D12nBodyGravity::RunEnsemble()
+{
+    static const float ScaleRadius = 10.0f;
+    static const float GravitationalMass = 66.73f;
+    static const float TimeStep = 0.005f;
+    static const float Softening = 0.5f;
+
+    const uint32_t systemCount = m_ensembleSystems;
+    const uint32_t particleCount = m_ensembleParticles;
+    const uint32_t steps = m_ensembleSteps;
+    const int threads = m_hardwareThreads;
+    const StepClock& clock = m_timer.GetClock();
+
+    Ensemble initial;
+    for (uint32_t system = 0; system < systemCount; system++)
+    {
+        // From 0.5 to 1.5 times the nominal values across the ensemble.
+        const float spread = 0.5f + ((systemCount > 1) ? static_cast<float>(system) / static_cast<float>(systemCount - 1) : 0.5f);
+        initial.AddSystem(particleCount, TimeStep * spread, Softening * spread, GravitationalMass);
+    }
+
+    concurrency::parallel_for<int>(0, m_hardwareThreads, [&](int thread)
+    {
+        uint32_t start = static_cast<uint32_t>((static_cast<uint64_t>(systemCount) * thread) / m_hardwareThreads);
+        uint32_t end = static_cast<uint32_t>((static_cast<uint64_t>(systemCount) * (thread + 1)) / m_hardwareThreads);
+
+        for (uint32_t system = start; system < end; system++)
+            InitialConditions::GeneratePlummerSystem(initial.GetParticles(system), particleCount, system, ScaleRadius, GravitationalMass);
+    });
+
+    const double interactions = initial.GetInteractionsPerStep() * steps;
+
+    {
+        std::wstringstream line;
+        line << L"Ensemble: " << systemCount << L" systems of " << particleCount << L" particles, " << steps << L" steps, " << threads << L" threads\n";
+        OutputDebugStringW(line.str().c_str());
+    }
+
+    auto report = [&](const wchar_t* pName, uint64_t ticks)
+    {
+        const double seconds = clock.ToNanoseconds(ticks) * 1e-9;
+
+        std::wstringstream line;
+        line << pName << L": " << seconds * 1e3 << L" ms, " << static_cast<double>(systemCount) * steps / seconds << L" system steps/s, "
+             << interactions / seconds * 1e-9 << L" G interactions/s\n";
+        OutputDebugStringW(line.str().c_str());
+    };
+
+    static const Ensemble::Mode modes[] = { Ensemble::e_LanesPerSystem, Ensemble::e_ThreadsPerSystem, Ensemble::e_Auto };
+    static const wchar_t* modeNames[] = { L"systems on lanes", L"systems on threads", L"automatic" };
+
+    std::vector<Ensemble> results(_countof(modes), initial);
+    for (size_t mode = 0; mode < _countof(modes); mode++)
+    {
+        uint64_t begin = clock.Now();
+        results[mode].Step(steps, modes[mode], threads);
+        report(modeNames[mode], clock.Now() - begin);
+    }
+
+    {
+        std::vector<ispc::Particle> read(initial.GetParticles(0), initial.GetParticles(0) + initial.GetParticleCount());
+        std::vector<ispc::Particle> write(read.size());
+
+        ReservePartialAccels(threads, particleCount);
+
+        uint64_t begin = clock.Now();
+        for (uint32_t system = 0; system < systemCount; system++)
+        {
+            ispc::Particle* pRead = &read[initial.GetSystem(system).firstParticle];
+            ispc::Particle* pWrite = &write[initial.GetSystem(system).firstParticle];
+
+            for (uint32_t step = 0; step < steps; step++)
+            {
+                concurrency::parallel_for<int>(0, threads, [&](int thread)
+                {
+                    uint32_t start = static_cast<uint32_t>((static_cast<uint64_t>(particleCount) * thread) / threads);
+                    uint32_t end = static_cast<uint32_t>((static_cast<uint64_t>(particleCount) * (thread + 1)) / threads);
+
+                    if (start < end)
+                        ispc::ProcessParticles(start, end - start, pRead, pWrite, particleCount, m_kernelConfig.unroll, m_kernelConfig.tileSize,
+                                               &m_partialAccels[thread][0], nullptr);
+                });
+                std::swap(pRead, pWrite);
+            }
+        }
+        report(L"one launch per system", clock.Now() - begin);
+    }
+
+    //
+    // Every mode sums in the same order with the same arithmetic, so the particles must be identical, as in
+    // -verifydeterminism. The largest position difference against the lanes mode, in scale radii, shows how
+    // far apart they are when they are not.
+    //
+    bool identical = true;
+    const ispc::Particle* pLanes = results[0].GetParticles(0);
+    for (size_t mode = 1; mode < _countof(modes); mode++)
+    {
+        const ispc::Particle* pOther = results[mode].GetParticles(0);
+        const bool same = memcmp(pLanes, pOther, initial.GetParticleCount() * sizeof(ispc::Particle)) == 0;
+
+        double maxDifference = 0.0;
+        for (uint32_t ii = 0; ii < initial.GetParticleCount() && !same; ii++)
+        {
+            const double dx = pLanes[ii].position.x - pOther[ii].position.x;
+            const double dy = pLanes[ii].position.y - pOther[ii].position.y;
+            const double dz = pLanes[ii].position.z - pOther[ii].position.z;
+            const double difference = sqrt(dx * dx + dy * dy + dz * dz) / ScaleRadius;
+            if (difference > maxDifference)
+                maxDifference = difference;
+        }
+
+        std::wstringstream line;
+        line << modeNames[0] << L" and " << modeNames[mode] << L" modes: " << (same ? L"identical" : L"DIFFER");
+        if (!same)
+            line << L", largest position difference " << maxDifference << L" scale radii";
+        line << L"\n";
+        OutputDebugStringW(line.str().c_str());
+
+        identical = identical && same;
+    }
+
+    return identical;
 }
 
-void D3D12nBodyGravity::OnKeyDown(UINT8 key)
+//
+// Tune the ISPC direct sum for the current particle count on this machine and store the result in the cache.
+// Each configuration is timed by the median of a few steps after a warm up step. Only the outer loop kernel
+// takes the tuned work items, unroll and tile, so a system small enough for the inner loop kernel is not
+// tuned at all.
+//
+void D3D12nBodyGravity::RunAutotune(const std::wstring& cachePath)
 {
-    m_camera.OnKeyDown(key);
+    static const int measuredSteps = 5;
 
-    switch (key)
+    if (UseInnerLoopKernel())
     {
-    case VK_SPACE:
-        // toggle the modes
-        m_bReset = true;
-        m_processingType = (ProcessingType)(((int)m_processingType + 1) % e_MAX_ProcessingType);
-        break;
+        std::wstringstream line;
+        line << L"Not autotuning: " << m_particleCount << L" particles run the inner loop kernel, which takes none of the tuned parameters; -loop outer tunes the outer loop kernel\n";
+        OutputDebugStringW(line.str().c_str());
+        return;
+    }
+
+    std::vector<Particle> initial(m_particleCount);
+    LoadInitialParticles(&initial[0], m_hardwareThreads);
+
+    const StepClock& clock = m_timer.GetClock();
+
+    auto measure = [&](const Autotuner::KernelConfig& config)
+    {
+        m_kernelConfig = config;
+
+        std::vector<Particle> read = initial;
+        std::vector<Particle> write = initial;
+        StepParticlesCPU(e_CPU_Vector, &read, &write, config.threads);
+        std::swap(read, write);
+
+        TimeHistogram stepTimes;
+        for (int step = 0; step < measuredSteps; step++)
+        {
+            uint64_t begin = clock.Now();
+            StepParticlesCPU(e_CPU_Vector, &read, &write, config.threads);
+            stepTimes.Record(clock.ToNanoseconds(clock.Now() - begin));
+            std::swap(read, write);
+        }
+
+        std::wstringstream line;
+        line << L"  work items " << config.grainSize << L", unroll " << config.unroll << L", tile " << config.tileSize << L", " << config.threads
+             << L" threads: " << stepTimes.GetPercentile(50.0) * 1e-6 << L" ms\n";
+        OutputDebugStringW(line.str().c_str());
+
+        return stepTimes.GetPercentile(50.0) * 1e-9;
+    };
+
+    {
+        std::wstringstream line;
+        line << L"Autotuning the ISPC direct sum for " << m_particleCount << L" particles on " << Autotuner::GetHostKey().c_str() << L":\n";
+        OutputDebugStringW(line.str().c_str());
     }
 
+    m_kernelConfig = Autotuner::Tune(m_hardwareThreads, measure);
+    bool saved = Autotuner::SaveConfig(cachePath.c_str(), m_particleCount, m_kernelConfig);
+
+    std::wstringstream line;
+    line << L"Selected work items " << m_kernelConfig.grainSize << L", unroll " << m_kernelConfig.unroll << L", tile " << m_kernelConfig.tileSize
+         << L", " << m_kernelConfig.threads << L" threads" << (saved ? L", saved to " : L", could not save to ") << cachePath << L"\n";
+    OutputDebugStringW(line.str().c_str());
 }
 
-void D3D12nBodyGravity::OnKeyUp(UINT8 key)
+//
+// Report the frame and CPU step time distributions of the compute type timed since the last reload.
+// Average frame rates hide the stalls; the tail percentiles and the maximum show them.
+//
+void D3D12nBodyGravity::ReportFrameTimes()
 {
-    m_camera.OnKeyUp(key);
+    static const wchar_t* ProcessingTypeNames[e_MAX_ProcessingType] =
+    {
+        L"CPU ISPC", L"CPU scalar", L"CPU particle-mesh", L"CPU fast multipole", L"CPU mixed precision", L"CPU C++ SIMD", L"GPU"
+    };
+
+    std::wstringstream report;
+    report << ProcessingTypeNames[m_timedProcessingType] << L", " << m_particleCount << L" particles, "
+           << (m_timer.GetClock().GetSource() == StepClock::e_TimeStampCounter ? L"TSC" : L"steady clock") << L":\n";
+
+    const TimeHistogram* pHistograms[] = { &m_frameTimes, &m_stepTimes };
+    const wchar_t* pNames[] = { L"  frame", L"  CPU step" };
+    for (UINT ii = 0; ii < _countof(pHistograms); ii++)
+    {
+        const TimeHistogram& histogram = *pHistograms[ii];
+        if (histogram.GetCount() == 0)
+            continue;
+
+        report << pNames[ii] << L" times over " << histogram.GetCount() << L" samples: mean " << histogram.GetMean() * 1e-6
+               << L" ms, p50 " << histogram.GetPercentile(50.0) * 1e-6 << L" ms, p99 " << histogram.GetPercentile(99.0) * 1e-6
+               << L" ms, p99.9 " << histogram.GetPercentile(99.9) * 1e-6 << L" ms, max " << histogram.GetMax() * 1e-6 << L" ms\n";
+    }
+
+    if (m_frameTimes.GetCount() != 0)
+        OutputDebugStringW(report.str().c_str());
+}
+
+//
+// Write the spans recorded so far next to the executable, for chrome://tracing or Perfetto.
+//
+void D3D12nBodyGravity::WriteProfilerTrace()
+{
+    std::wstring path = GetAssetFullPath(L"nBodyGravityTrace.json");
+
+    std::wstringstream message;
+    if (Profiler::WriteTrace(path.c_str()))
+        message << L"Profiler trace written to " << path << L"\n";
+    else
+        message << L"Could not write profiler trace to " << path << L"\n";
+    OutputDebugStringW(message.str().c_str());
 }
 
 void D3D12nBodyGravity::WaitForRenderContext()
@@ -1066,6 +2539,7 @@ void D3D12nBodyGravity::WaitForRenderContext()
     m_renderContextFenceValue++;
 
     // Wait until the signal command has been processed.
+    PROFILE_SCOPE("Wait for render context");
     WaitForSingleObject(m_renderContextFenceEvent, INFINITE);
 }
 
@@ -1087,7 +2561,739 @@ void D3D12nBodyGravity::MoveToNextFrame()
     // If the next frame is not ready to be rendered yet, wait until it is ready.
     if (m_renderContextFence->GetCompletedValue() < m_frameFenceValues[m_frameIndex])
     {
+        PROFILE_SCOPE("Wait for frame fence");
         ThrowIfFailed(m_renderContextFence->SetEventOnCompletion(m_frameFenceValues[m_frameIndex], m_renderContextFenceEvent));
         WaitForSingleObject(m_renderContextFenceEvent, INFINITE);
     }
 }
+
+//
+// Headless rendering for machines without a GPU: m_renderFrames frames, m_stepsPerFrame steps apart, of the
+// current CPU compute type (the ISPC direct sum in place of the GPU), splatted from the initial camera. The
+// frame number goes before the extension, frame.png gives frame_0000.png, frame_0001.png and so on, and a
+// .raw extension writes the bare 8 bit RGB pixels instead of a PNG.
+//
+void D3D12nBodyGravity::RunRender()
+{
+    const ProcessingType processingType = (m_processingType == e_GPU) ? e_CPU_Vector : m_processingType;
+    const int threads = GetStepThreads(processingType);
+    const StepClock& clock = m_timer.GetClock();
+
+    std::vector<Particle> read(m_particleCount);
+    LoadInitialParticles(&read[0], m_hardwareThreads);
+    std::vector<Particle> write = read;
+    if (processingType == e_CPU_MixedPrecision)
+        m_mixedPrecision.Load((ispc::Particle *)&read[0], m_particleCount, m_hardwareThreads);
+
+    XMFLOAT4X4 view;
+    XMFLOAT4X4 projection;
+    XMStoreFloat4x4(&view, m_camera.GetViewMatrix());
+    XMStoreFloat4x4(&projection, m_camera.GetProjectionMatrix(0.8f, static_cast<float>(m_renderWidth) / static_cast<float>(m_renderHeight), 1.0f, 5000.0f));
+
+    SplatRenderer renderer;
+    renderer.SetSize(m_renderWidth, m_renderHeight);
+    renderer.SetCamera(view, projection, ParticleSpriteRadius);
+
+    const size_t separator = m_renderPath.find_last_of(L"\\/");
+    size_t dot = m_renderPath.find_last_of(L'.');
+    if (dot != std::wstring::npos && separator != std::wstring::npos && dot < separator)
+        dot = std::wstring::npos;
+
+    const std::wstring stem = m_renderPath.substr(0, dot);
+    const std::wstring extension = (dot != std::wstring::npos) ? m_renderPath.substr(dot) : L".png";
+    const bool raw = _wcsicmp(extension.c_str(), L".raw") == 0;
+
+    {
+        std::wstringstream line;
+        line << L"Render: " << m_particleCount << L" particles, " << m_renderWidth << L" x " << m_renderHeight << L", " << m_renderFrames << L" frames "
+             << m_stepsPerFrame << L" steps apart, " << threads << L" threads\n";
+        OutputDebugStringW(line.str().c_str());
+    }
+
+    for (UINT frame = 0; frame < m_renderFrames; frame++)
+    {
+        // The first frame is the initial state.
+        uint64_t begin = clock.Now();
+        for (UINT step = 0; frame > 0 && step < m_stepsPerFrame; step++)
+        {
+            StepParticlesCPU(processingType, &read, &write, threads);
+            std::swap(read, write);
+        }
+        const uint64_t stepTicks = clock.Now() - begin;
+
+        begin = clock.Now();
+        renderer.Render((const ispc::Particle *)&read[0], m_particleCount, threads);
+        const uint64_t renderTicks = clock.Now() - begin;
+
+        wchar_t number[16];
+        swprintf_s(number, L"_%04u", frame);
+        const std::wstring path = stem + number + extension;
+
+        begin = clock.Now();
+        const bool written = raw ? renderer.WriteRaw(path.c_str()) : renderer.WritePng(path.c_str());
+        const uint64_t writeTicks = clock.Now() - begin;
+
+        std::wstringstream line;
+        line << path << (written ? L"" : L" could not be written") << L": steps " << clock.ToNanoseconds(stepTicks) * 1e-6 << L" ms, render "
+             << clock.ToNanoseconds(renderTicks) * 1e-6 << L" ms, write " << clock.ToNanoseconds(writeTicks) * 1e-6 << L" ms\n";
+        OutputDebugStringW(line.str().c_str());
+    }
+}
+
+//
+// The direct sum out of core: the initial conditions go straight into the mapped state file, and every
+// step reports its traffic and the disk bandwidth it takes for the I/O thread to keep ahead of the
+// kernels. The first step also reads the initial positions out of the particles.
+//
+void D3D12nBodyGravity::RunOutOfCore()
+{
+    const int threads = m_hardwareThreads;
+
+    OutOfCoreSolver solver;
+    if (!solver.Create(m_outOfCorePath.c_str(), m_particleCount, m_outOfCoreBlockSize, m_outOfCoreTileSize))
+    {
+        OutputDebugStringW((L"Out of core: " + solver.GetError() + L"\n").c_str());
+        return;
+    }
+
+    {
+        std::wstringstream line;
+        line << L"Out of core: " << m_particleCount << L" particles in " << m_outOfCorePath << L", blocks of " << m_outOfCoreBlockSize << L", tiles of "
+             << m_outOfCoreTileSize << L", " << threads << L" threads\n";
+        OutputDebugStringW(line.str().c_str());
+    }
+
+    LoadInitialParticles(reinterpret_cast<Particle*>(solver.GetParticles()), m_hardwareThreads);
+
+    for (UINT step = 0; step < m_outOfCoreSteps; step++)
+    {
+        const OutOfCoreSolver::Statistics before = solver.GetStatistics();
+        auto begin = std::chrono::high_resolution_clock::now();
+        const bool ok = solver.Step(threads);
+        const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count();
+
+        const OutOfCoreSolver::Statistics& after = solver.GetStatistics();
+        const double computeSeconds = after.computeSeconds - before.computeSeconds;
+        const double ioSeconds = after.ioSeconds - before.ioSeconds;
+        const double stallSeconds = after.stallSeconds - before.stallSeconds;
+        const double bytes = static_cast<double>((after.bytesRead - before.bytesRead) + (after.bytesWritten - before.bytesWritten));
+
+        // Bound by the disk when the kernels spent more than a tenth of the step waiting for it.
+        std::wstringstream line;
+        line << L"step " << step << L": ";
+        if (ok)
+        {
+            line << seconds * 1e3 << L" ms (kernels " << computeSeconds * 1e3 << L" ms, stalled on I/O " << stallSeconds * 1e3 << L" ms), read "
+                 << (after.bytesRead - before.bytesRead) * 1e-9 << L" GB, wrote " << (after.bytesWritten - before.bytesWritten) * 1e-9 << L" GB, needs "
+                 << bytes / computeSeconds * 1e-6 << L" MB/s to stay compute bound, I/O thread moved " << bytes / ioSeconds * 1e-6 << L" MB/s, "
+                 << ((stallSeconds > 0.1 * seconds) ? L"I/O bound\n" : L"compute bound\n");
+        }
+        else
+        {
+            line << L"failed\n";
+        }
+        OutputDebugStringW(line.str().c_str());
+        if (!ok)
+            return;
+    }
+
+    OutputDebugStringW((L"Final state in " + solver.GetStatePath() + L"\n").c_str());
+}
+
+//
+// Planetesimals merging round a star. Reports the bodies left and the mergers every tenth of the run,
+// with the time per step of the forces and of the collision stage, and at the end the largest merger
+// and whether the total mass survived the mergers.
+//
+void D3D12nBodyGravity::RunPlanetesimals()
+{
+    const int threads = m_hardwareThreads;
+
+    Planetesimals::Parameters parameters = Planetesimals::GetDefaultParameters();
+    parameters.bodyRadius = m_planetesimalRadius;
+
+    Planetesimals planetesimals;
+    planetesimals.Generate(m_planetesimalCount, parameters);
+
+    {
+        std::wstringstream line;
+        line << L"Planetesimals: " << m_planetesimalCount << L" bodies of radius " << parameters.bodyRadius << L", " << m_planetesimalSteps << L" steps, "
+             << threads << L" threads\n";
+        OutputDebugStringW(line.str().c_str());
+    }
+
+    auto getTotalMass = [&planetesimals]()
+    {
+        double massG = 0.0;
+        for (uint32_t ii = 0; ii < planetesimals.GetBodyCount(); ii++)
+            massG += planetesimals.GetBodies()[ii].massG;
+        return massG;
+    };
+    const double initialMassG = getTotalMass();
+
+    const UINT reportInterval = (m_planetesimalSteps >= 10) ? m_planetesimalSteps / 10 : 1;
+    Planetesimals::Statistics reported = planetesimals.GetStatistics();
+    for (UINT step = 1; step <= m_planetesimalSteps; step++)
+    {
+        planetesimals.Step(threads);
+        if (step % reportInterval != 0 && step != m_planetesimalSteps)
+            continue;
+
+        const Planetesimals::Statistics& statistics = planetesimals.GetStatistics();
+        const UINT steps = statistics.steps - reported.steps;
+        const double forceMilliseconds = (statistics.forceSeconds - reported.forceSeconds) * 1e3 / steps;
+        const double collisionMilliseconds = (statistics.collisionSeconds - reported.collisionSeconds) * 1e3 / steps;
+
+        std::wstringstream line;
+        line << L"step " << step << L": " << planetesimals.GetBodyCount() << L" bodies, " << statistics.mergers - reported.mergers << L" mergers, forces "
+             << forceMilliseconds << L" ms/step, collisions " << collisionMilliseconds << L" ms/step (" << 100.0 * collisionMilliseconds / forceMilliseconds
+             << L"% of the forces)\n";
+        OutputDebugStringW(line.str().c_str());
+        reported = statistics;
+    }
+
+    std::wstringstream line;
+    line << L"Largest merger " << planetesimals.GetStatistics().largestGroup << L" bodies in one step, total mass changed by "
+         << (getTotalMass() - initialMassG) / initialMassG << L"\n";
+    OutputDebugStringW(line.str().c_str());
+}
+
+//
+// SPH gas among the particles. The gas is every so many of the initial particles, moved to the front, so
+// it follows every component of the model. Reports the state of the gas every tenth of the run with the
+// time per step of the gravity and of each SPH pass.
+//
+void D3D12nBodyGravity::RunSph()
+{
+    const int threads = m_hardwareThreads;
+    const UINT gasCount = (m_sphGasCount < m_particleCount) ? m_sphGasCount : m_particleCount;
+
+    std::vector<ispc::Particle> initial(m_particleCount);
+    LoadInitialParticles(reinterpret_cast<Particle*>(&initial[0]), m_hardwareThreads);
+
+    std::vector<ispc::Particle> particles;
+    particles.reserve(m_particleCount);
+    std::vector<bool> isGas(m_particleCount, false);
+    for (UINT gas = 0; gas < gasCount; gas++)
+    {
+        const UINT index = static_cast<UINT>((static_cast<uint64_t>(gas) * m_particleCount) / gasCount);
+        particles.push_back(initial[index]);
+        isGas[index] = true;
+    }
+    for (UINT ii = 0; ii < m_particleCount; ii++)
+    {
+        if (!isGas[ii])
+            particles.push_back(initial[ii]);
+    }
+
+    SphGas::Parameters parameters = SphGas::GetDefaultParameters();
+    parameters.initialSoundSpeed = m_sphSoundSpeed;
+
+    SphGas sph;
+    sph.Initialize(&particles[0], m_particleCount, gasCount, parameters, threads);
+
+    {
+        std::wstringstream line;
+        line << L"SPH: " << gasCount << L" gas particles of " << m_particleCount << L", initial sound speed " << parameters.initialSoundSpeed << L", "
+             << m_sphSteps << L" steps, " << threads << L" threads\n";
+        OutputDebugStringW(line.str().c_str());
+    }
+
+    const UINT reportInterval = (m_sphSteps >= 10) ? m_sphSteps / 10 : 1;
+    SphGas::Statistics reported = sph.GetStatistics();
+    for (UINT step = 1; step <= m_sphSteps; step++)
+    {
+        sph.Step(threads);
+        if (step % reportInterval != 0 && step != m_sphSteps)
+            continue;
+
+        const SphGas::Statistics& statistics = sph.GetStatistics();
+        const SphGas::Diagnostics diagnostics = sph.GetDiagnostics();
+        const double steps = statistics.steps - reported.steps;
+
+        std::wstringstream line;
+        line << L"step " << step << L": density mean " << diagnostics.meanDensity << L" max " << diagnostics.maxDensity << L", " << diagnostics.meanNeighbours
+             << L" neighbours, smoothing length " << diagnostics.meanSmoothingLength << L", thermal energy " << diagnostics.thermalEnergy << L", kinetic energy "
+             << diagnostics.kineticEnergy << L", Courant number " << diagnostics.courantNumber << ((diagnostics.courantNumber > 0.3f) ? L" (too large)" : L"")
+             << L"; ms/step gravity " << (statistics.gravitySeconds - reported.gravitySeconds) * 1e3 / steps << L", neighbours "
+             << (statistics.neighbourSeconds - reported.neighbourSeconds) * 1e3 / steps << L", density "
+             << (statistics.densitySeconds - reported.densitySeconds) * 1e3 / steps << L", forces " << (statistics.forceSeconds - reported.forceSeconds) * 1e3 / steps
+             << L", integration " << (statistics.integrateSeconds - reported.integrateSeconds) * 1e3 / steps << L"\n";
+        OutputDebugStringW(line.str().c_str());
+        reported = statistics;
+    }
+}
+
+std::wstring D3D12nBodyGravity::GetRingResultPath(UINT session)
+{
+    wchar_t tempPath[MAX_PATH];
+    GetTempPathW(MAX_PATH, tempPath);
+
+    std::wstringstream path;
+    path << tempPath << L"nBodyGravityRing_" << session << L".txt";
+    return path.str();
+}
+
+//
+// Start one process per rank, this executable with -ringrank and 'arguments', wait for them and read the
+// 'resultCount' numbers rank 0 leaves in a file named after the session. False when a rank failed.
+// With a particle file the file sets the ranks' particle count, whatever 'particleCount' says.
+//
+bool D3D12nBodyGravity::RunRanks(UINT ranks, UINT particleCount, int threadsPerRank, const std::wstring& arguments, UINT resultCount, double* pResults)
+{
+    wchar_t exePath[MAX_PATH];
+    GetModuleFileNameW(nullptr, exePath, MAX_PATH);
+
+    // Consecutive runs take turns over a few sessions, so a run never meets the sockets of the last one.
+    const UINT basePort = 20000 + (GetCurrentProcessId() % 32) * 1024;
+    const UINT session = basePort + (m_ringRuns++ % 16) * MaxRingRanks;
+    const std::wstring resultPath = GetRingResultPath(session);
+    DeleteFileW(resultPath.c_str());
+
+    // The ranks start from the same particles as this process: the same file, or the same model and orbit,
+    // to the last bit of each float.
+    std::wstringstream source;
+    source.precision(9);
+    if (m_particleFile.IsOpen())
+    {
+        source << L" -load \"" << m_particleFilePath << L"\"";
+    }
+    else
+    {
+        const InitialConditions::Orbit& orbit = m_initialConditions.GetOrbit();
+        source << L" -initialconditions " << InitialConditions::GetModelName(m_initialConditions.GetModel()) << L" -orbit " << orbit.pericenter << L" " << orbit.eccentricity
+               << L" -massratio " << orbit.massRatio << L" -inclination " << orbit.inclination[0] << L" " << orbit.inclination[1];
+    }
+
+    std::vector<PROCESS_INFORMATION> processes;
+    for (UINT rank = 0; rank < ranks; rank++)
+    {
+        std::wstringstream commandLine;
+        commandLine << L"\"" << exePath << L"\" -particles " << particleCount << source.str()
+                    << L" -ringsteps " << m_ringSteps << L" -ringrank " << rank << L" " << ranks << L" " << RingTransport::GetTypeName(m_ringTransport)
+                    << L" " << session << L" " << threadsPerRank << arguments;
+        std::wstring command = commandLine.str();
+
+        STARTUPINFOW startupInfo = { sizeof(startupInfo) };
+        PROCESS_INFORMATION process = {};
+        if (!CreateProcessW(exePath, &command[0], nullptr, nullptr, FALSE, 0, nullptr, nullptr, &startupInfo, &process))
+            break;
+        CloseHandle(process.hThread);
+        processes.push_back(process);
+    }
+
+    bool ok = processes.size() == ranks;
+    std::vector<HANDLE> handles;
+    for (const PROCESS_INFORMATION& process : processes)
+        handles.push_back(process.hProcess);
+    if (!handles.empty())
+        WaitForMultipleObjects(static_cast<DWORD>(handles.size()), &handles[0], TRUE, INFINITE);
+
+    for (HANDLE handle : handles)
+    {
+        DWORD exitCode = 1;
+        ok = ok && GetExitCodeProcess(handle, &exitCode) && exitCode == 0;
+        CloseHandle(handle);
+    }
+
+    FILE* pFile = nullptr;
+    if (ok && _wfopen_s(&pFile, resultPath.c_str(), L"r") == 0 && pFile)
+    {
+        for (UINT result = 0; result < resultCount && ok; result++)
+            ok = fwscanf_s(pFile, L"%lf", &pResults[result]) == 1;
+        fclose(pFile);
+    }
+    else
+    {
+        ok = false;
+    }
+    DeleteFileW(resultPath.c_str());
+    return ok;
+}
+
+//
+// Scaling harness of the distributed direct sum, one RunRanks() per run.
+//
+// Each rank gets the same share of this machine's threads in every run, as if it were a node of its
+// own: the strong scaling keeps the particle count, and the weak scaling grows it with the square root
+// of the rank count, which keeps the interactions per rank of the O(N^2) sum constant. Speedup and
+// efficiency are against the single rank run of the same curve.
+//
+void D3D12nBodyGravity::RunRing()
+{
+    const int threadsPerRank = (m_hardwareThreads / static_cast<int>(m_ringRanks) > 0) ? m_hardwareThreads / static_cast<int>(m_ringRanks) : 1;
+
+    std::vector<UINT> rankCounts;
+    for (UINT ranks = 1; ranks < m_ringRanks; ranks *= 2)
+        rankCounts.push_back(ranks);
+    rankCounts.push_back(m_ringRanks);
+
+    {
+        std::wstringstream line;
+        line << L"Ring: " << RingTransport::GetTypeName(m_ringTransport) << L", up to " << m_ringRanks << L" ranks of " << threadsPerRank << L" threads, "
+             << m_particleCount << L" particles, " << m_ringSteps << L" steps\n";
+        OutputDebugStringW(line.str().c_str());
+    }
+
+    // A particle file fixes the particle count, so it only runs the strong scaling.
+    const int curves = m_particleFile.IsOpen() ? 1 : 2;
+    for (int weak = 0; weak < curves; weak++)
+    {
+        double baseline = 0.0;
+        for (UINT ranks : rankCounts)
+        {
+            const UINT particleCount = weak ? (static_cast<UINT>(m_particleCount * sqrt(static_cast<double>(ranks))) + 7) & ~7u : m_particleCount;
+
+            std::wstringstream line;
+            line << (weak ? L"weak, " : L"strong, ") << ranks << L" ranks, " << particleCount << L" particles: ";
+
+            // Milliseconds per step in total, in the kernels and waiting on transfers.
+            double timings[3];
+            if (RunRanks(ranks, particleCount, threadsPerRank, std::wstring(), 3, timings))
+            {
+                if (ranks == 1)
+                    baseline = timings[0];
+
+                // Strong scaling divides the same work, weak scaling keeps the work per rank.
+                const double speedup = weak ? baseline * ranks / timings[0] : baseline / timings[0];
+                line << timings[0] << L" ms/step (kernels " << timings[1] << L" ms, exposed transfers " << timings[2] << L" ms), speedup " << speedup
+                     << L", efficiency " << 100.0 * speedup / ranks << L"%, " << static_cast<double>(particleCount) * particleCount / (timings[0] * 1e-3) * 1e-9 << L" G interactions/s\n";
+            }
+            else
+            {
+                line << L"failed\n";
+            }
+            OutputDebugStringW(line.str().c_str());
+        }
+    }
+}
+
+//
+// One rank of a -ring run: step this rank's slice m_ringSteps times after an untimed first step, and for
+// rank 0, write the per step timings where the harness reads them, followed with -rankverify by the
+// difference of all the slices from the direct sum.
+//
+bool D3D12nBodyGravity::RunRingRank()
+{
+    std::vector<Particle> initial(m_particleCount);
+    LoadInitialParticles(&initial[0], m_ringThreads);
+
+    // -rankverify finds the particles by their index in position.w, which no kernel reads.
+    if (m_bRankVerify)
+    {
+        for (UINT ii = 0; ii < m_particleCount; ii++)
+            initial[ii].position.w = static_cast<float>(ii);
+    }
+
+    std::wstring error;
+    std::unique_ptr<RingTransport> transport = RingTransport::Create(m_ringTransport, m_ringRank, m_ringRanks, m_ringSession,
+                                                                     RingSolver::GetMaxMessageSize(m_particleCount, m_ringRanks), &error);
+    if (!transport)
+    {
+        std::wstringstream line;
+        line << L"Ring rank " << m_ringRank << L": " << error << L"\n";
+        OutputDebugStringW(line.str().c_str());
+        return false;
+    }
+
+    RingSolver solver;
+    solver.Initialize((const ispc::Particle *)&initial[0], m_particleCount, m_ringRank, m_ringRanks);
+
+    if (!solver.Step(transport.get(), m_ringThreads))
+        return false;
+    const RingSolver::Timings warmUp = solver.GetTimings();
+
+    auto begin = std::chrono::high_resolution_clock::now();
+    for (UINT step = 0; step < m_ringSteps; step++)
+    {
+        if (!solver.Step(transport.get(), m_ringThreads))
+            return false;
+    }
+    const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+
+    double difference = 0.0;
+    if (m_bRankVerify && !CompareRankParticles(transport.get(), initial, solver.GetParticles(), solver.GetLocalCount(), &difference))
+        return false;
+
+    if (m_ringRank == 0)
+    {
+        const RingSolver::Timings& timings = solver.GetTimings();
+
+        FILE* pFile = nullptr;
+        if (_wfopen_s(&pFile, GetRingResultPath(m_ringSession).c_str(), L"w") != 0 || !pFile)
+            return false;
+        fwprintf_s(pFile, L"%f %f %f %g\n", milliseconds / m_ringSteps, (timings.computeSeconds - warmUp.computeSeconds) * 1e3 / m_ringSteps,
+                   (timings.waitSeconds - warmUp.waitSeconds) * 1e3 / m_ringSteps, difference);
+        fclose(pFile);
+    }
+    return true;
+}
+
+//
+// Self check for -verifyranks: run the distributed direct sum, then the domain decomposed solver at opening
+// angle 0, which opens every cell and makes it a direct sum too, on RankVerifyParticles particles in 1, 2
+// and 4 processes for RankVerifySteps steps. The ranks must end up holding every particle once, and
+// close to the single process ISPC direct sum: they add the pulls up in another order, so the two only
+// agree to rounding, which close encounters amplify. The largest difference of the positions and of the
+// velocities, relative to the largest reference component, must stay under RankVerifyTolerance. Results
+// go to the debug output; returns false if a run fails or differs.
+//
+bool D3D12nBodyGravity::VerifyRanks()
+{
+    static const UINT rankCounts[] = { 1, 2, 4 };
+
+    // The ranks take an untimed first step and m_ringSteps more.
+    m_ringSteps = RankVerifySteps - 1;
+    const int threadsPerRank = (m_hardwareThreads / 4 > 0) ? m_hardwareThreads / 4 : 1;
+
+    bool passed = true;
+    for (int domains = 0; domains < 2; domains++)
+    {
+        // The results of a -ring or a -domain run, then the difference.
+        std::wstringstream arguments;
+        arguments << L" -rankverify";
+        if (domains)
+            arguments << L" -domainrank " << m_domainThreshold;
+        const UINT resultCount = domains ? 7 : 4;
+
+        for (UINT ranks : rankCounts)
+        {
+            std::wstringstream line;
+            line << (domains ? L"domains, " : L"ring, ") << ranks << L" ranks against the direct sum: ";
+
+            double results[7];
+            if (RunRanks(ranks, RankVerifyParticles, threadsPerRank, arguments.str(), resultCount, results))
+            {
+                const double difference = results[resultCount - 1];
+                const bool same = difference <= RankVerifyTolerance;
+                line << L"difference " << difference << L" of at most " << RankVerifyTolerance << (same ? L", passed\n" : L", FAILED\n");
+                passed = passed && same;
+            }
+            else
+            {
+                line << L"FAILED, a rank failed or lost particles\n";
+                passed = false;
+            }
+            OutputDebugStringW(line.str().c_str());
+        }
+    }
+
+    return passed;
+}
+
+//
+// -rankverify: gather every rank's local particles on rank 0, which puts them back in order by the index
+// the rank tagged each with in position.w and fails unless every index turns up once. There it steps
+// 'initial' with the ISPC direct sum as often as the ranks stepped and sets *pDifference to the largest
+// difference of the positions and of the velocities, relative to the largest reference component. Every
+// rank calls it.
+//
+bool D3D12nBodyGravity::CompareRankParticles(RingTransport* pTransport, const std::vector<Particle>& initial, const ispc::Particle* pLocal, uint32_t localCount,
+                                             double* pDifference)
+{
+    std::vector<uint8_t> own(reinterpret_cast<const uint8_t*>(pLocal), reinterpret_cast<const uint8_t*>(pLocal) + localCount * sizeof(ispc::Particle));
+    std::vector<std::vector<uint8_t>> all;
+    if (!pTransport->AllGather(own, &all))
+        return false;
+
+    *pDifference = 0.0;
+    if (m_ringRank != 0)
+        return true;
+
+    std::vector<Particle> gathered(m_particleCount);
+    std::vector<bool> found(m_particleCount, false);
+    uint64_t held = 0;
+    uint64_t placed = 0;
+    for (const std::vector<uint8_t>& rankParticles : all)
+    {
+        for (size_t offset = 0; offset + sizeof(Particle) <= rankParticles.size(); offset += sizeof(Particle))
+        {
+            Particle particle;
+            memcpy(&particle, &rankParticles[offset], sizeof(particle));
+            held++;
+
+            const UINT index = static_cast<UINT>(particle.position.w);
+            if (index < m_particleCount && !found[index])
+            {
+                found[index] = true;
+                gathered[index] = particle;
+                placed++;
+            }
+        }
+    }
+    if (held != m_particleCount || placed != m_particleCount)
+    {
+        std::wstringstream line;
+        line << L"Rank 0: the ranks hold " << held << L" particles, " << placed << L" of the " << m_particleCount << L" different\n";
+        OutputDebugStringW(line.str().c_str());
+        return false;
+    }
+
+    std::vector<Particle> read = initial;
+    std::vector<Particle> write = initial;
+    for (UINT step = 0; step < m_ringSteps + 1; step++)
+    {
+        StepParticlesCPU(e_CPU_Vector, &read, &write, m_ringThreads);
+        std::swap(read, write);
+    }
+
+    double positionScale = 0.0;
+    double velocityScale = 0.0;
+    double positionDifference = 0.0;
+    double velocityDifference = 0.0;
+    for (UINT ii = 0; ii < m_particleCount; ii++)
+    {
+        const float* pPosition = &gathered[ii].position.x;
+        const float* pVelocity = &gathered[ii].velocity.x;
+        const float* pReferencePosition = &read[ii].position.x;
+        const float* pReferenceVelocity = &read[ii].velocity.x;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            positionScale = (fabs(pReferencePosition[axis]) > positionScale) ? fabs(pReferencePosition[axis]) : positionScale;
+            velocityScale = (fabs(pReferenceVelocity[axis]) > velocityScale) ? fabs(pReferenceVelocity[axis]) : velocityScale;
+
+            const double positionError = fabs(static_cast<double>(pPosition[axis]) - pReferencePosition[axis]);
+            const double velocityError = fabs(static_cast<double>(pVelocity[axis]) - pReferenceVelocity[axis]);
+            positionDifference = (positionError > positionDifference) ? positionError : positionDifference;
+            velocityDifference = (velocityError > velocityDifference) ? velocityError : velocityDifference;
+        }
+    }
+    positionDifference = (positionScale > 0.0) ? positionDifference / positionScale : positionDifference;
+    velocityDifference = (velocityScale > 0.0) ? velocityDifference / velocityScale : velocityDifference;
+    *pDifference = (positionDifference > velocityDifference) ? positionDifference : velocityDifference;
+    return true;
+}
+
+//
+// Harness of the domain decomposed solver: every rank count from 1 up, once keeping the first, count
+// balanced domains and once rebuilding them from the measured costs whenever the imbalance exceeds the
+// threshold. The gap shows best on a clustered model such as -initialconditions merger, whose dense
+// centres would otherwise leave most ranks waiting on the one that holds them.
+//
+void D3D12nBodyGravity::RunDomain()
+{
+    const int threadsPerRank = (m_hardwareThreads / static_cast<int>(m_domainRanks) > 0) ? m_hardwareThreads / static_cast<int>(m_domainRanks) : 1;
+
+    std::vector<UINT> rankCounts;
+    for (UINT ranks = 1; ranks < m_domainRanks; ranks *= 2)
+        rankCounts.push_back(ranks);
+    rankCounts.push_back(m_domainRanks);
+
+    {
+        std::wstringstream line;
+        line << L"Domains: " << RingTransport::GetTypeName(m_ringTransport) << L", up to " << m_domainRanks << L" ranks of " << threadsPerRank << L" threads, "
+             << m_particleCount << L" particles, " << InitialConditions::GetModelName(m_initialConditions.GetModel()) << L", " << m_ringSteps << L" steps\n";
+        OutputDebugStringW(line.str().c_str());
+    }
+
+    for (int rebalance = 0; rebalance < 2; rebalance++)
+    {
+        const float threshold = rebalance ? m_domainThreshold : 0.0f;
+        std::wstringstream arguments;
+        arguments << L" -domainrank " << threshold;
+
+        for (UINT ranks : rankCounts)
+        {
+            std::wstringstream line;
+            line << ranks << L" ranks, ";
+            if (rebalance)
+                line << L"rebalancing above " << threshold << L": ";
+            else
+                line << L"fixed domains: ";
+
+            // Milliseconds per step in total, in the kernels and in the collectives, the mean imbalance,
+            // the rebalances and the particles migrated per step.
+            double results[6];
+            if (RunRanks(ranks, m_particleCount, threadsPerRank, arguments.str(), 6, results))
+            {
+                line << results[0] << L" ms/step (kernels " << results[1] << L" ms, communication " << results[2] << L" ms), imbalance " << results[3]
+                     << L", " << results[4] << L" rebalances, " << results[5] << L" particles migrated per step\n";
+            }
+            else
+            {
+                line << L"failed\n";
+            }
+            OutputDebugStringW(line.str().c_str());
+        }
+    }
+}
+
+//
+// One rank of a -domain run, like RunRingRank(), with rank 0 also adding up the migrations of all of them.
+// With -rankverify every cell opens, and rank 0 appends the difference from the direct sum.
+//
+bool D3D12nBodyGravity::RunDomainRank()
+{
+    std::vector<Particle> initial(m_particleCount);
+    LoadInitialParticles(&initial[0], m_ringThreads);
+
+    // The particles move between ranks, -rankverify finds them by their index in position.w.
+    if (m_bRankVerify)
+    {
+        for (UINT ii = 0; ii < m_particleCount; ii++)
+            initial[ii].position.w = static_cast<float>(ii);
+    }
+
+    std::wstring error;
+    std::unique_ptr<RingTransport> transport = RingTransport::Create(m_ringTransport, m_ringRank, m_ringRanks, m_ringSession, DomainSolver::MailboxSize, &error);
+    if (!transport)
+    {
+        std::wstringstream line;
+        line << L"Domain rank " << m_ringRank << L": " << error << L"\n";
+        OutputDebugStringW(line.str().c_str());
+        return false;
+    }
+
+    DomainSolver solver;
+    solver.SetRebalanceThreshold(m_domainThreshold);
+    if (m_bRankVerify)
+        solver.SetOpeningAngle(0.0f);
+    if (!solver.Initialize((const ispc::Particle *)&initial[0], m_particleCount, transport.get()))
+        return false;
+
+    if (!solver.Step(transport.get(), m_ringThreads))
+        return false;
+    const DomainSolver::Statistics warmUp = solver.GetStatistics();
+
+    auto begin = std::chrono::high_resolution_clock::now();
+    for (UINT step = 0; step < m_ringSteps; step++)
+    {
+        if (!solver.Step(transport.get(), m_ringThreads))
+            return false;
+    }
+    const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+
+    // Every rank counts its own migrations; the rebalances and the imbalance are the same on all of them.
+    const DomainSolver::Statistics& statistics = solver.GetStatistics();
+    const double ownMigrated = static_cast<double>(statistics.migratedParticles - warmUp.migratedParticles);
+    std::vector<uint8_t> own(reinterpret_cast<const uint8_t*>(&ownMigrated), reinterpret_cast<const uint8_t*>(&ownMigrated) + sizeof(ownMigrated));
+    std::vector<std::vector<uint8_t>> all;
+    if (!transport->AllGather(own, &all))
+        return false;
+
+    double difference = 0.0;
+    if (m_bRankVerify && !CompareRankParticles(transport.get(), initial, solver.GetParticles(), solver.GetLocalCount(), &difference))
+        return false;
+
+    if (m_ringRank == 0)
+    {
+        double migrated = 0.0;
+        for (const std::vector<uint8_t>& rankMigrated : all)
+        {
+            double count = 0.0;
+            if (rankMigrated.size() == sizeof(count))
+                memcpy(&count, rankMigrated.data(), sizeof(count));
+            migrated += count;
+        }
+
+        FILE* pFile = nullptr;
+        if (_wfopen_s(&pFile, GetRingResultPath(m_ringSession).c_str(), L"w") != 0 || !pFile)
+            return false;
+        fwprintf_s(pFile, L"%f %f %f %f %f %f %g\n", milliseconds / m_ringSteps, (statistics.computeSeconds - warmUp.computeSeconds) * 1e3 / m_ringSteps,
+                   (statistics.communicationSeconds - warmUp.communicationSeconds) * 1e3 / m_ringSteps,
+                   (statistics.imbalanceSum - warmUp.imbalanceSum) / m_ringSteps, static_cast<double>(statistics.rebalances - warmUp.rebalances), migrated / m_ringSteps,
+                   difference);
+        fclose(pFile);
+    }
+    return true;
+}
@@ -29,6 +29,25 @@
 #include "DXSample.h"
 #include "SimpleCamera.h"
 #include "StepTimer.h"
+#include "TimeHistogram.h"
+#include "PerfCounters.h"
+#include "Autotuner.h"
+#include "SimdKernel.h"
+#include "ParticleMesh.h"
+#include "FastMultipole.h"
+#include "MixedPrecision.h"
+#include "Ensemble.h"
+#include "Diagnostics.h"
+#include "FrustumCuller.h"
+#include "LevelOfDetail.h"
+#include "RingSolver.h"
+#include "DomainSolver.h"
+#include "OutOfCoreSolver.h"
+#include "Planetesimals.h"
+#include "SphGas.h"
+#include "SplatRenderer.h"
+#include "InitialConditions.h"
+#include "ParticleFile.h"
 
 using namespace DirectX;
 
@@ -50,11 +69,13 @@ public:
     virtual void OnDestroy();
     virtual void OnKeyDown(UINT8 key);
     virtual void OnKeyUp(UINT8 key);
+    virtual void ParseCommandLineArgs(_In_reads_(argc) WCHAR* argv[], int argc);
 
 private:
     static const UINT FrameCount = 2;
-    static const float ParticleSpread;
-    static const UINT ParticleCount = 10000;		// The number of particles in the n-body simulation.
+    static const UINT DefaultParticleCount = 10000;	// The number of particles in the n-body simulation, unless set with -particles.
+    static const UINT ParticleMeshGridSize = 64;	// Cells per axis of the particle-mesh solver, must be a power of two.
+    static const float ParticleMeshBoxSize;			// Side length of the periodic particle-mesh box.
 
     // "Vertex" definition for particles. Triangle vertices are generated 
     // by the geometry shader. Color data will be assigned to those 
@@ -75,6 +96,13 @@ private:
         XMFLOAT4 velocity;
     };
 
+    // Largest particle count, a multiple of 8, whose Particle buffer fits in one D3D12 buffer resource.
+    // Every mode but -outofcore keeps its particles in such buffers and is clamped to it.
+    static const UINT MaxParticleCount = static_cast<UINT>((D3D12_REQ_RESOURCE_SIZE_IN_MEGABYTES_EXPRESSION_C_TERM * 1024ull * 1024ull) / sizeof(Particle)) & ~7u;
+
+    // Largest particle count of -outofcore, whose state lives in files: the largest multiple of 8 in a UINT.
+    static const UINT MaxOutOfCoreParticleCount = 0xfffffff8u;
+
     struct ConstantBufferGS
     {
         XMFLOAT4X4 worldViewProjection;
@@ -109,6 +137,8 @@ private:
 
     // Asset objects.
     ComPtr<ID3D12PipelineState> m_pipelineState;
+    ComPtr<ID3D12PipelineState> m_pipelineStatePacked;
+    ComPtr<ID3D12PipelineState> m_pipelineStateImpostor;
     ComPtr<ID3D12PipelineState> m_computeState;
     ComPtr<ID3D12GraphicsCommandList> m_commandList;
     ComPtr<ID3D12Resource> m_vertexBuffer;
@@ -118,6 +148,33 @@ private:
     ComPtr<ID3D12Resource> m_particleBuffer1;
     ComPtr<ID3D12Resource> m_particleBuffer0Upload;
     ComPtr<ID3D12Resource> m_particleBuffer1Upload;
+
+    // Half precision render records the CPU paths upload instead of the particles, -renderstream full|half.
+    // The kernels write them straight into the persistently mapped upload buffers.
+    ComPtr<ID3D12Resource> m_renderRecordBuffer0;
+    ComPtr<ID3D12Resource> m_renderRecordBuffer1;
+    ComPtr<ID3D12Resource> m_renderRecordBuffer0Upload;
+    ComPtr<ID3D12Resource> m_renderRecordBuffer1Upload;
+    ispc::RenderRecord* m_pRenderRecordUploadData[2];
+    bool m_bPackedRenderStream;
+
+    // Culling of the packed render records to the view frustum, off by default, -cull on|off and C toggle it.
+    // The draw count of each record buffer is the number of particles its last upload kept.
+    static const float ParticleSpriteRadius;
+    FrustumCuller m_frustumCuller;
+    bool m_bFrustumCulling;
+    UINT m_renderRecordCount[2];
+
+    // Far particles merged into impostors, off by default, -lod <pixels> sets the threshold and turns it on
+    // (0 for off) and L toggles it.
+    // The impostors have their own pair of buffers, drawn after the records.
+    LevelOfDetail m_levelOfDetail;
+    ComPtr<ID3D12Resource> m_impostorBuffer0;
+    ComPtr<ID3D12Resource> m_impostorBuffer1;
+    ComPtr<ID3D12Resource> m_impostorBuffer0Upload;
+    ComPtr<ID3D12Resource> m_impostorBuffer1Upload;
+    LevelOfDetail::Impostor* m_pImpostorUploadData[2];
+    UINT m_impostorCount[2];
     ComPtr<ID3D12Resource> m_constantBufferGS;
     UINT8* m_pConstantBufferGSData;
     ComPtr<ID3D12Resource> m_constantBufferCS;
@@ -147,16 +204,139 @@ private:
     int m_hardwareThreads;
     bool m_bReset;
 
+    // Periodic long range solver
+    ParticleMesh m_particleMesh;
+
+    // Tree solver, the expansion order is changed with +/- and M reports the error/time trade-off
+    FastMultipole m_fastMultipole;
+    bool m_bReportFastMultipole;
+
+    // Double precision state for the mixed precision direct sum
+    MixedPrecision m_mixedPrecision;
+
+    // Conservation diagnostics of the CPU paths, every N steps with -diagnostics N
+    Diagnostics m_diagnostics;
+    bool m_bVerifyDeterminism;
+
+    // CPU steps per rendered frame, only the last one is uploaded. -stepsperframe N, Page Up/Page Down double/halve it
+    static const UINT MaxStepsPerFrame = 256;
+    UINT m_stepsPerFrame;
+
+    // -benchmark N times N steps of every CPU path with hardware counters where available, then exits
+    UINT m_benchmarkSteps;
+
+    // -ensemble <systems> <particles> [steps] times a batch of small independent systems (100 steps by default), then exits
+    UINT m_ensembleSystems;
+    UINT m_ensembleParticles;
+    UINT m_ensembleSteps;
+
+    // -render <file> <frames> splats the CPU simulation into numbered .png or .raw images without a GPU, then
+    // exits. -rendersize <width> <height> sets the image size, 1920 by 1080 by default.
+    std::wstring m_renderPath;
+    UINT m_renderFrames;
+    UINT m_renderWidth;
+    UINT m_renderHeight;
+
+    // -outofcore <directory> [steps] runs the direct sum with the state in files in <directory>, streamed
+    // through memory, for 3 steps by default, then exits; -outofcoreblock N sets the particles kept in
+    // memory at once (4M) and -outofcoretile N the positions streamed past them at once (1M).
+    std::wstring m_outOfCorePath;
+    UINT m_outOfCoreSteps;
+    UINT m_outOfCoreBlockSize;
+    UINT m_outOfCoreTileSize;
+
+    // -planetesimals <bodies> [steps] runs a ring of merging planetesimals (200 steps by default) and
+    // reports the collisions and the cost of the collision stage, then exits; -planetesimalradius R sets
+    // the initial body radius.
+    UINT m_planetesimalCount;
+    UINT m_planetesimalSteps;
+    float m_planetesimalRadius;
+
+    // -sph <gas particles> [steps] makes that many of the particles SPH gas and runs gas and particles
+    // together (100 steps by default), reporting the state of the gas and the cost of each pass, then
+    // exits; -sphsoundspeed C sets the gas's initial sound speed.
+    UINT m_sphGasCount;
+    UINT m_sphSteps;
+    float m_sphSoundSpeed;
+
+    // -ring <ranks> [tcp|unix|shm] times the distributed direct sum in 1, 2, 4 .. <ranks> processes on this
+    // machine, for fixed and growing particle counts, then exits; -ringsteps N sets the timed steps (10).
+    // The processes it starts get -ringrank <rank> <ranks> <transport> <session> <threads>.
+    static const UINT MaxRingRanks = 64;
+    UINT m_ringRanks;
+    RingTransport::Type m_ringTransport;
+    UINT m_ringSteps;
+    int m_ringRank;
+    UINT m_ringSession;
+    int m_ringThreads;
+    UINT m_ringRuns;
+
+    // -verifyranks [tcp|unix|shm] checks the distributed solvers against the single process direct sum
+    // in 1, 2 and 4 processes, then exits. Its processes get -rankverify on top of -ringrank.
+    static const UINT RankVerifyParticles = 4096;
+    static const UINT RankVerifySteps = 4;
+    static const double RankVerifyTolerance;
+    bool m_bVerifyRanks;
+    bool m_bRankVerify;
+
+    // -domain <ranks> [tcp|unix|shm] times the domain decomposed solver the same way, with and without
+    // rebalancing when the imbalance exceeds -domainthreshold X (1.2), then exits. Its processes get
+    // -domainrank <threshold> on top of -ringrank.
+    UINT m_domainRanks;
+    float m_domainThreshold;
+    bool m_bDomainRank;
+
+    // Direct sum work item size, ISPC unroll and tile size and CPU thread count, tuned per host with -autotune.
+    // The tuned thread count only applies to the ISPC direct sum, the other solvers use every hardware thread.
+    Autotuner::KernelConfig m_kernelConfig;
+    bool m_bAutotune;
+
+    // Partial accelerations the tiled ISPC direct sum keeps between tiles, one buffer per worker thread,
+    // grown when needed and kept across steps.
+    std::vector<std::vector<ispc::Vec3>> m_partialAccels;
+
+    // Loop the ISPC direct sum vectorises: over the written particles, or over the read particles for small
+    // systems. -loop outer|inner|auto, auto takes the inner loop below InnerLoopMaxParticles particles,
+    // about where the outer loop stops filling four AVX2 gangs per thread on a desktop part.
+    enum DirectSumLoop
+    {
+        e_AutoLoop = 0,
+        e_OuterLoop,
+        e_InnerLoop
+    };
+    static const UINT InnerLoopMaxParticles = 512;
+    DirectSumLoop m_directSumLoop;
+
+    // Instantiation of the C++ SIMD direct sum, -simd float|double <width> <unroll> picks another one
+    const SimdKernel::KernelEntry* m_pSimdKernel;
+
+    // Particle count and initial condition model, set with -particles and -initialconditions, I cycles the model
+    UINT m_particleCount;
+    InitialConditions m_initialConditions;
+
+    // Initial conditions loaded with -load <file>, .bin for raw particles, anything else is text
+    std::wstring m_particleFilePath;
+    ParticleFile m_particleFile;
+
     enum ProcessingType 
     {
         e_CPU_Vector = 0,
         e_CPU_Scalar,
+        e_CPU_ParticleMesh,
+        e_CPU_FastMultipole,
+        e_CPU_MixedPrecision,
+        e_CPU_Simd,
         e_GPU,
 
         e_MAX_ProcessingType
     };
     ProcessingType m_processingType;
 
+    // Frame and CPU step time distributions of the current compute type, H reports them, -clock tsc times with the TSC
+    TimeHistogram m_frameTimes;
+    TimeHistogram m_stepTimes;
+    ProcessingType m_timedProcessingType;
+
     // Indices of the root signature parameters.
     enum GraphicsRootParameters : UINT32
     {
@@ -180,21 +360,50 @@ private:
         UavParticlePosVelo1 = UavParticlePosVelo0 + 1,
         SrvParticlePosVelo0 = UavParticlePosVelo1 + 1,
         SrvParticlePosVelo1 = SrvParticlePosVelo0 + 1,
-        DescriptorCount = SrvParticlePosVelo1 + 1
+        SrvRenderRecords0 = SrvParticlePosVelo1 + 1,
+        SrvRenderRecords1 = SrvRenderRecords0 + 1,
+        SrvImpostors0 = SrvRenderRecords1 + 1,
+        SrvImpostors1 = SrvImpostors0 + 1,
+        DescriptorCount = SrvImpostors1 + 1
     };
 
     void LoadPipeline();
     void LoadAssets();
     void CreateComputeContexts();
     void CreateVertexBuffer();
-    float RandomPercent();
-    void LoadParticles(_Out_writes_(numParticles) Particle* pParticles, const XMFLOAT3 &center, const XMFLOAT4 &velocity, float spread, UINT numParticles);
+    void LoadInitialParticles(_Out_writes_(m_particleCount) Particle* pParticles, int threads);
     void CreateParticleBuffers();
     void ReloadParticleBuffers();
     void PopulateCommandList();
     void ProcessParticles(uint32_t particleStart, uint32_t particleCount, std::vector<Particle> * pReadParticles, std::vector<Particle> * pWriteParticles);
     void SimulateGPU();
     void SimulateCPU();
+    void StepParticlesCPU(ProcessingType processingType, std::vector<Particle> * pReadParticles, std::vector<Particle> * pWriteParticles, int threads,
+                          ispc::RenderRecord* pRenderRecords = nullptr);
+    void ReportDiagnostics(const ispc::Particle* pParticles);
+    bool VerifyDeterminism();
+    bool UseInnerLoopKernel() const;
+    int GetStepThreads(ProcessingType processingType) const;
+    void ReservePartialAccels(int threads, uint32_t count);
+    void RunBenchmark();
+    bool RunEnsemble();
+    void RunRender();
+    void RunOutOfCore();
+    void RunPlanetesimals();
+    void RunSph();
+    void RunRing();
+    bool RunRingRank();
+    void RunDomain();
+    bool RunDomainRank();
+    bool RunRanks(UINT ranks, UINT particleCount, int threadsPerRank, const std::wstring& arguments, UINT resultCount, double* pResults);
+    bool VerifyRanks();
+    bool CompareRankParticles(RingTransport* pTransport, const std::vector<Particle>& initial, const ispc::Particle* pLocal, uint32_t localCount,
+                              double* pDifference);
+    static std::wstring GetRingResultPath(UINT session);
+    void RunAutotune(const std::wstring& cachePath);
+    void WriteProfilerTrace();
+    void ReportFrameTimes();
+    void ReportFastMultipoleAccuracy(const ispc::Particle* pParticles);
 
     void WaitForRenderContext();
     void MoveToNextFrame();
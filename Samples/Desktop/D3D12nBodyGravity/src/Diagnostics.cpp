@@ -0,0 +1,141 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#include "stdafx.h"
+#include "Diagnostics.h"
+#include "ParticleMesh.h"
+#include "Profiler.h"
+#include <chrono>
+
+// Concurrency
+#include <ppl.h>
+
+//
+// Sum 'count' values 'stride' apart by recursive halving. The shape of the tree only depends on the count.
+//
+static double PairwiseSum(const double* pValues, uint32_t count, uint32_t stride)
+{
+    if (count == 0)
+        return 0.0;
+    if (count == 1)
+        return pValues[0];
+
+    uint32_t half = count / 2;
+    return PairwiseSum(pValues, half, stride) + PairwiseSum(pValues + static_cast<size_t>(half) * stride, count - half, stride);
+}
+
+Diagnostics::Diagnostics() :
+    m_interval(0),
+    m_step(0),
+    m_bHasReference(false),
+    m_referenceEnergy(0.0),
+    m_bHasResult(false),
+    m_lastResult(),
+    m_pParticleMesh(nullptr)
+{
+}
+
+void Diagnostics::Reset()
+{
+    m_step = 0;
+    m_bHasReference = false;
+    m_bHasResult = false;
+}
+
+bool Diagnostics::Update(const ispc::Particle* pParticles, uint32_t particleCount, int threads)
+{
+    m_step++;
+
+    if (m_interval == 0 || (m_step % m_interval) != 0)
+        return false;
+
+    m_lastResult = Compute(pParticles, particleCount, threads);
+    m_bHasResult = true;
+    return true;
+}
+
+Diagnostics::Result Diagnostics::Compute(const ispc::Particle* pParticles, uint32_t particleCount, int threads)
+{
+    PROFILE_SCOPE("Diagnostics");
+
+    auto begin = std::chrono::high_resolution_clock::now();
+
+    const uint32_t blockCount = (particleCount + BlockSize - 1) / BlockSize;
+    m_blockMoments.resize(static_cast<size_t>(blockCount) * MomentCount);
+    m_blockPotential.resize(blockCount);
+
+    //
+    // Threads take whole blocks, each block has its own slot for the partial sums.
+    //
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        PROFILE_SCOPE("Diagnostics worker");
+
+        uint32_t blockStart = static_cast<uint32_t>((static_cast<uint64_t>(blockCount) * thread) / threads);
+        uint32_t blockEnd = static_cast<uint32_t>((static_cast<uint64_t>(blockCount) * (thread + 1)) / threads);
+
+        for (uint32_t block = blockStart; block < blockEnd; block++)
+        {
+            uint32_t start = block * BlockSize;
+            uint32_t count = (particleCount - start < BlockSize) ? particleCount - start : BlockSize;
+
+            ispc::DiagnosticsMoments(pParticles, start, count, &m_blockMoments[static_cast<size_t>(block) * MomentCount]);
+            if (!m_pParticleMesh)
+                ispc::DiagnosticsPotential(pParticles, start, count, particleCount, &m_blockPotential[block]);
+        }
+    });
+
+    double moments[MomentCount];
+    for (uint32_t ii = 0; ii < MomentCount; ii++)
+        moments[ii] = PairwiseSum(&m_blockMoments[ii], blockCount, MomentCount);
+
+    Result result = {};
+    result.step = m_step;
+    result.kineticEnergy = moments[0];
+    if (m_pParticleMesh)
+        result.potentialEnergy = m_pParticleMesh->ComputePotentialEnergy(pParticles, particleCount, threads);
+    else
+        result.potentialEnergy = -0.5 * PairwiseSum(&m_blockPotential[0], blockCount, 1);
+    result.totalEnergy = result.kineticEnergy + result.potentialEnergy;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        result.momentum[axis] = moments[1 + axis];
+        result.angularMomentum[axis] = moments[4 + axis];
+        result.centerOfMass[axis] = (particleCount > 0) ? moments[7 + axis] / particleCount : 0.0;
+    }
+
+    if (!m_bHasReference)
+    {
+        m_referenceEnergy = result.totalEnergy;
+        m_bHasReference = true;
+    }
+    result.relativeEnergyDrift = (m_referenceEnergy != 0.0) ? (result.totalEnergy - m_referenceEnergy) / fabs(m_referenceEnergy) : 0.0;
+
+    auto end = std::chrono::high_resolution_clock::now();
+    result.milliseconds = std::chrono::duration<double, std::milli>(end - begin).count();
+
+    return result;
+}
@@ -0,0 +1,95 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#pragma once
+
+// Add the auto generated ISPC kernel header
+#include "nBodyGravityDiagnostics_ispc.h"
+
+class ParticleMesh;
+
+//
+// Energy, momentum and centre of mass diagnostics, run every 'interval' steps.
+//
+// Particles are reduced in fixed blocks of BlockSize; each block writes its own partial sums, which are
+// then combined with a fixed tree. The result is bitwise the same for any number of threads.
+// The potential energy is a direct O(N^2) sum, so a diagnostics step costs about as much as a direct
+// sum step; the interval keeps that cost off most frames. The particle mesh solver feels a periodic
+// potential instead, so with a mesh set the potential energy is taken from the mesh.
+//
+class Diagnostics
+{
+public:
+    static const uint32_t BlockSize = 1024;
+
+    struct Result
+    {
+        uint64_t step;
+        double kineticEnergy;
+        double potentialEnergy;
+        double totalEnergy;
+        double relativeEnergyDrift;     // (E - E0) / |E0| against the first diagnostics step after Reset().
+        double momentum[3];
+        double angularMomentum[3];
+        double centerOfMass[3];
+        double milliseconds;            // Cost of this diagnostics pass alone.
+    };
+
+    Diagnostics();
+
+    // Run the diagnostics every 'interval' steps, 0 disables them.
+    void SetInterval(uint32_t interval)     { m_interval = interval; }
+    uint32_t GetInterval() const            { return m_interval; }
+
+    // Take the potential energy from this particle mesh instead of the direct sum, nullptr for the direct sum.
+    void SetParticleMesh(ParticleMesh* pParticleMesh)   { m_pParticleMesh = pParticleMesh; }
+
+    // Restart the step count and forget the reference energy, e.g. when the particles are reloaded.
+    void Reset();
+
+    // Call once per simulation step with the new particle state. Returns true when the diagnostics ran.
+    bool Update(const ispc::Particle* pParticles, uint32_t particleCount, int threads);
+
+    // Compute the diagnostics now, regardless of the interval.
+    Result Compute(const ispc::Particle* pParticles, uint32_t particleCount, int threads);
+
+    const Result& GetLastResult() const     { return m_lastResult; }
+    bool HasResult() const                  { return m_bHasResult; }
+
+private:
+    static const uint32_t MomentCount = 10;
+
+    uint32_t m_interval;
+    uint64_t m_step;
+    bool m_bHasReference;
+    double m_referenceEnergy;
+    bool m_bHasResult;
+    Result m_lastResult;
+    ParticleMesh* m_pParticleMesh;
+
+    std::vector<double> m_blockMoments;
+    std::vector<double> m_blockPotential;
+};
@@ -0,0 +1,136 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#include "stdafx.h"
+#include "DomainDecomposition.h"
+#include <algorithm>
+#include <cfloat>
+
+DomainDecomposition::DomainDecomposition() :
+    m_ranks(1)
+{
+}
+
+void DomainDecomposition::Build(std::vector<Sample>& samples, uint32_t ranks)
+{
+    m_nodes.clear();
+    m_ranks = ranks;
+    if (ranks > 1)
+        Bisect(samples, 0, samples.size(), 0, ranks);
+}
+
+uint32_t DomainDecomposition::Bisect(std::vector<Sample>& samples, size_t begin, size_t end, uint32_t rankBegin, uint32_t rankEnd)
+{
+    const uint32_t index = static_cast<uint32_t>(m_nodes.size());
+    m_nodes.push_back(Node());
+
+    const uint32_t rankSplit = rankBegin + (rankEnd - rankBegin) / 2;
+
+    // Cut across the longest side of the samples' bounds.
+    float lower[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float upper[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    double totalWeight = 0.0;
+    for (size_t ii = begin; ii < end; ii++)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            lower[axis] = (samples[ii].position[axis] < lower[axis]) ? samples[ii].position[axis] : lower[axis];
+            upper[axis] = (samples[ii].position[axis] > upper[axis]) ? samples[ii].position[axis] : upper[axis];
+        }
+        totalWeight += samples[ii].weight;
+    }
+
+    uint32_t axis = 0;
+    for (uint32_t candidate = 1; candidate < 3; candidate++)
+    {
+        if (upper[candidate] - lower[candidate] > upper[axis] - lower[axis])
+            axis = candidate;
+    }
+
+    //
+    // Walk the samples along the axis until the first ranks have their share of the cost, and cut halfway
+    // to the next sample. Ties are broken by the other coordinates so every rank sorts alike.
+    //
+    size_t middle = begin;
+    float split = 0.0f;
+    if (end > begin)
+    {
+        std::sort(samples.begin() + begin, samples.begin() + end, [axis](const Sample& a, const Sample& b)
+        {
+            for (uint32_t ii = 0; ii < 3; ii++)
+            {
+                const uint32_t component = (axis + ii) % 3;
+                if (a.position[component] != b.position[component])
+                    return a.position[component] < b.position[component];
+            }
+            return a.weight < b.weight;
+        });
+
+        const double target = totalWeight * (rankSplit - rankBegin) / (rankEnd - rankBegin);
+        double weight = 0.0;
+        while (middle < end && weight + samples[middle].weight * 0.5 < target)
+            weight += samples[middle++].weight;
+
+        if (middle == begin)
+            split = samples[begin].position[axis];
+        else if (middle == end)
+            split = samples[end - 1].position[axis];
+        else
+            split = 0.5f * (samples[middle - 1].position[axis] + samples[middle].position[axis]);
+    }
+
+    Node node = {};
+    node.axis = axis;
+    node.split = split;
+
+    const size_t ranges[2][2] = { { begin, middle }, { middle, end } };
+    const uint32_t rankRanges[2][2] = { { rankBegin, rankSplit }, { rankSplit, rankEnd } };
+    for (int side = 0; side < 2; side++)
+    {
+        node.leaf[side] = (rankRanges[side][1] - rankRanges[side][0] == 1);
+        node.children[side] = node.leaf[side] ? rankRanges[side][0] : Bisect(samples, ranges[side][0], ranges[side][1], rankRanges[side][0], rankRanges[side][1]);
+    }
+
+    m_nodes[index] = node;
+    return index;
+}
+
+uint32_t DomainDecomposition::GetOwner(float x, float y, float z) const
+{
+    if (m_nodes.empty())
+        return 0;
+
+    const float position[3] = { x, y, z };
+    uint32_t index = 0;
+    for (;;)
+    {
+        const Node& node = m_nodes[index];
+        const int side = (position[node.axis] < node.split) ? 0 : 1;
+        if (node.leaf[side])
+            return node.children[side];
+        index = node.children[side];
+    }
+}
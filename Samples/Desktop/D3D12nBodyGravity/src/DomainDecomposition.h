@@ -0,0 +1,75 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#pragma once
+
+#include <vector>
+
+//
+// Orthogonal recursive bisection (ORB) of space into one domain per rank, for the DomainSolver.
+//
+// The ranks contribute weighted samples of their particles, every particle's weight being the cost of
+// its last force evaluation. Build() halves the ranks and splits the samples across the longest side of
+// their bounds where the cost on either side matches the ranks there, then recurses into both halves
+// until every range holds a single rank. Each rank builds the same tree from the same samples, so they
+// all agree on the owner of any point without talking to each other.
+//
+// The splits are planes, not boxes: the outermost domains reach to infinity and every point has an owner.
+//
+class DomainDecomposition
+{
+public:
+    struct Sample
+    {
+        float position[3];
+        float weight;
+    };
+
+    DomainDecomposition();
+
+    // The samples in any order the ranks agree on, sorted in place. Ranks are numbered from 0.
+    void Build(std::vector<Sample>& samples, uint32_t ranks);
+
+    // The rank whose domain holds the point; 0 before the first Build().
+    uint32_t GetOwner(float x, float y, float z) const;
+
+    uint32_t GetRanks() const   { return m_ranks; }
+
+private:
+    struct Node
+    {
+        uint32_t axis;
+        float split;            // Points below it on 'axis' belong to the first child.
+        uint32_t children[2];   // Node indices, or leaf ranks when 'leaf' is set for that side.
+        bool leaf[2];
+    };
+
+    // Split samples [begin, end) among ranks [rankBegin, rankEnd), which must hold at least two ranks.
+    uint32_t Bisect(std::vector<Sample>& samples, size_t begin, size_t end, uint32_t rankBegin, uint32_t rankEnd);
+
+    std::vector<Node> m_nodes;
+    uint32_t m_ranks;
+};
@@ -0,0 +1,440 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#include "stdafx.h"
+#include "DomainSolver.h"
+#include "RingSolver.h"
+#include "Profiler.h"
+#include <cfloat>
+#include <chrono>
+#include <cstring>
+
+// Concurrency
+#include <ppl.h>
+
+namespace
+{
+    template <typename T>
+    void AppendBytes(std::vector<uint8_t>* pBuffer, const T* pData, size_t count)
+    {
+        const uint8_t* pBytes = reinterpret_cast<const uint8_t*>(pData);
+        pBuffer->insert(pBuffer->end(), pBytes, pBytes + count * sizeof(T));
+    }
+
+    struct Migrant
+    {
+        ispc::Particle particle;
+        float cost;
+    };
+}
+
+DomainSolver::DomainSolver() :
+    m_openingAngle(0.5f),
+    m_rebalanceThreshold(1.2f),
+    m_summary(),
+    m_statistics()
+{
+}
+
+bool DomainSolver::Initialize(const ispc::Particle* pParticles, uint32_t particleCount, RingTransport* pTransport)
+{
+    uint32_t start, end;
+    RingSolver::GetSlice(particleCount, pTransport->GetRank(), pTransport->GetRanks(), &start, &end);
+
+    m_particles.assign(pParticles + start, pParticles + end);
+    m_costs.assign(m_particles.size(), 1.0f);
+
+    return Rebalance(pTransport) && Migrate(pTransport);
+}
+
+bool DomainSolver::IsOpenedFrom(const Summary& bounds, const ispc::DomainCell& cell) const
+{
+    if (bounds.particleCount == 0)
+        return false;
+
+    // The nearest point of the bounds to the centre of mass.
+    const float center[3] = { cell.centerOfMass.x, cell.centerOfMass.y, cell.centerOfMass.z };
+    float distSqr = 0.0f;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float distance = 0.0f;
+        if (center[axis] < bounds.lower[axis])
+            distance = bounds.lower[axis] - center[axis];
+        else if (center[axis] > bounds.upper[axis])
+            distance = center[axis] - bounds.upper[axis];
+        distSqr += distance * distance;
+    }
+
+    return distSqr * m_openingAngle * m_openingAngle < cell.size * cell.size;
+}
+
+//
+// Bin the particles into the cells with a counting sort, then sum each cell's centre of mass and bounds.
+//
+void DomainSolver::BuildCells()
+{
+    PROFILE_SCOPE("Domain cells");
+
+    const uint32_t localCount = GetLocalCount();
+    const uint32_t cellTotal = CellGrid * CellGrid * CellGrid;
+
+    Summary& summary = m_summary;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        summary.lower[axis] = FLT_MAX;
+        summary.upper[axis] = -FLT_MAX;
+    }
+    for (const ispc::Particle& particle : m_particles)
+    {
+        const float position[3] = { particle.position.x, particle.position.y, particle.position.z };
+        for (int axis = 0; axis < 3; axis++)
+        {
+            summary.lower[axis] = (position[axis] < summary.lower[axis]) ? position[axis] : summary.lower[axis];
+            summary.upper[axis] = (position[axis] > summary.upper[axis]) ? position[axis] : summary.upper[axis];
+        }
+    }
+
+    float scale[3] = {};
+    for (int axis = 0; axis < 3; axis++)
+    {
+        const float extent = summary.upper[axis] - summary.lower[axis];
+        scale[axis] = (extent > 0.0f) ? CellGrid / extent : 0.0f;
+    }
+
+    std::vector<uint32_t> cellOfParticle(localCount);
+    std::vector<uint32_t> cellStarts(cellTotal + 1, 0);
+    for (uint32_t ii = 0; ii < localCount; ii++)
+    {
+        const float position[3] = { m_particles[ii].position.x, m_particles[ii].position.y, m_particles[ii].position.z };
+        uint32_t cell = 0;
+        for (int axis = 2; axis >= 0; axis--)
+        {
+            uint32_t coordinate = static_cast<uint32_t>((position[axis] - summary.lower[axis]) * scale[axis]);
+            coordinate = (coordinate < CellGrid) ? coordinate : CellGrid - 1;
+            cell = cell * CellGrid + coordinate;
+        }
+        cellOfParticle[ii] = cell;
+        cellStarts[cell + 1]++;
+    }
+    for (uint32_t cell = 0; cell < cellTotal; cell++)
+        cellStarts[cell + 1] += cellStarts[cell];
+
+    m_cellParticles.resize(localCount);
+    std::vector<uint32_t> cursors(cellStarts.begin(), cellStarts.end() - 1);
+    for (uint32_t ii = 0; ii < localCount; ii++)
+        m_cellParticles[cursors[cellOfParticle[ii]]++] = ii;
+
+    m_cells.clear();
+    for (uint32_t cell = 0; cell < cellTotal; cell++)
+    {
+        const uint32_t start = cellStarts[cell];
+        const uint32_t count = cellStarts[cell + 1] - start;
+        if (count == 0)
+            continue;
+
+        double sum[3] = {};
+        float lower[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+        float upper[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        for (uint32_t ii = start; ii < start + count; ii++)
+        {
+            const ispc::Vec4& position = m_particles[m_cellParticles[ii]].position;
+            const float components[3] = { position.x, position.y, position.z };
+            for (int axis = 0; axis < 3; axis++)
+            {
+                sum[axis] += components[axis];
+                lower[axis] = (components[axis] < lower[axis]) ? components[axis] : lower[axis];
+                upper[axis] = (components[axis] > upper[axis]) ? components[axis] : upper[axis];
+            }
+        }
+
+        ispc::DomainCell domainCell = {};
+        domainCell.centerOfMass.x = static_cast<float>(sum[0] / count);
+        domainCell.centerOfMass.y = static_cast<float>(sum[1] / count);
+        domainCell.centerOfMass.z = static_cast<float>(sum[2] / count);
+        domainCell.centerOfMass.w = static_cast<float>(count);
+        for (int axis = 0; axis < 3; axis++)
+            domainCell.size = (upper[axis] - lower[axis] > domainCell.size) ? upper[axis] - lower[axis] : domainCell.size;
+        domainCell.sourceStart = start;
+        domainCell.particleCount = count;
+        m_cells.push_back(domainCell);
+    }
+
+    summary.particleCount = localCount;
+    summary.cellCount = static_cast<uint32_t>(m_cells.size());
+}
+
+//
+// Rebuild the decomposition from every rank's samples: one particle in 'stride', weighted with the costs
+// of the stride it stands for, so the samples of all the ranks together carry the whole cost.
+//
+bool DomainSolver::Rebalance(RingTransport* pTransport)
+{
+    PROFILE_SCOPE("Domain rebalance");
+
+    const uint32_t localCount = GetLocalCount();
+    const uint32_t stride = (localCount + SamplesPerRank - 1) / SamplesPerRank;
+
+    std::vector<DomainDecomposition::Sample> samples;
+    for (uint32_t start = 0; start < localCount; start += stride)
+    {
+        DomainDecomposition::Sample sample;
+        sample.position[0] = m_particles[start].position.x;
+        sample.position[1] = m_particles[start].position.y;
+        sample.position[2] = m_particles[start].position.z;
+        sample.weight = 0.0f;
+        for (uint32_t ii = start; ii < start + stride && ii < localCount; ii++)
+            sample.weight += m_costs[ii];
+        samples.push_back(sample);
+    }
+
+    std::vector<uint8_t> own;
+    AppendBytes(&own, samples.data(), samples.size());
+
+    std::vector<std::vector<uint8_t>> all;
+    auto begin = std::chrono::high_resolution_clock::now();
+    const bool ok = pTransport->AllGather(own, &all);
+    m_statistics.communicationSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count();
+    if (!ok)
+        return false;
+
+    samples.clear();
+    for (const std::vector<uint8_t>& rankSamples : all)
+    {
+        const size_t offset = samples.size();
+        samples.resize(offset + rankSamples.size() / sizeof(DomainDecomposition::Sample));
+        if (!rankSamples.empty())
+            memcpy(&samples[offset], rankSamples.data(), rankSamples.size());
+    }
+
+    m_decomposition.Build(samples, pTransport->GetRanks());
+    return true;
+}
+
+bool DomainSolver::Migrate(RingTransport* pTransport)
+{
+    PROFILE_SCOPE("Domain migrate");
+
+    const uint32_t rank = pTransport->GetRank();
+    std::vector<std::vector<uint8_t>> outgoing(pTransport->GetRanks());
+
+    size_t kept = 0;
+    for (size_t ii = 0; ii < m_particles.size(); ii++)
+    {
+        const ispc::Vec4& position = m_particles[ii].position;
+        const uint32_t owner = m_decomposition.GetOwner(position.x, position.y, position.z);
+        if (owner == rank)
+        {
+            m_particles[kept] = m_particles[ii];
+            m_costs[kept] = m_costs[ii];
+            kept++;
+        }
+        else
+        {
+            const Migrant migrant = { m_particles[ii], m_costs[ii] };
+            AppendBytes(&outgoing[owner], &migrant, 1);
+        }
+    }
+    m_statistics.migratedParticles += m_particles.size() - kept;
+    m_particles.resize(kept);
+    m_costs.resize(kept);
+
+    std::vector<std::vector<uint8_t>> incoming;
+    auto begin = std::chrono::high_resolution_clock::now();
+    const bool ok = pTransport->AllToAll(outgoing, &incoming);
+    m_statistics.communicationSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count();
+    if (!ok)
+        return false;
+
+    for (const std::vector<uint8_t>& migrants : incoming)
+    {
+        for (size_t offset = 0; offset + sizeof(Migrant) <= migrants.size(); offset += sizeof(Migrant))
+        {
+            Migrant migrant;
+            memcpy(&migrant, &migrants[offset], sizeof(migrant));
+            m_particles.push_back(migrant.particle);
+            m_costs.push_back(migrant.cost);
+        }
+    }
+    return true;
+}
+
+bool DomainSolver::Step(RingTransport* pTransport, int threads)
+{
+    PROFILE_SCOPE("Domain step");
+
+    const uint32_t rank = pTransport->GetRank();
+    const uint32_t ranks = pTransport->GetRanks();
+
+    BuildCells();
+
+    // Every rank's bounds and cells.
+    std::vector<uint8_t> own;
+    AppendBytes(&own, &m_summary, 1);
+    AppendBytes(&own, m_cells.data(), m_cells.size());
+
+    std::vector<std::vector<uint8_t>> all;
+    auto communicationBegin = std::chrono::high_resolution_clock::now();
+    if (!pTransport->AllGather(own, &all))
+        return false;
+    m_statistics.communicationSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - communicationBegin).count();
+
+    std::vector<Summary> summaries(ranks);
+    std::vector<std::vector<ispc::DomainCell>> cells(ranks);
+    for (uint32_t other = 0; other < ranks; other++)
+    {
+        if (all[other].size() < sizeof(Summary))
+            return false;
+        memcpy(&summaries[other], all[other].data(), sizeof(Summary));
+        if (all[other].size() != sizeof(Summary) + summaries[other].cellCount * sizeof(ispc::DomainCell))
+            return false;
+        cells[other].resize(summaries[other].cellCount);
+        if (!cells[other].empty())
+            memcpy(&cells[other][0], all[other].data() + sizeof(Summary), cells[other].size() * sizeof(ispc::DomainCell));
+    }
+
+    // The positions of this rank's cells that the others will open, in cell order.
+    std::vector<std::vector<uint8_t>> outgoing(ranks);
+    for (uint32_t other = 0; other < ranks; other++)
+    {
+        if (other == rank)
+            continue;
+
+        for (const ispc::DomainCell& cell : m_cells)
+        {
+            if (!IsOpenedFrom(summaries[other], cell))
+                continue;
+
+            for (uint32_t ii = cell.sourceStart; ii < cell.sourceStart + cell.particleCount; ii++)
+                AppendBytes(&outgoing[other], &m_particles[m_cellParticles[ii]].position, 1);
+        }
+    }
+
+    std::vector<std::vector<uint8_t>> incoming;
+    communicationBegin = std::chrono::high_resolution_clock::now();
+    if (!pTransport->AllToAll(outgoing, &incoming))
+        return false;
+    m_statistics.communicationSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - communicationBegin).count();
+
+    // Make the same choice the owners made to find the imported cells among the rest.
+    m_remoteCells.clear();
+    m_sources.clear();
+    for (uint32_t other = 0; other < ranks; other++)
+    {
+        if (other == rank)
+            continue;
+
+        size_t offset = 0;
+        for (ispc::DomainCell cell : cells[other])
+        {
+            cell.sourceStart = 0;
+            cell.sourceCount = 0;
+            if (IsOpenedFrom(m_summary, cell))
+            {
+                const size_t bytes = cell.particleCount * sizeof(ispc::Vec4);
+                if (offset + bytes > incoming[other].size())
+                    return false;
+
+                cell.sourceStart = static_cast<uint32_t>(m_sources.size());
+                cell.sourceCount = cell.particleCount;
+                m_sources.resize(m_sources.size() + cell.particleCount);
+                memcpy(&m_sources[cell.sourceStart], incoming[other].data() + offset, bytes);
+                offset += bytes;
+            }
+            m_remoteCells.push_back(cell);
+        }
+        if (offset != incoming[other].size())
+            return false;
+    }
+
+    const uint32_t localCount = GetLocalCount();
+    m_accelerations.resize(localCount);
+    m_costs.resize(localCount);
+
+    auto computeBegin = std::chrono::high_resolution_clock::now();
+    {
+        PROFILE_SCOPE("Domain accumulate");
+
+        const float openingAngleSquared = m_openingAngle * m_openingAngle;
+        const ispc::DomainCell* pCells = m_remoteCells.empty() ? nullptr : &m_remoteCells[0];
+        const ispc::Vec4* pSources = m_sources.empty() ? nullptr : &m_sources[0];
+        concurrency::parallel_for<int>(0, threads, [&](int thread)
+        {
+            uint32_t start, end;
+            RingSolver::GetSlice(localCount, thread, threads, &start, &end);
+            if (start < end)
+            {
+                ispc::DomainAccumulate(&m_particles[0], start, end, localCount, pCells, static_cast<uint32_t>(m_remoteCells.size()), pSources,
+                                       openingAngleSquared, &m_accelerations[start], &m_costs[start]);
+            }
+        });
+    }
+
+    // Only once every thread is done reading the positions.
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        uint32_t start, end;
+        RingSolver::GetSlice(localCount, thread, threads, &start, &end);
+        if (start < end)
+            ispc::RingIntegrate(&m_particles[0], start, end, &m_accelerations[start]);
+    });
+    m_statistics.computeSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - computeBegin).count();
+
+    // The imbalance is the busiest rank's cost over the mean.
+    double localCost = 0.0;
+    for (float cost : m_costs)
+        localCost += cost;
+
+    std::vector<uint8_t> ownCost;
+    AppendBytes(&ownCost, &localCost, 1);
+    std::vector<std::vector<uint8_t>> costs;
+    communicationBegin = std::chrono::high_resolution_clock::now();
+    if (!pTransport->AllGather(ownCost, &costs))
+        return false;
+    m_statistics.communicationSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - communicationBegin).count();
+
+    double maxCost = 0.0;
+    double totalCost = 0.0;
+    for (const std::vector<uint8_t>& rankCost : costs)
+    {
+        double cost = 0.0;
+        if (rankCost.size() == sizeof(cost))
+            memcpy(&cost, rankCost.data(), sizeof(cost));
+        maxCost = (cost > maxCost) ? cost : maxCost;
+        totalCost += cost;
+    }
+    const double imbalance = (totalCost > 0.0) ? maxCost * ranks / totalCost : 1.0;
+    m_statistics.imbalanceSum += imbalance;
+    m_statistics.steps++;
+
+    if (m_rebalanceThreshold > 0.0f && imbalance > m_rebalanceThreshold)
+    {
+        if (!Rebalance(pTransport))
+            return false;
+        m_statistics.rebalances++;
+    }
+
+    return Migrate(pTransport);
+}
@@ -0,0 +1,125 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#pragma once
+
+#include "DomainDecomposition.h"
+#include "RingTransport.h"
+
+// Add the auto generated ISPC kernel header
+#include "nBodyGravityDomain_ispc.h"
+
+//
+// One rank of the spatially decomposed tree solver.
+//
+// Where the RingSolver hands every rank a slice of the particle indices and passes all the positions
+// round, this one gives every rank a region of space (DomainDecomposition) and only sends what the
+// others need. Each step:
+//   1. The rank bins its particles into a CellGrid^3 grid over their bounds and every rank gathers the
+//      bounds and cell monopoles of every other (RingTransport::AllGather).
+//   2. A cell some particle of another rank would open, judging by the distance from that rank's bounds,
+//      sends its positions there (RingTransport::AllToAll). Both sides make the same test.
+//   3. The kernel sums the local particles directly and the remote cells as monopoles or, when opened,
+//      particle by particle, counting each particle's interactions (nBodyGravityDomain.ispc).
+//   4. The particles advance, and those that left the domain migrate to the rank that owns it now.
+//
+// The ranks also gather their summed interaction counts. When the busiest rank does more than the
+// rebalance threshold times the average, the ranks rebuild the decomposition weighted by those costs
+// before migrating, so a collapsing cluster is shared out again rather than left to a single rank.
+//
+class DomainSolver
+{
+public:
+    // Largest piece a transfer moves at once, for RingTransport::Create().
+    static const size_t MailboxSize = 1 << 20;
+
+    struct Statistics
+    {
+        double computeSeconds;          // In the kernels.
+        double communicationSeconds;    // In the collectives, waiting for the other ranks included.
+        double imbalanceSum;            // Of the busiest rank's cost over the mean, every step.
+        uint32_t steps;
+        uint32_t rebalances;
+        uint64_t migratedParticles;     // Sent to other ranks, from this one.
+    };
+
+    DomainSolver();
+
+    // A cell opens for a particle closer than its size over the opening angle.
+    void SetOpeningAngle(float openingAngle)        { m_openingAngle = openingAngle; }
+    float GetOpeningAngle() const                   { return m_openingAngle; }
+
+    // Rebuild the domains when the imbalance exceeds this; 0 keeps the first ones throughout.
+    void SetRebalanceThreshold(float threshold)     { m_rebalanceThreshold = threshold; }
+    float GetRebalanceThreshold() const             { return m_rebalanceThreshold; }
+
+    // Take this rank's slice of the whole initial state and move it into the first domains, which
+    // balance the particle counts.
+    bool Initialize(const ispc::Particle* pParticles, uint32_t particleCount, RingTransport* pTransport);
+
+    bool Step(RingTransport* pTransport, int threads);
+
+    const Statistics& GetStatistics() const         { return m_statistics; }
+    const ispc::Particle* GetParticles() const      { return m_particles.empty() ? nullptr : &m_particles[0]; }
+    uint32_t GetLocalCount() const                  { return static_cast<uint32_t>(m_particles.size()); }
+
+private:
+    static const uint32_t CellGrid = 4;
+    static const uint32_t SamplesPerRank = 2048;
+
+    // What a rank tells the others each step, followed by its cells.
+    struct Summary
+    {
+        float lower[3];
+        float upper[3];
+        uint32_t particleCount;
+        uint32_t cellCount;
+    };
+
+    // Whether any particle inside the bounds could open the cell.
+    bool IsOpenedFrom(const Summary& bounds, const ispc::DomainCell& cell) const;
+
+    void BuildCells();
+    bool Rebalance(RingTransport* pTransport);
+    bool Migrate(RingTransport* pTransport);
+
+    float m_openingAngle;
+    float m_rebalanceThreshold;
+    DomainDecomposition m_decomposition;
+
+    std::vector<ispc::Particle> m_particles;
+    std::vector<float> m_costs;                 // Interactions of each particle in the last step.
+    std::vector<ispc::Vec3> m_accelerations;
+
+    Summary m_summary;
+    std::vector<ispc::DomainCell> m_cells;      // This rank's non empty cells.
+    std::vector<uint32_t> m_cellParticles;      // Particle indices, cell by cell.
+
+    std::vector<ispc::DomainCell> m_remoteCells;
+    std::vector<ispc::Vec4> m_sources;          // Positions of the opened remote cells.
+
+    Statistics m_statistics;
+};
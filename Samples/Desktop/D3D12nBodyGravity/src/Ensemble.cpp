@@ -0,0 +1,153 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#include "stdafx.h"
+#include "Ensemble.h"
+#include "Profiler.h"
+#include <algorithm>
+
+// Concurrency
+#include <ppl.h>
+
+Ensemble::Ensemble() :
+    m_readIndex(0)
+{
+}
+
+void Ensemble::Clear()
+{
+    m_readIndex = 0;
+    m_systems.clear();
+    m_particles[0].clear();
+    m_particles[1].clear();
+}
+
+uint32_t Ensemble::AddSystem(uint32_t particleCount, float timeStep, float softening, float gravitationalMass)
+{
+    ispc::EnsembleSystem system;
+    system.firstParticle = GetParticleCount();
+    system.particleCount = particleCount;
+    system.timeStep = timeStep;
+    system.softeningSquared = softening * softening;
+    system.gravitationalMass = gravitationalMass;
+    m_systems.push_back(system);
+
+    const ispc::Particle zero = {};
+    m_particles[0].resize(m_particles[0].size() + particleCount, zero);
+    m_particles[1].resize(m_particles[1].size() + particleCount, zero);
+
+    return static_cast<uint32_t>(m_systems.size() - 1);
+}
+
+ispc::Particle* Ensemble::GetParticles(uint32_t system)
+{
+    return m_particles[m_readIndex].data() + m_systems[system].firstParticle;
+}
+
+const ispc::Particle* Ensemble::GetParticles(uint32_t system) const
+{
+    return m_particles[m_readIndex].data() + m_systems[system].firstParticle;
+}
+
+double Ensemble::GetInteractionsPerStep() const
+{
+    double interactions = 0.0;
+    for (const ispc::EnsembleSystem& system : m_systems)
+        interactions += static_cast<double>(system.particleCount) * static_cast<double>(system.particleCount);
+
+    return interactions;
+}
+
+//
+// Split 'systems' into 'threads' consecutive ranges of about equal cost. Range t is
+// [(*pBounds)[t], (*pBounds)[t + 1]).
+//
+void Ensemble::Partition(const std::vector<uint32_t>& systems, int threads, std::vector<size_t>* pBounds) const
+{
+    std::vector<double> prefixCost(systems.size() + 1, 0.0);
+    for (size_t ii = 0; ii < systems.size(); ii++)
+    {
+        const double count = static_cast<double>(m_systems[systems[ii]].particleCount);
+        prefixCost[ii + 1] = prefixCost[ii] + count * count;
+    }
+
+    pBounds->resize(threads + 1);
+    for (int thread = 0; thread <= threads; thread++)
+    {
+        const double target = prefixCost.back() * thread / threads;
+        (*pBounds)[thread] = std::lower_bound(prefixCost.begin(), prefixCost.end(), target) - prefixCost.begin();
+    }
+    pBounds->back() = systems.size();
+}
+
+void Ensemble::Step(uint32_t steps, Mode mode, int threads)
+{
+    if (steps == 0 || m_systems.empty())
+        return;
+
+    //
+    // Sort the systems into the two kernels. The lanes list is in increasing particle count so that a
+    // gang's systems are about the same size, the threads list in decreasing count so that the biggest
+    // systems start first.
+    //
+    std::vector<uint32_t> laneSystems;
+    std::vector<uint32_t> threadSystems;
+    for (uint32_t system = 0; system < m_systems.size(); system++)
+    {
+        const bool lanes = (mode == e_LanesPerSystem) || (mode == e_Auto && m_systems[system].particleCount <= LanesMaxParticles);
+        (lanes ? laneSystems : threadSystems).push_back(system);
+    }
+
+    auto particleCount = [&](uint32_t system) { return m_systems[system].particleCount; };
+    std::stable_sort(laneSystems.begin(), laneSystems.end(), [&](uint32_t a, uint32_t b) { return particleCount(a) < particleCount(b); });
+    std::stable_sort(threadSystems.begin(), threadSystems.end(), [&](uint32_t a, uint32_t b) { return particleCount(a) > particleCount(b); });
+
+    std::vector<size_t> laneBounds;
+    std::vector<size_t> threadBounds;
+    Partition(laneSystems, threads, &laneBounds);
+    Partition(threadSystems, threads, &threadBounds);
+
+    ispc::Particle* pRead = m_particles[m_readIndex].data();
+    ispc::Particle* pWrite = m_particles[1 - m_readIndex].data();
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        PROFILE_SCOPE("Ensemble worker");
+
+        if (laneBounds[thread] < laneBounds[thread + 1])
+        {
+            ispc::EnsembleStepLanes(m_systems.data(), laneSystems.data(), static_cast<uint32_t>(laneBounds[thread]), static_cast<uint32_t>(laneBounds[thread + 1]),
+                pRead, pWrite, steps);
+        }
+
+        for (size_t ii = threadBounds[thread]; ii < threadBounds[thread + 1]; ii++)
+        {
+            ispc::EnsembleStepSystem(m_systems[threadSystems[ii]], pRead, pWrite, steps);
+        }
+    });
+
+    m_readIndex ^= steps & 1;
+}
@@ -0,0 +1,91 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#pragma once
+
+// Add the auto generated ISPC kernel header
+#include "nBodyGravityEnsemble_ispc.h"
+
+//
+// A batch of small, independent n-body systems, each with its own particle count, time step, softening
+// and particle mass, stepped together by direct summation.
+//
+// Launching the direct sum once per system leaves most of the SIMD lanes and threads idle when systems
+// have tens or hundreds of particles. Here all the systems share one double buffered arena and a single
+// Step() spreads them over the threads:
+//
+//  - e_LanesPerSystem runs one system per program instance (nBodyGravityEnsemble.ispc), a gang steps
+//    as many systems as it has lanes. Systems are sorted by particle count first.
+//  - e_ThreadsPerSystem runs each system with the gang over its particles, one system at a time per
+//    thread.
+//  - e_Auto takes the first for systems of up to LanesMaxParticles particles and the second for the rest.
+//
+// Each thread gets a share of the systems of about equal total cost, the sum of the squared particle
+// counts. All the steps of a Step() call run without synchronising, systems being independent.
+//
+class Ensemble
+{
+public:
+    enum Mode
+    {
+        e_Auto = 0,
+        e_LanesPerSystem,
+        e_ThreadsPerSystem,
+
+        e_MAX_Mode
+    };
+
+    static const uint32_t LanesMaxParticles = 128;
+
+    Ensemble();
+
+    void Clear();
+
+    // Add a system of zeroed particles and return its index. This moves the arena, so particle pointers
+    // from GetParticles() are only valid until the next AddSystem().
+    uint32_t AddSystem(uint32_t particleCount, float timeStep, float softening, float gravitationalMass);
+
+    // The current state of a system, to fill in before the first Step() or read back after one.
+    ispc::Particle* GetParticles(uint32_t system);
+    const ispc::Particle* GetParticles(uint32_t system) const;
+
+    void Step(uint32_t steps, Mode mode, int threads);
+
+    uint32_t GetSystemCount() const     { return static_cast<uint32_t>(m_systems.size()); }
+    uint32_t GetParticleCount() const   { return static_cast<uint32_t>(m_particles[0].size()); }
+    const ispc::EnsembleSystem& GetSystem(uint32_t system) const { return m_systems[system]; }
+
+    // Pair interactions in one step of every system.
+    double GetInteractionsPerStep() const;
+
+private:
+    void Partition(const std::vector<uint32_t>& systems, int threads, std::vector<size_t>* pBounds) const;
+
+    uint32_t m_readIndex;
+
+    std::vector<ispc::EnsembleSystem> m_systems;
+    std::vector<ispc::Particle> m_particles[2];
+};
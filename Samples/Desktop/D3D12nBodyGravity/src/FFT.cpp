@@ -0,0 +1,253 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#include "stdafx.h"
+#include "FFT.h"
+#include <assert.h>
+
+// Concurrency
+#include <ppl.h>
+
+static const float TwoPi = 6.283185307179586f;
+
+RealFFT3D::RealFFT3D() :
+    m_n(0)
+{
+}
+
+void RealFFT3D::Initialize(uint32_t n)
+{
+    // The grid must be a power of two, and at least 4 so the packed half length transform is valid.
+    assert(n >= 4 && (n & (n - 1)) == 0);
+
+    m_n = n;
+    m_half.Initialize(n / 2);
+    m_full.Initialize(n);
+
+    m_realTwiddles.resize(n / 2 + 1);
+    for (uint32_t k = 0; k <= n / 2; k++)
+    {
+        float angle = -TwoPi * static_cast<float>(k) / static_cast<float>(n);
+        m_realTwiddles[k] = Complex(cosf(angle), sinf(angle));
+    }
+}
+
+void RealFFT3D::Plan::Initialize(uint32_t n)
+{
+    length = n;
+
+    uint32_t bits = 0;
+    while ((1u << bits) < n)
+        bits++;
+
+    bitReverse.resize(n);
+    for (uint32_t ii = 0; ii < n; ii++)
+    {
+        uint32_t r = 0;
+        for (uint32_t b = 0; b < bits; b++)
+        {
+            r |= ((ii >> b) & 1) << (bits - 1 - b);
+        }
+        bitReverse[ii] = r;
+    }
+
+    twiddles.resize(n / 2);
+    for (uint32_t k = 0; k < n / 2; k++)
+    {
+        float angle = -TwoPi * static_cast<float>(k) / static_cast<float>(n);
+        twiddles[k] = Complex(cosf(angle), sinf(angle));
+    }
+}
+
+//
+// Iterative in-place radix-2 Cooley-Tukey transform. The inverse is unnormalised.
+//
+void RealFFT3D::Plan::Transform(Complex* pData, bool inverse) const
+{
+    for (uint32_t ii = 0; ii < length; ii++)
+    {
+        uint32_t jj = bitReverse[ii];
+        if (ii < jj)
+            std::swap(pData[ii], pData[jj]);
+    }
+
+    for (uint32_t size = 2; size <= length; size <<= 1)
+    {
+        uint32_t halfSize = size >> 1;
+        uint32_t twiddleStep = length / size;
+
+        for (uint32_t start = 0; start < length; start += size)
+        {
+            for (uint32_t k = 0; k < halfSize; k++)
+            {
+                Complex w = twiddles[k * twiddleStep];
+                if (inverse)
+                    w = std::conj(w);
+
+                Complex a = pData[start + k];
+                Complex b = pData[start + k + halfSize] * w;
+                pData[start + k] = a + b;
+                pData[start + k + halfSize] = a - b;
+            }
+        }
+    }
+}
+
+//
+// Transform every line of 'm_n' complex values that runs along the given stride.
+// Lines are gathered into a contiguous scratch buffer so the butterflies run on unit stride data.
+//
+void RealFFT3D::TransformColumns(Complex* pSpectrum, size_t stride, size_t lineStride, uint32_t lines, size_t planeStride, bool inverse, int threads) const
+{
+    const uint32_t n = m_n;
+    const uint32_t planes = n;
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        std::vector<Complex> line(n);
+
+        uint32_t planeStart = (planes * thread) / threads;
+        uint32_t planeEnd = (planes * (thread + 1)) / threads;
+
+        for (uint32_t plane = planeStart; plane < planeEnd; plane++)
+        {
+            for (uint32_t l = 0; l < lines; l++)
+            {
+                Complex* pLine = pSpectrum + plane * planeStride + l * lineStride;
+
+                for (uint32_t ii = 0; ii < n; ii++)
+                    line[ii] = pLine[ii * stride];
+
+                m_full.Transform(&line[0], inverse);
+
+                for (uint32_t ii = 0; ii < n; ii++)
+                    pLine[ii * stride] = line[ii];
+            }
+        }
+    });
+}
+
+//
+// Real to complex transform.
+//
+// Along x each row of n reals is treated as n/2 complex values, transformed with the half length plan
+// and then split into the n/2 + 1 non-redundant bins of the real transform. The y and z passes are plain
+// complex transforms over the half spectrum.
+//
+void RealFFT3D::Forward(const float* pReal, Complex* pSpectrum, int threads) const
+{
+    const uint32_t n = m_n;
+    const uint32_t h = n / 2;
+    const uint32_t rowLength = h + 1;
+    const uint32_t rows = n * n;
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        std::vector<Complex> packed(h);
+
+        uint32_t rowStart = (rows * thread) / threads;
+        uint32_t rowEnd = (rows * (thread + 1)) / threads;
+
+        for (uint32_t row = rowStart; row < rowEnd; row++)
+        {
+            const float* pIn = pReal + static_cast<size_t>(row) * n;
+            Complex* pOut = pSpectrum + static_cast<size_t>(row) * rowLength;
+
+            for (uint32_t m = 0; m < h; m++)
+                packed[m] = Complex(pIn[2 * m], pIn[2 * m + 1]);
+
+            m_half.Transform(&packed[0], false);
+
+            for (uint32_t k = 0; k <= h; k++)
+            {
+                Complex zk = packed[k % h];
+                Complex zc = std::conj(packed[(h - k) % h]);
+
+                Complex even = (zk + zc) * 0.5f;
+                Complex odd = (zk - zc) * Complex(0.0f, -0.5f);
+
+                pOut[k] = even + m_realTwiddles[k] * odd;
+            }
+        }
+    });
+
+    // y lines: stride rowLength, one line per kx, n planes (z) of rowLength * n.
+    TransformColumns(pSpectrum, rowLength, 1, rowLength, static_cast<size_t>(rowLength) * n, false, threads);
+
+    // z lines: stride rowLength * n, one line per (ky, kx), treat each ky as a 'plane'.
+    TransformColumns(pSpectrum, static_cast<size_t>(rowLength) * n, 1, rowLength, rowLength, false, threads);
+}
+
+//
+// Complex to real transform, the exact reverse of Forward() including the 1/n^3 normalisation.
+// The spectrum is used as scratch space and is overwritten.
+//
+void RealFFT3D::Inverse(Complex* pSpectrum, float* pReal, int threads) const
+{
+    const uint32_t n = m_n;
+    const uint32_t h = n / 2;
+    const uint32_t rowLength = h + 1;
+    const uint32_t rows = n * n;
+    const float scale = 1.0f / (static_cast<float>(n) * static_cast<float>(n) * static_cast<float>(n));
+
+    TransformColumns(pSpectrum, static_cast<size_t>(rowLength) * n, 1, rowLength, rowLength, true, threads);
+    TransformColumns(pSpectrum, rowLength, 1, rowLength, static_cast<size_t>(rowLength) * n, true, threads);
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        std::vector<Complex> packed(h);
+
+        uint32_t rowStart = (rows * thread) / threads;
+        uint32_t rowEnd = (rows * (thread + 1)) / threads;
+
+        for (uint32_t row = rowStart; row < rowEnd; row++)
+        {
+            const Complex* pIn = pSpectrum + static_cast<size_t>(row) * rowLength;
+            float* pOut = pReal + static_cast<size_t>(row) * n;
+
+            // Rebuild the packed half length spectrum from the real spectrum.
+            for (uint32_t k = 0; k < h; k++)
+            {
+                Complex xk = pIn[k];
+                Complex xc = std::conj(pIn[h - k]);
+
+                Complex even = xk + xc;
+                Complex odd = (xk - xc) * std::conj(m_realTwiddles[k]);
+
+                packed[k] = even + Complex(0.0f, 1.0f) * odd;
+            }
+
+            m_half.Transform(&packed[0], true);
+
+            // The half length inverse contributes a factor of n/2, the packing a factor of 2.
+            for (uint32_t m = 0; m < h; m++)
+            {
+                pOut[2 * m] = packed[m].real() * scale;
+                pOut[2 * m + 1] = packed[m].imag() * scale;
+            }
+        }
+    });
+}
@@ -0,0 +1,77 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#pragma once
+
+#include <stdint.h>
+#include <complex>
+
+//
+// Self contained 3D real <-> complex FFT for cubic, power of two grids.
+//
+// The real grid is n*n*n floats, indexed (z * n + y) * n + x.
+// The complex grid holds the non-redundant half of the spectrum, (n/2 + 1) * n * n values,
+// indexed (kz * n + ky) * (n/2 + 1) + kx.
+//
+// The forward transform is unnormalised, the inverse transform divides by n^3 so that
+// Inverse(Forward(x)) == x.
+//
+class RealFFT3D
+{
+public:
+    typedef std::complex<float> Complex;
+
+    RealFFT3D();
+
+    void Initialize(uint32_t n);
+
+    uint32_t GetSize() const                { return m_n; }
+    uint32_t GetComplexRowLength() const    { return m_n / 2 + 1; }
+    size_t GetRealCount() const             { return static_cast<size_t>(m_n) * m_n * m_n; }
+    size_t GetComplexCount() const          { return static_cast<size_t>(GetComplexRowLength()) * m_n * m_n; }
+
+    void Forward(const float* pReal, Complex* pSpectrum, int threads) const;
+    void Inverse(Complex* pSpectrum, float* pReal, int threads) const;
+
+private:
+    // Precomputed tables for an in-place radix-2 transform of a fixed length.
+    struct Plan
+    {
+        uint32_t length;
+        std::vector<uint32_t> bitReverse;
+        std::vector<Complex> twiddles;
+
+        void Initialize(uint32_t n);
+        void Transform(Complex* pData, bool inverse) const;
+    };
+
+    void TransformColumns(Complex* pSpectrum, size_t stride, size_t lineStride, uint32_t lines, size_t planeStride, bool inverse, int threads) const;
+
+    uint32_t m_n;
+    Plan m_half;                        // Length n/2, used to transform two real values per complex element along x.
+    Plan m_full;                        // Length n, used along y and z.
+    std::vector<Complex> m_realTwiddles; // e^(-2 pi i k / n), k = 0 .. n/2, used to split the packed x transform.
+};
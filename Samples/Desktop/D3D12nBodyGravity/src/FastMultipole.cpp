@@ -0,0 +1,714 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#include "stdafx.h"
+#include "FastMultipole.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <float.h>
+
+// Concurrency
+#include <ppl.h>
+
+// G * m for a single particle and the softening, matching the direct sum kernels.
+static const double ParticleMassG = 66.73;
+static const double SofteningSquared = 0.0000015625;
+
+static const uint32_t NoParent = 0xffffffff;
+
+//
+// Spread the low 21 bits of v so that two zero bits separate each of them.
+//
+static uint64_t SpreadBits(uint64_t v)
+{
+    v &= 0x1fffff;
+    v = (v | (v << 32)) & 0x001f00000000ffffull;
+    v = (v | (v << 16)) & 0x001f0000ff0000ffull;
+    v = (v | (v << 8)) & 0x100f00f00f00f00full;
+    v = (v | (v << 4)) & 0x10c30c30c30c30c3ull;
+    v = (v | (v << 2)) & 0x1249249249249249ull;
+    return v;
+}
+
+uint64_t FastMultipole::GetMortonKey(uint64_t x, uint64_t y, uint64_t z)
+{
+    return SpreadBits(x) | (SpreadBits(y) << 1) | (SpreadBits(z) << 2);
+}
+
+FastMultipole::FastMultipole() :
+    m_order(4),
+    m_coefficientCount(0),
+    m_openingAngle(0.5f),
+    m_gradientCount(0)
+{
+    BuildTerms();
+    BuildOperators();
+}
+
+void FastMultipole::SetOrder(uint32_t order)
+{
+    if (order < 1)
+        order = 1;
+    if (order > MaxOrder)
+        order = MaxOrder;
+
+    if (order != m_order)
+    {
+        m_order = order;
+        BuildOperators();
+    }
+}
+
+//
+// Enumerate every multi-index up to MaxOrder, lowest degree first.
+//
+void FastMultipole::BuildTerms()
+{
+    m_terms.clear();
+    memset(m_termIndex, 0xff, sizeof(m_termIndex));
+
+    for (int degree = 0; degree <= static_cast<int>(MaxOrder); degree++)
+    {
+        for (int x = degree; x >= 0; x--)
+        {
+            for (int y = degree - x; y >= 0; y--)
+            {
+                int z = degree - x - y;
+
+                Term term;
+                term.power[0] = static_cast<uint8_t>(x);
+                term.power[1] = static_cast<uint8_t>(y);
+                term.power[2] = static_cast<uint8_t>(z);
+                term.degree = static_cast<uint8_t>(degree);
+
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    int p[3] = { x, y, z };
+
+                    p[axis] -= 1;
+                    term.lower[axis] = (p[axis] >= 0) ? static_cast<int16_t>(m_termIndex[p[0]][p[1]][p[2]]) : -1;
+
+                    p[axis] -= 1;
+                    term.lower2[axis] = (p[axis] >= 0) ? static_cast<int16_t>(m_termIndex[p[0]][p[1]][p[2]]) : -1;
+                }
+
+                m_termIndex[x][y][z] = static_cast<uint16_t>(m_terms.size());
+                m_terms.push_back(term);
+            }
+        }
+    }
+}
+
+//
+// Flatten the translation operators of the current order into lists of coefficient triples.
+//
+void FastMultipole::BuildOperators()
+{
+    const uint32_t p = m_order;
+    m_coefficientCount = (p + 1) * (p + 2) * (p + 3) / 6;
+    m_gradientCount = p * (p + 1) * (p + 2) / 6;
+
+    m_shiftTerms.clear();
+    m_localTerms.clear();
+    m_gradientTerms.clear();
+
+    for (uint32_t outer = 0; outer < m_coefficientCount; outer++)
+    {
+        const Term& a = m_terms[outer];
+
+        for (uint32_t inner = 0; inner < m_coefficientCount; inner++)
+        {
+            const Term& b = m_terms[inner];
+
+            if (b.power[0] <= a.power[0] && b.power[1] <= a.power[1] && b.power[2] <= a.power[2])
+            {
+                ShiftTerm shift;
+                shift.outer = static_cast<uint16_t>(outer);
+                shift.inner = static_cast<uint16_t>(inner);
+                shift.offset = m_termIndex[a.power[0] - b.power[0]][a.power[1] - b.power[1]][a.power[2] - b.power[2]];
+                m_shiftTerms.push_back(shift);
+            }
+
+            if (a.degree + b.degree <= p)
+            {
+                LocalTerm local;
+                local.local = static_cast<uint16_t>(outer);
+                local.multipole = static_cast<uint16_t>(inner);
+                local.derivative = m_termIndex[a.power[0] + b.power[0]][a.power[1] + b.power[1]][a.power[2] + b.power[2]];
+                m_localTerms.push_back(local);
+            }
+        }
+    }
+
+    for (uint32_t t = 0; t < m_gradientCount; t++)
+    {
+        const Term& term = m_terms[t];
+        m_gradientTerms.push_back(m_termIndex[term.power[0] + 1][term.power[1]][term.power[2]]);
+        m_gradientTerms.push_back(m_termIndex[term.power[0]][term.power[1] + 1][term.power[2]]);
+        m_gradientTerms.push_back(m_termIndex[term.power[0]][term.power[1]][term.power[2] + 1]);
+    }
+}
+
+//
+// pMonomials[alpha] = d^alpha / alpha!
+//
+void FastMultipole::ComputeMonomials(double x, double y, double z, uint32_t count, double* pMonomials) const
+{
+    const double d[3] = { x, y, z };
+
+    pMonomials[0] = 1.0;
+    for (uint32_t t = 1; t < count; t++)
+    {
+        const Term& term = m_terms[t];
+        int axis = (term.power[0] > 0) ? 0 : ((term.power[1] > 0) ? 1 : 2);
+        pMonomials[t] = pMonomials[term.lower[axis]] * d[axis] / term.power[axis];
+    }
+}
+
+//
+// pDerivatives[alpha] = d^alpha (1 / |r|) / dr^alpha, from the recurrence
+//   |r|^2 D_alpha = -(2n - 1) / n * sum_i alpha_i r_i D_(alpha - e_i) - (n - 1) / n * sum_i alpha_i (alpha_i - 1) D_(alpha - 2 e_i)
+// where n = |alpha|.
+//
+void FastMultipole::ComputeDerivatives(double x, double y, double z, uint32_t count, double* pDerivatives) const
+{
+    const double r[3] = { x, y, z };
+    const double invDistSqr = 1.0 / (x * x + y * y + z * z);
+
+    pDerivatives[0] = sqrt(invDistSqr);
+    for (uint32_t t = 1; t < count; t++)
+    {
+        const Term& term = m_terms[t];
+        const double n = term.degree;
+
+        double first = 0.0;
+        double second = 0.0;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (term.power[axis] > 0)
+                first += term.power[axis] * r[axis] * pDerivatives[term.lower[axis]];
+            if (term.power[axis] > 1)
+                second += term.power[axis] * (term.power[axis] - 1) * pDerivatives[term.lower2[axis]];
+        }
+
+        pDerivatives[t] = -((2.0 * n - 1.0) * first + (n - 1.0) * second) * invDistSqr / n;
+    }
+}
+
+void FastMultipole::Step(const ispc::Particle* pReadParticles, ispc::Particle* pWriteParticles, uint32_t particleCount, int threads)
+{
+    Solve(pReadParticles, particleCount, threads);
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        PROFILE_SCOPE("FMM integrate worker");
+
+        uint32_t start = static_cast<uint32_t>((static_cast<uint64_t>(particleCount) * thread) / threads);
+        uint32_t end = static_cast<uint32_t>((static_cast<uint64_t>(particleCount) * (thread + 1)) / threads);
+
+        ispc::FMMIntegrate(pReadParticles, pWriteParticles, start, end - start, &m_ranks[0], &m_sortedAccelerations[0]);
+    });
+}
+
+void FastMultipole::ComputeAccelerations(const ispc::Particle* pParticles, uint32_t particleCount, int threads, ispc::Vec3* pAccelerations)
+{
+    Solve(pParticles, particleCount, threads);
+
+    for (uint32_t ii = 0; ii < particleCount; ii++)
+    {
+        pAccelerations[ii] = m_sortedAccelerations[m_ranks[ii]];
+    }
+}
+
+void FastMultipole::Solve(const ispc::Particle* pParticles, uint32_t particleCount, int threads)
+{
+    {
+        PROFILE_SCOPE("FMM build tree");
+        BuildTree(pParticles, particleCount, threads);
+    }
+
+    m_sortedAccelerations.assign(particleCount, ispc::Vec3());
+    m_multipoles.resize(m_nodes.size() * m_coefficientCount);
+    m_locals.assign(m_nodes.size() * m_coefficientCount, 0.0);
+
+    {
+        PROFILE_SCOPE("FMM upward pass");
+        UpwardPass();
+    }
+    {
+        PROFILE_SCOPE("FMM interactions");
+        Interact(0, 0);
+    }
+    {
+        PROFILE_SCOPE("FMM downward pass");
+        DownwardPass();
+    }
+}
+
+//
+// Sort the particles by Morton key within their bounding cube and build the octree over the sorted order.
+//
+void FastMultipole::BuildTree(const ispc::Particle* pParticles, uint32_t particleCount, int threads)
+{
+    std::vector<float> bounds(static_cast<size_t>(threads) * 6);
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        uint32_t start = static_cast<uint32_t>((static_cast<uint64_t>(particleCount) * thread) / threads);
+        uint32_t end = static_cast<uint32_t>((static_cast<uint64_t>(particleCount) * (thread + 1)) / threads);
+
+        float* pBounds = &bounds[static_cast<size_t>(thread) * 6];
+        pBounds[0] = pBounds[1] = pBounds[2] = FLT_MAX;
+        pBounds[3] = pBounds[4] = pBounds[5] = -FLT_MAX;
+
+        for (uint32_t ii = start; ii < end; ii++)
+        {
+            const ispc::Vec4& pos = pParticles[ii].position;
+            pBounds[0] = std::min(pBounds[0], pos.x);
+            pBounds[1] = std::min(pBounds[1], pos.y);
+            pBounds[2] = std::min(pBounds[2], pos.z);
+            pBounds[3] = std::max(pBounds[3], pos.x);
+            pBounds[4] = std::max(pBounds[4], pos.y);
+            pBounds[5] = std::max(pBounds[5], pos.z);
+        }
+    });
+
+    float boxMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float boxSize = 0.0f;
+    for (int thread = 0; thread < threads; thread++)
+    {
+        for (int axis = 0; axis < 3; axis++)
+            boxMin[axis] = std::min(boxMin[axis], bounds[thread * 6 + axis]);
+    }
+    for (int thread = 0; thread < threads; thread++)
+    {
+        for (int axis = 0; axis < 3; axis++)
+            boxSize = std::max(boxSize, bounds[thread * 6 + 3 + axis] - boxMin[axis]);
+    }
+
+    const double cellsPerUnit = (boxSize > 0.0f) ? static_cast<double>(1 << MaxDepth) / boxSize : 0.0;
+    const double maxCell = static_cast<double>((1 << MaxDepth) - 1);
+
+    m_keys.resize(particleCount);
+    m_sortedIndices.resize(particleCount);
+    m_ranks.resize(particleCount);
+    m_sortedPositions.resize(particleCount);
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        uint32_t start = static_cast<uint32_t>((static_cast<uint64_t>(particleCount) * thread) / threads);
+        uint32_t end = static_cast<uint32_t>((static_cast<uint64_t>(particleCount) * (thread + 1)) / threads);
+
+        for (uint32_t ii = start; ii < end; ii++)
+        {
+            const ispc::Vec4& pos = pParticles[ii].position;
+            uint64_t x = static_cast<uint64_t>(std::min((pos.x - boxMin[0]) * cellsPerUnit, maxCell));
+            uint64_t y = static_cast<uint64_t>(std::min((pos.y - boxMin[1]) * cellsPerUnit, maxCell));
+            uint64_t z = static_cast<uint64_t>(std::min((pos.z - boxMin[2]) * cellsPerUnit, maxCell));
+
+            m_keys[ii] = std::make_pair(GetMortonKey(x, y, z), ii);
+        }
+    });
+
+    // Ties are broken by particle index, so the order is the same for any thread count.
+    concurrency::parallel_sort(m_keys.begin(), m_keys.end());
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        uint32_t start = static_cast<uint32_t>((static_cast<uint64_t>(particleCount) * thread) / threads);
+        uint32_t end = static_cast<uint32_t>((static_cast<uint64_t>(particleCount) * (thread + 1)) / threads);
+
+        for (uint32_t ii = start; ii < end; ii++)
+        {
+            m_sortedIndices[ii] = m_keys[ii].second;
+            m_ranks[m_keys[ii].second] = ii;
+        }
+
+        ispc::FMMGatherPositions(pParticles, &m_sortedIndices[0], start, end - start, &m_sortedPositions[0]);
+    });
+
+    //
+    // Split nodes breadth first. All keys within a node share their leading 3 * level bits, and the next
+    // three bits select the child, so children are found by partitioning the sorted range.
+    //
+    m_nodes.clear();
+    m_levelStart.clear();
+
+    Node root = {};
+    root.particleCount = particleCount;
+    root.parent = NoParent;
+    m_nodes.push_back(root);
+    m_levelStart.push_back(0);
+
+    for (uint32_t level = 0; ; level++)
+    {
+        uint32_t levelStart = m_levelStart.back();
+        uint32_t levelEnd = static_cast<uint32_t>(m_nodes.size());
+
+        for (uint32_t index = levelStart; index < levelEnd; index++)
+        {
+            if (m_nodes[index].particleCount <= LeafSize || level >= MaxDepth)
+                continue;
+
+            const uint32_t shift = 3 * (MaxDepth - 1 - level);
+            const uint32_t firstChild = static_cast<uint32_t>(m_nodes.size());
+
+            uint32_t begin = m_nodes[index].particleStart;
+            uint32_t end = begin + m_nodes[index].particleCount;
+            while (begin < end)
+            {
+                uint64_t octant = (m_keys[begin].first >> shift) & 7;
+                auto split = std::partition_point(m_keys.begin() + begin, m_keys.begin() + end,
+                    [&](const std::pair<uint64_t, uint32_t>& key) { return ((key.first >> shift) & 7) <= octant; });
+                uint32_t childEnd = static_cast<uint32_t>(split - m_keys.begin());
+
+                Node child = {};
+                child.particleStart = begin;
+                child.particleCount = childEnd - begin;
+                child.parent = index;
+                m_nodes.push_back(child);
+
+                begin = childEnd;
+            }
+
+            m_nodes[index].firstChild = firstChild;
+            m_nodes[index].childCount = static_cast<uint32_t>(m_nodes.size()) - firstChild;
+        }
+
+        if (m_nodes.size() == levelEnd)
+            break;
+
+        m_levelStart.push_back(levelEnd);
+    }
+
+    m_levelStart.push_back(static_cast<uint32_t>(m_nodes.size()));
+}
+
+//
+// Build the multipoles from the deepest level up. Nodes within a level are independent.
+//
+void FastMultipole::UpwardPass()
+{
+    for (size_t level = m_levelStart.size() - 1; level-- > 0; )
+    {
+        concurrency::parallel_for<uint32_t>(m_levelStart[level], m_levelStart[level + 1], [&](uint32_t index)
+        {
+            Node& node = m_nodes[index];
+
+            if (node.childCount == 0)
+            {
+                ParticleToMultipole(index);
+                return;
+            }
+
+            // Centre of mass and bounding radius from the children, all particles have the same mass.
+            double center[3] = { 0.0, 0.0, 0.0 };
+            for (uint32_t child = node.firstChild; child < node.firstChild + node.childCount; child++)
+            {
+                for (int axis = 0; axis < 3; axis++)
+                    center[axis] += m_nodes[child].center[axis] * m_nodes[child].particleCount;
+            }
+            for (int axis = 0; axis < 3; axis++)
+                node.center[axis] = center[axis] / node.particleCount;
+
+            node.radius = 0.0;
+            for (uint32_t child = node.firstChild; child < node.firstChild + node.childCount; child++)
+            {
+                double dx = m_nodes[child].center[0] - node.center[0];
+                double dy = m_nodes[child].center[1] - node.center[1];
+                double dz = m_nodes[child].center[2] - node.center[2];
+                node.radius = std::max(node.radius, sqrt(dx * dx + dy * dy + dz * dz) + m_nodes[child].radius);
+            }
+
+            std::fill_n(&m_multipoles[static_cast<size_t>(index) * m_coefficientCount], m_coefficientCount, 0.0);
+            for (uint32_t child = node.firstChild; child < node.firstChild + node.childCount; child++)
+            {
+                MultipoleToMultipole(child, index);
+            }
+        });
+    }
+}
+
+//
+// Dual tree traversal. Well separated pairs interact through their expansions, otherwise the larger node
+// is opened. Only the target node is ever written, so splitting the target creates independent tasks
+// while the children of the source are visited in turn.
+//
+void FastMultipole::Interact(uint32_t target, uint32_t source)
+{
+    const Node& a = m_nodes[target];
+    const Node& b = m_nodes[source];
+
+    double dx = a.center[0] - b.center[0];
+    double dy = a.center[1] - b.center[1];
+    double dz = a.center[2] - b.center[2];
+    double distSqr = dx * dx + dy * dy + dz * dz;
+    double radii = a.radius + b.radius;
+
+    if (radii * radii < m_openingAngle * m_openingAngle * distSqr)
+    {
+        MultipoleToLocal(source, target);
+        return;
+    }
+
+    if (a.childCount == 0 && b.childCount == 0)
+    {
+        ispc::FMMComputeP2P(&m_sortedPositions[0], a.particleStart, a.particleCount, b.particleStart, b.particleCount, &m_sortedAccelerations[0]);
+        return;
+    }
+
+    if (b.childCount == 0 || (a.childCount != 0 && a.radius >= b.radius))
+    {
+        if (a.particleCount > TaskParticleCount)
+        {
+            concurrency::parallel_for<uint32_t>(a.firstChild, a.firstChild + a.childCount, [&](uint32_t child)
+            {
+                Interact(child, source);
+            });
+        }
+        else
+        {
+            for (uint32_t child = a.firstChild; child < a.firstChild + a.childCount; child++)
+                Interact(child, source);
+        }
+    }
+    else
+    {
+        for (uint32_t child = b.firstChild; child < b.firstChild + b.childCount; child++)
+            Interact(target, child);
+    }
+}
+
+//
+// Push the locals down from the root and evaluate them at the leaves.
+//
+void FastMultipole::DownwardPass()
+{
+    for (size_t level = 0; level + 1 < m_levelStart.size(); level++)
+    {
+        concurrency::parallel_for<uint32_t>(m_levelStart[level], m_levelStart[level + 1], [&](uint32_t index)
+        {
+            const Node& node = m_nodes[index];
+
+            if (node.parent != NoParent)
+                LocalToLocal(node.parent, index);
+
+            if (node.childCount == 0)
+                LocalToParticle(index);
+        });
+    }
+}
+
+void FastMultipole::ParticleToMultipole(uint32_t index)
+{
+    Node& node = m_nodes[index];
+    const ispc::Vec4* pPositions = &m_sortedPositions[node.particleStart];
+
+    double center[3] = { 0.0, 0.0, 0.0 };
+    for (uint32_t ii = 0; ii < node.particleCount; ii++)
+    {
+        center[0] += pPositions[ii].x;
+        center[1] += pPositions[ii].y;
+        center[2] += pPositions[ii].z;
+    }
+    for (int axis = 0; axis < 3; axis++)
+        node.center[axis] = center[axis] / node.particleCount;
+
+    double* pMultipole = &m_multipoles[static_cast<size_t>(index) * m_coefficientCount];
+    std::fill_n(pMultipole, m_coefficientCount, 0.0);
+
+    double monomials[MaxCoefficients];
+    double radiusSqr = 0.0;
+    for (uint32_t ii = 0; ii < node.particleCount; ii++)
+    {
+        double dx = pPositions[ii].x - node.center[0];
+        double dy = pPositions[ii].y - node.center[1];
+        double dz = pPositions[ii].z - node.center[2];
+        radiusSqr = std::max(radiusSqr, dx * dx + dy * dy + dz * dz);
+
+        ComputeMonomials(dx, dy, dz, m_coefficientCount, monomials);
+        for (uint32_t t = 0; t < m_coefficientCount; t++)
+            pMultipole[t] += monomials[t];
+    }
+    node.radius = sqrt(radiusSqr);
+
+    for (uint32_t t = 0; t < m_coefficientCount; t++)
+        pMultipole[t] *= ParticleMassG;
+}
+
+void FastMultipole::MultipoleToMultipole(uint32_t child, uint32_t parent)
+{
+    const Node& c = m_nodes[child];
+    const Node& p = m_nodes[parent];
+
+    double monomials[MaxCoefficients];
+    ComputeMonomials(c.center[0] - p.center[0], c.center[1] - p.center[1], c.center[2] - p.center[2], m_coefficientCount, monomials);
+
+    const double* pChild = &m_multipoles[static_cast<size_t>(child) * m_coefficientCount];
+    double* pParent = &m_multipoles[static_cast<size_t>(parent) * m_coefficientCount];
+
+    for (const ShiftTerm& shift : m_shiftTerms)
+        pParent[shift.outer] += pChild[shift.inner] * monomials[shift.offset];
+}
+
+void FastMultipole::MultipoleToLocal(uint32_t source, uint32_t target)
+{
+    const Node& s = m_nodes[source];
+    const Node& t = m_nodes[target];
+
+    double derivatives[MaxCoefficients];
+    ComputeDerivatives(t.center[0] - s.center[0], t.center[1] - s.center[1], t.center[2] - s.center[2], m_coefficientCount, derivatives);
+
+    // The multipole enters with (-1)^|alpha|.
+    const double* pSource = &m_multipoles[static_cast<size_t>(source) * m_coefficientCount];
+    double multipole[MaxCoefficients];
+    for (uint32_t ii = 0; ii < m_coefficientCount; ii++)
+        multipole[ii] = (m_terms[ii].degree & 1) ? -pSource[ii] : pSource[ii];
+
+    double* pLocal = &m_locals[static_cast<size_t>(target) * m_coefficientCount];
+    for (const LocalTerm& term : m_localTerms)
+        pLocal[term.local] += multipole[term.multipole] * derivatives[term.derivative];
+}
+
+void FastMultipole::LocalToLocal(uint32_t parent, uint32_t child)
+{
+    const Node& c = m_nodes[child];
+    const Node& p = m_nodes[parent];
+
+    double monomials[MaxCoefficients];
+    ComputeMonomials(c.center[0] - p.center[0], c.center[1] - p.center[1], c.center[2] - p.center[2], m_coefficientCount, monomials);
+
+    const double* pParent = &m_locals[static_cast<size_t>(parent) * m_coefficientCount];
+    double* pChild = &m_locals[static_cast<size_t>(child) * m_coefficientCount];
+
+    for (const ShiftTerm& shift : m_shiftTerms)
+        pChild[shift.inner] += pParent[shift.outer] * monomials[shift.offset];
+}
+
+//
+// The acceleration is the gradient of the local expansion of the potential.
+//
+void FastMultipole::LocalToParticle(uint32_t index)
+{
+    const Node& node = m_nodes[index];
+    const double* pLocal = &m_locals[static_cast<size_t>(index) * m_coefficientCount];
+
+    double monomials[MaxCoefficients];
+    for (uint32_t ii = node.particleStart; ii < node.particleStart + node.particleCount; ii++)
+    {
+        const ispc::Vec4& pos = m_sortedPositions[ii];
+        ComputeMonomials(pos.x - node.center[0], pos.y - node.center[1], pos.z - node.center[2], m_gradientCount, monomials);
+
+        double accel[3] = { 0.0, 0.0, 0.0 };
+        for (uint32_t t = 0; t < m_gradientCount; t++)
+        {
+            accel[0] += pLocal[m_gradientTerms[t * 3 + 0]] * monomials[t];
+            accel[1] += pLocal[m_gradientTerms[t * 3 + 1]] * monomials[t];
+            accel[2] += pLocal[m_gradientTerms[t * 3 + 2]] * monomials[t];
+        }
+
+        m_sortedAccelerations[ii].x += static_cast<float>(accel[0]);
+        m_sortedAccelerations[ii].y += static_cast<float>(accel[1]);
+        m_sortedAccelerations[ii].z += static_cast<float>(accel[2]);
+    }
+}
+
+//
+// Compare every expansion order against a double precision direct sum over an even sample of the particles.
+//
+std::vector<FastMultipole::AccuracyResult> FastMultipole::MeasureAccuracy(const ispc::Particle* pParticles, uint32_t particleCount, int threads, uint32_t samples)
+{
+    samples = std::max(1u, std::min(samples, particleCount));
+    const uint32_t sampleStride = particleCount / samples;
+
+    std::vector<double> reference(static_cast<size_t>(samples) * 3);
+    concurrency::parallel_for<uint32_t>(0, samples, [&](uint32_t sample)
+    {
+        const ispc::Vec4& pos = pParticles[sample * sampleStride].position;
+
+        double accel[3] = { 0.0, 0.0, 0.0 };
+        for (uint32_t jj = 0; jj < particleCount; jj++)
+        {
+            const ispc::Vec4& other = pParticles[jj].position;
+            double rx = static_cast<double>(other.x) - pos.x;
+            double ry = static_cast<double>(other.y) - pos.y;
+            double rz = static_cast<double>(other.z) - pos.z;
+            double distSqr = rx * rx + ry * ry + rz * rz + SofteningSquared;
+            double s = ParticleMassG / (distSqr * sqrt(distSqr));
+
+            accel[0] += rx * s;
+            accel[1] += ry * s;
+            accel[2] += rz * s;
+        }
+
+        reference[sample * 3 + 0] = accel[0];
+        reference[sample * 3 + 1] = accel[1];
+        reference[sample * 3 + 2] = accel[2];
+    });
+
+    const uint32_t savedOrder = m_order;
+    std::vector<ispc::Vec3> accelerations(particleCount);
+    std::vector<AccuracyResult> results;
+
+    for (uint32_t order = 1; order <= MaxOrder; order++)
+    {
+        SetOrder(order);
+
+        // The first run warms the caches and sizes the buffers, the second is timed.
+        ComputeAccelerations(pParticles, particleCount, threads, &accelerations[0]);
+
+        auto begin = std::chrono::high_resolution_clock::now();
+        ComputeAccelerations(pParticles, particleCount, threads, &accelerations[0]);
+        auto end = std::chrono::high_resolution_clock::now();
+
+        AccuracyResult result = {};
+        result.order = order;
+        result.milliseconds = std::chrono::duration<double, std::milli>(end - begin).count();
+
+        double sumSqr = 0.0;
+        for (uint32_t sample = 0; sample < samples; sample++)
+        {
+            const ispc::Vec3& accel = accelerations[sample * sampleStride];
+            const double* pReference = &reference[sample * 3];
+
+            double ex = accel.x - pReference[0];
+            double ey = accel.y - pReference[1];
+            double ez = accel.z - pReference[2];
+            double magnitudeSqr = pReference[0] * pReference[0] + pReference[1] * pReference[1] + pReference[2] * pReference[2];
+            double errorSqr = (ex * ex + ey * ey + ez * ez) / std::max(magnitudeSqr, DBL_MIN);
+
+            sumSqr += errorSqr;
+            result.maxError = std::max(result.maxError, sqrt(errorSqr));
+        }
+        result.rmsError = sqrt(sumSqr / samples);
+
+        results.push_back(result);
+    }
+
+    SetOrder(savedOrder);
+    return results;
+}
@@ -0,0 +1,165 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#pragma once
+
+// Add the auto generated ISPC kernel header
+#include "nBodyGravityFMM_ispc.h"
+
+//
+// Fast multipole method (FMM) gravity solver for open boundaries.
+//
+// Particles are sorted along a Morton curve and an octree is built over the sorted order, so every node
+// owns a contiguous range of particles. Each step then runs:
+//   1. Upward pass: P2M at the leaves and M2M from children to parents, one level at a time.
+//   2. Dual tree traversal: well separated node pairs interact through M2L, neighbouring leaves through
+//      the ISPC P2P kernel. Target subtrees never share data, so they are traversed as parallel tasks.
+//   3. Downward pass: L2L from parents to children and L2P at the leaves.
+//
+// Expansions are Cartesian Taylor series of 1/r truncated at a selectable order, stored in double
+// precision. Higher orders trade time for accuracy; MeasureAccuracy() reports that trade-off.
+//
+class FastMultipole
+{
+public:
+    static const uint32_t MaxOrder = 8;
+    static const uint32_t MortonAxisBits = 21;
+
+    // Interleave the low MortonAxisBits bits of the cell coordinates, x lowest, into a Morton key.
+    static uint64_t GetMortonKey(uint64_t x, uint64_t y, uint64_t z);
+
+    struct AccuracyResult
+    {
+        uint32_t order;
+        double rmsError;        // Relative acceleration error against a double precision direct sum.
+        double maxError;
+        double milliseconds;    // Time to compute the accelerations of every particle.
+    };
+
+    FastMultipole();
+
+    // Order of the expansions, from 1 to MaxOrder.
+    void SetOrder(uint32_t order);
+    uint32_t GetOrder() const                       { return m_order; }
+
+    // Two nodes interact through their expansions when (radiusA + radiusB) < openingAngle * distance.
+    void SetOpeningAngle(float openingAngle)        { m_openingAngle = openingAngle; }
+    float GetOpeningAngle() const                   { return m_openingAngle; }
+
+    void Step(const ispc::Particle* pReadParticles, ispc::Particle* pWriteParticles, uint32_t particleCount, int threads);
+
+    // Accelerations in the original particle order.
+    void ComputeAccelerations(const ispc::Particle* pParticles, uint32_t particleCount, int threads, ispc::Vec3* pAccelerations);
+
+    // Time every expansion order on the given particles and measure the error on 'samples' of them.
+    std::vector<AccuracyResult> MeasureAccuracy(const ispc::Particle* pParticles, uint32_t particleCount, int threads, uint32_t samples);
+
+private:
+    static const uint32_t LeafSize = 64;
+    static const uint32_t MaxDepth = MortonAxisBits;    // One Morton key bit per axis and level.
+    static const uint32_t TaskParticleCount = 4096;     // Target nodes larger than this traverse their children as tasks.
+    static const uint32_t MaxCoefficients = (MaxOrder + 1) * (MaxOrder + 2) * (MaxOrder + 3) / 6;
+
+    struct Node
+    {
+        double center[3];       // Expansion centre, the centre of mass of the particles.
+        double radius;          // Bounds the distance from the centre to any particle in the node.
+        uint32_t particleStart;
+        uint32_t particleCount;
+        uint32_t firstChild;
+        uint32_t childCount;
+        uint32_t parent;
+    };
+
+    //
+    // Multi-index alpha = (x, y, z) of a Taylor coefficient. Terms are sorted by degree, so the
+    // coefficients of any order are a prefix of the MaxOrder table.
+    //
+    struct Term
+    {
+        uint8_t power[3];
+        uint8_t degree;
+        int16_t lower[3];       // Index of alpha - e_axis, or -1.
+        int16_t lower2[3];      // Index of alpha - 2 e_axis, or -1.
+    };
+
+    // Coefficient triples for the translation operators, rebuilt whenever the order changes.
+    struct ShiftTerm
+    {
+        uint16_t outer;         // M2M: target multipole, L2L: source local.
+        uint16_t inner;         // M2M: source multipole, L2L: target local.
+        uint16_t offset;        // Monomial of the shift, outer - inner.
+    };
+
+    struct LocalTerm
+    {
+        uint16_t local;
+        uint16_t multipole;
+        uint16_t derivative;    // local + multipole.
+    };
+
+    void BuildTerms();
+    void BuildOperators();
+
+    void BuildTree(const ispc::Particle* pParticles, uint32_t particleCount, int threads);
+    void Solve(const ispc::Particle* pParticles, uint32_t particleCount, int threads);
+    void UpwardPass();
+    void Interact(uint32_t target, uint32_t source);
+    void DownwardPass();
+
+    void ComputeMonomials(double x, double y, double z, uint32_t count, double* pMonomials) const;
+    void ComputeDerivatives(double x, double y, double z, uint32_t count, double* pDerivatives) const;
+
+    void ParticleToMultipole(uint32_t node);
+    void MultipoleToMultipole(uint32_t child, uint32_t parent);
+    void MultipoleToLocal(uint32_t source, uint32_t target);
+    void LocalToLocal(uint32_t parent, uint32_t child);
+    void LocalToParticle(uint32_t node);
+
+    uint32_t m_order;
+    uint32_t m_coefficientCount;
+    float m_openingAngle;
+
+    std::vector<Term> m_terms;
+    uint16_t m_termIndex[MaxOrder + 1][MaxOrder + 1][MaxOrder + 1];
+    std::vector<ShiftTerm> m_shiftTerms;
+    std::vector<LocalTerm> m_localTerms;
+    std::vector<uint16_t> m_gradientTerms;      // For every term of degree < order, the indices of alpha + e_x, e_y, e_z.
+    uint32_t m_gradientCount;
+
+    // Particles in tree order.
+    std::vector<std::pair<uint64_t, uint32_t>> m_keys;     // Morton key and original index.
+    std::vector<uint32_t> m_sortedIndices;
+    std::vector<uint32_t> m_ranks;              // Inverse of m_sortedIndices.
+    std::vector<ispc::Vec4> m_sortedPositions;
+    std::vector<ispc::Vec3> m_sortedAccelerations;
+
+    // Nodes are stored breadth first, so each level is a contiguous range and children are adjacent.
+    std::vector<Node> m_nodes;
+    std::vector<uint32_t> m_levelStart;
+    std::vector<double> m_multipoles;
+    std::vector<double> m_locals;
+};
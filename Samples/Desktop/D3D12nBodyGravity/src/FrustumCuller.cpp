@@ -0,0 +1,138 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#include "stdafx.h"
+#include "FrustumCuller.h"
+#include "Profiler.h"
+#include <cmath>
+
+// Concurrency
+#include <ppl.h>
+
+FrustumCuller::FrustumCuller() :
+    m_radius(0.0f)
+{
+    // No culling until a frustum is set: every plane passes every point.
+    for (uint32_t plane = 0; plane < PlaneCount; plane++)
+    {
+        m_planes[4 * plane + 0] = 0.0f;
+        m_planes[4 * plane + 1] = 0.0f;
+        m_planes[4 * plane + 2] = 0.0f;
+        m_planes[4 * plane + 3] = 1.0f;
+    }
+}
+
+//
+// Clip space is p * M with -w <= x, y <= w and 0 <= z <= w, so with c0 .. c3 the columns of M the
+// planes are c3 + c0, c3 - c0 (left, right), c3 + c1, c3 - c1 (bottom, top), c2 (near) and c3 - c2 (far).
+//
+void FrustumCuller::SetFrustum(const DirectX::XMFLOAT4X4& viewProjection, float radius)
+{
+    for (int row = 0; row < 4; row++)
+    {
+        const float* m = viewProjection.m[row];
+        m_planes[0 * 4 + row] = m[3] + m[0];    // Left
+        m_planes[1 * 4 + row] = m[3] - m[0];    // Right
+        m_planes[2 * 4 + row] = m[3] + m[1];    // Bottom
+        m_planes[3 * 4 + row] = m[3] - m[1];    // Top
+        m_planes[4 * 4 + row] = m[2];           // Near
+        m_planes[5 * 4 + row] = m[3] - m[2];    // Far
+    }
+
+    for (uint32_t plane = 0; plane < PlaneCount; plane++)
+    {
+        float* pPlane = &m_planes[4 * plane];
+        const float length = std::sqrt(pPlane[0] * pPlane[0] + pPlane[1] * pPlane[1] + pPlane[2] * pPlane[2]);
+        const float scale = (length > 0.0f) ? 1.0f / length : 0.0f;
+        for (int ii = 0; ii < 4; ii++)
+            pPlane[ii] *= scale;
+    }
+
+    m_radius = radius;
+}
+
+float FrustumCuller::GetDistance(const ispc::Particle& particle) const
+{
+    const ispc::Vec4& p = particle.position;
+
+    float distance = m_planes[0] * p.x + m_planes[1] * p.y + m_planes[2] * p.z + m_planes[3];
+    for (uint32_t plane = 1; plane < PlaneCount; plane++)
+    {
+        const float* pPlane = &m_planes[4 * plane];
+        const float planeDistance = pPlane[0] * p.x + pPlane[1] * p.y + pPlane[2] * p.z + pPlane[3];
+        if (planeDistance < distance)
+            distance = planeDistance;
+    }
+
+    return distance + m_radius;
+}
+
+uint32_t FrustumCuller::Cull(const ispc::Particle* pParticles, uint32_t particleCount, int threads, ispc::RenderRecord* pRecords, uint32_t* pIndices)
+{
+    PROFILE_SCOPE("Frustum cull");
+
+    const uint32_t blockCount = (particleCount + BlockSize - 1) / BlockSize;
+    if (blockCount == 0)
+        return 0;
+
+    // m_blockOffsets[block + 1] first receives the count of the block, the prefix sum then makes it the end offset.
+    m_blockOffsets.resize(blockCount + 1);
+    m_blockOffsets[0] = 0;
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        PROFILE_SCOPE("Cull count");
+
+        const uint32_t blockStart = (blockCount * thread) / threads;
+        const uint32_t blockEnd = (blockCount * (thread + 1)) / threads;
+        for (uint32_t block = blockStart; block < blockEnd; block++)
+        {
+            const uint32_t particleStart = block * BlockSize;
+            const uint32_t particleEnd = (particleCount - particleStart < BlockSize) ? particleCount : particleStart + BlockSize;
+            m_blockOffsets[block + 1] = ispc::CountVisible(pParticles, particleStart, particleEnd, m_planes, m_radius);
+        }
+    });
+
+    // A few hundred blocks at most for a million particles, so the scan itself stays serial.
+    for (uint32_t block = 0; block < blockCount; block++)
+        m_blockOffsets[block + 1] += m_blockOffsets[block];
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        PROFILE_SCOPE("Cull compact");
+
+        const uint32_t blockStart = (blockCount * thread) / threads;
+        const uint32_t blockEnd = (blockCount * (thread + 1)) / threads;
+        for (uint32_t block = blockStart; block < blockEnd; block++)
+        {
+            const uint32_t particleStart = block * BlockSize;
+            const uint32_t particleEnd = (particleCount - particleStart < BlockSize) ? particleCount : particleStart + BlockSize;
+            ispc::CompactVisible(pParticles, particleStart, particleEnd, m_planes, m_radius, pRecords, pIndices, m_blockOffsets[block]);
+        }
+    });
+
+    return m_blockOffsets[blockCount];
+}
@@ -0,0 +1,71 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#pragma once
+
+// Add the auto generated ISPC kernel header
+#include "nBodyGravityCull_ispc.h"
+
+//
+// View frustum culling of the CPU paths' draw list.
+//
+// Cull() writes the render records of the particles whose sprite can touch the view frustum, in particle
+// order, and returns how many it wrote, which becomes the draw count. It is a two pass stream compaction
+// over fixed blocks of BlockSize particles: the threads count the visible particles of their blocks, a
+// prefix sum over the block counts gives each block its output offset, and the threads then write their
+// blocks from those offsets (nBodyGravityCull.ispc). The output does not depend on the thread count.
+//
+// Nothing here touches D3D, so the culler runs on any particle array, as in -verifydeterminism.
+//
+class FrustumCuller
+{
+public:
+    static const uint32_t BlockSize = 4096;
+    static const uint32_t PlaneCount = 6;
+
+    FrustumCuller();
+
+    // Take the frustum of a view * projection matrix for row vectors, as in the draw constant buffer.
+    // Particles are kept while a sphere of 'radius' around them touches the frustum.
+    void SetFrustum(const DirectX::XMFLOAT4X4& viewProjection, float radius);
+
+    // Smallest signed distance from the sphere around a particle to the frustum planes: the particle is
+    // kept when it is not negative. A scalar reference for the ISPC kernels.
+    float GetDistance(const ispc::Particle& particle) const;
+
+    const float* GetPlanes() const  { return m_planes; }
+    float GetRadius() const         { return m_radius; }
+
+    // Write the records of the visible particles to pRecords and, when pIndices is set, their indices to
+    // pIndices. Both need room for particleCount entries. Returns the number of visible particles.
+    uint32_t Cull(const ispc::Particle* pParticles, uint32_t particleCount, int threads, ispc::RenderRecord* pRecords, uint32_t* pIndices = nullptr);
+
+private:
+    float m_planes[PlaneCount * 4];     // (nx, ny, nz, d) per plane, unit normals pointing inwards.
+    float m_radius;
+
+    std::vector<uint32_t> m_blockOffsets;
+};
@@ -0,0 +1,285 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+#include "stdafx.h"
+#include "InitialConditions.h"
+#include "Profiler.h"
+
+// Concurrency
+#include <ppl.h>
+
+static const float ParticleMassG = 66.73f;
+
+// Particles per work item of the generators.
+static const uint32_t GenerateBlockSize = 65536;
+
+// Key of the counter based generator.
+static const uint32_t Seed = 0;
+
+// position.w and velocity.w of the generated particles.
+static const float PositionW = 10000.0f * 10000.0f;
+static const float VelocityW = 1.0f / 100000000.0f;
+
+// Two spheres.
+static const float SphereRadius = 400.0f;
+static const float SphereSpeed = 20.0f;
+
+// Plummer and Hernquist spheres, truncated at a multiple of the scale radius.
+static const float PlummerScaleRadius = 100.0f;
+static const float HernquistScaleRadius = 80.0f;
+static const float SphereTruncation = 15.0f;
+
+// Galaxies, before scaling by the cube root of the mass in the merger.
+static const float DiskFraction = 0.25f;
+static const float DiskScaleLength = 60.0f;
+static const float DiskScaleHeight = 6.0f;
+static const float DiskTruncation = 8.0f;
+static const float HaloScaleRadius = 120.0f;
+static const float HaloTruncation = 10.0f;
+
+static const float DegreesToRadians = 3.14159265358979f / 180.0f;
+
+static const wchar_t* ModelNames[] = { L"spheres", L"plummer", L"hernquist", L"disk", L"merger" };
+
+//
+// Run 'kernel(pParticles, start, end)' over fixed blocks of GenerateBlockSize particles, split across threads.
+//
+template <typename Kernel>
+static void GenerateBlocks(ispc::Particle* pParticles, uint32_t particleCount, int threads, const Kernel& kernel)
+{
+    const uint32_t blockCount = (particleCount + GenerateBlockSize - 1) / GenerateBlockSize;
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        PROFILE_SCOPE("Initial conditions worker");
+
+        uint32_t blockStart = (blockCount * thread) / threads;
+        uint32_t blockEnd = (blockCount * (thread + 1)) / threads;
+
+        uint32_t particleStart = blockStart * GenerateBlockSize;
+        uint32_t particleEnd = (blockEnd * GenerateBlockSize < particleCount) ? blockEnd * GenerateBlockSize : particleCount;
+
+        if (particleStart < particleEnd)
+            kernel(pParticles, particleStart, particleEnd);
+    });
+}
+
+static void GenerateUniformSphere(ispc::Particle* pParticles, uint32_t particleCount, uint32_t stream, const ispc::Vec4& center, const ispc::Vec4& velocity,
+                                  float radius, int threads)
+{
+    GenerateBlocks(pParticles, particleCount, threads, [&](ispc::Particle* p, uint32_t start, uint32_t end)
+    {
+        ispc::GenerateUniformSphere(p, start, end, Seed, stream, center, velocity, radius);
+    });
+}
+
+static void GeneratePlummer(ispc::Particle* pParticles, uint32_t particleCount, uint32_t stream, const ispc::Vec4& center, const ispc::Vec4& velocity,
+                            const ispc::SphereParameters& sphere, int threads)
+{
+    GenerateBlocks(pParticles, particleCount, threads, [&](ispc::Particle* p, uint32_t start, uint32_t end)
+    {
+        ispc::GeneratePlummer(p, start, end, Seed, stream, center, velocity, sphere);
+    });
+}
+
+static void GenerateHernquist(ispc::Particle* pParticles, uint32_t particleCount, uint32_t stream, const ispc::Vec4& center, const ispc::Vec4& velocity,
+                              const ispc::SphereParameters& sphere, int threads)
+{
+    GenerateBlocks(pParticles, particleCount, threads, [&](ispc::Particle* p, uint32_t start, uint32_t end)
+    {
+        ispc::GenerateHernquist(p, start, end, Seed, stream, center, velocity, sphere);
+    });
+}
+
+static void GenerateExponentialDisk(ispc::Particle* pParticles, uint32_t particleCount, uint32_t stream, const ispc::Vec4& center, const ispc::Vec4& velocity,
+                                    const ispc::DiskParameters& disk, int threads)
+{
+    GenerateBlocks(pParticles, particleCount, threads, [&](ispc::Particle* p, uint32_t start, uint32_t end)
+    {
+        ispc::GenerateExponentialDisk(p, start, end, Seed, stream, center, velocity, disk);
+    });
+}
+
+InitialConditions::InitialConditions() :
+    m_model(e_TwoSpheres)
+{
+    m_orbit.separation = 1000.0f;
+    m_orbit.pericenter = 150.0f;
+    m_orbit.eccentricity = 1.0f;
+    m_orbit.massRatio = 1.0f;
+    m_orbit.inclination[0] = 0.0f;
+    m_orbit.inclination[1] = 60.0f;
+}
+
+const wchar_t* InitialConditions::GetModelName(Model model)
+{
+    return (model >= 0 && model < e_MAX_Model) ? ModelNames[model] : L"unknown";
+}
+
+bool InitialConditions::ParseModel(const wchar_t* pName, Model* pModel)
+{
+    for (int model = 0; model < e_MAX_Model; model++)
+    {
+        if (_wcsicmp(pName, ModelNames[model]) == 0)
+        {
+            *pModel = static_cast<Model>(model);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//
+// A disk galaxy of 'particleCount' particles: DiskFraction of them in the disk, the rest in the halo.
+// Lengths are multiplied by 'scale'. The disk rotates in the combined potential. The halo velocities
+// come from the isotropic Hernquist distribution function for the mass of the whole galaxy, as if the
+// disk were spread like the halo, which keeps the galaxy close to virial equilibrium.
+//
+void InitialConditions::GenerateGalaxy(ispc::Particle* pParticles, uint32_t particleCount, uint32_t stream, const ispc::Vec4& center, const ispc::Vec4& velocity,
+                                       float scale, float inclination, int threads) const
+{
+    uint32_t diskCount = static_cast<uint32_t>(particleCount * DiskFraction);
+    uint32_t haloCount = particleCount - diskCount;
+
+    ispc::SphereParameters halo;
+    halo.scaleRadius = HaloScaleRadius * scale;
+    halo.mass = ParticleMassG * particleCount;
+    halo.maxRadius = HaloTruncation * halo.scaleRadius;
+
+    // Mass of the untruncated halo model with haloCount particles inside the truncation radius.
+    const float haloEnclosed = HaloTruncation / (HaloTruncation + 1.0f);
+
+    ispc::DiskParameters disk;
+    disk.scaleLength = DiskScaleLength * scale;
+    disk.scaleHeight = DiskScaleHeight * scale;
+    disk.mass = ParticleMassG * diskCount;
+    disk.maxRadius = DiskTruncation * disk.scaleLength;
+    disk.haloScaleRadius = halo.scaleRadius;
+    disk.haloMass = ParticleMassG * haloCount / (haloEnclosed * haloEnclosed);
+    disk.inclination = inclination * DegreesToRadians;
+
+    GenerateExponentialDisk(pParticles, diskCount, stream, center, velocity, disk, threads);
+    GenerateHernquist(pParticles + diskCount, haloCount, stream + 1, center, velocity, halo, threads);
+}
+
+void InitialConditions::GeneratePlummerSystem(ispc::Particle* pParticles, uint32_t particleCount, uint32_t stream, float scaleRadius, float gravitationalMass)
+{
+    const ispc::Vec4 origin = { 0.0f, 0.0f, 0.0f, PositionW };
+    const ispc::Vec4 rest = { 0.0f, 0.0f, 0.0f, VelocityW };
+
+    ispc::SphereParameters sphere;
+    sphere.scaleRadius = scaleRadius;
+    sphere.mass = gravitationalMass * particleCount;
+    sphere.maxRadius = SphereTruncation * scaleRadius;
+
+    ispc::GeneratePlummer(pParticles, 0, particleCount, Seed, stream, origin, rest, sphere);
+}
+
+void InitialConditions::Generate(ispc::Particle* pParticles, uint32_t particleCount, int threads) const
+{
+    PROFILE_SCOPE("Generate initial conditions");
+
+    const ispc::Vec4 origin = { 0.0f, 0.0f, 0.0f, PositionW };
+    const ispc::Vec4 rest = { 0.0f, 0.0f, 0.0f, VelocityW };
+
+    switch (m_model)
+    {
+    case e_TwoSpheres:
+    {
+        // Split the particles into two groups, drawn from separate streams.
+        const uint32_t half = particleCount / 2;
+        const float centerSpread = SphereRadius * 0.50f;
+        const ispc::Vec4 center0 = { centerSpread, 0.0f, 0.0f, PositionW };
+        const ispc::Vec4 center1 = { -centerSpread, 0.0f, 0.0f, PositionW };
+        const ispc::Vec4 velocity0 = { 0.0f, 0.0f, -SphereSpeed, VelocityW };
+        const ispc::Vec4 velocity1 = { 0.0f, 0.0f, SphereSpeed, VelocityW };
+
+        GenerateUniformSphere(pParticles, half, 0, center0, velocity0, SphereRadius, threads);
+        GenerateUniformSphere(pParticles + half, particleCount - half, 1, center1, velocity1, SphereRadius, threads);
+        break;
+    }
+
+    case e_Plummer:
+    case e_Hernquist:
+    {
+        ispc::SphereParameters sphere;
+        sphere.scaleRadius = (m_model == e_Plummer) ? PlummerScaleRadius : HernquistScaleRadius;
+        sphere.mass = ParticleMassG * particleCount;
+        sphere.maxRadius = SphereTruncation * sphere.scaleRadius;
+
+        if (m_model == e_Plummer)
+            GeneratePlummer(pParticles, particleCount, 0, origin, rest, sphere, threads);
+        else
+            GenerateHernquist(pParticles, particleCount, 0, origin, rest, sphere, threads);
+        break;
+    }
+
+    case e_Disk:
+        GenerateGalaxy(pParticles, particleCount, 0, origin, rest, 1.0f, 0.0f, threads);
+        break;
+
+    case e_Merger:
+    {
+        //
+        // Place the galaxies on the Kepler orbit of two point masses in the x-y plane, approaching at
+        // 'separation', with the centre of mass at rest at the origin.
+        //
+        const float massRatio = (m_orbit.massRatio > 0.0f) ? m_orbit.massRatio : 1.0f;
+        const uint32_t count0 = static_cast<uint32_t>(particleCount / (1.0f + massRatio));
+        const uint32_t count1 = particleCount - count0;
+
+        const double totalMass = static_cast<double>(ParticleMassG) * particleCount;
+        const double fraction0 = static_cast<double>(count0) / particleCount;
+        const double fraction1 = static_cast<double>(count1) / particleCount;
+        const double pericenter = m_orbit.pericenter;
+        const double eccentricity = m_orbit.eccentricity;
+        const double separation = (m_orbit.separation > pericenter) ? m_orbit.separation : pericenter;
+
+        // Vis-viva, with the parabolic orbit as the limit of an infinite semi-major axis.
+        double speed2 = 2.0 * totalMass / separation;
+        if (fabs(1.0 - eccentricity) > 1e-6)
+            speed2 -= totalMass * (1.0 - eccentricity) / pericenter;
+
+        const double angularMomentum = sqrt(totalMass * pericenter * (1.0 + eccentricity));
+        const double tangentialSpeed = angularMomentum / separation;
+        const double radialSpeed = -sqrt((speed2 > tangentialSpeed * tangentialSpeed) ? speed2 - tangentialSpeed * tangentialSpeed : 0.0);
+
+        const ispc::Vec4 center0 = { static_cast<float>(-fraction1 * separation), 0.0f, 0.0f, PositionW };
+        const ispc::Vec4 center1 = { static_cast<float>(fraction0 * separation), 0.0f, 0.0f, PositionW };
+        const ispc::Vec4 velocity0 = { static_cast<float>(-fraction1 * radialSpeed), static_cast<float>(-fraction1 * tangentialSpeed), 0.0f, VelocityW };
+        const ispc::Vec4 velocity1 = { static_cast<float>(fraction0 * radialSpeed), static_cast<float>(fraction0 * tangentialSpeed), 0.0f, VelocityW };
+
+        const float scale1 = static_cast<float>(pow(static_cast<double>(count1) / (count0 > 0 ? count0 : 1), 1.0 / 3.0));
+
+        GenerateGalaxy(pParticles, count0, 0, center0, velocity0, 1.0f, m_orbit.inclination[0], threads);
+        GenerateGalaxy(pParticles + count0, count1, 2, center1, velocity1, scale1, m_orbit.inclination[1], threads);
+        break;
+    }
+
+    default:
+        break;
+    }
+}
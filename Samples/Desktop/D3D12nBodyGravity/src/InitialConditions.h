@@ -0,0 +1,86 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+#pragma once
+
+// Add the auto generated ISPC kernel header
+#include "nBodyGravityInit_ispc.h"
+
+//
+// Initial condition models.
+//
+// Every model is built from the ISPC samplers in nBodyGravityInit.ispc, run over fixed blocks of
+// particles on all threads. Each particle is a function of its model, component and index only, so the
+// output is the same for any number of threads.
+//
+class InitialConditions
+{
+public:
+    enum Model
+    {
+        e_TwoSpheres = 0,       // Two uniform spheres moving apart along z, the original scenario.
+        e_Plummer,              // A Plummer sphere in equilibrium.
+        e_Hernquist,            // A Hernquist halo with isotropic velocities.
+        e_Disk,                 // A rotating exponential disk in a Hernquist halo.
+        e_Merger,               // Two disk galaxies on a Kepler orbit.
+
+        e_MAX_Model
+    };
+
+    // Relative orbit of the two galaxies of e_Merger, as point masses.
+    struct Orbit
+    {
+        float separation;       // Initial distance between the galaxy centres.
+        float pericenter;       // Closest approach.
+        float eccentricity;     // 1 for a parabolic encounter, below 1 bound, above 1 hyperbolic.
+        float massRatio;        // Mass of the second galaxy relative to the first.
+        float inclination[2];   // Tilt of each disk out of the orbital plane, in degrees.
+    };
+
+    InitialConditions();
+
+    void SetModel(Model model)              { m_model = model; }
+    Model GetModel() const                  { return m_model; }
+    void SetOrbit(const Orbit& orbit)       { m_orbit = orbit; }
+    const Orbit& GetOrbit() const           { return m_orbit; }
+
+    static const wchar_t* GetModelName(Model model);
+
+    // Case insensitive match against the model names, returns false if there is none.
+    static bool ParseModel(const wchar_t* pName, Model* pModel);
+
+    void Generate(ispc::Particle* pParticles, uint32_t particleCount, int threads) const;
+
+    // A small Plummer sphere at rest at the origin, on the calling thread. Each stream gives a different
+    // realisation, for the systems of an ensemble.
+    static void GeneratePlummerSystem(ispc::Particle* pParticles, uint32_t particleCount, uint32_t stream, float scaleRadius, float gravitationalMass);
+
+private:
+    void GenerateGalaxy(ispc::Particle* pParticles, uint32_t particleCount, uint32_t stream, const ispc::Vec4& center, const ispc::Vec4& velocity,
+                        float scale, float inclination, int threads) const;
+
+    Model m_model;
+    Orbit m_orbit;
+};
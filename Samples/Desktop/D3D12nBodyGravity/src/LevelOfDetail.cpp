@@ -0,0 +1,341 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#include "stdafx.h"
+#include "LevelOfDetail.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+// Concurrency
+#include <ppl.h>
+
+const float LevelOfDetail::DefaultThreshold = 4.0f;
+
+LevelOfDetail::LevelOfDetail() :
+    m_threshold(DefaultThreshold),
+    m_bEnabled(false),
+    m_cameraPosition(0.0f, 0.0f, 0.0f),
+    m_pixelScale(0.0f),
+    m_bHasGrid(false),
+    m_particleCount(0),
+    m_framesSinceRebuild(0),
+    m_gridOrigin(0.0f, 0.0f, 0.0f),
+    m_cellSize(1.0f)
+{
+}
+
+void LevelOfDetail::SetThreshold(float pixels)
+{
+    if (pixels > 0.0f)
+        m_threshold = pixels;
+    m_bEnabled = (pixels > 0.0f);
+}
+
+void LevelOfDetail::Reset()
+{
+    m_bHasGrid = false;
+}
+
+void LevelOfDetail::SetCamera(const DirectX::XMFLOAT3& position, float pixelScale)
+{
+    m_cameraPosition = position;
+    m_pixelScale = pixelScale;
+}
+
+//
+// A cube around the bounds, a little larger so that the particles reaching out before the next rebuild
+// still fall in.
+//
+void LevelOfDetail::FitGrid(const float* pBounds)
+{
+    float extent = 0.0f;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (pBounds[3 + axis] - pBounds[axis] > extent)
+            extent = pBounds[3 + axis] - pBounds[axis];
+    }
+
+    m_cellSize = (extent > 0.0f) ? extent * (1.0f + 2.0f / GridSize) / GridSize : 1.0f;
+
+    const float halfSize = 0.5f * GridSize * m_cellSize;
+    m_gridOrigin.x = 0.5f * (pBounds[0] + pBounds[3]) - halfSize;
+    m_gridOrigin.y = 0.5f * (pBounds[1] + pBounds[4]) - halfSize;
+    m_gridOrigin.z = 0.5f * (pBounds[2] + pBounds[5]) - halfSize;
+    m_bHasGrid = true;
+}
+
+//
+// Fit the grid to the particles, sort their indices by cell and take the impostor sums of every cell.
+// Four passes over the particles, which Build() only makes every RebuildFrames frames.
+//
+void LevelOfDetail::Rebuild(const ispc::Particle* pParticles, uint32_t particleCount, int threads)
+{
+    PROFILE_SCOPE("Lod rebuild");
+
+    const uint32_t blockCount = (particleCount + BlockSize - 1) / BlockSize;
+
+    m_threadBounds.resize((size_t)threads * 6);
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        float* pBounds = &m_threadBounds[(size_t)thread * 6];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            pBounds[axis] = FLT_MAX;
+            pBounds[3 + axis] = -FLT_MAX;
+        }
+
+        const uint32_t blockStart = (blockCount * thread) / threads;
+        const uint32_t blockEnd = (blockCount * (thread + 1)) / threads;
+        for (uint32_t block = blockStart; block < blockEnd; block++)
+        {
+            const uint32_t particleStart = block * BlockSize;
+            const uint32_t particleEnd = (particleCount - particleStart < BlockSize) ? particleCount : particleStart + BlockSize;
+            ispc::LodBounds(pParticles, particleStart, particleEnd, pBounds);
+        }
+    });
+
+    float bounds[6];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        bounds[axis] = FLT_MAX;
+        bounds[3 + axis] = -FLT_MAX;
+    }
+    for (int thread = 0; thread < threads; thread++)
+    {
+        const float* pBounds = &m_threadBounds[(size_t)thread * 6];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (pBounds[axis] < bounds[axis])
+                bounds[axis] = pBounds[axis];
+            if (pBounds[3 + axis] > bounds[3 + axis])
+                bounds[3 + axis] = pBounds[3 + axis];
+        }
+    }
+    FitGrid(bounds);
+
+    ispc::LodGrid grid;
+    grid.originX = m_gridOrigin.x;
+    grid.originY = m_gridOrigin.y;
+    grid.originZ = m_gridOrigin.z;
+    grid.invCellSize = 1.0f / m_cellSize;
+    grid.gridSize = GridSize;
+
+    // The histograms only grow with the thread count; each thread clears its own.
+    if (m_threadCounts.size() < (size_t)threads * MaxImpostors)
+        m_threadCounts.resize((size_t)threads * MaxImpostors);
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        PROFILE_SCOPE("Lod count");
+
+        uint32_t* pCounts = &m_threadCounts[(size_t)thread * MaxImpostors];
+        memset(pCounts, 0, MaxImpostors * sizeof(uint32_t));
+
+        const uint32_t blockStart = (blockCount * thread) / threads;
+        const uint32_t blockEnd = (blockCount * (thread + 1)) / threads;
+        for (uint32_t block = blockStart; block < blockEnd; block++)
+        {
+            const uint32_t particleStart = block * BlockSize;
+            const uint32_t particleEnd = (particleCount - particleStart < BlockSize) ? particleCount : particleStart + BlockSize;
+            ispc::LodCountCells(pParticles, particleStart, particleEnd, grid, pCounts);
+        }
+    });
+
+    // Cell major and thread minor, so each cell lists its particles in index order. The counts become the
+    // threads' write cursors.
+    m_cellStarts.resize(MaxImpostors + 1);
+    uint32_t offset = 0;
+    for (uint32_t cell = 0; cell < MaxImpostors; cell++)
+    {
+        m_cellStarts[cell] = offset;
+        for (int thread = 0; thread < threads; thread++)
+        {
+            uint32_t& count = m_threadCounts[(size_t)thread * MaxImpostors + cell];
+            const uint32_t cellCount = count;
+            count = offset;
+            offset += cellCount;
+        }
+    }
+    m_cellStarts[MaxImpostors] = offset;
+
+    m_sortedParticles.resize(particleCount);
+    m_cellSums.resize(MaxImpostors);
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        PROFILE_SCOPE("Lod sort");
+
+        uint32_t* pCursors = &m_threadCounts[(size_t)thread * MaxImpostors];
+
+        const uint32_t blockStart = (blockCount * thread) / threads;
+        const uint32_t blockEnd = (blockCount * (thread + 1)) / threads;
+        for (uint32_t block = blockStart; block < blockEnd; block++)
+        {
+            const uint32_t particleStart = block * BlockSize;
+            const uint32_t particleEnd = (particleCount - particleStart < BlockSize) ? particleCount : particleStart + BlockSize;
+            ispc::LodSortCells(pParticles, particleStart, particleEnd, grid, pCursors, &m_sortedParticles[0]);
+        }
+    });
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        PROFILE_SCOPE("Lod sum");
+
+        const uint32_t cellStart = (MaxImpostors * thread) / threads;
+        const uint32_t cellEnd = (MaxImpostors * (thread + 1)) / threads;
+        ispc::LodSumCells(pParticles, &m_sortedParticles[0], &m_cellStarts[0], cellStart, cellEnd, &m_cellSums[0]);
+    });
+
+    m_particleCount = particleCount;
+    m_framesSinceRebuild = 0;
+}
+
+void LevelOfDetail::Build(const ispc::Particle* pParticles, uint32_t particleCount, int threads, const FrustumCuller* pCuller,
+                          ispc::RenderRecord* pRecords, uint32_t* pRecordCount, Impostor* pImpostors, uint32_t* pImpostorCount)
+{
+    PROFILE_SCOPE("Level of detail");
+
+    *pRecordCount = 0;
+    *pImpostorCount = 0;
+
+    if (particleCount == 0)
+        return;
+
+    if (!m_bHasGrid || particleCount != m_particleCount || m_framesSinceRebuild >= RebuildFrames)
+        Rebuild(pParticles, particleCount, threads);
+    m_framesSinceRebuild++;
+
+    const FrustumCuller& culler = pCuller ? *pCuller : m_noCulling;
+    const float* pPlanes = culler.GetPlanes();
+    const float radius = culler.GetRadius();
+
+    // A cell of m_cellSize at distance d covers m_cellSize * m_pixelScale / d pixels. A cell is near when
+    // its bounding sphere reaches closer than the distance where that falls to the threshold.
+    const float farDistance = m_cellSize * m_pixelScale / m_threshold;
+    const float cellRadius = 0.8660254f * m_cellSize;
+
+    // Particles can have moved out of their cell since the sort, so the near cells are tested against the
+    // frustum with another cell size of margin.
+    const float cellMargin = cellRadius + m_cellSize;
+
+    //
+    // Split the cells by the camera. Only the cells are visited here; the far ones in view become impostors
+    // straight away and the near ones in view are listed with their particle counts for the passes below.
+    //
+    m_nearCells.clear();
+    m_nearParticles.clear();
+    m_nearParticles.push_back(0);
+
+    uint32_t impostorCount = 0;
+    for (uint32_t cell = 0; cell < MaxImpostors; cell++)
+    {
+        const uint32_t count = m_cellStarts[cell + 1] - m_cellStarts[cell];
+        if (count == 0)
+            continue;
+
+        ispc::Particle centre = {};
+        centre.position.x = m_gridOrigin.x + ((cell % GridSize) + 0.5f) * m_cellSize;
+        centre.position.y = m_gridOrigin.y + (((cell / GridSize) % GridSize) + 0.5f) * m_cellSize;
+        centre.position.z = m_gridOrigin.z + ((cell / (GridSize * GridSize)) + 0.5f) * m_cellSize;
+
+        const float dx = centre.position.x - m_cameraPosition.x;
+        const float dy = centre.position.y - m_cameraPosition.y;
+        const float dz = centre.position.z - m_cameraPosition.z;
+        if (std::sqrt(dx * dx + dy * dy + dz * dz) - cellRadius < farDistance)
+        {
+            if (culler.GetDistance(centre) + cellMargin >= 0.0f)
+            {
+                m_nearCells.push_back(cell);
+                m_nearParticles.push_back(m_nearParticles.back() + count);
+            }
+            continue;
+        }
+
+        const ispc::LodCell& sum = m_cellSums[cell];
+        const float invCount = 1.0f / sum.count;
+
+        ispc::Particle mean = {};
+        mean.position.x = sum.x * invCount;
+        mean.position.y = sum.y * invCount;
+        mean.position.z = sum.z * invCount;
+        if (culler.GetDistance(mean) < 0.0f)
+            continue;
+
+        Impostor& impostor = pImpostors[impostorCount++];
+        impostor.position = DirectX::XMFLOAT3(mean.position.x, mean.position.y, mean.position.z);
+        impostor.speed = sum.speed * invCount;
+        impostor.weight = (float)sum.count;
+    }
+    *pImpostorCount = impostorCount;
+
+    const uint32_t nearCount = static_cast<uint32_t>(m_nearCells.size());
+    if (nearCount == 0)
+        return;
+
+    // Each thread takes the near cells starting in its even share of the near particles.
+    const uint32_t nearTotal = m_nearParticles[nearCount];
+    auto firstCell = [&](int thread)
+    {
+        const uint32_t share = static_cast<uint32_t>((static_cast<uint64_t>(nearTotal) * thread) / threads);
+        return static_cast<uint32_t>(std::lower_bound(m_nearParticles.begin(), m_nearParticles.begin() + nearCount, share) - m_nearParticles.begin());
+    };
+
+    // m_nearOffsets[nearCell + 1] first receives the count of the cell, the prefix sum then makes it the end offset.
+    m_nearOffsets.resize(nearCount + 1);
+    m_nearOffsets[0] = 0;
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        PROFILE_SCOPE("Lod count near");
+
+        const uint32_t nearEnd = firstCell(thread + 1);
+        for (uint32_t nearCell = firstCell(thread); nearCell < nearEnd; nearCell++)
+        {
+            const uint32_t cell = m_nearCells[nearCell];
+            m_nearOffsets[nearCell + 1] = ispc::LodCountNear(pParticles, &m_sortedParticles[0], m_cellStarts[cell], m_cellStarts[cell + 1], pPlanes, radius);
+        }
+    });
+
+    for (uint32_t nearCell = 0; nearCell < nearCount; nearCell++)
+        m_nearOffsets[nearCell + 1] += m_nearOffsets[nearCell];
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        PROFILE_SCOPE("Lod compact near");
+
+        const uint32_t nearEnd = firstCell(thread + 1);
+        for (uint32_t nearCell = firstCell(thread); nearCell < nearEnd; nearCell++)
+        {
+            const uint32_t cell = m_nearCells[nearCell];
+            ispc::LodCompactNear(pParticles, &m_sortedParticles[0], m_cellStarts[cell], m_cellStarts[cell + 1], pPlanes, radius,
+                                 pRecords, m_nearOffsets[nearCell]);
+        }
+    });
+
+    *pRecordCount = m_nearOffsets[nearCount];
+}
@@ -0,0 +1,118 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#pragma once
+
+#include "FrustumCuller.h"
+
+// Add the auto generated ISPC kernel header
+#include "nBodyGravityLod_ispc.h"
+
+//
+// Distance based level of detail for the CPU paths' draw list.
+//
+// The particles are sorted into the cells of a GridSize cubed grid over them. Cells reaching closer to the
+// camera than the distance where a cell covers the threshold's pixels on screen are near, and their
+// particles in view are drawn one by one; every other occupied cell in view is drawn as one impostor at its
+// particles' mean position, as bright as all of them (nBodyGravityLod.ispc).
+//
+// The sort and the impostor sums are only redone every RebuildFrames frames, or after Reset(). In between
+// Build() decides near and far per cell from the camera position and only reads the particles of the near
+// cells, so a frame costs a pass over the cells plus the near particles, and camera motion just moves cells
+// between the two lists. Particles are drawn from their current positions, but stay in the cell they were
+// sorted into and the impostors keep the positions of the last sort until the next one.
+//
+// The near records are in cell order and then particle order, and the impostors in cell order, whatever
+// the thread count.
+//
+class LevelOfDetail
+{
+public:
+    static const uint32_t GridSize = 32;
+    static const uint32_t MaxImpostors = GridSize * GridSize * GridSize;
+    static const uint32_t BlockSize = FrustumCuller::BlockSize;
+    static const uint32_t RebuildFrames = 16;
+    static const float DefaultThreshold;
+
+    // Layout of StructuredBuffer<Impostor> in ParticleDraw.hlsl.
+    struct Impostor
+    {
+        DirectX::XMFLOAT3 position;
+        float speed;
+        float weight;
+    };
+
+    LevelOfDetail();
+
+    // Cells smaller than 'pixels' on screen are drawn as impostors. A threshold of 0 or less turns the
+    // level of detail off and keeps the previous threshold for SetEnabled(true). It is off to begin with,
+    // at DefaultThreshold.
+    void SetThreshold(float pixels);
+    float GetThreshold() const      { return m_threshold; }
+
+    void SetEnabled(bool enabled)   { m_bEnabled = enabled; }
+    bool IsEnabled() const          { return m_bEnabled; }
+
+    // Drop the grid, for a new set of particles.
+    void Reset();
+
+    // The camera position, and its pixels per world unit at unit distance: the projection's y scale
+    // times half the image height.
+    void SetCamera(const DirectX::XMFLOAT3& position, float pixelScale);
+
+    // Write the records of the near particles in view to pRecords (room for particleCount) and the
+    // impostors of the far cells in view to pImpostors (room for MaxImpostors), and their counts to
+    // *pRecordCount and *pImpostorCount. With no culler nothing is culled.
+    void Build(const ispc::Particle* pParticles, uint32_t particleCount, int threads, const FrustumCuller* pCuller,
+               ispc::RenderRecord* pRecords, uint32_t* pRecordCount, Impostor* pImpostors, uint32_t* pImpostorCount);
+
+private:
+    void Rebuild(const ispc::Particle* pParticles, uint32_t particleCount, int threads);
+    void FitGrid(const float* pBounds);
+
+    float m_threshold;
+    bool m_bEnabled;
+
+    DirectX::XMFLOAT3 m_cameraPosition;
+    float m_pixelScale;
+
+    bool m_bHasGrid;
+    uint32_t m_particleCount;
+    uint32_t m_framesSinceRebuild;
+    DirectX::XMFLOAT3 m_gridOrigin;
+    float m_cellSize;
+
+    FrustumCuller m_noCulling;
+
+    std::vector<uint32_t> m_threadCounts;           // MaxImpostors per thread, kept across rebuilds.
+    std::vector<float> m_threadBounds;              // Min x, y, z then max x, y, z per thread.
+    std::vector<uint32_t> m_cellStarts;             // MaxImpostors + 1 offsets into m_sortedParticles.
+    std::vector<uint32_t> m_sortedParticles;        // Particle indices by cell.
+    std::vector<ispc::LodCell> m_cellSums;          // Impostor sums of every cell at the last rebuild.
+    std::vector<uint32_t> m_nearCells;
+    std::vector<uint32_t> m_nearOffsets;            // Record offset of each near cell, then the total.
+    std::vector<uint32_t> m_nearParticles;          // Particles in the near cells before each, then the total.
+};
@@ -0,0 +1,175 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#include "stdafx.h"
+#include "MixedPrecision.h"
+#include "FastMultipole.h"
+#include "Profiler.h"
+#include "PerfCounters.h"
+#include <algorithm>
+#include <float.h>
+
+// Concurrency
+#include <ppl.h>
+
+MixedPrecision::MixedPrecision() :
+    m_particleCount(0),
+    m_readIndex(0)
+{
+}
+
+void MixedPrecision::Load(const ispc::Particle* pParticles, uint32_t particleCount, int threads)
+{
+    m_particleCount = particleCount;
+    m_readIndex = 0;
+
+    m_positions[0].resize(static_cast<size_t>(particleCount) * 3);
+    m_positions[1].resize(static_cast<size_t>(particleCount) * 3);
+    m_velocities.resize(static_cast<size_t>(particleCount) * 3);
+    m_positionW.resize(particleCount);
+    m_tileOrigins.resize(static_cast<size_t>((particleCount + TileSize - 1) / TileSize) * 3);
+    m_tileOffsets.resize(particleCount);
+    m_keys.resize(particleCount);
+    m_tileOrder.resize(particleCount);
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        uint32_t start = static_cast<uint32_t>((static_cast<uint64_t>(particleCount) * thread) / threads);
+        uint32_t end = static_cast<uint32_t>((static_cast<uint64_t>(particleCount) * (thread + 1)) / threads);
+
+        ispc::MixedLoadParticles(pParticles, start, end - start, particleCount, &m_positions[0][0], &m_velocities[0], &m_positionW[0]);
+    });
+}
+
+void MixedPrecision::Step(ispc::Particle* pRenderParticles, int threads)
+{
+    const uint32_t particleCount = m_particleCount;
+    const uint32_t tileCount = (particleCount + TileSize - 1) / TileSize;
+
+    const double* pRead = &m_positions[m_readIndex][0];
+    double* pWrite = &m_positions[1 - m_readIndex][0];
+
+    SortTiles(pRead, threads);
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        PROFILE_SCOPE("Mixed precision tiles worker");
+
+        uint32_t tileStart = (tileCount * thread) / threads;
+        uint32_t tileEnd = (tileCount * (thread + 1)) / threads;
+
+        ispc::MixedPrepareTiles(pRead, &m_tileOrder[0], particleCount, TileSize, tileStart, tileEnd, &m_tileOrigins[0], &m_tileOffsets[0]);
+    });
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        PROFILE_SCOPE("Mixed precision worker");
+
+        uint32_t start = static_cast<uint32_t>((static_cast<uint64_t>(particleCount) * thread) / threads);
+        uint32_t end = static_cast<uint32_t>((static_cast<uint64_t>(particleCount) * (thread + 1)) / threads);
+
+        PerfCounterScope counters;
+        ispc::ProcessParticlesMixed(start, end - start, particleCount, TileSize, pRead, pWrite, &m_velocities[0],
+            &m_tileOrigins[0], &m_tileOffsets[0], &m_positionW[0], pRenderParticles);
+    });
+
+    m_readIndex = 1 - m_readIndex;
+}
+
+//
+// Order the particles along a Morton curve through the cube that bounds them, for MixedPrepareTiles() to
+// cut into tiles. The keys are ordered by particle index when equal, so the order is the same for any
+// thread count.
+//
+void MixedPrecision::SortTiles(const double* pPositions, int threads)
+{
+    PROFILE_SCOPE("Mixed precision sort");
+
+    const uint32_t particleCount = m_particleCount;
+    const double* pAxes[3] = { pPositions, pPositions + particleCount, pPositions + 2 * static_cast<size_t>(particleCount) };
+
+    m_bounds.resize(static_cast<size_t>(threads) * 6);
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        uint32_t start = static_cast<uint32_t>((static_cast<uint64_t>(particleCount) * thread) / threads);
+        uint32_t end = static_cast<uint32_t>((static_cast<uint64_t>(particleCount) * (thread + 1)) / threads);
+
+        double* pBounds = &m_bounds[static_cast<size_t>(thread) * 6];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            pBounds[axis] = DBL_MAX;
+            pBounds[3 + axis] = -DBL_MAX;
+            for (uint32_t ii = start; ii < end; ii++)
+            {
+                pBounds[axis] = std::min(pBounds[axis], pAxes[axis][ii]);
+                pBounds[3 + axis] = std::max(pBounds[3 + axis], pAxes[axis][ii]);
+            }
+        }
+    });
+
+    double boxMin[3] = { DBL_MAX, DBL_MAX, DBL_MAX };
+    double boxMax[3] = { -DBL_MAX, -DBL_MAX, -DBL_MAX };
+    for (int thread = 0; thread < threads; thread++)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            boxMin[axis] = std::min(boxMin[axis], m_bounds[thread * 6 + axis]);
+            boxMax[axis] = std::max(boxMax[axis], m_bounds[thread * 6 + 3 + axis]);
+        }
+    }
+    double boxSize = 0.0;
+    for (int axis = 0; axis < 3; axis++)
+        boxSize = std::max(boxSize, boxMax[axis] - boxMin[axis]);
+
+    const double cellsPerUnit = (boxSize > 0.0) ? static_cast<double>(1 << FastMultipole::MortonAxisBits) / boxSize : 0.0;
+    const double maxCell = static_cast<double>((1 << FastMultipole::MortonAxisBits) - 1);
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        uint32_t start = static_cast<uint32_t>((static_cast<uint64_t>(particleCount) * thread) / threads);
+        uint32_t end = static_cast<uint32_t>((static_cast<uint64_t>(particleCount) * (thread + 1)) / threads);
+
+        for (uint32_t ii = start; ii < end; ii++)
+        {
+            uint64_t x = static_cast<uint64_t>(std::min((pAxes[0][ii] - boxMin[0]) * cellsPerUnit, maxCell));
+            uint64_t y = static_cast<uint64_t>(std::min((pAxes[1][ii] - boxMin[1]) * cellsPerUnit, maxCell));
+            uint64_t z = static_cast<uint64_t>(std::min((pAxes[2][ii] - boxMin[2]) * cellsPerUnit, maxCell));
+
+            m_keys[ii] = std::make_pair(FastMultipole::GetMortonKey(x, y, z), ii);
+        }
+    });
+
+    concurrency::parallel_sort(m_keys.begin(), m_keys.end());
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        uint32_t start = static_cast<uint32_t>((static_cast<uint64_t>(particleCount) * thread) / threads);
+        uint32_t end = static_cast<uint32_t>((static_cast<uint64_t>(particleCount) * (thread + 1)) / threads);
+
+        for (uint32_t ii = start; ii < end; ii++)
+            m_tileOrder[ii] = m_keys[ii].second;
+    });
+}
@@ -0,0 +1,75 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#pragma once
+
+// Add the auto generated ISPC kernel header
+#include "nBodyGravityMixed_ispc.h"
+
+//
+// Direct sum solver that keeps the particle state in double precision.
+//
+// The pair interactions run in float SIMD against per-tile float offsets (see nBodyGravityMixed.ispc),
+// while positions, velocities and the per-particle acceleration totals are double. This removes the
+// drift of long runs that comes from accumulating thousands of float contributions into a float total
+// and from float positions far from the origin, at the cost of one double subtraction per particle
+// and tile. Every step the tiles are cut from the particles in Morton order (FastMultipole's keys over
+// the bounding cube), so a tile's particles are close together and the float offsets from its origin
+// stay small; the state itself stays in particle order.
+//
+// The float particle buffers are only written for rendering; the double state is the simulation.
+//
+class MixedPrecision
+{
+public:
+    static const uint32_t TileSize = 64;
+
+    MixedPrecision();
+
+    // Take the initial state from the float particles.
+    void Load(const ispc::Particle* pParticles, uint32_t particleCount, int threads);
+
+    // Advance one time step and write the result to pRenderParticles.
+    void Step(ispc::Particle* pRenderParticles, int threads);
+
+    uint32_t GetParticleCount() const   { return m_particleCount; }
+
+private:
+    uint32_t m_particleCount;
+    uint32_t m_readIndex;
+
+    std::vector<double> m_positions[2];     // Double buffered, SoA.
+    std::vector<double> m_velocities;       // Updated in place, SoA.
+    std::vector<float> m_positionW;         // Passed through to the render particles.
+    std::vector<double> m_tileOrigins;
+    std::vector<ispc::Vec4> m_tileOffsets;  // In tile order.
+
+    std::vector<std::pair<uint64_t, uint32_t>> m_keys;     // Morton key and particle index.
+    std::vector<uint32_t> m_tileOrder;                      // Particle index of each tile slot.
+    std::vector<double> m_bounds;                           // Per thread, minimum then maximum.
+
+    void SortTiles(const double* pPositions, int threads);
+};
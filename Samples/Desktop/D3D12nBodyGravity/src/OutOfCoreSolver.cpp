@@ -0,0 +1,385 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#include "stdafx.h"
+#include "OutOfCoreSolver.h"
+#include "RingSolver.h"
+#include "Profiler.h"
+#include <chrono>
+#include <cstring>
+
+// Concurrency
+#include <ppl.h>
+
+// Ask the memory manager to start reading a range of a mapped file.
+static void Prefetch(const void* pData, size_t size)
+{
+    if (size == 0)
+        return;
+
+    WIN32_MEMORY_RANGE_ENTRY range = { const_cast<void*>(pData), size };
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+}
+
+OutOfCoreSolver::OutOfCoreSolver() :
+    m_particleCount(0),
+    m_blockSize(DefaultBlockSize),
+    m_tileSize(DefaultTileSize),
+    m_current(0),
+    m_bPositionsCurrent(false),
+    m_bIoStopping(false),
+    m_statistics()
+{
+    for (MappedFile* pFile : { &m_state[0], &m_state[1], &m_positions[0], &m_positions[1] })
+    {
+        pFile->file = INVALID_HANDLE_VALUE;
+        pFile->mapping = nullptr;
+        pFile->pView = nullptr;
+        pFile->size = 0;
+    }
+}
+
+OutOfCoreSolver::~OutOfCoreSolver()
+{
+    Close();
+}
+
+bool OutOfCoreSolver::Map(MappedFile* pFile, const std::wstring& path, uint64_t size)
+{
+    pFile->path = path;
+    pFile->size = size;
+
+    CREATEFILE2_EXTENDED_PARAMETERS extendedParams = {};
+    extendedParams.dwSize = sizeof(CREATEFILE2_EXTENDED_PARAMETERS);
+    extendedParams.dwFileAttributes = FILE_ATTRIBUTE_NORMAL;
+    extendedParams.dwFileFlags = FILE_FLAG_SEQUENTIAL_SCAN;
+    extendedParams.dwSecurityQosFlags = SECURITY_ANONYMOUS;
+
+    pFile->file = CreateFile2(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, CREATE_ALWAYS, &extendedParams);
+    if (pFile->file == INVALID_HANDLE_VALUE)
+    {
+        m_error = path + L": cannot create the file";
+        return false;
+    }
+
+    // Mapping the file at its full size extends it.
+    pFile->mapping = CreateFileMappingW(pFile->file, nullptr, PAGE_READWRITE, static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), nullptr);
+    if (pFile->mapping)
+        pFile->pView = MapViewOfFile(pFile->mapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, 0);
+    if (!pFile->pView)
+    {
+        m_error = path + L": cannot map the file";
+        return false;
+    }
+    return true;
+}
+
+void OutOfCoreSolver::Unmap(MappedFile* pFile)
+{
+    if (pFile->pView)
+        UnmapViewOfFile(pFile->pView);
+    if (pFile->mapping)
+        CloseHandle(pFile->mapping);
+    if (pFile->file != INVALID_HANDLE_VALUE)
+        CloseHandle(pFile->file);
+
+    pFile->file = INVALID_HANDLE_VALUE;
+    pFile->mapping = nullptr;
+    pFile->pView = nullptr;
+    pFile->size = 0;
+}
+
+bool OutOfCoreSolver::Create(const wchar_t* pDirectory, uint32_t particleCount, uint32_t blockSize, uint32_t tileSize)
+{
+    Close();
+    m_error.clear();
+
+    m_particleCount = particleCount;
+    m_blockSize = (blockSize < particleCount) ? blockSize : particleCount;
+    m_tileSize = (tileSize < particleCount) ? tileSize : particleCount;
+    m_current = 0;
+    m_bPositionsCurrent = false;
+    m_statistics = Statistics();
+
+    std::wstring directory(pDirectory);
+    if (!directory.empty() && directory.back() != L'\\' && directory.back() != L'/')
+        directory += L'\\';
+
+    // The particle files are in the .bin layout of ParticleFile, so a run can continue from either.
+    for (uint32_t ii = 0; ii < 2; ii++)
+    {
+        const std::wstring index = std::to_wstring(ii);
+        if (!Map(&m_state[ii], directory + L"nBodyGravityState" + index + L".bin", static_cast<uint64_t>(particleCount) * sizeof(ispc::Particle)) ||
+            !Map(&m_positions[ii], directory + L"nBodyGravityPositions" + index + L".bin", static_cast<uint64_t>(particleCount) * sizeof(ispc::Vec4)))
+        {
+            Close();
+            return false;
+        }
+    }
+
+    m_blocks[0].resize(m_blockSize);
+    m_blocks[1].resize(m_blockSize);
+    m_accelerations.resize(m_blockSize);
+    m_tiles[0].resize(m_tileSize);
+    m_tiles[1].resize(m_tileSize);
+
+    m_bIoStopping = false;
+    m_ioThread = std::thread(&OutOfCoreSolver::RunIoThread, this);
+    return true;
+}
+
+void OutOfCoreSolver::Close(bool bDeleteFiles)
+{
+    if (m_ioThread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_ioMutex);
+            m_bIoStopping = true;
+        }
+        m_ioWake.notify_one();
+        m_ioThread.join();
+    }
+
+    for (MappedFile* pFile : { &m_state[0], &m_state[1], &m_positions[0], &m_positions[1] })
+    {
+        const bool mapped = pFile->file != INVALID_HANDLE_VALUE;
+        Unmap(pFile);
+        if (bDeleteFiles && mapped)
+            DeleteFileW(pFile->path.c_str());
+    }
+
+    m_blocks[0].clear();
+    m_blocks[1].clear();
+    m_accelerations.clear();
+    m_tiles[0].clear();
+    m_tiles[1].clear();
+}
+
+std::future<void> OutOfCoreSolver::Post(std::function<void()> job)
+{
+    // The job times itself, so its time is counted before anyone waiting for it wakes up. Only the I/O
+    // thread writes ioSeconds while a step runs.
+    std::packaged_task<void()> task([this, job]()
+    {
+        auto begin = std::chrono::high_resolution_clock::now();
+        job();
+        m_statistics.ioSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count();
+    });
+    std::future<void> done = task.get_future();
+    {
+        std::lock_guard<std::mutex> lock(m_ioMutex);
+        m_ioJobs.push_back(std::move(task));
+    }
+    m_ioWake.notify_one();
+    return done;
+}
+
+void OutOfCoreSolver::RunIoThread()
+{
+    for (;;)
+    {
+        std::packaged_task<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_ioMutex);
+            m_ioWake.wait(lock, [this]() { return m_bIoStopping || !m_ioJobs.empty(); });
+            if (m_ioJobs.empty())
+                return;
+            task = std::move(m_ioJobs.front());
+            m_ioJobs.pop_front();
+        }
+
+        task();
+    }
+}
+
+//
+// The positions of freshly written initial conditions, read straight from the mapped particles.
+//
+void OutOfCoreSolver::GatherPositions(int threads)
+{
+    PROFILE_SCOPE("Out of core gather positions");
+
+    const ispc::Particle* pParticles = static_cast<const ispc::Particle*>(m_state[m_current].pView);
+    ispc::Vec4* pPositions = static_cast<ispc::Vec4*>(m_positions[m_current].pView);
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        uint32_t start, end;
+        RingSolver::GetSlice(m_particleCount, thread, threads, &start, &end);
+        if (start < end)
+            ispc::RingGatherPositions(pParticles, start, end, pPositions + start);
+    });
+
+    m_statistics.bytesRead += static_cast<uint64_t>(m_particleCount) * sizeof(ispc::Particle);
+    m_statistics.bytesWritten += static_cast<uint64_t>(m_particleCount) * sizeof(ispc::Vec4);
+    m_bPositionsCurrent = true;
+}
+
+bool OutOfCoreSolver::Step(int threads)
+{
+    PROFILE_SCOPE("Out of core step");
+
+    if (!m_ioThread.joinable())
+        return false;
+
+    if (!m_bPositionsCurrent)
+        GatherPositions(threads);
+
+    const uint32_t read = m_current;
+    const uint32_t write = 1 - m_current;
+    const ispc::Particle* pReadParticles = static_cast<const ispc::Particle*>(m_state[read].pView);
+    const ispc::Vec4* pReadPositions = static_cast<const ispc::Vec4*>(m_positions[read].pView);
+    ispc::Particle* pWriteParticles = static_cast<ispc::Particle*>(m_state[write].pView);
+    ispc::Vec4* pWritePositions = static_cast<ispc::Vec4*>(m_positions[write].pView);
+
+    const uint32_t blocks = (m_particleCount + m_blockSize - 1) / m_blockSize;
+    const uint32_t tiles = (m_particleCount + m_tileSize - 1) / m_tileSize;
+
+    auto getCount = [this](uint32_t start, uint32_t size) { return (m_particleCount - start < size) ? m_particleCount - start : size; };
+
+    // Every block's particles into m_blocks[block % 2].
+    auto readBlock = [&](uint32_t block)
+    {
+        return Post([=]()
+        {
+            const uint32_t start = block * m_blockSize;
+            const uint32_t count = getCount(start, m_blockSize);
+            Prefetch(pReadParticles + start, count * sizeof(ispc::Particle));
+            memcpy(&m_blocks[block % 2][0], pReadParticles + start, count * sizeof(ispc::Particle));
+            m_statistics.bytesRead += count * sizeof(ispc::Particle);
+        });
+    };
+
+    // The tiles in order, block after block, into m_tiles[sequence % 2], the next one prefetched.
+    auto readTile = [&](uint64_t sequence)
+    {
+        return Post([=]()
+        {
+            const uint32_t start = static_cast<uint32_t>(sequence % tiles) * m_tileSize;
+            const uint32_t next = static_cast<uint32_t>((sequence + 1) % tiles) * m_tileSize;
+            Prefetch(pReadPositions + next, getCount(next, m_tileSize) * sizeof(ispc::Vec4));
+
+            const uint32_t count = getCount(start, m_tileSize);
+            memcpy(&m_tiles[sequence % 2][0], pReadPositions + start, count * sizeof(ispc::Vec4));
+            m_statistics.bytesRead += count * sizeof(ispc::Vec4);
+        });
+    };
+
+    // Write a finished block back and start its pages on their way to the disk.
+    auto writeBlock = [&](uint32_t block)
+    {
+        return Post([=]()
+        {
+            const uint32_t start = block * m_blockSize;
+            const uint32_t count = getCount(start, m_blockSize);
+            const ispc::Particle* pBlock = &m_blocks[block % 2][0];
+            memcpy(pWriteParticles + start, pBlock, count * sizeof(ispc::Particle));
+            ispc::RingGatherPositions(pBlock, 0, count, pWritePositions + start);
+            FlushViewOfFile(pWriteParticles + start, count * sizeof(ispc::Particle));
+            FlushViewOfFile(pWritePositions + start, count * sizeof(ispc::Vec4));
+            m_statistics.bytesWritten += count * (sizeof(ispc::Particle) + sizeof(ispc::Vec4));
+        });
+    };
+
+    auto wait = [this](std::future<void>& done)
+    {
+        auto begin = std::chrono::high_resolution_clock::now();
+        done.get();
+        m_statistics.stallSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count();
+    };
+
+    std::vector<std::future<void>> writes;
+    std::future<void> blockReady = readBlock(0);
+    std::future<void> tileReady = readTile(0);
+    uint64_t sequence = 0;
+
+    for (uint32_t block = 0; block < blocks; block++)
+    {
+        const uint32_t blockStart = block * m_blockSize;
+        const uint32_t blockCount = getCount(blockStart, m_blockSize);
+        ispc::Particle* pBlock = &m_blocks[block % 2][0];
+
+        wait(blockReady);
+        const ispc::Vec3 zero = {};
+        std::fill(m_accelerations.begin(), m_accelerations.begin() + blockCount, zero);
+
+        std::future<void> nextBlock;
+        for (uint32_t tile = 0; tile < tiles; tile++, sequence++)
+        {
+            // Queue the next tile before waiting for this one. The next block's particles go in just
+            // before its first tile, after the write of the block whose buffer they reuse.
+            std::future<void> nextTile;
+            if (tile + 1 < tiles)
+            {
+                nextTile = readTile(sequence + 1);
+            }
+            else if (block + 1 < blocks)
+            {
+                nextBlock = readBlock(block + 1);
+                nextTile = readTile(sequence + 1);
+            }
+
+            wait(tileReady);
+
+            auto computeBegin = std::chrono::high_resolution_clock::now();
+            {
+                PROFILE_SCOPE("Out of core accumulate");
+
+                const ispc::Vec4* pSources = &m_tiles[sequence % 2][0];
+                const uint32_t sourceCount = getCount(tile * m_tileSize, m_tileSize);
+                concurrency::parallel_for<int>(0, threads, [&](int thread)
+                {
+                    uint32_t start, end;
+                    RingSolver::GetSlice(blockCount, thread, threads, &start, &end);
+                    if (start < end)
+                        ispc::RingAccumulate(pBlock, start, end, pSources, sourceCount, &m_accelerations[start]);
+                });
+            }
+            m_statistics.computeSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - computeBegin).count();
+
+            tileReady = std::move(nextTile);
+        }
+
+        auto integrateBegin = std::chrono::high_resolution_clock::now();
+        concurrency::parallel_for<int>(0, threads, [&](int thread)
+        {
+            uint32_t start, end;
+            RingSolver::GetSlice(blockCount, thread, threads, &start, &end);
+            if (start < end)
+                ispc::RingIntegrate(pBlock, start, end, &m_accelerations[start]);
+        });
+        m_statistics.computeSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - integrateBegin).count();
+
+        writes.push_back(writeBlock(block));
+        blockReady = std::move(nextBlock);
+    }
+
+    for (std::future<void>& done : writes)
+        wait(done);
+
+    m_current = write;
+    m_statistics.steps++;
+    return true;
+}
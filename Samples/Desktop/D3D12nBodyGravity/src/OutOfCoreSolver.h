@@ -0,0 +1,133 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Add the auto generated ISPC kernel header
+#include "nBodyGravityRing_ispc.h"
+
+//
+// Direct sum over more particles than fit in memory.
+//
+// The state lives in memory mapped files in a working directory, two of particles and two of positions
+// only, one of each read and the other written every step, like the particle buffers of the in memory
+// paths. A step walks the particles in i-blocks of 'blockSize' that stay in memory, and for each one
+// streams every position past it in j-tiles of 'tileSize', adding their pull with the ring kernels
+// (nBodyGravityRing.ispc). Finished blocks are integrated and written back in order.
+//
+// All file access happens on a dedicated I/O thread that runs the reads and writes the step posts, in
+// the order posted. It prefetches the tile after the one it copies (PrefetchVirtualMemory, the Windows
+// madvise(MADV_WILLNEED)) and the step double buffers both tiles and blocks, so the disk works on the
+// next tile while the kernel runs on the current one and the kernel only stalls when the disk is slower.
+//
+// Each step reads the particles once and the positions once per i-block, and writes both once: the
+// bandwidth the disk needs to keep up is those bytes over the kernel time, which GetStatistics() allows
+// comparing with what the I/O thread achieved.
+//
+class OutOfCoreSolver
+{
+public:
+    static const uint32_t DefaultBlockSize = 4 * 1024 * 1024;
+    static const uint32_t DefaultTileSize = 1024 * 1024;
+
+    struct Statistics
+    {
+        uint32_t steps;
+        double computeSeconds;          // In the kernels.
+        double stallSeconds;            // The kernels waiting for the I/O thread.
+        double ioSeconds;               // The I/O thread busy.
+        uint64_t bytesRead;
+        uint64_t bytesWritten;
+    };
+
+    OutOfCoreSolver();
+    ~OutOfCoreSolver();
+
+    // Create the state files for 'particleCount' particles in pDirectory, replacing any from an earlier
+    // run. On failure the reason is available from GetError().
+    bool Create(const wchar_t* pDirectory, uint32_t particleCount, uint32_t blockSize, uint32_t tileSize);
+
+    // Unmap the state, and with bDeleteFiles remove its files as well.
+    void Close(bool bDeleteFiles = false);
+
+    // The current state, mapped. Write the initial conditions here before the first Step().
+    ispc::Particle* GetParticles()              { return static_cast<ispc::Particle*>(m_state[m_current].pView); }
+    const std::wstring& GetStatePath() const    { return m_state[m_current].path; }
+
+    bool Step(int threads);
+
+    uint32_t GetParticleCount() const           { return m_particleCount; }
+    const Statistics& GetStatistics() const     { return m_statistics; }
+    const std::wstring& GetError() const        { return m_error; }
+
+private:
+    struct MappedFile
+    {
+        std::wstring path;
+        HANDLE file;
+        HANDLE mapping;
+        void* pView;
+        uint64_t size;
+    };
+
+    bool Map(MappedFile* pFile, const std::wstring& path, uint64_t size);
+    static void Unmap(MappedFile* pFile);
+
+    // Queue a job for the I/O thread; the future is ready once it has run.
+    std::future<void> Post(std::function<void()> job);
+    void RunIoThread();
+
+    void GatherPositions(int threads);
+
+    uint32_t m_particleCount;
+    uint32_t m_blockSize;
+    uint32_t m_tileSize;
+    MappedFile m_state[2];
+    MappedFile m_positions[2];
+    uint32_t m_current;
+    bool m_bPositionsCurrent;                   // Whether m_positions[m_current] holds the current positions.
+
+    std::vector<ispc::Particle> m_blocks[2];
+    std::vector<ispc::Vec3> m_accelerations;
+    std::vector<ispc::Vec4> m_tiles[2];
+
+    std::thread m_ioThread;
+    std::mutex m_ioMutex;
+    std::condition_variable m_ioWake;
+    std::deque<std::packaged_task<void()>> m_ioJobs;
+    bool m_bIoStopping;
+
+    Statistics m_statistics;
+    std::wstring m_error;
+};
@@ -42,6 +42,19 @@ struct PosVelo
 
 StructuredBuffer<PosVelo> g_bufPosVelo;
 
+// Packed render records of the CPU paths: half float x, y, z and speed (velo.w), low half first.
+StructuredBuffer<uint2> g_bufRenderRecords;
+
+// Level of detail impostors: the far particles of a grid cell, drawn at their mean position.
+struct Impostor
+{
+	float3 pos;
+	float speed;
+	float weight;		// Number of particles merged.
+};
+
+StructuredBuffer<Impostor> g_bufImpostors;
+
 cbuffer cb0
 {
 	row_major float4x4 g_mWorldViewProj;
@@ -87,6 +100,37 @@ VSParticleDrawOut VSParticleDraw(VSParticleIn input)
 	return output;
 }
 
+//
+// The same from the packed render records.
+//
+VSParticleDrawOut VSParticleDrawPacked(VSParticleIn input)
+{
+	VSParticleDrawOut output;
+
+	uint2 record = g_bufRenderRecords[input.id];
+	output.pos = float3(f16tof32(record.x), f16tof32(record.x >> 16), f16tof32(record.y));
+
+	float mag = f16tof32(record.y >> 16) / 9;
+	output.color = lerp(float4(1.0f, 0.1f, 0.1f, 1.0f), input.color, mag);
+
+	return output;
+}
+
+VSParticleDrawOut VSImpostorDraw(VSParticleIn input)
+{
+	VSParticleDrawOut output;
+
+	Impostor impostor = g_bufImpostors[input.id];
+	output.pos = impostor.pos;
+
+	// As bright as the particles it stands for, which the additive blend would have summed.
+	float mag = impostor.speed / 9;
+	output.color = lerp(float4(1.0f, 0.1f, 0.1f, 1.0f), input.color, mag);
+	output.color.xyz *= impostor.weight;
+
+	return output;
+}
+
 //
 // GS for rendering point sprite particles.  Takes a point and turns 
 // it into 2 triangles.
@@ -0,0 +1,440 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+#include "stdafx.h"
+#include "ParticleFile.h"
+#include "Profiler.h"
+
+// Concurrency
+#include <ppl.h>
+
+// position.w and velocity.w of particles read from text, which only gives the position and velocity.
+static const float PositionW = 10000.0f * 10000.0f;
+static const float VelocityW = 1.0f / 100000000.0f;
+
+static const uint64_t NoError = ~0ull;
+
+// Position, velocity and the optional position.w.
+static const int MaxColumns = 7;
+
+// Particles per work item of the binary copy.
+static const uint32_t CopyBlockSize = 65536;
+
+static const double PowersOfTen[] =
+{
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline bool IsSeparator(char c)
+{
+    return c == ',' || c == ';' || c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline bool IsDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+//
+// Parse a decimal number such as -12.5e-3 starting at p. Returns the position after it, or nullptr if
+// there are no digits. Up to 19 significant digits are accumulated in an integer and scaled once by a
+// power of ten, which is exact up to 10^22, so the usual 9 digit float output round trips.
+//
+static const char* ParseFloat(const char* p, const char* end, float* pValue)
+{
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = (*p == '-');
+        p++;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool anyDigits = false;
+
+    for (; p < end && IsDigit(*p); p++)
+    {
+        anyDigits = true;
+        if (digits < 19)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa != 0)
+                digits++;
+        }
+        else
+        {
+            exponent++;
+        }
+    }
+
+    if (p < end && *p == '.')
+    {
+        for (p++; p < end && IsDigit(*p); p++)
+        {
+            anyDigits = true;
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa != 0)
+                    digits++;
+                exponent--;
+            }
+        }
+    }
+
+    if (!anyDigits)
+        return nullptr;
+
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char* pExponent = p + 1;
+        bool negativeExponent = false;
+        if (pExponent < end && (*pExponent == '-' || *pExponent == '+'))
+        {
+            negativeExponent = (*pExponent == '-');
+            pExponent++;
+        }
+
+        if (pExponent < end && IsDigit(*pExponent))
+        {
+            int value = 0;
+            for (; pExponent < end && IsDigit(*pExponent); pExponent++)
+            {
+                if (value < 10000)
+                    value = value * 10 + (*pExponent - '0');
+            }
+            exponent += negativeExponent ? -value : value;
+            p = pExponent;
+        }
+    }
+
+    double value = static_cast<double>(mantissa);
+    if (mantissa != 0 && exponent != 0)
+    {
+        if (exponent > 0 && exponent <= 22)
+            value *= PowersOfTen[exponent];
+        else if (exponent < 0 && exponent >= -22)
+            value /= PowersOfTen[-exponent];
+        else
+            value *= pow(10.0, exponent);
+    }
+
+    *pValue = static_cast<float>(negative ? -value : value);
+    return p;
+}
+
+//
+// Rows without particle data: empty, whitespace, '#' comments and the column header of the first row.
+//
+static bool IsParticleRow(const char* p, const char* pRowEnd, bool firstRow)
+{
+    while (p < pRowEnd && IsSeparator(*p))
+        p++;
+
+    if (p == pRowEnd || *p == '#')
+        return false;
+
+    if (firstRow && !(IsDigit(*p) || *p == '-' || *p == '+' || *p == '.'))
+        return false;
+
+    return true;
+}
+
+static inline const char* FindRowEnd(const char* p, const char* end)
+{
+    const char* pNewline = static_cast<const char*>(memchr(p, '\n', end - p));
+    return pNewline ? pNewline : end;
+}
+
+static inline const char* NextRow(const char* pRowEnd, const char* end)
+{
+    return (pRowEnd < end) ? pRowEnd + 1 : end;
+}
+
+ParticleFile::ParticleFile() :
+    m_file(INVALID_HANDLE_VALUE),
+    m_mapping(nullptr),
+    m_pData(nullptr),
+    m_size(0),
+    m_bBinary(false),
+    m_particleCount(0)
+{
+}
+
+ParticleFile::~ParticleFile()
+{
+    Close();
+}
+
+void ParticleFile::Close()
+{
+    if (m_pData)
+        UnmapViewOfFile(m_pData);
+    if (m_mapping)
+        CloseHandle(m_mapping);
+    if (m_file != INVALID_HANDLE_VALUE)
+        CloseHandle(m_file);
+
+    m_file = INVALID_HANDLE_VALUE;
+    m_mapping = nullptr;
+    m_pData = nullptr;
+    m_size = 0;
+    m_particleCount = 0;
+    m_chunks.clear();
+}
+
+bool ParticleFile::Open(const wchar_t* pPath, int threads)
+{
+    PROFILE_SCOPE("Particle file open");
+
+    Close();
+    m_error.clear();
+
+    CREATEFILE2_EXTENDED_PARAMETERS extendedParams = {};
+    extendedParams.dwSize = sizeof(CREATEFILE2_EXTENDED_PARAMETERS);
+    extendedParams.dwFileAttributes = FILE_ATTRIBUTE_NORMAL;
+    extendedParams.dwFileFlags = FILE_FLAG_SEQUENTIAL_SCAN;
+    extendedParams.dwSecurityQosFlags = SECURITY_ANONYMOUS;
+
+    m_file = CreateFile2(pPath, GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, &extendedParams);
+    if (m_file == INVALID_HANDLE_VALUE)
+    {
+        m_error = L"cannot open the file";
+        return false;
+    }
+
+    LARGE_INTEGER size = {};
+    if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+    {
+        m_error = L"the file is empty";
+        Close();
+        return false;
+    }
+    m_size = static_cast<uint64_t>(size.QuadPart);
+
+    m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_mapping)
+        m_pData = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!m_pData)
+    {
+        m_error = L"cannot map the file";
+        Close();
+        return false;
+    }
+
+    const wchar_t* pExtension = wcsrchr(pPath, L'.');
+    m_bBinary = pExtension && _wcsicmp(pExtension, L".bin") == 0;
+
+    if (m_bBinary)
+    {
+        if (m_size % sizeof(ispc::Particle) != 0)
+        {
+            m_error = L"the binary file size is not a multiple of the particle size";
+            Close();
+            return false;
+        }
+        m_particleCount = m_size / sizeof(ispc::Particle);
+        return true;
+    }
+
+    return CountTextParticles(threads);
+}
+
+//
+// Split the text at row boundaries and count the particle rows of every chunk.
+//
+bool ParticleFile::CountTextParticles(int threads)
+{
+    const char* pEnd = m_pData + m_size;
+    const uint64_t chunkCount = (m_size + ChunkSize - 1) / ChunkSize;
+
+    m_chunks.resize(static_cast<size_t>(chunkCount));
+    for (uint64_t chunk = 0; chunk < chunkCount; chunk++)
+    {
+        uint64_t begin = 0;
+        if (chunk > 0)
+        {
+            // Start after the first newline at or after the nominal start.
+            const char* pRowEnd = FindRowEnd(m_pData + chunk * ChunkSize - 1, pEnd);
+            begin = (pRowEnd < pEnd) ? static_cast<uint64_t>(pRowEnd + 1 - m_pData) : m_size;
+            m_chunks[chunk - 1].end = begin;
+        }
+        m_chunks[chunk].begin = begin;
+        m_chunks[chunk].end = m_size;
+        m_chunks[chunk].errorRow = NoError;
+    }
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        const uint64_t chunkStart = (chunkCount * thread) / threads;
+        const uint64_t chunkEnd = (chunkCount * (thread + 1)) / threads;
+
+        PROFILE_SCOPE("Particle file count worker");
+
+        for (uint64_t chunk = chunkStart; chunk < chunkEnd; chunk++)
+        {
+            Chunk& c = m_chunks[static_cast<size_t>(chunk)];
+            const char* p = m_pData + c.begin;
+            const char* pChunkEnd = m_pData + c.end;
+            uint64_t count = 0;
+
+            while (p < pChunkEnd)
+            {
+                const char* pRowEnd = FindRowEnd(p, pChunkEnd);
+                if (IsParticleRow(p, pRowEnd, p == m_pData))
+                    count++;
+                p = NextRow(pRowEnd, pChunkEnd);
+            }
+
+            c.particleCount = count;
+        }
+    });
+
+    m_particleCount = 0;
+    for (Chunk& c : m_chunks)
+    {
+        c.firstParticle = m_particleCount;
+        m_particleCount += c.particleCount;
+    }
+
+    if (m_particleCount == 0)
+    {
+        m_error = L"the file has no particle rows";
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+bool ParticleFile::Load(ispc::Particle* pParticles, uint32_t particleCount, int threads)
+{
+    PROFILE_SCOPE("Particle file load");
+
+    m_error.clear();
+
+    if (!IsOpen() || particleCount > m_particleCount)
+    {
+        m_error = L"the file does not have enough particles";
+        return false;
+    }
+
+    if (m_bBinary)
+    {
+        const ispc::Particle* pSource = reinterpret_cast<const ispc::Particle*>(m_pData);
+        const uint32_t blockCount = (particleCount + CopyBlockSize - 1) / CopyBlockSize;
+
+        concurrency::parallel_for<int>(0, threads, [&](int thread)
+        {
+            uint32_t blockStart = (blockCount * thread) / threads;
+            uint32_t blockEnd = (blockCount * (thread + 1)) / threads;
+
+            uint32_t particleStart = blockStart * CopyBlockSize;
+            uint32_t particleEnd = (blockEnd * CopyBlockSize < particleCount) ? blockEnd * CopyBlockSize : particleCount;
+
+            if (particleStart < particleEnd)
+                memcpy(pParticles + particleStart, pSource + particleStart, (particleEnd - particleStart) * sizeof(ispc::Particle));
+        });
+        return true;
+    }
+
+    const uint64_t chunkCount = m_chunks.size();
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        const uint64_t chunkStart = (chunkCount * thread) / threads;
+        const uint64_t chunkEnd = (chunkCount * (thread + 1)) / threads;
+
+        PROFILE_SCOPE("Particle file parse worker");
+
+        for (uint64_t chunk = chunkStart; chunk < chunkEnd; chunk++)
+        {
+            Chunk& c = m_chunks[static_cast<size_t>(chunk)];
+            const char* p = m_pData + c.begin;
+            const char* pChunkEnd = m_pData + c.end;
+            uint64_t particle = c.firstParticle;
+
+            c.errorRow = NoError;
+
+            while (p < pChunkEnd && particle < particleCount)
+            {
+                const char* pRowEnd = FindRowEnd(p, pChunkEnd);
+                if (!IsParticleRow(p, pRowEnd, p == m_pData))
+                {
+                    p = NextRow(pRowEnd, pChunkEnd);
+                    continue;
+                }
+
+                float values[MaxColumns];
+                int valueCount = 0;
+                while (true)
+                {
+                    while (p < pRowEnd && IsSeparator(*p))
+                        p++;
+                    if (p == pRowEnd || valueCount == MaxColumns)
+                        break;
+
+                    p = ParseFloat(p, pRowEnd, &values[valueCount]);
+                    if (!p || (p < pRowEnd && !IsSeparator(*p)))
+                        break;
+                    valueCount++;
+                }
+
+                if (!p || p != pRowEnd || valueCount < 6)
+                {
+                    c.errorRow = particle - c.firstParticle;
+                    break;
+                }
+
+                ispc::Particle& out = pParticles[particle];
+                out.position.x = values[0];
+                out.position.y = values[1];
+                out.position.z = values[2];
+                out.position.w = (valueCount > 6) ? values[6] : PositionW;
+                out.velocity.x = values[3];
+                out.velocity.y = values[4];
+                out.velocity.z = values[5];
+                out.velocity.w = VelocityW;
+
+                particle++;
+                p = NextRow(pRowEnd, pChunkEnd);
+            }
+        }
+    });
+
+    for (const Chunk& c : m_chunks)
+    {
+        if (c.errorRow != NoError)
+        {
+            m_error = L"cannot parse particle " + std::to_wstring(c.firstParticle + c.errorRow);
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,84 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+#pragma once
+
+// Add the auto generated ISPC kernel header
+#include "nBodyGravityInit_ispc.h"
+
+//
+// Initial conditions read from a file, memory mapped and parsed on all threads straight into the
+// particle array.
+//
+// Two layouts are understood, chosen by the file extension:
+//   .bin   Raw particles, 8 little endian floats each: position x, y, z, w and velocity x, y, z, w.
+//   other  Text, one particle per row: x, y, z, vx, vy, vz and an optional position.w, separated by
+//          commas, semicolons, spaces or tabs. Empty rows and rows starting with '#' are skipped, and
+//          so is a first row that does not start with a number (a column header).
+//
+// Text is split into chunks of ChunkSize bytes at row boundaries. Open() counts the rows of every chunk
+// in parallel, which gives each chunk the index of its first particle, and Load() then parses the chunks
+// in parallel with a float parser that works directly on the mapped bytes.
+//
+class ParticleFile
+{
+public:
+    static const uint32_t ChunkSize = 4 * 1024 * 1024;
+
+    ParticleFile();
+    ~ParticleFile();
+
+    // Map the file and count its particles. On failure the reason is available from GetError().
+    bool Open(const wchar_t* pPath, int threads);
+    void Close();
+
+    bool IsOpen() const                         { return m_pData != nullptr; }
+    uint64_t GetParticleCount() const           { return m_particleCount; }
+    const std::wstring& GetError() const        { return m_error; }
+
+    // Fill pParticles with the first particleCount particles of the file.
+    bool Load(ispc::Particle* pParticles, uint32_t particleCount, int threads);
+
+private:
+    struct Chunk
+    {
+        uint64_t begin;                         // Byte offset of the first row.
+        uint64_t end;                           // Byte offset one past the last row.
+        uint64_t firstParticle;
+        uint64_t particleCount;
+        uint64_t errorRow;                      // Row in the chunk that failed to parse, or ~0.
+    };
+
+    bool CountTextParticles(int threads);
+
+    HANDLE m_file;
+    HANDLE m_mapping;
+    const char* m_pData;
+    uint64_t m_size;
+    bool m_bBinary;
+    uint64_t m_particleCount;
+    std::vector<Chunk> m_chunks;
+    std::wstring m_error;
+};
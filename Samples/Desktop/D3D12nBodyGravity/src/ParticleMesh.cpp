@@ -0,0 +1,233 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#include "stdafx.h"
+#include "ParticleMesh.h"
+#include "Profiler.h"
+
+// Concurrency
+#include <ppl.h>
+
+// G * m for a single particle, matching g_fParticleMass in the direct sum kernels.
+static const float ParticleMassG = 66.73f;
+
+ParticleMesh::ParticleMesh() :
+    m_gridSize(0),
+    m_boxSize(0.0f),
+    m_boxMin(0.0f)
+{
+}
+
+void ParticleMesh::Initialize(uint32_t gridSize, float boxSize)
+{
+    m_gridSize = gridSize;
+    m_boxSize = boxSize;
+    m_boxMin = -0.5f * boxSize;
+
+    m_fft.Initialize(gridSize);
+
+    m_density.resize(m_fft.GetRealCount());
+    m_spectrum.resize(m_fft.GetComplexCount());
+    m_forceX.resize(m_fft.GetRealCount());
+    m_forceY.resize(m_fft.GetRealCount());
+    m_forceZ.resize(m_fft.GetRealCount());
+    m_slabStart.resize(gridSize + 1);
+}
+
+//
+// Run one complete PM step: mass assignment, Poisson solve and particle update.
+//
+void ParticleMesh::Step(const ispc::Particle* pReadParticles, ispc::Particle* pWriteParticles, uint32_t particleCount, int threads)
+{
+    AssignMass(pReadParticles, particleCount, threads);
+    SolvePotential(threads);
+    SolveForces(threads);
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        PROFILE_SCOPE("PM interpolate worker");
+
+        uint32_t start = static_cast<uint32_t>((static_cast<uint64_t>(particleCount) * thread) / threads);
+        uint32_t end = static_cast<uint32_t>((static_cast<uint64_t>(particleCount) * (thread + 1)) / threads);
+
+        ispc::PMInterpolateAndIntegrate(pReadParticles, pWriteParticles, start, end - start,
+            &m_forceX[0], &m_forceY[0], &m_forceZ[0], m_boxMin, m_boxSize, m_gridSize);
+    });
+}
+
+//
+// The particles' potential energy in their own mesh potential. The particles are summed in fixed blocks,
+// and the blocks in order.
+//
+double ParticleMesh::ComputePotentialEnergy(const ispc::Particle* pParticles, uint32_t particleCount, int threads)
+{
+    PROFILE_SCOPE("PM potential energy");
+
+    AssignMass(pParticles, particleCount, threads);
+    SolvePotential(threads);
+
+    const uint32_t blockCount = (particleCount + EnergyBlockSize - 1) / EnergyBlockSize;
+    m_blockEnergy.resize(blockCount);
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        uint32_t blockStart = static_cast<uint32_t>((static_cast<uint64_t>(blockCount) * thread) / threads);
+        uint32_t blockEnd = static_cast<uint32_t>((static_cast<uint64_t>(blockCount) * (thread + 1)) / threads);
+
+        for (uint32_t block = blockStart; block < blockEnd; block++)
+        {
+            uint32_t start = block * EnergyBlockSize;
+            uint32_t count = (particleCount - start < EnergyBlockSize) ? particleCount - start : EnergyBlockSize;
+
+            m_blockEnergy[block] = ispc::PMPotentialEnergy(pParticles, start, count, &m_density[0], m_boxMin, m_boxSize, m_gridSize);
+        }
+    });
+
+    double energy = 0.0;
+    for (uint32_t block = 0; block < blockCount; block++)
+        energy += m_blockEnergy[block];
+
+    return energy;
+}
+
+//
+// Cloud-in-cell deposit of all particles onto m_density.
+//
+// The particles are first bucketed by the z slab their footprint starts in, using a stable parallel
+// counting sort. Each slab only writes to itself and the next slab, so all even slabs can be deposited
+// in parallel, followed by all odd slabs.
+//
+void ParticleMesh::AssignMass(const ispc::Particle* pParticles, uint32_t particleCount, int threads)
+{
+    PROFILE_SCOPE("PM assign mass");
+
+    const uint32_t n = m_gridSize;
+    const float cellsPerUnit = static_cast<float>(n) / m_boxSize;
+
+    m_particleSlabs.resize(particleCount);
+    m_sortedIndices.resize(particleCount);
+    m_slabHistograms.assign(static_cast<size_t>(threads) * n, 0);
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        uint32_t start = static_cast<uint32_t>((static_cast<uint64_t>(particleCount) * thread) / threads);
+        uint32_t end = static_cast<uint32_t>((static_cast<uint64_t>(particleCount) * (thread + 1)) / threads);
+
+        ispc::PMComputeSlabs(pParticles, start, end - start, m_boxMin, cellsPerUnit, n, &m_particleSlabs[0]);
+
+        uint32_t* pHistogram = &m_slabHistograms[static_cast<size_t>(thread) * n];
+        for (uint32_t ii = start; ii < end; ii++)
+        {
+            pHistogram[m_particleSlabs[ii]]++;
+        }
+    });
+
+    // Exclusive scan, slab major then thread, so the sort is stable.
+    uint32_t offset = 0;
+    for (uint32_t slab = 0; slab < n; slab++)
+    {
+        m_slabStart[slab] = offset;
+        for (int thread = 0; thread < threads; thread++)
+        {
+            uint32_t& entry = m_slabHistograms[static_cast<size_t>(thread) * n + slab];
+            uint32_t count = entry;
+            entry = offset;
+            offset += count;
+        }
+    }
+    m_slabStart[n] = offset;
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        uint32_t start = static_cast<uint32_t>((static_cast<uint64_t>(particleCount) * thread) / threads);
+        uint32_t end = static_cast<uint32_t>((static_cast<uint64_t>(particleCount) * (thread + 1)) / threads);
+
+        uint32_t* pOffsets = &m_slabHistograms[static_cast<size_t>(thread) * n];
+        for (uint32_t ii = start; ii < end; ii++)
+        {
+            m_sortedIndices[pOffsets[m_particleSlabs[ii]]++] = ii;
+        }
+    });
+
+    std::fill(m_density.begin(), m_density.end(), 0.0f);
+
+    // Mass per particle spread over one cell volume, with G folded in.
+    const float massScale = ParticleMassG * cellsPerUnit * cellsPerUnit * cellsPerUnit;
+
+    for (uint32_t colour = 0; colour < 2; colour++)
+    {
+        concurrency::parallel_for<uint32_t>(0, n / 2, [&](uint32_t pair)
+        {
+            uint32_t slab = pair * 2 + colour;
+            uint32_t count = m_slabStart[slab + 1] - m_slabStart[slab];
+            if (count == 0)
+                return;
+
+            ispc::PMDepositCIC(pParticles, &m_sortedIndices[m_slabStart[slab]], count, m_boxMin, cellsPerUnit, n, massScale, &m_density[0]);
+        });
+    }
+}
+
+//
+// Solve the Poisson equation for the potential in Fourier space, leaving it in m_density.
+//
+void ParticleMesh::SolvePotential(int threads)
+{
+    PROFILE_SCOPE("PM solve potential");
+
+    const int n = static_cast<int>(m_gridSize);
+
+    m_fft.Forward(&m_density[0], &m_spectrum[0], threads);
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        int planeStart = (n * thread) / threads;
+        int planeEnd = (n * (thread + 1)) / threads;
+
+        ispc::PMApplyGreensFunction(reinterpret_cast<float*>(&m_spectrum[0]), n, planeStart, planeEnd, m_boxSize);
+    });
+
+    // m_density now becomes the potential.
+    m_fft.Inverse(&m_spectrum[0], &m_density[0], threads);
+}
+
+//
+// Difference the potential into mesh forces.
+//
+void ParticleMesh::SolveForces(int threads)
+{
+    PROFILE_SCOPE("PM solve forces");
+
+    const int n = static_cast<int>(m_gridSize);
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        int planeStart = (n * thread) / threads;
+        int planeEnd = (n * (thread + 1)) / threads;
+
+        ispc::PMComputeForces(&m_density[0], n, planeStart, planeEnd, m_boxSize, &m_forceX[0], &m_forceY[0], &m_forceZ[0]);
+    });
+}
@@ -0,0 +1,88 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#pragma once
+
+#include "FFT.h"
+
+// Add the auto generated ISPC kernel header
+#include "nBodyGravityPM_ispc.h"
+
+//
+// Particle-mesh long range gravity solver for periodic boxes.
+//
+// Each step runs four stages:
+//   1. Cloud-in-cell mass assignment. Particles are bucketed by z slab and even/odd slabs are
+//      deposited in two passes, so no two threads ever write the same cell and no atomics are needed.
+//   2. Forward 3D real FFT of the density.
+//   3. Multiplication with the Green's function of the Poisson equation.
+//   4. Inverse FFT, finite differenced forces on the mesh, and CIC interpolation back to the particles,
+//      which are then advanced with the same kick/drift update as the direct sum kernels.
+//
+class ParticleMesh
+{
+public:
+    ParticleMesh();
+
+    // gridSize must be a power of two. The box is centred on the origin.
+    void Initialize(uint32_t gridSize, float boxSize);
+
+    void Step(const ispc::Particle* pReadParticles, ispc::Particle* pWriteParticles, uint32_t particleCount, int threads);
+
+    // Potential energy per unit mass of the particles in the periodic mesh potential, for the diagnostics.
+    // Assigns the particles' mass and solves for the potential again, so it costs most of a step. The
+    // result is the same for any thread count.
+    double ComputePotentialEnergy(const ispc::Particle* pParticles, uint32_t particleCount, int threads);
+
+    uint32_t GetGridSize() const    { return m_gridSize; }
+    float GetBoxSize() const        { return m_boxSize; }
+
+private:
+    static const uint32_t EnergyBlockSize = 1024;
+
+    void AssignMass(const ispc::Particle* pParticles, uint32_t particleCount, int threads);
+    void SolvePotential(int threads);
+    void SolveForces(int threads);
+
+    uint32_t m_gridSize;
+    float m_boxSize;
+    float m_boxMin;
+
+    RealFFT3D m_fft;
+    std::vector<float> m_density;                   // Density on input to the solve, potential on output.
+    std::vector<RealFFT3D::Complex> m_spectrum;
+    std::vector<float> m_forceX;
+    std::vector<float> m_forceY;
+    std::vector<float> m_forceZ;
+
+    // Particle bucketing by z slab.
+    std::vector<uint32_t> m_particleSlabs;
+    std::vector<uint32_t> m_slabHistograms;          // threads * gridSize counts, then exclusive offsets.
+    std::vector<uint32_t> m_slabStart;               // gridSize + 1 offsets into m_sortedIndices.
+    std::vector<uint32_t> m_sortedIndices;
+
+    std::vector<double> m_blockEnergy;              // Potential energy of each EnergyBlockSize particles.
+};
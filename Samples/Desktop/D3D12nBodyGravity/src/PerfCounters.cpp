@@ -0,0 +1,124 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#include "stdafx.h"
+#include "PerfCounters.h"
+
+bool PerfCounters::s_bAvailable = false;
+std::atomic<bool> PerfCounters::s_bEnabled(false);
+std::mutex PerfCounters::s_threadsMutex;
+std::vector<std::unique_ptr<PerfCounters::ThreadCounters>> PerfCounters::s_threads;
+
+PerfCounters::ThreadCounters* PerfCounters::OpenThreadCounters()
+{
+    std::unique_ptr<ThreadCounters> counters(new ThreadCounters);
+    memset(counters.get(), 0, sizeof(ThreadCounters));
+
+    ULONG64 cycles = 0;
+    counters->valid[e_Cycles] = QueryThreadCycleTime(GetCurrentThread(), &cycles) != FALSE;
+
+    ThreadCounters* pCounters = counters.get();
+
+    std::lock_guard<std::mutex> lock(s_threadsMutex);
+    s_threads.push_back(std::move(counters));
+    return pCounters;
+}
+
+void PerfCounters::Read(const ThreadCounters* pCounters, Sample* pSample)
+{
+    memset(pSample, 0, sizeof(Sample));
+
+    ULONG64 cycles = 0;
+    if (pCounters->valid[e_Cycles] && QueryThreadCycleTime(GetCurrentThread(), &cycles))
+        pSample->values[e_Cycles] = cycles;
+}
+
+bool PerfCounters::Initialize()
+{
+    const ThreadCounters* pCounters = GetThreadCounters();
+
+    s_bAvailable = false;
+    for (int counter = 0; counter < e_MAX_Counter; counter++)
+        s_bAvailable = s_bAvailable || pCounters->valid[counter];
+
+    return s_bAvailable;
+}
+
+PerfCounters::ThreadCounters* PerfCounters::GetThreadCounters()
+{
+    static thread_local ThreadCounters* t_pCounters = nullptr;
+
+    if (!t_pCounters)
+        t_pCounters = OpenThreadCounters();
+
+    return t_pCounters;
+}
+
+void PerfCounters::Accumulate(ThreadCounters* pCounters, const Sample& begin, const Sample& end)
+{
+    for (int counter = 0; counter < e_MAX_Counter; counter++)
+    {
+        if (pCounters->valid[counter])
+            pCounters->totals[counter] += static_cast<double>(end.values[counter] - begin.values[counter]);
+    }
+}
+
+void PerfCounters::Reset()
+{
+    std::lock_guard<std::mutex> lock(s_threadsMutex);
+
+    for (const std::unique_ptr<ThreadCounters>& counters : s_threads)
+    {
+        for (int counter = 0; counter < e_MAX_Counter; counter++)
+            counters->totals[counter] = 0.0;
+    }
+}
+
+//
+// A counter is valid in the sum only when every thread that counted could open it.
+//
+PerfCounters::Totals PerfCounters::Collect()
+{
+    Totals totals;
+    for (int counter = 0; counter < e_MAX_Counter; counter++)
+    {
+        totals.values[counter] = 0.0;
+        totals.valid[counter] = s_bAvailable;
+    }
+
+    std::lock_guard<std::mutex> lock(s_threadsMutex);
+
+    for (const std::unique_ptr<ThreadCounters>& counters : s_threads)
+    {
+        for (int counter = 0; counter < e_MAX_Counter; counter++)
+        {
+            totals.values[counter] += counters->totals[counter];
+            totals.valid[counter] = totals.valid[counter] && counters->valid[counter];
+        }
+    }
+
+    return totals;
+}
@@ -0,0 +1,157 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+//
+// Hardware performance counters per thread, for the -benchmark harness.
+//
+// Windows gives user mode no access to the PMU events, so the counters are the ones the kernel keeps for
+// every thread: QueryThreadCycleTime() counts the CPU cycles the thread has run, in user and kernel mode,
+// without the time it was switched out. Each thread that enters a PerfCounterScope registers its
+// counters the first time, and the scope adds the counts between its construction and destruction to
+// that thread's totals.
+//
+// A counter the probe cannot read is invalid, and with none valid IsAvailable() is false and the harness
+// reports timings only.
+//
+class PerfCounters
+{
+public:
+    enum Counter
+    {
+        e_Cycles = 0,
+
+        e_MAX_Counter
+    };
+
+    struct Totals
+    {
+        double values[e_MAX_Counter];
+        bool valid[e_MAX_Counter];
+
+        bool IsValid(Counter counter) const     { return valid[counter]; }
+        double Get(Counter counter) const       { return values[counter]; }
+    };
+
+    // Probe the counters on the calling thread, returns IsAvailable().
+    static bool Initialize();
+    static bool IsAvailable()               { return s_bAvailable; }
+
+    // Scopes only count while enabled.
+    static void SetEnabled(bool enabled)    { s_bEnabled.store(enabled && s_bAvailable, std::memory_order_relaxed); }
+    static bool IsEnabled()                 { return s_bEnabled.load(std::memory_order_relaxed); }
+
+    // Clear or sum the totals of every thread. Call these between parallel sections, not during one.
+    static void Reset();
+    static Totals Collect();
+
+private:
+    friend class PerfCounterScope;
+
+    struct Sample
+    {
+        uint64_t values[e_MAX_Counter];
+    };
+
+    struct ThreadCounters
+    {
+        double totals[e_MAX_Counter];
+        bool valid[e_MAX_Counter];
+    };
+
+    static ThreadCounters* GetThreadCounters();
+    static ThreadCounters* OpenThreadCounters();
+    static void Read(const ThreadCounters* pCounters, Sample* pSample);
+    static void Accumulate(ThreadCounters* pCounters, const Sample& begin, const Sample& end);
+
+    static bool s_bAvailable;
+    static std::atomic<bool> s_bEnabled;
+
+    static std::mutex s_threadsMutex;
+    static std::vector<std::unique_ptr<ThreadCounters>> s_threads;
+};
+class PerfCounterScope;
+
+    static const int GroupCount = 3;
+    static const int MaxGroupSize = 4;
+
+    struct Sample
+    {
+        uint64_t values[e_MAX_Counter];
+        uint64_t enabled[GroupCount];
+        uint64_t running[GroupCount];
+    };
+
+    struct ThreadCounters
+    {
+        int groupFds[GroupCount];
+        int groupSize[GroupCount];
+        Counter groupCounters[GroupCount][MaxGroupSize];
+        double totals[e_MAX_Counter];
+        bool valid[e_MAX_Counter];
+    };
+
+    static ThreadCounters* GetThreadCounters();
+    static ThreadCounters* OpenThreadCounters();
+    static void Read(const ThreadCounters* pCounters, Sample* pSample);
+    static void Accumulate(ThreadCounters* pCounters, const Sample& begin, const Sample& end);
+
+    static bool s_bAvailable;
+    static std::atomic<bool> s_bEnabled;
+
+    static std::mutex s_threadsMutex;
+    static std::vector<std::unique_ptr<ThreadCounters>> s_threads;
+};
+
+class PerfCounterScope
+{
+public:
+    PerfCounterScope() :
+        m_pCounters(PerfCounters::IsEnabled() ? PerfCounters::GetThreadCounters() : nullptr)
+    {
+        if (m_pCounters)
+            PerfCounters::Read(m_pCounters, &m_begin);
+    }
+
+    ~PerfCounterScope()
+    {
+        if (m_pCounters)
+        {
+            PerfCounters::Sample end;
+            PerfCounters::Read(m_pCounters, &end);
+            PerfCounters::Accumulate(m_pCounters, m_begin, end);
+        }
+    }
+
+private:
+    PerfCounters::ThreadCounters* m_pCounters;
+    PerfCounters::Sample m_begin;
+};
@@ -0,0 +1,342 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#include "stdafx.h"
+#include "Planetesimals.h"
+#include "RingSolver.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+// Concurrency
+#include <ppl.h>
+
+static const uint32_t NoPartner = 0xffffffff;
+
+// The smallest cell of the collision hash, relative to the outer radius of the ring, for bodies of no size.
+static const float MinCellSize = 1.0e-5f;
+
+Planetesimals::Planetesimals() :
+    m_parameters(GetDefaultParameters()),
+    m_softeningSquared(0.0f),
+    m_statistics()
+{
+}
+
+Planetesimals::Parameters Planetesimals::GetDefaultParameters()
+{
+    Parameters parameters;
+    parameters.starMassG = 1.0e6f;
+    parameters.innerRadius = 100.0f;
+    parameters.outerRadius = 200.0f;
+    parameters.thickness = 0.01f;
+    parameters.diskMassG = 1.0e3f;
+    parameters.bodyRadius = 0.2f;
+    parameters.velocityDispersion = 0.01f;
+    parameters.timeStep = 0.002f;
+    return parameters;
+}
+
+void Planetesimals::Generate(uint32_t count, const Parameters& parameters)
+{
+    m_parameters = parameters;
+    m_statistics = Statistics();
+
+    // Softened on the scale of a body, closer approaches merge anyway.
+    m_softeningSquared = parameters.bodyRadius * parameters.bodyRadius;
+
+    m_bodies.resize(count);
+    std::mt19937 generator(1);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+    const float innerSquared = parameters.innerRadius * parameters.innerRadius;
+    const float outerSquared = parameters.outerRadius * parameters.outerRadius;
+    for (ispc::Planetesimal& body : m_bodies)
+    {
+        // Uniform over the area of the ring.
+        const float radius = sqrtf(innerSquared + uniform(generator) * (outerSquared - innerSquared));
+        const float angle = 6.2831853f * uniform(generator);
+        const float height = parameters.thickness * radius * (uniform(generator) - 0.5f);
+        const float speed = sqrtf(parameters.starMassG / radius);
+        const float dispersion = parameters.velocityDispersion * speed;
+
+        body.x = radius * cosf(angle);
+        body.y = radius * sinf(angle);
+        body.z = height;
+        body.radius = parameters.bodyRadius;
+        body.vx = -speed * sinf(angle) + dispersion * (uniform(generator) - 0.5f);
+        body.vy = speed * cosf(angle) + dispersion * (uniform(generator) - 0.5f);
+        body.vz = dispersion * (uniform(generator) - 0.5f);
+        body.massG = parameters.diskMassG / count;
+    }
+}
+
+void Planetesimals::Step(int threads)
+{
+    PROFILE_SCOPE("Planetesimals step");
+
+    const uint32_t count = GetBodyCount();
+    m_accelerations.resize(count);
+
+    auto forceBegin = std::chrono::high_resolution_clock::now();
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        uint32_t start, end;
+        RingSolver::GetSlice(count, thread, threads, &start, &end);
+        if (start < end)
+            ispc::PlanetesimalAccumulate(&m_bodies[0], start, end, count, m_parameters.starMassG, m_softeningSquared, &m_accelerations[start]);
+    });
+
+    // Only once every thread is done reading the positions.
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        uint32_t start, end;
+        RingSolver::GetSlice(count, thread, threads, &start, &end);
+        if (start < end)
+            ispc::PlanetesimalIntegrate(&m_bodies[0], start, end, &m_accelerations[start], m_parameters.timeStep);
+    });
+    auto collisionBegin = std::chrono::high_resolution_clock::now();
+
+    m_statistics.mergers += Collide(threads);
+
+    m_statistics.forceSeconds += std::chrono::duration<double>(collisionBegin - forceBegin).count();
+    m_statistics.collisionSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - collisionBegin).count();
+    m_statistics.steps++;
+}
+
+uint32_t Planetesimals::Collide(int threads)
+{
+    PROFILE_SCOPE("Collisions");
+
+    const uint32_t count = GetBodyCount();
+    if (count < 2)
+        return 0;
+
+    // Cells of four times the mean radius, but never so small that the cell coordinates overflow.
+    std::vector<double> radiusSums(threads, 0.0);
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        uint32_t start, end;
+        RingSolver::GetSlice(count, thread, threads, &start, &end);
+        for (uint32_t ii = start; ii < end; ii++)
+            radiusSums[thread] += m_bodies[ii].radius;
+    });
+    double radiusSum = 0.0;
+    for (double sum : radiusSums)
+        radiusSum += sum;
+
+    const float minCellSize = MinCellSize * m_parameters.outerRadius;
+    const float meanCellSize = static_cast<float>(4.0 * radiusSum / count);
+    const float cellSize = (meanCellSize > minCellSize) ? meanCellSize : minCellSize;
+
+    const uint32_t stride = sizeof(ispc::Planetesimal) / sizeof(float);
+    m_hash.Build(&m_bodies[0].x, &m_bodies[0].y, &m_bodies[0].z, stride, count, cellSize, threads);
+
+    // The bodies the walk of the neighbouring cells can miss, in order.
+    m_threadLarge.resize(threads);
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        uint32_t start, end;
+        RingSolver::GetSlice(count, thread, threads, &start, &end);
+        m_threadLarge[thread].clear();
+        for (uint32_t ii = start; ii < end; ii++)
+        {
+            if (m_bodies[ii].radius > 0.5f * cellSize)
+                m_threadLarge[thread].push_back(ii);
+        }
+    });
+    m_large.clear();
+    for (const std::vector<uint32_t>& threadLarge : m_threadLarge)
+        m_large.insert(m_large.end(), threadLarge.begin(), threadLarge.end());
+    const uint32_t largeCount = static_cast<uint32_t>(m_large.size());
+
+    // Every body's partner, and the bodies that have one, in order.
+    m_partners.resize(count);
+    m_threadColliders.resize(threads);
+    {
+        PROFILE_SCOPE("Collision partners");
+
+        concurrency::parallel_for<int>(0, threads, [&](int thread)
+        {
+            uint32_t start, end;
+            RingSolver::GetSlice(count, thread, threads, &start, &end);
+            if (start >= end)
+                return;
+
+            ispc::CollisionFindPartners(&m_bodies[0], start, end, m_hash.GetBucketStarts(), m_hash.GetSortedIndices(), m_hash.GetInvCellSize(),
+                                        m_hash.GetTableMask(), &m_partners[0]);
+            if (largeCount > 0)
+                ispc::CollisionFindLargePartners(&m_bodies[0], start, end, &m_large[0], largeCount, &m_partners[0]);
+        });
+
+        // A large body's partner can be outside its neighbouring cells, whatever its size.
+        concurrency::parallel_for<int>(0, threads, [&](int thread)
+        {
+            uint32_t start, end;
+            RingSolver::GetSlice(largeCount, thread, threads, &start, &end);
+            for (uint32_t slot = start; slot < end; slot++)
+                m_partners[m_large[slot]] = ispc::CollisionFindPartnerDirect(&m_bodies[0], count, m_large[slot]);
+        });
+
+        concurrency::parallel_for<int>(0, threads, [&](int thread)
+        {
+            uint32_t start, end;
+            RingSolver::GetSlice(count, thread, threads, &start, &end);
+            m_threadColliders[thread].clear();
+            for (uint32_t ii = start; ii < end; ii++)
+            {
+                if (m_partners[ii] != NoPartner)
+                    m_threadColliders[thread].push_back(ii);
+            }
+        });
+    }
+
+    std::vector<uint32_t> colliders;
+    for (const std::vector<uint32_t>& threadColliders : m_threadColliders)
+        colliders.insert(colliders.end(), threadColliders.begin(), threadColliders.end());
+    if (colliders.empty())
+        return 0;
+
+    //
+    // Join the groups over the partner links, by slots in 'colliders'. Slots are in body order, so making
+    // the lower slot the root of every union leaves each group's lowest body at its root.
+    //
+    const uint32_t colliderCount = static_cast<uint32_t>(colliders.size());
+    std::vector<uint32_t> parents(colliderCount);
+    for (uint32_t slot = 0; slot < colliderCount; slot++)
+        parents[slot] = slot;
+
+    auto find = [&parents](uint32_t slot)
+    {
+        while (parents[slot] != slot)
+        {
+            parents[slot] = parents[parents[slot]];
+            slot = parents[slot];
+        }
+        return slot;
+    };
+
+    for (uint32_t slot = 0; slot < colliderCount; slot++)
+    {
+        const uint32_t partnerSlot = static_cast<uint32_t>(std::lower_bound(colliders.begin(), colliders.end(), m_partners[colliders[slot]]) - colliders.begin());
+        const uint32_t root = find(slot);
+        const uint32_t partnerRoot = find(partnerSlot);
+        if (root < partnerRoot)
+            parents[partnerRoot] = root;
+        else if (partnerRoot < root)
+            parents[root] = partnerRoot;
+    }
+
+    // Sum every group at its root, in double precision: mass, mass weighted position and velocity, volume.
+    struct GroupSum
+    {
+        double massG;
+        double position[3];
+        double velocity[3];
+        double volume;
+        uint32_t bodies;
+    };
+    std::vector<GroupSum> sums(colliderCount, GroupSum());
+    for (uint32_t slot = 0; slot < colliderCount; slot++)
+    {
+        const ispc::Planetesimal& body = m_bodies[colliders[slot]];
+        GroupSum& sum = sums[find(slot)];
+        sum.massG += body.massG;
+        sum.position[0] += static_cast<double>(body.massG) * body.x;
+        sum.position[1] += static_cast<double>(body.massG) * body.y;
+        sum.position[2] += static_cast<double>(body.massG) * body.z;
+        sum.velocity[0] += static_cast<double>(body.massG) * body.vx;
+        sum.velocity[1] += static_cast<double>(body.massG) * body.vy;
+        sum.velocity[2] += static_cast<double>(body.massG) * body.vz;
+        sum.volume += static_cast<double>(body.radius) * body.radius * body.radius;
+        sum.bodies++;
+    }
+
+    uint32_t absorbed = 0;
+    for (uint32_t slot = 0; slot < colliderCount; slot++)
+    {
+        ispc::Planetesimal& body = m_bodies[colliders[slot]];
+        if (find(slot) != slot)
+        {
+            body.massG = 0.0f;
+            absorbed++;
+            continue;
+        }
+
+        const GroupSum& sum = sums[slot];
+        body.x = static_cast<float>(sum.position[0] / sum.massG);
+        body.y = static_cast<float>(sum.position[1] / sum.massG);
+        body.z = static_cast<float>(sum.position[2] / sum.massG);
+        body.vx = static_cast<float>(sum.velocity[0] / sum.massG);
+        body.vy = static_cast<float>(sum.velocity[1] / sum.massG);
+        body.vz = static_cast<float>(sum.velocity[2] / sum.massG);
+        body.radius = static_cast<float>(cbrt(sum.volume));
+        body.massG = static_cast<float>(sum.massG);
+        m_statistics.largestGroup = (sum.bodies > m_statistics.largestGroup) ? sum.bodies : m_statistics.largestGroup;
+    }
+
+    //
+    // Compact the survivors: count them per block, give every block its offset with a prefix sum and copy
+    // the blocks from their offsets.
+    //
+    {
+        PROFILE_SCOPE("Collision compact");
+
+        const uint32_t blockCount = (count + BlockSize - 1) / BlockSize;
+        m_blockOffsets.resize(blockCount + 1);
+        concurrency::parallel_for<int>(0, threads, [&](int thread)
+        {
+            uint32_t start, end;
+            RingSolver::GetSlice(blockCount, thread, threads, &start, &end);
+            for (uint32_t block = start; block < end; block++)
+            {
+                const uint32_t blockEnd = (block + 1 < blockCount) ? (block + 1) * BlockSize : count;
+                m_blockOffsets[block + 1] = ispc::CollisionCountSurvivors(&m_bodies[0], block * BlockSize, blockEnd);
+            }
+        });
+
+        m_blockOffsets[0] = 0;
+        for (uint32_t block = 0; block < blockCount; block++)
+            m_blockOffsets[block + 1] += m_blockOffsets[block];
+
+        m_compacted.resize(m_blockOffsets[blockCount]);
+        concurrency::parallel_for<int>(0, threads, [&](int thread)
+        {
+            uint32_t start, end;
+            RingSolver::GetSlice(blockCount, thread, threads, &start, &end);
+            for (uint32_t block = start; block < end; block++)
+            {
+                const uint32_t blockEnd = (block + 1 < blockCount) ? (block + 1) * BlockSize : count;
+                ispc::CollisionCompact(&m_bodies[0], block * BlockSize, blockEnd, m_compacted.empty() ? nullptr : &m_compacted[0], m_blockOffsets[block]);
+            }
+        });
+        m_bodies.swap(m_compacted);
+    }
+
+    return absorbed;
+}
@@ -0,0 +1,110 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#pragma once
+
+#include "SpatialHash.h"
+
+// Add the auto generated ISPC kernel header
+#include "nBodyGravityCollide_ispc.h"
+
+//
+// A ring of planetesimals round a star, whose bodies merge when they touch.
+//
+// Every step sums the bodies' pull on each other directly, advances them and then runs the collision
+// stage, which costs O(N) against the O(N^2) of the forces:
+//   1. The bodies go into a SpatialHash with cells of four times the mean radius, so touching bodies of up
+//      to half a cell are in neighbouring cells, and every body finds the lowest indexed body it overlaps,
+//      in parallel. The few bodies larger than half a cell, grown by mergers, are checked against every
+//      body instead, so one large body cannot blow the cells up for all the others.
+//   2. Bodies linked by these partners form groups, joined with a union-find over the colliding bodies
+//      only. Each group becomes one body at the group's lowest index with the sum of the masses, the
+//      centre of mass and the total momentum, and the radius of the summed volume: a perfectly
+//      inelastic merger.
+//   3. The absorbed bodies are compacted away in parallel, over blocks of BlockSize like the
+//      FrustumCuller, which keeps the survivors in order.
+// A body touching several others joins the group of the lowest one only, and merges with the rest in
+// the following steps if they still overlap.
+//
+class Planetesimals
+{
+public:
+    static const uint32_t BlockSize = 4096;
+
+    struct Parameters
+    {
+        float starMassG;                // G times the star's mass.
+        float innerRadius;              // Of the ring.
+        float outerRadius;
+        float thickness;                // Of the ring, relative to the orbit radius.
+        float diskMassG;                // G times the mass of all the bodies.
+        float bodyRadius;               // Of the initial bodies, which are all alike.
+        float velocityDispersion;       // Random velocities on top of the circular orbits, relative to them.
+        float timeStep;
+    };
+
+    struct Statistics
+    {
+        uint32_t steps;
+        uint64_t mergers;               // Bodies absorbed by others.
+        uint32_t largestGroup;          // Most bodies merged into one in a single step.
+        double forceSeconds;            // Summing the forces and integrating.
+        double collisionSeconds;        // The whole collision stage.
+    };
+
+    Planetesimals();
+
+    static Parameters GetDefaultParameters();
+
+    // Start over with 'count' bodies on circular orbits, the same for any thread count.
+    void Generate(uint32_t count, const Parameters& parameters);
+
+    void Step(int threads);
+
+    uint32_t GetBodyCount() const                   { return static_cast<uint32_t>(m_bodies.size()); }
+    const ispc::Planetesimal* GetBodies() const     { return m_bodies.empty() ? nullptr : &m_bodies[0]; }
+    const Statistics& GetStatistics() const         { return m_statistics; }
+
+private:
+    // Merge the touching bodies and drop the absorbed ones. Returns the bodies absorbed.
+    uint32_t Collide(int threads);
+
+    Parameters m_parameters;
+    float m_softeningSquared;
+
+    std::vector<ispc::Planetesimal> m_bodies;
+    std::vector<ispc::Planetesimal> m_compacted;
+    std::vector<ispc::Vec3> m_accelerations;
+
+    SpatialHash m_hash;
+    std::vector<uint32_t> m_partners;
+    std::vector<std::vector<uint32_t>> m_threadLarge;
+    std::vector<uint32_t> m_large;                  // Bodies larger than half a cell, in order.
+    std::vector<std::vector<uint32_t>> m_threadColliders;
+    std::vector<uint32_t> m_blockOffsets;
+
+    Statistics m_statistics;
+};
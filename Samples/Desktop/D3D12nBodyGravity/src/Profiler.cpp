@@ -0,0 +1,139 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+#include "stdafx.h"
+#include "Profiler.h"
+
+std::atomic<bool> Profiler::s_bEnabled(false);
+std::mutex Profiler::s_ringsMutex;
+std::vector<std::unique_ptr<Profiler::ThreadRing>> Profiler::s_rings;
+uint64_t Profiler::s_startTimestamp = 0;
+int64_t Profiler::s_startCounter = 0;
+
+void Profiler::SetEnabled(bool enabled)
+{
+    if (enabled && !IsEnabled())
+    {
+        LARGE_INTEGER counter;
+        QueryPerformanceCounter(&counter);
+        s_startCounter = counter.QuadPart;
+        s_startTimestamp = Timestamp();
+    }
+
+    s_bEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+Profiler::ThreadRing* Profiler::GetThreadRing()
+{
+    static thread_local ThreadRing* t_pRing = nullptr;
+
+    if (!t_pRing)
+    {
+        std::unique_ptr<ThreadRing> ring(new ThreadRing);
+        ring->threadId = GetCurrentThreadId();
+        ring->count.store(0, std::memory_order_relaxed);
+        t_pRing = ring.get();
+
+        std::lock_guard<std::mutex> lock(s_ringsMutex);
+        s_rings.push_back(std::move(ring));
+    }
+
+    return t_pRing;
+}
+
+void Profiler::Record(const char* pName, uint64_t begin, uint64_t end)
+{
+    ThreadRing* pRing = GetThreadRing();
+
+    uint64_t count = pRing->count.load(std::memory_order_relaxed);
+    Event& event = pRing->events[count % RingSize];
+    event.pName = pName;
+    event.begin = begin;
+    event.end = end;
+
+    pRing->count.store(count + 1, std::memory_order_release);
+}
+
+bool Profiler::WriteTrace(const wchar_t* pPath)
+{
+    LARGE_INTEGER counter;
+    LARGE_INTEGER frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    const uint64_t timestamp = Timestamp();
+
+    // Time stamp counter ticks per microsecond over the recording so far.
+    const double seconds = static_cast<double>(counter.QuadPart - s_startCounter) / static_cast<double>(frequency.QuadPart);
+    const double ticksPerMicrosecond = (seconds > 0.0) ? static_cast<double>(timestamp - s_startTimestamp) / (seconds * 1e6) : 1.0;
+
+    FILE* pFile = nullptr;
+    if (_wfopen_s(&pFile, pPath, L"wb") != 0 || !pFile)
+        return false;
+
+    fprintf(pFile, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+
+    std::vector<Event> events;
+    std::lock_guard<std::mutex> lock(s_ringsMutex);
+
+    for (const std::unique_ptr<ThreadRing>& ring : s_rings)
+    {
+        //
+        // Copy the newest RingSize events, then drop any that the owner may have overwritten meanwhile. The
+        // owner writes the slot of event endAfterCopy before it publishes it, so that slot, which held
+        // event endAfterCopy - RingSize, may be torn as well: every event below endAfterCopy + 1 - RingSize
+        // goes.
+        //
+        uint64_t end = ring->count.load(std::memory_order_acquire);
+        uint64_t begin = (end > RingSize) ? end - RingSize : 0;
+
+        events.clear();
+        for (uint64_t ii = begin; ii < end; ii++)
+            events.push_back(ring->events[ii % RingSize]);
+
+        uint64_t endAfterCopy = ring->count.load(std::memory_order_acquire);
+        uint64_t overwritten = (endAfterCopy + 1 > begin + RingSize) ? endAfterCopy + 1 - (begin + RingSize) : 0;
+
+        fprintf(pFile, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"Thread %u\"}}",
+            first ? "" : ",\n", ring->threadId, ring->threadId);
+        first = false;
+
+        for (size_t ii = static_cast<size_t>(overwritten < events.size() ? overwritten : events.size()); ii < events.size(); ii++)
+        {
+            const Event& event = events[ii];
+            if (event.begin < s_startTimestamp)
+                continue;
+
+            fprintf(pFile, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                event.pName, ring->threadId,
+                static_cast<double>(event.begin - s_startTimestamp) / ticksPerMicrosecond,
+                static_cast<double>(event.end - event.begin) / ticksPerMicrosecond);
+        }
+    }
+
+    fprintf(pFile, "\n]}\n");
+    fclose(pFile);
+    return true;
+}
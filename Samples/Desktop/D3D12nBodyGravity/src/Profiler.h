@@ -0,0 +1,109 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <intrin.h>
+
+//
+// Scoped span profiler with Chrome trace export.
+//
+// Spans are recorded with PROFILE_SCOPE("name") into a ring buffer of the calling thread. Each thread is
+// the only writer of its ring and publishes an event by advancing its count, so recording takes no locks
+// and threads never share a cache line. Timestamps are raw time stamp counter reads; WriteTrace()
+// converts them to microseconds against QueryPerformanceCounter and writes JSON that chrome://tracing
+// and Perfetto open directly, one track per thread.
+//
+// While recording is off, a scope costs one relaxed load and a branch. Span names must be string
+// literals, only the pointer is stored.
+//
+class Profiler
+{
+public:
+    static const uint32_t RingSize = 65536;     // Spans kept per thread, older spans are overwritten.
+
+    static void SetEnabled(bool enabled);
+    static bool IsEnabled()                 { return s_bEnabled.load(std::memory_order_relaxed); }
+
+    static uint64_t Timestamp()             { return __rdtsc(); }
+    static void Record(const char* pName, uint64_t begin, uint64_t end);
+
+    // Write the spans currently held by all threads. Safe to call while other threads are recording.
+    static bool WriteTrace(const wchar_t* pPath);
+
+private:
+    struct Event
+    {
+        const char* pName;
+        uint64_t begin;
+        uint64_t end;
+    };
+
+    struct ThreadRing
+    {
+        uint32_t threadId;
+        std::atomic<uint64_t> count;
+        Event events[RingSize];
+    };
+
+    static ThreadRing* GetThreadRing();
+
+    static std::atomic<bool> s_bEnabled;
+
+    // Every ring ever created, rings live until the process exits.
+    static std::mutex s_ringsMutex;
+    static std::vector<std::unique_ptr<ThreadRing>> s_rings;
+
+    // Time stamp counter and QueryPerformanceCounter at the start of recording, for the conversion to time.
+    static uint64_t s_startTimestamp;
+    static int64_t s_startCounter;
+};
+
+class ProfileScope
+{
+public:
+    explicit ProfileScope(const char* pName) :
+        m_pName(Profiler::IsEnabled() ? pName : nullptr),
+        m_begin(m_pName ? Profiler::Timestamp() : 0)
+    {
+    }
+
+    ~ProfileScope()
+    {
+        if (m_pName)
+            Profiler::Record(m_pName, m_begin, Profiler::Timestamp());
+    }
+
+private:
+    const char* m_pName;
+    uint64_t m_begin;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
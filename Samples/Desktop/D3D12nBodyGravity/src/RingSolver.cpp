@@ -0,0 +1,141 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#include "stdafx.h"
+#include "RingSolver.h"
+#include "Profiler.h"
+#include <chrono>
+#include <cstring>
+
+// Concurrency
+#include <ppl.h>
+
+RingSolver::RingSolver() :
+    m_particleStart(0),
+    m_timings()
+{
+}
+
+void RingSolver::GetSlice(uint32_t particleCount, uint32_t rank, uint32_t ranks, uint32_t* pStart, uint32_t* pEnd)
+{
+    *pStart = static_cast<uint32_t>((static_cast<uint64_t>(particleCount) * rank) / ranks);
+    *pEnd = static_cast<uint32_t>((static_cast<uint64_t>(particleCount) * (rank + 1)) / ranks);
+}
+
+size_t RingSolver::GetMaxMessageSize(uint32_t particleCount, uint32_t ranks)
+{
+    const size_t largestSlice = (particleCount + ranks - 1) / ranks;
+    return (largestSlice + 1) * sizeof(ispc::Vec4);
+}
+
+uint32_t RingSolver::GetBlockCount(const std::vector<ispc::Vec4>& block)
+{
+    uint32_t count;
+    memcpy(&count, &block[0].x, sizeof(count));
+    return count;
+}
+
+void RingSolver::Initialize(const ispc::Particle* pParticles, uint32_t particleCount, uint32_t rank, uint32_t ranks)
+{
+    uint32_t end;
+    GetSlice(particleCount, rank, ranks, &m_particleStart, &end);
+
+    m_particles.assign(pParticles + m_particleStart, pParticles + end);
+    m_accelerations.resize(end - m_particleStart);
+
+    const size_t blockSize = GetMaxMessageSize(particleCount, ranks) / sizeof(ispc::Vec4);
+    m_blocks[0].assign(blockSize, ispc::Vec4());
+    m_blocks[1].assign(blockSize, ispc::Vec4());
+}
+
+bool RingSolver::Step(RingTransport* pTransport, int threads)
+{
+    PROFILE_SCOPE("Ring step");
+
+    const uint32_t localCount = GetLocalCount();
+    const uint32_t ranks = pTransport->GetRanks();
+    const size_t messageSize = m_blocks[0].size() * sizeof(ispc::Vec4);
+
+    // The first block is this rank's own.
+    std::vector<ispc::Vec4>* pCurrent = &m_blocks[0];
+    std::vector<ispc::Vec4>* pNext = &m_blocks[1];
+    memcpy(&(*pCurrent)[0].x, &localCount, sizeof(localCount));
+    if (localCount > 0)
+        ispc::RingGatherPositions(&m_particles[0], 0, localCount, &(*pCurrent)[1]);
+
+    const ispc::Vec3 zero = {};
+    std::fill(m_accelerations.begin(), m_accelerations.end(), zero);
+
+    bool ok = true;
+    for (uint32_t pass = 0; pass < ranks && ok; pass++)
+    {
+        // Pass the block on while working on it; the last one has been everywhere else already.
+        const bool forward = (pass + 1 < ranks);
+        if (forward)
+            pTransport->BeginExchange(&(*pCurrent)[0], &(*pNext)[0], messageSize);
+
+        auto computeBegin = std::chrono::high_resolution_clock::now();
+        {
+            PROFILE_SCOPE("Ring accumulate");
+
+            const uint32_t sourceCount = GetBlockCount(*pCurrent);
+            const ispc::Vec4* pSources = &(*pCurrent)[1];
+            concurrency::parallel_for<int>(0, threads, [&](int thread)
+            {
+                uint32_t start, end;
+                GetSlice(localCount, thread, threads, &start, &end);
+                if (start < end)
+                    ispc::RingAccumulate(&m_particles[0], start, end, pSources, sourceCount, &m_accelerations[start]);
+            });
+        }
+        auto computeEnd = std::chrono::high_resolution_clock::now();
+        m_timings.computeSeconds += std::chrono::duration<double>(computeEnd - computeBegin).count();
+
+        if (forward)
+        {
+            PROFILE_SCOPE("Ring wait");
+
+            ok = pTransport->WaitExchange();
+            std::swap(pCurrent, pNext);
+            m_timings.waitSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - computeEnd).count();
+        }
+    }
+
+    if (!ok)
+        return false;
+
+    auto integrateBegin = std::chrono::high_resolution_clock::now();
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        uint32_t start, end;
+        GetSlice(localCount, thread, threads, &start, &end);
+        if (start < end)
+            ispc::RingIntegrate(&m_particles[0], start, end, &m_accelerations[start]);
+    });
+    m_timings.computeSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - integrateBegin).count();
+
+    return true;
+}
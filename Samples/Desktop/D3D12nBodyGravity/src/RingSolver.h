@@ -0,0 +1,85 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#pragma once
+
+#include "RingTransport.h"
+
+// Add the auto generated ISPC kernel header
+#include "nBodyGravityRing_ispc.h"
+
+//
+// One rank of the distributed direct sum.
+//
+// The rank owns a contiguous slice of the particles, the i-particles it advances. Each step the positions
+// of every rank's slice, the j-blocks, pass once round the ring: the rank adds the pull of the block it
+// holds to its own particles while the transport sends that block on to the next rank and receives the
+// previous rank's, so after 'ranks' passes every slice has met every other and the transfers are hidden
+// behind the kernel whenever it takes longer than they do (nBodyGravityRing.ispc).
+//
+// The accelerations are summed block by block in ring order, which starts at each rank's own block, so
+// the result matches the single process direct sum to rounding only.
+//
+class RingSolver
+{
+public:
+    struct Timings
+    {
+        double computeSeconds;          // In the kernels.
+        double waitSeconds;             // Waiting for transfers the kernels did not hide.
+    };
+
+    RingSolver();
+
+    // Slice [start, end) of 'particleCount' particles for 'rank' of 'ranks', the split every rank uses.
+    static void GetSlice(uint32_t particleCount, uint32_t rank, uint32_t ranks, uint32_t* pStart, uint32_t* pEnd);
+
+    // Bytes of the largest block a ring of 'ranks' passes round, for RingTransport::Create().
+    static size_t GetMaxMessageSize(uint32_t particleCount, uint32_t ranks);
+
+    // Keep this rank's slice of the whole initial state.
+    void Initialize(const ispc::Particle* pParticles, uint32_t particleCount, uint32_t rank, uint32_t ranks);
+
+    bool Step(RingTransport* pTransport, int threads);
+
+    const Timings& GetTimings() const           { return m_timings; }
+    const ispc::Particle* GetParticles() const  { return m_particles.empty() ? nullptr : &m_particles[0]; }
+    uint32_t GetParticleStart() const           { return m_particleStart; }
+    uint32_t GetLocalCount() const              { return static_cast<uint32_t>(m_particles.size()); }
+
+private:
+    //
+    // A block is its particle count in the first Vec4's x bits, padded to 16 bytes, then the positions.
+    // Every exchange moves a whole buffer of the largest block's size.
+    //
+    static uint32_t GetBlockCount(const std::vector<ispc::Vec4>& block);
+
+    uint32_t m_particleStart;
+    std::vector<ispc::Particle> m_particles;
+    std::vector<ispc::Vec3> m_accelerations;
+    std::vector<ispc::Vec4> m_blocks[2];
+    Timings m_timings;
+};
@@ -0,0 +1,603 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#include "stdafx.h"
+#include "RingTransport.h"
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <afunix.h>
+#include <sstream>
+
+namespace
+{
+    const DWORD ConnectTimeoutMs = 30000;
+    const DWORD ExchangeTimeoutMs = 60000;
+
+    std::wstring SocketError(const wchar_t* pWhat)
+    {
+        std::wstringstream message;
+        message << pWhat << L" failed, socket error " << WSAGetLastError();
+        return message.str();
+    }
+
+    //
+    // Stream sockets, over TCP on the loopback interface or AF_UNIX. Every rank listens, connects to the
+    // next rank, retrying until it listens too, then accepts the previous rank's connection.
+    //
+    class SocketRingTransport : public RingTransport
+    {
+    public:
+        SocketRingTransport(uint32_t rank, uint32_t ranks, bool bUnix) :
+            RingTransport(rank, ranks),
+            m_bUnix(bUnix),
+            m_bStarted(false),
+            m_listener(INVALID_SOCKET),
+            m_next(INVALID_SOCKET),
+            m_previous(INVALID_SOCKET)
+        {
+        }
+
+        ~SocketRingTransport()
+        {
+            if (m_previous != INVALID_SOCKET)
+                closesocket(m_previous);
+            if (m_next != INVALID_SOCKET)
+                closesocket(m_next);
+            if (m_listener != INVALID_SOCKET)
+                closesocket(m_listener);
+            if (m_bUnix && !m_listenPath.empty())
+                DeleteFileA(m_listenPath.c_str());
+            if (m_bStarted)
+                WSACleanup();
+        }
+
+        bool Connect(uint32_t session, std::wstring* pError)
+        {
+            WSADATA data;
+            if (WSAStartup(MAKEWORD(2, 2), &data) != 0)
+            {
+                *pError = L"WSAStartup failed";
+                return false;
+            }
+            m_bStarted = true;
+
+            sockaddr_storage address;
+            int addressLength = MakeAddress(session, m_rank, &address);
+
+            m_listener = socket(address.ss_family, SOCK_STREAM, 0);
+            if (m_listener == INVALID_SOCKET)
+            {
+                *pError = SocketError(L"socket");
+                return false;
+            }
+
+            if (m_bUnix)
+            {
+                m_listenPath = reinterpret_cast<sockaddr_un*>(&address)->sun_path;
+                DeleteFileA(m_listenPath.c_str());
+            }
+            else
+            {
+                BOOL reuse = TRUE;
+                setsockopt(m_listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+            }
+
+            if (bind(m_listener, reinterpret_cast<sockaddr*>(&address), addressLength) != 0 || listen(m_listener, 1) != 0)
+            {
+                *pError = SocketError(L"bind");
+                return false;
+            }
+
+            // The next rank may not be listening yet.
+            addressLength = MakeAddress(session, (m_rank + 1) % m_ranks, &address);
+            for (DWORD waited = 0; ; waited += 10)
+            {
+                m_next = socket(address.ss_family, SOCK_STREAM, 0);
+                if (m_next != INVALID_SOCKET && connect(m_next, reinterpret_cast<sockaddr*>(&address), addressLength) == 0)
+                    break;
+
+                if (m_next != INVALID_SOCKET)
+                    closesocket(m_next);
+                m_next = INVALID_SOCKET;
+
+                if (waited >= ConnectTimeoutMs)
+                {
+                    *pError = SocketError(L"connect to the next rank");
+                    return false;
+                }
+                Sleep(10);
+            }
+
+            fd_set listeners;
+            FD_ZERO(&listeners);
+            FD_SET(m_listener, &listeners);
+            timeval timeout = { static_cast<long>(ConnectTimeoutMs / 1000), 0 };
+            if (select(0, &listeners, nullptr, nullptr, &timeout) != 1)
+            {
+                *pError = L"the previous rank did not connect";
+                return false;
+            }
+
+            m_previous = accept(m_listener, nullptr, nullptr);
+            if (m_previous == INVALID_SOCKET)
+            {
+                *pError = SocketError(L"accept");
+                return false;
+            }
+
+            // Blocks are sent whole, so Nagle's algorithm only delays their tails.
+            if (!m_bUnix)
+            {
+                BOOL noDelay = TRUE;
+                setsockopt(m_next, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+            }
+
+            int bufferSize = 4 * 1024 * 1024;
+            setsockopt(m_next, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&bufferSize), sizeof(bufferSize));
+            setsockopt(m_previous, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>(&bufferSize), sizeof(bufferSize));
+
+            // Non-blocking, so the transport thread can feed one link while the other waits.
+            u_long nonBlocking = 1;
+            if (ioctlsocket(m_next, FIONBIO, &nonBlocking) != 0 || ioctlsocket(m_previous, FIONBIO, &nonBlocking) != 0)
+            {
+                *pError = SocketError(L"ioctlsocket");
+                return false;
+            }
+
+            return true;
+        }
+
+    protected:
+        bool Transfer(const void* pSend, size_t sendSize, void* pReceive, size_t receiveSize) override
+        {
+            const char* pSendBytes = static_cast<const char*>(pSend);
+            char* pReceiveBytes = static_cast<char*>(pReceive);
+
+            while (sendSize > 0 || receiveSize > 0)
+            {
+                fd_set writable;
+                fd_set readable;
+                FD_ZERO(&writable);
+                FD_ZERO(&readable);
+                if (sendSize > 0)
+                    FD_SET(m_next, &writable);
+                if (receiveSize > 0)
+                    FD_SET(m_previous, &readable);
+
+                timeval timeout = { static_cast<long>(ExchangeTimeoutMs / 1000), 0 };
+                if (select(0, &readable, &writable, nullptr, &timeout) <= 0)
+                    return false;
+
+                if (FD_ISSET(m_next, &writable))
+                {
+                    const int chunk = (sendSize < 0x40000000) ? static_cast<int>(sendSize) : 0x40000000;
+                    const int sent = send(m_next, pSendBytes, chunk, 0);
+                    if (sent == SOCKET_ERROR && WSAGetLastError() != WSAEWOULDBLOCK)
+                        return false;
+                    if (sent > 0)
+                    {
+                        pSendBytes += sent;
+                        sendSize -= sent;
+                    }
+                }
+
+                if (FD_ISSET(m_previous, &readable))
+                {
+                    const int chunk = (receiveSize < 0x40000000) ? static_cast<int>(receiveSize) : 0x40000000;
+                    const int received = recv(m_previous, pReceiveBytes, chunk, 0);
+                    if (received == 0 || (received == SOCKET_ERROR && WSAGetLastError() != WSAEWOULDBLOCK))
+                        return false;
+                    if (received > 0)
+                    {
+                        pReceiveBytes += received;
+                        receiveSize -= received;
+                    }
+                }
+            }
+            return true;
+        }
+
+    private:
+        int MakeAddress(uint32_t session, uint32_t rank, sockaddr_storage* pAddress) const
+        {
+            ZeroMemory(pAddress, sizeof(*pAddress));
+
+            if (m_bUnix)
+            {
+                sockaddr_un* pUnix = reinterpret_cast<sockaddr_un*>(pAddress);
+                pUnix->sun_family = AF_UNIX;
+
+                char tempPath[MAX_PATH];
+                GetTempPathA(MAX_PATH, tempPath);
+                sprintf_s(pUnix->sun_path, "%snBodyGravityRing_%u_%u.sock", tempPath, session, rank);
+                return sizeof(sockaddr_un);
+            }
+
+            sockaddr_in* pInet = reinterpret_cast<sockaddr_in*>(pAddress);
+            pInet->sin_family = AF_INET;
+            pInet->sin_port = htons(static_cast<u_short>(session + rank));
+            pInet->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            return sizeof(sockaddr_in);
+        }
+
+        bool m_bUnix;
+        bool m_bStarted;
+        SOCKET m_listener;
+        SOCKET m_next;
+        SOCKET m_previous;
+        std::string m_listenPath;
+    };
+
+    //
+    // Every rank receives through a mailbox of one message in a named file mapping. A message counts as
+    // sent once the sender has copied it in and bumped 'sent', and as taken once the receiver has copied
+    // it out and bumped 'received'; the 'full' and 'empty' events wake the side waiting for the other.
+    // Larger transfers go through in mailbox sized pieces, sending and receiving by turns: a rank only
+    // waits to send piece k once it has taken piece k - 1 itself, so the ring cannot stall. Mappings and
+    // events are created by whichever rank gets there first and opened by the other.
+    //
+    class SharedMemoryRingTransport : public RingTransport
+    {
+    public:
+        SharedMemoryRingTransport(uint32_t rank, uint32_t ranks) :
+            RingTransport(rank, ranks),
+            m_capacity(0)
+        {
+        }
+
+        ~SharedMemoryRingTransport()
+        {
+            for (int side = 0; side < 2; side++)
+            {
+                Endpoint& endpoint = m_endpoints[side];
+                if (endpoint.pMailbox)
+                    UnmapViewOfFile(endpoint.pMailbox);
+                if (endpoint.mapping)
+                    CloseHandle(endpoint.mapping);
+                if (endpoint.full)
+                    CloseHandle(endpoint.full);
+                if (endpoint.empty)
+                    CloseHandle(endpoint.empty);
+            }
+        }
+
+        bool Connect(uint32_t session, size_t maxMessageSize, std::wstring* pError)
+        {
+            m_capacity = maxMessageSize;
+            return Open(session, m_rank, &m_endpoints[e_Own], pError) && Open(session, (m_rank + 1) % m_ranks, &m_endpoints[e_Next], pError);
+        }
+
+    protected:
+        bool Transfer(const void* pSend, size_t sendSize, void* pReceive, size_t receiveSize) override
+        {
+            const uint8_t* pSendBytes = static_cast<const uint8_t*>(pSend);
+            uint8_t* pReceiveBytes = static_cast<uint8_t*>(pReceive);
+
+            // An empty transfer is still one (empty) piece, on both sides.
+            bool bSending = true;
+            bool bReceiving = true;
+            while (bSending || bReceiving)
+            {
+                if (bSending)
+                {
+                    const size_t piece = (sendSize < m_capacity) ? sendSize : m_capacity;
+                    if (!SendPiece(pSendBytes, piece))
+                        return false;
+                    pSendBytes += piece;
+                    sendSize -= piece;
+                    bSending = (sendSize > 0);
+                }
+
+                if (bReceiving)
+                {
+                    const size_t piece = (receiveSize < m_capacity) ? receiveSize : m_capacity;
+                    if (!ReceivePiece(pReceiveBytes, piece))
+                        return false;
+                    pReceiveBytes += piece;
+                    receiveSize -= piece;
+                    bReceiving = (receiveSize > 0);
+                }
+            }
+            return true;
+        }
+
+    private:
+        // A cache line of counters ahead of the message.
+        struct alignas(64) Mailbox
+        {
+            volatile LONG64 sent;
+            volatile LONG64 received;
+        };
+
+        struct Endpoint
+        {
+            HANDLE mapping = nullptr;
+            HANDLE full = nullptr;
+            HANDLE empty = nullptr;
+            Mailbox* pMailbox = nullptr;
+        };
+
+        enum Side
+        {
+            e_Own = 0,
+            e_Next
+        };
+
+        bool SendPiece(const uint8_t* pBytes, size_t piece)
+        {
+            Endpoint& next = m_endpoints[e_Next];
+
+            while (next.pMailbox->sent != next.pMailbox->received)
+            {
+                if (WaitForSingleObject(next.empty, ExchangeTimeoutMs) != WAIT_OBJECT_0)
+                    return false;
+            }
+
+            if (piece > 0)
+                memcpy(next.pMailbox + 1, pBytes, piece);
+            InterlockedIncrement64(&next.pMailbox->sent);
+            SetEvent(next.full);
+            return true;
+        }
+
+        bool ReceivePiece(uint8_t* pBytes, size_t piece)
+        {
+            Endpoint& own = m_endpoints[e_Own];
+
+            while (own.pMailbox->sent == own.pMailbox->received)
+            {
+                if (WaitForSingleObject(own.full, ExchangeTimeoutMs) != WAIT_OBJECT_0)
+                    return false;
+            }
+
+            if (piece > 0)
+                memcpy(pBytes, own.pMailbox + 1, piece);
+            InterlockedIncrement64(&own.pMailbox->received);
+            SetEvent(own.empty);
+            return true;
+        }
+
+        bool Open(uint32_t session, uint32_t rank, Endpoint* pEndpoint, std::wstring* pError)
+        {
+            std::wstringstream name;
+            name << L"Local\\nBodyGravityRing_" << session << L"_" << rank;
+
+            const uint64_t size = sizeof(Mailbox) + m_capacity;
+            pEndpoint->mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), name.str().c_str());
+            if (pEndpoint->mapping)
+                pEndpoint->pMailbox = static_cast<Mailbox*>(MapViewOfFile(pEndpoint->mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0));
+
+            pEndpoint->full = CreateEventW(nullptr, FALSE, FALSE, (name.str() + L"_full").c_str());
+            pEndpoint->empty = CreateEventW(nullptr, FALSE, FALSE, (name.str() + L"_empty").c_str());
+
+            if (!pEndpoint->pMailbox || !pEndpoint->full || !pEndpoint->empty)
+            {
+                std::wstringstream message;
+                message << L"shared memory mailbox " << name.str() << L" failed, error " << GetLastError();
+                *pError = message.str();
+                return false;
+            }
+            return true;
+        }
+
+        size_t m_capacity;
+        Endpoint m_endpoints[2];
+    };
+}
+
+RingTransport::RingTransport(uint32_t rank, uint32_t ranks) :
+    m_rank(rank),
+    m_ranks(ranks),
+    m_bTransportStopping(false)
+{
+}
+
+//
+// By now the derived transport has closed its links, but the transport thread is idle: every exchange
+// has been waited for.
+//
+RingTransport::~RingTransport()
+{
+    if (m_transportThread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_transportMutex);
+            m_bTransportStopping = true;
+        }
+        m_transportWake.notify_one();
+        m_transportThread.join();
+    }
+}
+
+void RingTransport::StartTransportThread()
+{
+    m_bTransportStopping = false;
+    m_transportThread = std::thread(&RingTransport::RunTransportThread, this);
+}
+
+void RingTransport::RunTransportThread()
+{
+    for (;;)
+    {
+        std::packaged_task<bool()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_transportMutex);
+            m_transportWake.wait(lock, [this]() { return m_bTransportStopping || !m_transportJobs.empty(); });
+            if (m_transportJobs.empty())
+                return;
+            task = std::move(m_transportJobs.front());
+            m_transportJobs.pop_front();
+        }
+
+        task();
+    }
+}
+
+const wchar_t* RingTransport::GetTypeName(Type type)
+{
+    static const wchar_t* names[] = { L"tcp", L"unix", L"shm" };
+    return (type >= 0 && type < e_MAX_Type) ? names[type] : L"unknown";
+}
+
+bool RingTransport::ParseType(const wchar_t* pName, Type* pType)
+{
+    for (int type = 0; type < e_MAX_Type; type++)
+    {
+        if (_wcsicmp(pName, GetTypeName(static_cast<Type>(type))) == 0)
+        {
+            *pType = static_cast<Type>(type);
+            return true;
+        }
+    }
+    return false;
+}
+
+std::unique_ptr<RingTransport> RingTransport::Create(Type type, uint32_t rank, uint32_t ranks, uint32_t session, size_t maxMessageSize, std::wstring* pError)
+{
+    if (type == e_SharedMemory)
+    {
+        std::unique_ptr<SharedMemoryRingTransport> transport(new SharedMemoryRingTransport(rank, ranks));
+        if (!transport->Connect(session, maxMessageSize, pError))
+            return nullptr;
+        transport->StartTransportThread();
+        return std::move(transport);
+    }
+
+    std::unique_ptr<SocketRingTransport> transport(new SocketRingTransport(rank, ranks, type == e_UnixSocket));
+    if (!transport->Connect(session, pError))
+        return nullptr;
+    transport->StartTransportThread();
+    return std::move(transport);
+}
+
+void RingTransport::BeginExchange(const void* pSend, void* pReceive, size_t size)
+{
+    BeginExchange(pSend, size, pReceive, size);
+}
+
+void RingTransport::BeginExchange(const void* pSend, size_t sendSize, void* pReceive, size_t receiveSize)
+{
+    std::packaged_task<bool()> task([this, pSend, sendSize, pReceive, receiveSize]() { return Transfer(pSend, sendSize, pReceive, receiveSize); });
+    m_exchange = task.get_future();
+    {
+        std::lock_guard<std::mutex> lock(m_transportMutex);
+        m_transportJobs.push_back(std::move(task));
+    }
+    m_transportWake.notify_one();
+}
+
+bool RingTransport::WaitExchange()
+{
+    return m_exchange.get();
+}
+
+bool RingTransport::Exchange(const std::vector<uint8_t>& send, std::vector<uint8_t>* pReceive)
+{
+    // The sizes first, so the receiver can make room.
+    uint64_t sendSize = send.size();
+    uint64_t receiveSize = 0;
+    BeginExchange(&sendSize, sizeof(sendSize), &receiveSize, sizeof(receiveSize));
+    if (!WaitExchange())
+        return false;
+
+    pReceive->resize(static_cast<size_t>(receiveSize));
+    BeginExchange(send.empty() ? nullptr : &send[0], send.size(), pReceive->empty() ? nullptr : &(*pReceive)[0], pReceive->size());
+    return WaitExchange();
+}
+
+bool RingTransport::AllGather(const std::vector<uint8_t>& own, std::vector<std::vector<uint8_t>>* pAll)
+{
+    pAll->assign(m_ranks, std::vector<uint8_t>());
+    (*pAll)[m_rank] = own;
+
+    // After pass k a rank holds the data of the rank k places before it.
+    std::vector<uint8_t> current = own;
+    std::vector<uint8_t> received;
+    for (uint32_t pass = 1; pass < m_ranks; pass++)
+    {
+        if (!Exchange(current, &received))
+            return false;
+        (*pAll)[(m_rank + m_ranks - pass) % m_ranks] = received;
+        current.swap(received);
+    }
+    return true;
+}
+
+//
+// The messages travel as packets of source, destination and size, followed by the data. Each pass every
+// rank keeps the packets for itself and forwards the rest, so a packet is delivered after as many passes
+// as its destination is ranks ahead of its source.
+//
+bool RingTransport::AllToAll(const std::vector<std::vector<uint8_t>>& outgoing, std::vector<std::vector<uint8_t>>* pIncoming)
+{
+    struct PacketHeader
+    {
+        uint32_t source;
+        uint32_t destination;
+        uint64_t size;
+    };
+
+    pIncoming->assign(m_ranks, std::vector<uint8_t>());
+    (*pIncoming)[m_rank] = outgoing[m_rank];
+
+    std::vector<uint8_t> travelling;
+    auto append = [&](uint32_t source, uint32_t destination, const uint8_t* pData, size_t size)
+    {
+        const PacketHeader header = { source, destination, size };
+        const uint8_t* pHeader = reinterpret_cast<const uint8_t*>(&header);
+        travelling.insert(travelling.end(), pHeader, pHeader + sizeof(header));
+        travelling.insert(travelling.end(), pData, pData + size);
+    };
+
+    for (uint32_t destination = 0; destination < m_ranks; destination++)
+    {
+        if (destination != m_rank)
+            append(m_rank, destination, outgoing[destination].data(), outgoing[destination].size());
+    }
+
+    std::vector<uint8_t> received;
+    for (uint32_t pass = 1; pass < m_ranks; pass++)
+    {
+        if (!Exchange(travelling, &received))
+            return false;
+
+        travelling.clear();
+        size_t offset = 0;
+        while (offset + sizeof(PacketHeader) <= received.size())
+        {
+            PacketHeader header;
+            memcpy(&header, &received[offset], sizeof(header));
+            const uint8_t* pData = received.data() + offset + sizeof(header);
+            offset += sizeof(header) + static_cast<size_t>(header.size);
+
+            if (header.destination == m_rank)
+                (*pIncoming)[header.source].assign(pData, pData + header.size);
+            else
+                append(header.source, header.destination, pData, static_cast<size_t>(header.size));
+        }
+    }
+    return true;
+}
@@ -0,0 +1,112 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//
+// Links between the processes of a ring, for the distributed direct sum (RingSolver).
+//
+// Rank r sends to rank r + 1 and receives from rank r - 1, wrapping round at the ends. BeginExchange()
+// hands sending one buffer and receiving into another to the rank's transport thread and returns at once,
+// so the caller can compute while the data moves; WaitExchange() waits for both. The transport thread
+// lives as long as the transport and runs the exchanges in order.
+//
+// The transports only differ in their blocking Transfer(), which moves both directions at once:
+//   e_Tcp           TCP over the loopback interface, rank r listening on port session + r.
+//   e_UnixSocket    AF_UNIX stream sockets (Windows 10 1803 and later), a socket file per rank in %TEMP%.
+//   e_SharedMemory  A mailbox per rank in a named file mapping, handed over with a pair of named events.
+// All three run the ring on one machine, which is how it is tested; TCP could link several.
+//
+// Exchange(), AllGather() and AllToAll() build the collectives of the domain decomposition on the same
+// two links, for messages of any size.
+//
+class RingTransport
+{
+public:
+    enum Type
+    {
+        e_Tcp = 0,
+        e_UnixSocket,
+        e_SharedMemory,
+        e_MAX_Type
+    };
+
+    static const wchar_t* GetTypeName(Type type);
+    static bool ParseType(const wchar_t* pName, Type* pType);
+
+    // Join rank 'rank' of 'ranks' to the ring identified by 'session', which is also the TCP base port.
+    // maxMessageSize is the largest transfer expected, the shared memory mailbox size; larger ones still
+    // go through, in pieces. Returns null on failure, with the reason in *pError.
+    static std::unique_ptr<RingTransport> Create(Type type, uint32_t rank, uint32_t ranks, uint32_t session, size_t maxMessageSize, std::wstring* pError);
+
+    virtual ~RingTransport();
+
+    void BeginExchange(const void* pSend, void* pReceive, size_t size);
+    void BeginExchange(const void* pSend, size_t sendSize, void* pReceive, size_t receiveSize);
+    bool WaitExchange();
+
+    // Send a buffer to the next rank and receive the previous rank's, of whatever size, and wait.
+    bool Exchange(const std::vector<uint8_t>& send, std::vector<uint8_t>* pReceive);
+
+    // Every rank's 'own' into (*pAll)[rank], on every rank.
+    bool AllGather(const std::vector<uint8_t>& own, std::vector<std::vector<uint8_t>>* pAll);
+
+    // outgoing[rank] to each rank, and what each rank sent this one into (*pIncoming)[rank].
+    bool AllToAll(const std::vector<std::vector<uint8_t>>& outgoing, std::vector<std::vector<uint8_t>>* pIncoming);
+
+    uint32_t GetRank() const    { return m_rank; }
+    uint32_t GetRanks() const   { return m_ranks; }
+
+protected:
+    RingTransport(uint32_t rank, uint32_t ranks);
+
+    // Send sendSize bytes to the next rank while receiving receiveSize from the previous one, on the
+    // transport thread. Neither side may wait for the whole of one direction before starting the other.
+    virtual bool Transfer(const void* pSend, size_t sendSize, void* pReceive, size_t receiveSize) = 0;
+
+    uint32_t m_rank;
+    uint32_t m_ranks;
+
+private:
+    void StartTransportThread();
+    void RunTransportThread();
+
+    std::thread m_transportThread;
+    std::mutex m_transportMutex;
+    std::condition_variable m_transportWake;
+    std::deque<std::packaged_task<bool()>> m_transportJobs;
+    bool m_bTransportStopping;
+    std::future<bool> m_exchange;
+};
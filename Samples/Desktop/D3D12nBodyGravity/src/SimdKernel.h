@@ -0,0 +1,346 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#pragma once
+
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <immintrin.h>
+#define SIMD_KERNEL_SSE 1
+#endif
+
+#if defined(__AVX2__)
+#define SIMD_KERNEL_AVX 1
+#endif
+
+// Add the auto generated ISPC kernel header, for the particle layout
+#include "nBodyGravity_ispc.h"
+
+//
+// Direct sum written in plain C++ on thin SIMD wrappers, templated on precision, width and unroll.
+//
+// It does the same work as the ISPC ProcessParticles kernel: the outer loop runs 'Width' particles at
+// once, the inner loop broadcasts one read particle at a time to every lane, in particle order, and is
+// unrolled 'Unroll' times. In float it uses the same Q_rsqrt as the ISPC kernel, so it is a like for like
+// baseline; in double it uses a full precision square root.
+//
+// It needs no ISPC compiler. The SSE widths are always built on x86; the AVX widths only when the
+// compiler targets AVX2 (/arch:AVX2), since the SSE/AVX choice is made at compile time. GetKernels() lists
+// every instantiation that was built.
+//
+namespace SimdKernel
+{
+    enum Precision
+    {
+        e_Float = 0,
+        e_Double,
+    };
+
+    //
+    // SIMD wrappers. Each provides Splat, Load/Store of 'Width' values, +, -, * and InvSqrt.
+    //
+    template <typename T, int Width> struct Simd;
+
+    template <typename T>
+    struct Simd<T, 1>
+    {
+        T v;
+
+        static Simd Splat(T value)                          { Simd r; r.v = value; return r; }
+        static Simd Load(const T* p)                        { return Splat(p[0]); }
+        void Store(T* p) const                              { p[0] = v; }
+
+        friend Simd operator+(Simd a, Simd b)               { return Splat(a.v + b.v); }
+        friend Simd operator-(Simd a, Simd b)               { return Splat(a.v - b.v); }
+        friend Simd operator*(Simd a, Simd b)               { return Splat(a.v * b.v); }
+    };
+
+    // Q_rsqrt: the bit level estimate and one Newton step.
+    inline Simd<float, 1> InvSqrt(Simd<float, 1> x)
+    {
+        int32_t bits;
+        memcpy(&bits, &x.v, sizeof(bits));
+        bits = 0x5f3759df - (bits >> 1);
+
+        float y;
+        memcpy(&y, &bits, sizeof(y));
+        return Simd<float, 1>::Splat(y * (1.5f - (x.v * 0.5f * y * y)));
+    }
+
+    inline Simd<double, 1> InvSqrt(Simd<double, 1> x)
+    {
+        return Simd<double, 1>::Splat(1.0 / sqrt(x.v));
+    }
+
+#if SIMD_KERNEL_SSE
+    template <>
+    struct Simd<float, 4>
+    {
+        __m128 v;
+
+        static Simd Splat(float value)                      { Simd r; r.v = _mm_set1_ps(value); return r; }
+        static Simd Load(const float* p)                    { Simd r; r.v = _mm_loadu_ps(p); return r; }
+        void Store(float* p) const                          { _mm_storeu_ps(p, v); }
+
+        friend Simd operator+(Simd a, Simd b)               { Simd r; r.v = _mm_add_ps(a.v, b.v); return r; }
+        friend Simd operator-(Simd a, Simd b)               { Simd r; r.v = _mm_sub_ps(a.v, b.v); return r; }
+        friend Simd operator*(Simd a, Simd b)               { Simd r; r.v = _mm_mul_ps(a.v, b.v); return r; }
+    };
+
+    inline Simd<float, 4> InvSqrt(Simd<float, 4> x)
+    {
+        __m128i bits = _mm_sub_epi32(_mm_set1_epi32(0x5f3759df), _mm_srli_epi32(_mm_castps_si128(x.v), 1));
+        __m128 y = _mm_castsi128_ps(bits);
+
+        Simd<float, 4> r;
+        r.v = _mm_mul_ps(y, _mm_sub_ps(_mm_set1_ps(1.5f), _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(x.v, _mm_set1_ps(0.5f)), y), y)));
+        return r;
+    }
+
+    template <>
+    struct Simd<double, 2>
+    {
+        __m128d v;
+
+        static Simd Splat(double value)                     { Simd r; r.v = _mm_set1_pd(value); return r; }
+        static Simd Load(const double* p)                   { Simd r; r.v = _mm_loadu_pd(p); return r; }
+        void Store(double* p) const                         { _mm_storeu_pd(p, v); }
+
+        friend Simd operator+(Simd a, Simd b)               { Simd r; r.v = _mm_add_pd(a.v, b.v); return r; }
+        friend Simd operator-(Simd a, Simd b)               { Simd r; r.v = _mm_sub_pd(a.v, b.v); return r; }
+        friend Simd operator*(Simd a, Simd b)               { Simd r; r.v = _mm_mul_pd(a.v, b.v); return r; }
+    };
+
+    inline Simd<double, 2> InvSqrt(Simd<double, 2> x)
+    {
+        Simd<double, 2> r;
+        r.v = _mm_div_pd(_mm_set1_pd(1.0), _mm_sqrt_pd(x.v));
+        return r;
+    }
+#endif
+
+#if SIMD_KERNEL_AVX
+    template <>
+    struct Simd<float, 8>
+    {
+        __m256 v;
+
+        static Simd Splat(float value)                      { Simd r; r.v = _mm256_set1_ps(value); return r; }
+        static Simd Load(const float* p)                    { Simd r; r.v = _mm256_loadu_ps(p); return r; }
+        void Store(float* p) const                          { _mm256_storeu_ps(p, v); }
+
+        friend Simd operator+(Simd a, Simd b)               { Simd r; r.v = _mm256_add_ps(a.v, b.v); return r; }
+        friend Simd operator-(Simd a, Simd b)               { Simd r; r.v = _mm256_sub_ps(a.v, b.v); return r; }
+        friend Simd operator*(Simd a, Simd b)               { Simd r; r.v = _mm256_mul_ps(a.v, b.v); return r; }
+    };
+
+    inline Simd<float, 8> InvSqrt(Simd<float, 8> x)
+    {
+        __m256i bits = _mm256_sub_epi32(_mm256_set1_epi32(0x5f3759df), _mm256_srli_epi32(_mm256_castps_si256(x.v), 1));
+        __m256 y = _mm256_castsi256_ps(bits);
+
+        Simd<float, 8> r;
+        r.v = _mm256_mul_ps(y, _mm256_sub_ps(_mm256_set1_ps(1.5f), _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(x.v, _mm256_set1_ps(0.5f)), y), y)));
+        return r;
+    }
+
+    template <>
+    struct Simd<double, 4>
+    {
+        __m256d v;
+
+        static Simd Splat(double value)                     { Simd r; r.v = _mm256_set1_pd(value); return r; }
+        static Simd Load(const double* p)                   { Simd r; r.v = _mm256_loadu_pd(p); return r; }
+        void Store(double* p) const                         { _mm256_storeu_pd(p, v); }
+
+        friend Simd operator+(Simd a, Simd b)               { Simd r; r.v = _mm256_add_pd(a.v, b.v); return r; }
+        friend Simd operator-(Simd a, Simd b)               { Simd r; r.v = _mm256_sub_pd(a.v, b.v); return r; }
+        friend Simd operator*(Simd a, Simd b)               { Simd r; r.v = _mm256_mul_pd(a.v, b.v); return r; }
+    };
+
+    inline Simd<double, 4> InvSqrt(Simd<double, 4> x)
+    {
+        Simd<double, 4> r;
+        r.v = _mm256_div_pd(_mm256_set1_pd(1.0), _mm256_sqrt_pd(x.v));
+        return r;
+    }
+#endif
+
+    //
+    // One read particle pulling on every lane, the body-body interaction of nBodyGravity.isph.
+    //
+    template <typename V, typename T>
+    inline void Interact(V& ax, V& ay, V& az, const V& px, const V& py, const V& pz, const ispc::Vec4& that)
+    {
+        const V rx = V::Splat(static_cast<T>(that.x)) - px;
+        const V ry = V::Splat(static_cast<T>(that.y)) - py;
+        const V rz = V::Splat(static_cast<T>(that.z)) - pz;
+
+        const V distSqr = rx * rx + ry * ry + rz * rz + V::Splat(static_cast<T>(0.0000015625f));
+        const V invDist = InvSqrt(distSqr);
+        const V s = V::Splat(static_cast<T>(66.73f)) * (invDist * invDist * invDist);
+
+        ax = ax + rx * s;
+        ay = ay + ry * s;
+        az = az + rz * s;
+    }
+
+    //
+    // Update particles [particleStart, particleStart + particleCount) from all 'totalParticles' read particles.
+    //
+    template <typename T, int Width, int Unroll>
+    void ProcessParticles(uint32_t particleStart, uint32_t particleCount, const ispc::Particle* pRead, ispc::Particle* pWrite, uint32_t totalParticles)
+    {
+        typedef Simd<T, Width> V;
+        const float timeStepDelta = 0.1f;
+        const uint32_t particleEnd = particleStart + particleCount;
+
+        for (uint32_t ii = particleStart; ii < particleEnd; ii += Width)
+        {
+            // A partial last group repeats its final particle in the spare lanes and does not store them.
+            const uint32_t lanes = (particleEnd - ii < static_cast<uint32_t>(Width)) ? particleEnd - ii : Width;
+
+            T x[Width], y[Width], z[Width];
+            for (int lane = 0; lane < Width; lane++)
+            {
+                const ispc::Vec4& position = pRead[ii + ((static_cast<uint32_t>(lane) < lanes) ? lane : lanes - 1)].position;
+                x[lane] = static_cast<T>(position.x);
+                y[lane] = static_cast<T>(position.y);
+                z[lane] = static_cast<T>(position.z);
+            }
+
+            const V px = V::Load(x);
+            const V py = V::Load(y);
+            const V pz = V::Load(z);
+            V ax = V::Splat(0);
+            V ay = V::Splat(0);
+            V az = V::Splat(0);
+
+            uint32_t jj = 0;
+            for (; jj + Unroll <= totalParticles; jj += Unroll)
+            {
+                // A constant trip count, unrolled by the compiler.
+                for (int u = 0; u < Unroll; u++)
+                    Interact<V, T>(ax, ay, az, px, py, pz, pRead[jj + u].position);
+            }
+            for (; jj < totalParticles; jj++)
+            {
+                Interact<V, T>(ax, ay, az, px, py, pz, pRead[jj].position);
+            }
+
+            T accelX[Width], accelY[Width], accelZ[Width];
+            ax.Store(accelX);
+            ay.Store(accelY);
+            az.Store(accelZ);
+
+            //
+            // Integrate each lane in float, as the ISPC kernel does.
+            //
+            for (uint32_t lane = 0; lane < lanes; lane++)
+            {
+                const ispc::Particle& read = pRead[ii + lane];
+                ispc::Particle& write = pWrite[ii + lane];
+
+                const float accelerationX = static_cast<float>(accelX[lane]);
+                const float accelerationY = static_cast<float>(accelY[lane]);
+                const float accelerationZ = static_cast<float>(accelZ[lane]);
+
+                ispc::Vec4 vel = read.velocity;
+                vel.x += accelerationX * timeStepDelta;
+                vel.y += accelerationY * timeStepDelta;
+                vel.z += accelerationZ * timeStepDelta;
+                vel.w = 1.0f / InvSqrt(Simd<float, 1>::Splat((accelerationX * accelerationX) + (accelerationY * accelerationY) + (accelerationZ * accelerationZ))).v;
+
+                write.position.x = read.position.x + vel.x * timeStepDelta;
+                write.position.y = read.position.y + vel.y * timeStepDelta;
+                write.position.z = read.position.z + vel.z * timeStepDelta;
+                write.position.w = read.position.w;
+                write.velocity = vel;
+            }
+        }
+    }
+
+    //
+    // Compile time dispatch table of every built instantiation, widest first within each precision.
+    //
+    typedef void (*KernelFunction)(uint32_t particleStart, uint32_t particleCount, const ispc::Particle* pRead, ispc::Particle* pWrite, uint32_t totalParticles);
+
+    struct KernelEntry
+    {
+        Precision precision;
+        int width;
+        int unroll;
+        KernelFunction pFunction;
+    };
+
+    #define SIMD_KERNEL_ENTRIES(type, precision, width) \
+        { precision, width, 4, &ProcessParticles<type, width, 4> }, \
+        { precision, width, 8, &ProcessParticles<type, width, 8> }, \
+        { precision, width, 16, &ProcessParticles<type, width, 16> }
+
+    inline const KernelEntry* GetKernels(size_t* pCount)
+    {
+        static const KernelEntry kernels[] =
+        {
+#if SIMD_KERNEL_AVX
+            SIMD_KERNEL_ENTRIES(float, e_Float, 8),
+#endif
+#if SIMD_KERNEL_SSE
+            SIMD_KERNEL_ENTRIES(float, e_Float, 4),
+#endif
+            SIMD_KERNEL_ENTRIES(float, e_Float, 1),
+#if SIMD_KERNEL_AVX
+            SIMD_KERNEL_ENTRIES(double, e_Double, 4),
+#endif
+#if SIMD_KERNEL_SSE
+            SIMD_KERNEL_ENTRIES(double, e_Double, 2),
+#endif
+            SIMD_KERNEL_ENTRIES(double, e_Double, 1),
+        };
+
+        *pCount = sizeof(kernels) / sizeof(kernels[0]);
+        return kernels;
+    }
+
+    #undef SIMD_KERNEL_ENTRIES
+
+    // The kernel with the given precision and unroll, widest available if 'width' is 0. Null when not built.
+    inline const KernelEntry* FindKernel(Precision precision, int width, int unroll)
+    {
+        size_t count;
+        const KernelEntry* pKernels = GetKernels(&count);
+
+        for (size_t ii = 0; ii < count; ii++)
+        {
+            if (pKernels[ii].precision == precision && (width == 0 || pKernels[ii].width == width) && pKernels[ii].unroll == unroll)
+                return &pKernels[ii];
+        }
+
+        return nullptr;
+    }
+}
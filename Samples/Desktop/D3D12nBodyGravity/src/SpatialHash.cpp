@@ -0,0 +1,107 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#include "stdafx.h"
+#include "SpatialHash.h"
+#include "RingSolver.h"
+#include "Profiler.h"
+#include <algorithm>
+
+// Concurrency
+#include <ppl.h>
+
+SpatialHash::SpatialHash() :
+    m_invCellSize(1.0f),
+    m_tableMask(MinTableSize - 1),
+    m_bucketStarts(MinTableSize + 1, 0)
+{
+}
+
+void SpatialHash::Build(const float* pX, const float* pY, const float* pZ, uint32_t stride, uint32_t count, float cellSize, int threads)
+{
+    PROFILE_SCOPE("Spatial hash build");
+
+    uint32_t tableSize = MinTableSize;
+    while (tableSize < 2 * count)
+        tableSize *= 2;
+
+    m_invCellSize = 1.0f / cellSize;
+    m_tableMask = tableSize - 1;
+    m_buckets.resize(count);
+    m_bucketStarts.resize(tableSize + 1);
+    m_sortedIndices.resize(count);
+    if (m_cursors.size() != tableSize)
+        m_cursors = std::vector<std::atomic<uint32_t>>(tableSize);
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        uint32_t start, end;
+        RingSolver::GetSlice(tableSize, thread, threads, &start, &end);
+        for (uint32_t bucket = start; bucket < end; bucket++)
+            m_cursors[bucket].store(0, std::memory_order_relaxed);
+
+        RingSolver::GetSlice(count, thread, threads, &start, &end);
+        if (start < end)
+            ispc::HashPoints(pX, pY, pZ, stride, start, end, m_invCellSize, m_tableMask, &m_buckets[0]);
+    });
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        uint32_t start, end;
+        RingSolver::GetSlice(count, thread, threads, &start, &end);
+        for (uint32_t ii = start; ii < end; ii++)
+            m_cursors[m_buckets[ii]].fetch_add(1, std::memory_order_relaxed);
+    });
+
+    // The table is a few times the point count, a serial pass over it is cheap next to the rest.
+    uint32_t sum = 0;
+    for (uint32_t bucket = 0; bucket < tableSize; bucket++)
+    {
+        m_bucketStarts[bucket] = sum;
+        sum += m_cursors[bucket].load(std::memory_order_relaxed);
+        m_cursors[bucket].store(m_bucketStarts[bucket], std::memory_order_relaxed);
+    }
+    m_bucketStarts[tableSize] = sum;
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        uint32_t start, end;
+        RingSolver::GetSlice(count, thread, threads, &start, &end);
+        for (uint32_t ii = start; ii < end; ii++)
+            m_sortedIndices[m_cursors[m_buckets[ii]].fetch_add(1, std::memory_order_relaxed)] = ii;
+    });
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        uint32_t start, end;
+        RingSolver::GetSlice(tableSize, thread, threads, &start, &end);
+        for (uint32_t bucket = start; bucket < end; bucket++)
+        {
+            if (m_bucketStarts[bucket + 1] - m_bucketStarts[bucket] > 1)
+                std::sort(m_sortedIndices.begin() + m_bucketStarts[bucket], m_sortedIndices.begin() + m_bucketStarts[bucket + 1]);
+        }
+    });
+}
@@ -0,0 +1,72 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+// Add the auto generated ISPC kernel header
+#include "nBodyGravityHash_ispc.h"
+
+//
+// Points binned into the cells of a uniform grid, for finding everything within a cell size of a point
+// in O(N) without bounding the space.
+//
+// Cells hash into a table of at least twice as many buckets as points (HashCell() in nBodyGravity.isph).
+// Build() hashes the points with ISPC, counts the points of every bucket with atomic increments, turns
+// the counts into bucket starts with a prefix sum and scatters the point indices into bucket order, all
+// on all threads. The few indices of each bucket are then sorted, so the result does not depend on the
+// thread count or timing.
+//
+// A query visits the 27 cells around a point's cell; the kernels that walk the buckets live with their
+// users (nBodyGravityCollide.ispc).
+//
+class SpatialHash
+{
+public:
+    SpatialHash();
+
+    // Bin 'count' points whose coordinates are pX[ii * stride], pY[ii * stride] and pZ[ii * stride].
+    void Build(const float* pX, const float* pY, const float* pZ, uint32_t stride, uint32_t count, float cellSize, int threads);
+
+    float GetInvCellSize() const                { return m_invCellSize; }
+    uint32_t GetTableMask() const               { return m_tableMask; }
+
+    // Bucket b holds GetSortedIndices()[GetBucketStarts()[b] .. GetBucketStarts()[b + 1]).
+    const uint32_t* GetBucketStarts() const     { return &m_bucketStarts[0]; }
+    const uint32_t* GetSortedIndices() const    { return m_sortedIndices.empty() ? nullptr : &m_sortedIndices[0]; }
+
+private:
+    static const uint32_t MinTableSize = 1024;
+
+    float m_invCellSize;
+    uint32_t m_tableMask;
+    std::vector<uint32_t> m_buckets;                // Of every point.
+    std::vector<std::atomic<uint32_t>> m_cursors;   // Counts, then the next free slot of every bucket.
+    std::vector<uint32_t> m_bucketStarts;
+    std::vector<uint32_t> m_sortedIndices;
+};
@@ -0,0 +1,313 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#include "stdafx.h"
+#include "SphGas.h"
+#include "RingSolver.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+// Concurrency
+#include <ppl.h>
+
+// G times the mass of every particle and the softening without gas, as in bodyBodyInteraction(). Some
+// softening is needed for a particle's pull on itself to come out zero.
+static const float ParticleMassG = 66.73f;
+static const float MinSofteningSquared = 0.0000015625f;
+
+SphGas::SphGas() :
+    m_parameters(GetDefaultParameters()),
+    m_gasCount(0),
+    m_maxSmoothingLength(0.0f),
+    m_softeningSquared(MinSofteningSquared),
+    m_statistics()
+{
+}
+
+SphGas::Parameters SphGas::GetDefaultParameters()
+{
+    Parameters parameters;
+    parameters.adiabaticIndex = 5.0f / 3.0f;
+    parameters.initialSoundSpeed = 10.0f;
+    parameters.smoothingFactor = 1.2f;
+    parameters.maxSmoothingGrowth = 4.0f;
+    parameters.softeningFactor = 0.5f;
+    parameters.viscosityAlpha = 1.0f;
+    parameters.viscosityBeta = 2.0f;
+    parameters.timeStep = 0.1f;
+    return parameters;
+}
+
+void SphGas::Initialize(const ispc::Particle* pParticles, uint32_t particleCount, uint32_t gasCount, const Parameters& parameters, int threads)
+{
+    m_parameters = parameters;
+    m_gasCount = (gasCount < particleCount) ? gasCount : particleCount;
+    m_statistics = Statistics();
+
+    m_particles.assign(pParticles, pParticles + particleCount);
+    m_positions.resize(particleCount);
+    m_gravity.resize(particleCount);
+
+    const float gamma = parameters.adiabaticIndex;
+    m_densities.assign(m_gasCount, 0.0f);
+    m_pressures.assign(m_gasCount, 0.0f);
+    m_soundSpeeds.assign(m_gasCount, 0.0f);
+    m_internalEnergies.assign(m_gasCount, parameters.initialSoundSpeed * parameters.initialSoundSpeed / (gamma * (gamma - 1.0f)));
+    m_pressureAccelerations.resize(m_gasCount);
+    m_energyRates.assign(m_gasCount, 0.0f);
+    m_smoothingLengths.assign(m_gasCount, 0.0f);
+    m_neighbourStarts.assign(m_gasCount, 0);
+    m_neighbourCounts.assign(m_gasCount, 0);
+    m_softeningSquared = MinSofteningSquared;
+    if (m_gasCount == 0)
+        return;
+
+    // Start from the mean spacing of the gas spread evenly over its bounding box.
+    float lower[3] = { m_particles[0].position.x, m_particles[0].position.y, m_particles[0].position.z };
+    float upper[3] = { lower[0], lower[1], lower[2] };
+    for (uint32_t ii = 1; ii < m_gasCount; ii++)
+    {
+        const float position[3] = { m_particles[ii].position.x, m_particles[ii].position.y, m_particles[ii].position.z };
+        for (int axis = 0; axis < 3; axis++)
+        {
+            lower[axis] = (position[axis] < lower[axis]) ? position[axis] : lower[axis];
+            upper[axis] = (position[axis] > upper[axis]) ? position[axis] : upper[axis];
+        }
+    }
+
+    const double volume = static_cast<double>(upper[0] - lower[0]) * (upper[1] - lower[1]) * (upper[2] - lower[2]);
+    const float spacing = (volume > 0.0) ? static_cast<float>(cbrt(volume / m_gasCount)) : 1.0f;
+    std::fill(m_smoothingLengths.begin(), m_smoothingLengths.end(), parameters.smoothingFactor * spacing);
+    m_maxSmoothingLength = parameters.maxSmoothingGrowth * parameters.smoothingFactor * spacing;
+
+    // A few rounds of densities and the smoothing lengths they give, free to change more than in a step,
+    // settle each particle on its own density before the first step.
+    for (int round = 0; round < 3; round++)
+    {
+        BuildNeighbours(threads);
+        ComputeDensities(threads);
+
+        for (uint32_t ii = 0; ii < m_gasCount; ii++)
+        {
+            const float h = parameters.smoothingFactor / cbrtf(m_densities[ii]);
+            m_smoothingLengths[ii] = (h < m_maxSmoothingLength) ? h : m_maxSmoothingLength;
+        }
+    }
+
+    BuildNeighbours(threads);
+    ComputeDensities(threads);
+
+    double smoothingSum = 0.0;
+    for (uint32_t ii = 0; ii < m_gasCount; ii++)
+        smoothingSum += m_smoothingLengths[ii];
+    const float softening = parameters.softeningFactor * static_cast<float>(smoothingSum / m_gasCount);
+    m_softeningSquared = (softening * softening > MinSofteningSquared) ? softening * softening : MinSofteningSquared;
+}
+
+void SphGas::BuildNeighbours(int threads)
+{
+    PROFILE_SCOPE("SPH neighbours");
+
+    float largest = 0.0f;
+    for (uint32_t ii = 0; ii < m_gasCount; ii++)
+        largest = (m_smoothingLengths[ii] > largest) ? m_smoothingLengths[ii] : largest;
+
+    const uint32_t stride = sizeof(ispc::Particle) / sizeof(float);
+    m_hash.Build(&m_particles[0].position.x, &m_particles[0].position.y, &m_particles[0].position.z, stride, m_gasCount, 2.0f * largest, threads);
+
+    const size_t slotsSize = static_cast<size_t>(m_gasCount) * NeighbourCapacity;
+    m_neighbours.resize(slotsSize);
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        uint32_t start, end;
+        RingSolver::GetSlice(m_gasCount, thread, threads, &start, &end);
+        if (start < end)
+        {
+            ispc::SphFindNeighbours(&m_particles[0], start, end, &m_smoothingLengths[0], m_hash.GetBucketStarts(), m_hash.GetSortedIndices(),
+                                    m_hash.GetInvCellSize(), m_hash.GetTableMask(), &m_neighbours[static_cast<size_t>(start) * NeighbourCapacity], NeighbourCapacity,
+                                    &m_neighbourCounts[0]);
+        }
+    });
+
+    // The lists that did not fit go after the slots, in particle order.
+    std::vector<uint32_t> overflowed;
+    size_t overflowSize = 0;
+    for (uint32_t ii = 0; ii < m_gasCount; ii++)
+    {
+        if (m_neighbourCounts[ii] <= NeighbourCapacity)
+        {
+            m_neighbourStarts[ii] = static_cast<uint64_t>(ii) * NeighbourCapacity;
+            continue;
+        }
+
+        m_neighbourStarts[ii] = slotsSize + overflowSize;
+        overflowSize += m_neighbourCounts[ii];
+        overflowed.push_back(ii);
+    }
+    if (overflowed.empty())
+        return;
+
+    m_neighbours.resize(slotsSize + overflowSize);
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        uint32_t start, end;
+        RingSolver::GetSlice(static_cast<uint32_t>(overflowed.size()), thread, threads, &start, &end);
+        for (uint32_t slot = start; slot < end; slot++)
+        {
+            const uint32_t ii = overflowed[slot];
+            ispc::SphFindNeighbours(&m_particles[0], ii, ii + 1, &m_smoothingLengths[0], m_hash.GetBucketStarts(), m_hash.GetSortedIndices(),
+                                    m_hash.GetInvCellSize(), m_hash.GetTableMask(), &m_neighbours[m_neighbourStarts[ii]], m_neighbourCounts[ii],
+                                    &m_neighbourCounts[0]);
+        }
+    });
+}
+
+void SphGas::ComputeDensities(int threads)
+{
+    PROFILE_SCOPE("SPH density");
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        uint32_t start, end;
+        RingSolver::GetSlice(m_gasCount, thread, threads, &start, &end);
+        if (start < end)
+        {
+            ispc::SphDensity(&m_particles[0], start, end, &m_smoothingLengths[0], &m_internalEnergies[0], &m_neighbourStarts[0], &m_neighbourCounts[0],
+                             &m_neighbours[0], m_parameters.adiabaticIndex, &m_densities[0], &m_pressures[0], &m_soundSpeeds[0]);
+        }
+    });
+}
+
+void SphGas::Step(int threads)
+{
+    PROFILE_SCOPE("SPH step");
+
+    const uint32_t particleCount = GetParticleCount();
+    if (particleCount == 0)
+        return;
+
+    auto gravityBegin = std::chrono::high_resolution_clock::now();
+    {
+        PROFILE_SCOPE("SPH gravity");
+
+        concurrency::parallel_for<int>(0, threads, [&](int thread)
+        {
+            uint32_t start, end;
+            RingSolver::GetSlice(particleCount, thread, threads, &start, &end);
+            if (start < end)
+                ispc::RingGatherPositions(&m_particles[0], start, end, &m_positions[start]);
+        });
+
+        concurrency::parallel_for<int>(0, threads, [&](int thread)
+        {
+            uint32_t start, end;
+            RingSolver::GetSlice(particleCount, thread, threads, &start, &end);
+            if (start < end)
+                ispc::SphGravity(&m_particles[0], start, end, &m_positions[0], particleCount, ParticleMassG, m_softeningSquared, &m_gravity[start]);
+        });
+    }
+    auto neighbourBegin = std::chrono::high_resolution_clock::now();
+
+    const bool hasGas = (m_gasCount > 0);
+    if (hasGas)
+        BuildNeighbours(threads);
+    auto densityBegin = std::chrono::high_resolution_clock::now();
+
+    if (hasGas)
+        ComputeDensities(threads);
+    auto forceBegin = std::chrono::high_resolution_clock::now();
+
+    if (hasGas)
+    {
+        PROFILE_SCOPE("SPH forces");
+
+        concurrency::parallel_for<int>(0, threads, [&](int thread)
+        {
+            uint32_t start, end;
+            RingSolver::GetSlice(m_gasCount, thread, threads, &start, &end);
+            if (start < end)
+            {
+                ispc::SphForces(&m_particles[0], start, end, &m_smoothingLengths[0], &m_densities[0], &m_pressures[0], &m_soundSpeeds[0],
+                                &m_neighbourStarts[0], &m_neighbourCounts[0], &m_neighbours[0], m_parameters.viscosityAlpha, m_parameters.viscosityBeta,
+                                &m_pressureAccelerations[0], &m_energyRates[0]);
+            }
+        });
+    }
+    auto integrateBegin = std::chrono::high_resolution_clock::now();
+
+    // Only once every thread is done reading the positions and velocities.
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        uint32_t start, end;
+        RingSolver::GetSlice(particleCount, thread, threads, &start, &end);
+        if (start < end)
+        {
+            ispc::SphIntegrate(&m_particles[0], start, end, m_gasCount, &m_gravity[start], hasGas ? &m_pressureAccelerations[0] : nullptr,
+                               hasGas ? &m_energyRates[0] : nullptr, hasGas ? &m_densities[0] : nullptr, hasGas ? &m_internalEnergies[0] : nullptr,
+                               hasGas ? &m_smoothingLengths[0] : nullptr, m_parameters.smoothingFactor, m_maxSmoothingLength, m_parameters.timeStep);
+        }
+    });
+    auto integrateEnd = std::chrono::high_resolution_clock::now();
+
+    m_statistics.gravitySeconds += std::chrono::duration<double>(neighbourBegin - gravityBegin).count();
+    m_statistics.neighbourSeconds += std::chrono::duration<double>(densityBegin - neighbourBegin).count();
+    m_statistics.densitySeconds += std::chrono::duration<double>(forceBegin - densityBegin).count();
+    m_statistics.forceSeconds += std::chrono::duration<double>(integrateBegin - forceBegin).count();
+    m_statistics.integrateSeconds += std::chrono::duration<double>(integrateEnd - integrateBegin).count();
+    m_statistics.steps++;
+}
+
+SphGas::Diagnostics SphGas::GetDiagnostics() const
+{
+    Diagnostics diagnostics = {};
+    if (m_gasCount == 0)
+        return diagnostics;
+
+    double densitySum = 0.0;
+    double smoothingSum = 0.0;
+    uint64_t neighbourSum = 0;
+    for (uint32_t ii = 0; ii < m_gasCount; ii++)
+    {
+        const ispc::Vec4& velocity = m_particles[ii].velocity;
+        const float speedSquared = velocity.x * velocity.x + velocity.y * velocity.y + velocity.z * velocity.z;
+        const float courant = (m_soundSpeeds[ii] + sqrtf(speedSquared)) * m_parameters.timeStep / m_smoothingLengths[ii];
+
+        densitySum += m_densities[ii];
+        smoothingSum += m_smoothingLengths[ii];
+        neighbourSum += m_neighbourCounts[ii];
+        diagnostics.maxDensity = (m_densities[ii] > diagnostics.maxDensity) ? m_densities[ii] : diagnostics.maxDensity;
+        diagnostics.thermalEnergy += m_internalEnergies[ii];
+        diagnostics.kineticEnergy += 0.5 * speedSquared;
+        diagnostics.courantNumber = (courant > diagnostics.courantNumber) ? courant : diagnostics.courantNumber;
+    }
+
+    diagnostics.meanDensity = static_cast<float>(densitySum / m_gasCount);
+    diagnostics.meanSmoothingLength = static_cast<float>(smoothingSum / m_gasCount);
+    diagnostics.meanNeighbours = static_cast<float>(static_cast<double>(neighbourSum) / m_gasCount);
+    return diagnostics;
+}
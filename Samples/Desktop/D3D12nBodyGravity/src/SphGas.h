@@ -0,0 +1,146 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#pragma once
+
+#include "SpatialHash.h"
+
+// Add the auto generated ISPC kernel headers
+#include "nBodyGravityRing_ispc.h"
+#include "nBodyGravitySph_ispc.h"
+
+//
+// Gas by smoothed particle hydrodynamics, coupled to the gravity of the particles.
+//
+// The gas particles are the first gasCount of the particles and gravitate like the rest; their density,
+// pressure, sound speed, internal energy and smoothing length are kept in separate arrays alongside, one
+// float per gas particle each. Every step:
+//   1. The direct sum gives every particle its gravity, softened on the scale of the initial smoothing
+//      lengths since the gas is not resolved below them.
+//   2. The gas particles go into a SpatialHash with cells of twice the largest smoothing length, and each
+//      lists its neighbours in a slot of NeighbourCapacity. The few that find more are searched again
+//      into room after the slots, so the grid is walked about once.
+//   3. The density pass sums the spline over each list and applies the equation of state.
+//   4. The force pass walks the same lists for the pressure accelerations and heating.
+//   5. All particles are advanced, and the gas takes new smoothing lengths for its new densities.
+// So the grid is walked only to build the lists, and the two SPH passes read each particle's neighbours
+// contiguously, once each.
+//
+// The equation of state is the ideal gas with adiabatic index gamma, P = (gamma - 1) rho u, and shocks
+// heat the gas through the artificial viscosity.
+//
+class SphGas
+{
+public:
+    // Room for about twice the neighbours the default smoothing factor aims for.
+    static const uint32_t NeighbourCapacity = 128;
+
+    struct Parameters
+    {
+        float adiabaticIndex;           // Gamma of the equation of state.
+        float initialSoundSpeed;        // Sets the initial internal energy, the same for all the gas.
+        float smoothingFactor;          // Smoothing length over the mean spacing, 1.2 for about 58 neighbours.
+        float maxSmoothingGrowth;       // Cap on the smoothing lengths, relative to the gas spread evenly over its bounds.
+        float softeningFactor;          // Gravitational softening over the mean initial smoothing length.
+        float viscosityAlpha;
+        float viscosityBeta;
+        float timeStep;
+    };
+
+    struct Statistics
+    {
+        uint32_t steps;
+        double gravitySeconds;
+        double neighbourSeconds;        // The hash and the lists.
+        double densitySeconds;
+        double forceSeconds;
+        double integrateSeconds;
+    };
+
+    // The state of the gas now, for reports.
+    struct Diagnostics
+    {
+        float meanDensity;
+        float maxDensity;
+        float meanNeighbours;
+        float meanSmoothingLength;
+        double thermalEnergy;           // Of the whole gas, per unit mass of a particle.
+        double kineticEnergy;
+        float courantNumber;            // Largest (c + |v|) dt / h, which must stay below about 0.3.
+    };
+
+    SphGas();
+
+    static Parameters GetDefaultParameters();
+
+    // Take the particles, the first gasCount of which are gas, and give the gas its smoothing lengths
+    // and densities, all the same for any thread count.
+    void Initialize(const ispc::Particle* pParticles, uint32_t particleCount, uint32_t gasCount, const Parameters& parameters, int threads);
+
+    void Step(int threads);
+
+    Diagnostics GetDiagnostics() const;
+
+    uint32_t GetParticleCount() const               { return static_cast<uint32_t>(m_particles.size()); }
+    uint32_t GetGasCount() const                    { return m_gasCount; }
+    const ispc::Particle* GetParticles() const      { return m_particles.empty() ? nullptr : &m_particles[0]; }
+    const float* GetDensities() const               { return m_densities.empty() ? nullptr : &m_densities[0]; }
+    const float* GetInternalEnergies() const        { return m_internalEnergies.empty() ? nullptr : &m_internalEnergies[0]; }
+    const float* GetSmoothingLengths() const        { return m_smoothingLengths.empty() ? nullptr : &m_smoothingLengths[0]; }
+    const Statistics& GetStatistics() const         { return m_statistics; }
+
+private:
+    void BuildNeighbours(int threads);
+    void ComputeDensities(int threads);
+
+    Parameters m_parameters;
+    uint32_t m_gasCount;
+    float m_maxSmoothingLength;
+    float m_softeningSquared;
+
+    std::vector<ispc::Particle> m_particles;
+    std::vector<ispc::Vec4> m_positions;            // Of all the particles, the sources of the direct sum.
+    std::vector<ispc::Vec3> m_gravity;
+
+    // Per gas particle.
+    std::vector<float> m_densities;
+    std::vector<float> m_pressures;
+    std::vector<float> m_soundSpeeds;
+    std::vector<float> m_internalEnergies;
+    std::vector<float> m_smoothingLengths;
+    std::vector<ispc::Vec3> m_pressureAccelerations;
+    std::vector<float> m_energyRates;
+
+    // The neighbours of gas particle ii are m_neighbours[m_neighbourStarts[ii] ..], m_neighbourCounts[ii] of
+    // them: at ii * NeighbourCapacity, or past all the slots if there are more. The starts pass 32 bits
+    // with more than 2^32 / NeighbourCapacity gas particles.
+    SpatialHash m_hash;
+    std::vector<uint64_t> m_neighbourStarts;
+    std::vector<uint32_t> m_neighbourCounts;
+    std::vector<uint32_t> m_neighbours;
+
+    Statistics m_statistics;
+};
@@ -0,0 +1,317 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#include "stdafx.h"
+#include "SplatRenderer.h"
+#include "Profiler.h"
+#include <cmath>
+
+// Concurrency
+#include <ppl.h>
+
+SplatRenderer::SplatRenderer() :
+    m_width(0),
+    m_height(0),
+    m_tilesX(0),
+    m_tilesY(0),
+    m_viewProjection{},
+    m_spriteRadius(0.0f),
+    m_pixelScale(0.0f)
+{
+}
+
+void SplatRenderer::SetSize(uint32_t width, uint32_t height)
+{
+    m_width = width;
+    m_height = height;
+    m_tilesX = (width + TileSize - 1) / TileSize;
+    m_tilesY = (height + TileSize - 1) / TileSize;
+    m_image.assign(static_cast<size_t>(width) * height * 3, 0);
+}
+
+void SplatRenderer::SetCamera(const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4X4& projection, float spriteRadius)
+{
+    DirectX::XMFLOAT4X4 viewProjection;
+    DirectX::XMStoreFloat4x4(&viewProjection, DirectX::XMMatrixMultiply(DirectX::XMLoadFloat4x4(&view), DirectX::XMLoadFloat4x4(&projection)));
+    memcpy(m_viewProjection, viewProjection.m, sizeof(m_viewProjection));
+
+    m_spriteRadius = spriteRadius;
+    m_pixelScale = projection.m[1][1] * 0.5f * static_cast<float>(m_height);
+}
+
+//
+// The tiles a splat's footprint touches, [*pX0, *pX1) by [*pY0, *pY1).
+//
+static void GetTileRange(const ispc::SplatPoint& point, uint32_t tilesX, uint32_t tilesY, uint32_t* pX0, uint32_t* pX1, uint32_t* pY0, uint32_t* pY1)
+{
+    const float tileSize = static_cast<float>(SplatRenderer::TileSize);
+    const int x0 = static_cast<int>(std::floor((point.x - point.radius) / tileSize));
+    const int x1 = static_cast<int>(std::floor((point.x + point.radius) / tileSize)) + 1;
+    const int y0 = static_cast<int>(std::floor((point.y - point.radius) / tileSize));
+    const int y1 = static_cast<int>(std::floor((point.y + point.radius) / tileSize)) + 1;
+
+    *pX0 = (x0 < 0) ? 0 : static_cast<uint32_t>(x0);
+    *pX1 = (x1 > static_cast<int>(tilesX)) ? tilesX : static_cast<uint32_t>(x1);
+    *pY0 = (y0 < 0) ? 0 : static_cast<uint32_t>(y0);
+    *pY1 = (y1 > static_cast<int>(tilesY)) ? tilesY : static_cast<uint32_t>(y1);
+}
+
+//
+// Counting sort of the splats into the tiles. m_binCounts holds a row of tile counts per thread; the scan
+// runs over the tiles and, within a tile, over the threads, so each tile's list is in particle order.
+//
+void SplatRenderer::Bin(uint32_t particleCount, int threads)
+{
+    PROFILE_SCOPE("Splat bin");
+
+    const uint32_t tileCount = m_tilesX * m_tilesY;
+    m_binCounts.assign(static_cast<size_t>(tileCount) * threads, 0);
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        const uint32_t start = static_cast<uint32_t>((static_cast<uint64_t>(particleCount) * thread) / threads);
+        const uint32_t end = static_cast<uint32_t>((static_cast<uint64_t>(particleCount) * (thread + 1)) / threads);
+        uint32_t* pCounts = &m_binCounts[static_cast<size_t>(tileCount) * thread];
+
+        for (uint32_t ii = start; ii < end; ii++)
+        {
+            if (m_points[ii].radius <= 0.0f)
+                continue;
+
+            uint32_t x0, x1, y0, y1;
+            GetTileRange(m_points[ii], m_tilesX, m_tilesY, &x0, &x1, &y0, &y1);
+            for (uint32_t y = y0; y < y1; y++)
+                for (uint32_t x = x0; x < x1; x++)
+                    pCounts[y * m_tilesX + x]++;
+        }
+    });
+
+    m_tileStarts.resize(tileCount + 1);
+    uint32_t total = 0;
+    for (uint32_t tile = 0; tile < tileCount; tile++)
+    {
+        m_tileStarts[tile] = total;
+        for (int thread = 0; thread < threads; thread++)
+        {
+            uint32_t& count = m_binCounts[static_cast<size_t>(tileCount) * thread + tile];
+            const uint32_t start = total;
+            total += count;
+            count = start;
+        }
+    }
+    m_tileStarts[tileCount] = total;
+    m_binnedPoints.resize(total);
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        const uint32_t start = static_cast<uint32_t>((static_cast<uint64_t>(particleCount) * thread) / threads);
+        const uint32_t end = static_cast<uint32_t>((static_cast<uint64_t>(particleCount) * (thread + 1)) / threads);
+        uint32_t* pCursors = &m_binCounts[static_cast<size_t>(tileCount) * thread];
+
+        for (uint32_t ii = start; ii < end; ii++)
+        {
+            if (m_points[ii].radius <= 0.0f)
+                continue;
+
+            uint32_t x0, x1, y0, y1;
+            GetTileRange(m_points[ii], m_tilesX, m_tilesY, &x0, &x1, &y0, &y1);
+            for (uint32_t y = y0; y < y1; y++)
+                for (uint32_t x = x0; x < x1; x++)
+                    m_binnedPoints[pCursors[y * m_tilesX + x]++] = ii;
+        }
+    });
+}
+
+void SplatRenderer::Render(const ispc::Particle* pParticles, uint32_t particleCount, int threads)
+{
+    PROFILE_SCOPE("Splat render");
+
+    m_points.resize(particleCount);
+
+    concurrency::parallel_for<int>(0, threads, [&](int thread)
+    {
+        PROFILE_SCOPE("Splat project");
+
+        const uint32_t start = static_cast<uint32_t>((static_cast<uint64_t>(particleCount) * thread) / threads);
+        const uint32_t end = static_cast<uint32_t>((static_cast<uint64_t>(particleCount) * (thread + 1)) / threads);
+        if (start < end)
+            ispc::ProjectParticles(pParticles, start, end, m_viewProjection, m_spriteRadius, m_pixelScale, m_width, m_height, m_points.data());
+    });
+
+    Bin(particleCount, threads);
+
+    const int tileCount = static_cast<int>(m_tilesX * m_tilesY);
+    concurrency::parallel_for<int>(0, tileCount, [&](int tile)
+    {
+        PROFILE_SCOPE("Splat tile");
+
+        const uint32_t tileX = (tile % m_tilesX) * TileSize;
+        const uint32_t tileY = (tile / m_tilesX) * TileSize;
+        const uint32_t tileWidth = (m_width - tileX < TileSize) ? m_width - tileX : TileSize;
+        const uint32_t tileHeight = (m_height - tileY < TileSize) ? m_height - tileY : TileSize;
+
+        float red[TileSize * TileSize] = {};
+        float green[TileSize * TileSize] = {};
+        float blue[TileSize * TileSize] = {};
+
+        ispc::SplatTile(m_points.data(), m_binnedPoints.data() + m_tileStarts[tile], m_tileStarts[tile + 1] - m_tileStarts[tile],
+            tileX, tileY, tileWidth, tileHeight, red, green, blue);
+        ispc::ResolveTile(red, green, blue, tileX, tileY, tileWidth, tileHeight, m_width, m_image.data());
+    });
+}
+
+static uint32_t Crc32(const uint8_t* pData, size_t length, uint32_t crc)
+{
+    static uint32_t table[256];
+    static bool tableReady = false;
+    if (!tableReady)
+    {
+        for (uint32_t n = 0; n < 256; n++)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        tableReady = true;
+    }
+
+    crc = ~crc;
+    for (size_t ii = 0; ii < length; ii++)
+        crc = table[(crc ^ pData[ii]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void AppendBigEndian(std::vector<uint8_t>* pBytes, uint32_t value)
+{
+    pBytes->push_back(static_cast<uint8_t>(value >> 24));
+    pBytes->push_back(static_cast<uint8_t>(value >> 16));
+    pBytes->push_back(static_cast<uint8_t>(value >> 8));
+    pBytes->push_back(static_cast<uint8_t>(value));
+}
+
+static void AppendChunk(std::vector<uint8_t>* pFile, const char* pType, const std::vector<uint8_t>& data)
+{
+    AppendBigEndian(pFile, static_cast<uint32_t>(data.size()));
+
+    const size_t typeStart = pFile->size();
+    pFile->insert(pFile->end(), pType, pType + 4);
+    pFile->insert(pFile->end(), data.begin(), data.end());
+
+    AppendBigEndian(pFile, Crc32(pFile->data() + typeStart, pFile->size() - typeStart, 0));
+}
+
+//
+// The image rows, each behind a 'none' filter byte, go into a zlib stream of stored deflate blocks. The
+// files are about as large as the raw pixels, but need no compressor and write at disk speed.
+//
+bool SplatRenderer::WritePng(const wchar_t* pPath) const
+{
+    static const uint8_t Signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    static const size_t MaxStoredBlock = 65535;
+
+    if (m_width == 0 || m_height == 0)
+        return false;
+
+    const size_t rowBytes = static_cast<size_t>(m_width) * 3;
+    std::vector<uint8_t> rows;
+    rows.reserve((rowBytes + 1) * m_height);
+    for (uint32_t y = 0; y < m_height; y++)
+    {
+        rows.push_back(0);
+        rows.insert(rows.end(), m_image.begin() + y * rowBytes, m_image.begin() + (y + 1) * rowBytes);
+    }
+
+    std::vector<uint8_t> header;
+    AppendBigEndian(&header, m_width);
+    AppendBigEndian(&header, m_height);
+    header.push_back(8);        // Bit depth
+    header.push_back(2);        // RGB
+    header.push_back(0);        // Deflate
+    header.push_back(0);        // Adaptive filtering
+    header.push_back(0);        // No interlace
+
+    std::vector<uint8_t> zlib;
+    zlib.reserve(rows.size() + rows.size() / MaxStoredBlock * 5 + 16);
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+
+    uint32_t adlerA = 1;
+    uint32_t adlerB = 0;
+    for (size_t start = 0; ; start += MaxStoredBlock)
+    {
+        const size_t length = (rows.size() - start < MaxStoredBlock) ? rows.size() - start : MaxStoredBlock;
+        const bool last = start + length >= rows.size();
+
+        zlib.push_back(last ? 1 : 0);
+        zlib.push_back(static_cast<uint8_t>(length));
+        zlib.push_back(static_cast<uint8_t>(length >> 8));
+        zlib.push_back(static_cast<uint8_t>(~length));
+        zlib.push_back(static_cast<uint8_t>(~length >> 8));
+        zlib.insert(zlib.end(), rows.begin() + start, rows.begin() + start + length);
+
+        // Runs of up to 5552 bytes cannot overflow the sums before the modulo.
+        for (size_t ii = start; ii < start + length; )
+        {
+            const size_t runEnd = (start + length - ii < 5552) ? start + length : ii + 5552;
+            for (; ii < runEnd; ii++)
+            {
+                adlerA += rows[ii];
+                adlerB += adlerA;
+            }
+            adlerA %= 65521;
+            adlerB %= 65521;
+        }
+
+        if (last)
+            break;
+    }
+    AppendBigEndian(&zlib, (adlerB << 16) | adlerA);
+
+    std::vector<uint8_t> file(Signature, Signature + sizeof(Signature));
+    AppendChunk(&file, "IHDR", header);
+    AppendChunk(&file, "IDAT", zlib);
+    AppendChunk(&file, "IEND", std::vector<uint8_t>());
+
+    FILE* pFile = nullptr;
+    if (_wfopen_s(&pFile, pPath, L"wb") != 0 || !pFile)
+        return false;
+
+    const bool written = fwrite(file.data(), 1, file.size(), pFile) == file.size();
+    fclose(pFile);
+    return written;
+}
+
+bool SplatRenderer::WriteRaw(const wchar_t* pPath) const
+{
+    FILE* pFile = nullptr;
+    if (_wfopen_s(&pFile, pPath, L"wb") != 0 || !pFile)
+        return false;
+
+    const bool written = fwrite(m_image.data(), 1, m_image.size(), pFile) == m_image.size();
+    fclose(pFile);
+    return written;
+}
@@ -0,0 +1,85 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#pragma once
+
+// Add the auto generated ISPC kernel header
+#include "nBodyGravitySplat_ispc.h"
+
+//
+// CPU renderer of the particles as additive Gaussian sprites, for machines without a GPU.
+//
+// Render() runs three parallel stages (nBodyGravitySplat.ispc):
+//
+//  - project every particle to a screen space splat with the camera's matrices;
+//  - bin the splats into TileSize square tiles, each thread counting then writing the splats of its
+//    share of the particles, so every tile lists its splats in particle order;
+//  - splat and resolve the tiles, one tile per task, each in its own small accumulators.
+//
+// No two tasks write the same pixel and the sums run in particle order, so the image does not depend on
+// the thread count. It is 8 bit RGB, top row first, written out with WritePng() or WriteRaw().
+//
+class SplatRenderer
+{
+public:
+    static const uint32_t TileSize = 32;
+
+    SplatRenderer();
+
+    void SetSize(uint32_t width, uint32_t height);
+    uint32_t GetWidth() const   { return m_width; }
+    uint32_t GetHeight() const  { return m_height; }
+
+    // Row vector view and projection matrices, as SimpleCamera gives them, and the world space half size
+    // of a sprite.
+    void SetCamera(const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4X4& projection, float spriteRadius);
+
+    void Render(const ispc::Particle* pParticles, uint32_t particleCount, int threads);
+
+    const std::vector<uint8_t>& GetImage() const { return m_image; }
+
+    // An RGB PNG with stored (uncompressed) deflate blocks, or the bare pixels.
+    bool WritePng(const wchar_t* pPath) const;
+    bool WriteRaw(const wchar_t* pPath) const;
+
+private:
+    void Bin(uint32_t particleCount, int threads);
+
+    uint32_t m_width;
+    uint32_t m_height;
+    uint32_t m_tilesX;
+    uint32_t m_tilesY;
+
+    float m_viewProjection[16];
+    float m_spriteRadius;
+    float m_pixelScale;
+
+    std::vector<ispc::SplatPoint> m_points;
+    std::vector<uint32_t> m_binCounts;          // Per thread and tile, then the start of each in m_binnedPoints.
+    std::vector<uint32_t> m_tileStarts;         // Start of each tile's splats in m_binnedPoints, and the end.
+    std::vector<uint32_t> m_binnedPoints;
+    std::vector<uint8_t> m_image;
+};
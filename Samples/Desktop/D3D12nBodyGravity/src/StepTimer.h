@@ -11,54 +11,137 @@
 
 #pragma once
 
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+
+//
+// Monotonic clock behind StepTimer.
+//
+// The default source is std::chrono::steady_clock, which is QueryPerformanceCounter on Windows and
+// clock_gettime(CLOCK_MONOTONIC) on Linux. The time stamp counter source reads __rdtsc directly, it is
+// cheaper to read and its rate is calibrated against the steady clock when the source is selected.
+// It assumes an invariant TSC, which every x64 CPU of the last decade has.
+//
+class StepClock
+{
+public:
+    enum Source
+    {
+        e_SteadyClock,
+        e_TimeStampCounter,
+    };
+
+    explicit StepClock(Source source = e_SteadyClock)    { SetSource(source); }
+
+    void SetSource(Source source)
+    {
+        m_source = source;
+
+        if (source == e_TimeStampCounter)
+        {
+            // Count TSC ticks over 10ms of steady clock time.
+            auto begin = std::chrono::steady_clock::now();
+            uint64_t tscBegin = __rdtsc();
+            auto end = begin;
+            while (end - begin < std::chrono::milliseconds(10))
+                end = std::chrono::steady_clock::now();
+            uint64_t tscEnd = __rdtsc();
+
+            double seconds = std::chrono::duration<double>(end - begin).count();
+            m_ticksPerSecond = static_cast<uint64_t>(static_cast<double>(tscEnd - tscBegin) / seconds);
+        }
+        else
+        {
+            m_ticksPerSecond = static_cast<uint64_t>(std::chrono::steady_clock::period::den / std::chrono::steady_clock::period::num);
+        }
+    }
+
+    Source GetSource() const                { return m_source; }
+    uint64_t GetTicksPerSecond() const      { return m_ticksPerSecond; }
+
+    uint64_t Now() const
+    {
+        if (m_source == e_TimeStampCounter)
+            return __rdtsc();
+
+        return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+    }
+
+    uint64_t ToNanoseconds(uint64_t ticks) const
+    {
+        return static_cast<uint64_t>(static_cast<double>(ticks) * 1e9 / static_cast<double>(m_ticksPerSecond));
+    }
+
+private:
+    Source m_source;
+    uint64_t m_ticksPerSecond;
+};
+
 // Helper class for animation and simulation timing.
 class StepTimer
 {
 public:
     StepTimer() :
+        m_lastDeltaNanoseconds(0),
         m_elapsedTicks(0),
         m_totalTicks(0),
         m_leftOverTicks(0),
         m_frameCount(0),
         m_framesPerSecond(0),
         m_framesThisSecond(0),
-        m_qpcSecondCounter(0),
+        m_clockSecondCounter(0),
         m_isFixedTimeStep(false),
         m_targetElapsedTicks(TicksPerSecond / 60)
     {
-        QueryPerformanceFrequency(&m_qpcFrequency);
-        QueryPerformanceCounter(&m_qpcLastTime);
+        ResetClock();
+    }
 
-        // Initialize max delta to a second so the minimum frame rate is limited to 1fps.
-        m_qpcMaxDelta = m_qpcFrequency.QuadPart;
+    // Select the clock source. This restarts the elapsed time, the totals are kept.
+    void SetClockSource(StepClock::Source source)
+    {
+        m_clock.SetSource(source);
+        ResetClock();
+        ResetElapsedTime();
     }
 
+    const StepClock& GetClock() const					{ return m_clock; }
+
+    // Get the unclamped wall time between the last two Tick calls, for frame time statistics.
+    uint64_t GetLastDeltaNanoseconds() const			{ return m_lastDeltaNanoseconds; }
+
     // Get elapsed time since the previous Update call.
-    UINT64 GetElapsedTicks() const						{ return m_elapsedTicks; }
+    uint64_t GetElapsedTicks() const						{ return m_elapsedTicks; }
     double GetElapsedSeconds() const					{ return TicksToSeconds(m_elapsedTicks); }
 
     // Get total time since the start of the program.
-    UINT64 GetTotalTicks() const						{ return m_totalTicks; }
+    uint64_t GetTotalTicks() const						{ return m_totalTicks; }
     double GetTotalSeconds() const						{ return TicksToSeconds(m_totalTicks); }
 
     // Get total number of updates since start of the program.
-    UINT32 GetFrameCount() const						{ return m_frameCount; }
+    uint32_t GetFrameCount() const						{ return m_frameCount; }
 
     // Get the current framerate.
-    UINT32 GetFramesPerSecond() const					{ return m_framesPerSecond; }
+    uint32_t GetFramesPerSecond() const					{ return m_framesPerSecond; }
 
     // Set whether to use fixed or variable timestep mode.
     void SetFixedTimeStep(bool isFixedTimestep)			{ m_isFixedTimeStep = isFixedTimestep; }
 
     // Set how often to call Update when in fixed timestep mode.
-    void SetTargetElapsedTicks(UINT64 targetElapsed)	{ m_targetElapsedTicks = targetElapsed; }
+    void SetTargetElapsedTicks(uint64_t targetElapsed)	{ m_targetElapsedTicks = targetElapsed; }
     void SetTargetElapsedSeconds(double targetElapsed)	{ m_targetElapsedTicks = SecondsToTicks(targetElapsed); }
 
     // Integer format represents time using 10,000,000 ticks per second.
-    static const UINT64 TicksPerSecond = 10000000;
+    static const uint64_t TicksPerSecond = 10000000;
 
-    static double TicksToSeconds(UINT64 ticks)			{ return static_cast<double>(ticks) / TicksPerSecond; }
-    static UINT64 SecondsToTicks(double seconds)		{ return static_cast<UINT64>(seconds * TicksPerSecond); }
+    static double TicksToSeconds(uint64_t ticks)			{ return static_cast<double>(ticks) / TicksPerSecond; }
+    static uint64_t SecondsToTicks(double seconds)		{ return static_cast<uint64_t>(seconds * TicksPerSecond); }
 
     // After an intentional timing discontinuity (for instance a blocking IO operation)
     // call this to avoid having the fixed timestep logic attempt a set of catch-up 
@@ -66,12 +149,12 @@ public:
 
     void ResetElapsedTime()
     {
-        QueryPerformanceCounter(&m_qpcLastTime);
+        m_clockLastTime = m_clock.Now();
 
         m_leftOverTicks = 0;
         m_framesPerSecond = 0;
         m_framesThisSecond = 0;
-        m_qpcSecondCounter = 0;
+        m_clockSecondCounter = 0;
     }
 
     typedef void(*LPUPDATEFUNC) (void);
@@ -80,26 +163,26 @@ public:
     void Tick(LPUPDATEFUNC update)
     {
         // Query the current time.
-        LARGE_INTEGER currentTime;
-
-        QueryPerformanceCounter(&currentTime);
+        uint64_t currentTime = m_clock.Now();
 
-        UINT64 timeDelta = currentTime.QuadPart - m_qpcLastTime.QuadPart;
+        uint64_t timeDelta = currentTime - m_clockLastTime;
 
-        m_qpcLastTime = currentTime;
-        m_qpcSecondCounter += timeDelta;
+        m_clockLastTime = currentTime;
+        m_clockSecondCounter += timeDelta;
+        m_lastDeltaNanoseconds = m_clock.ToNanoseconds(timeDelta);
 
         // Clamp excessively large time deltas (e.g. after paused in the debugger).
-        if (timeDelta > m_qpcMaxDelta)
+        if (timeDelta > m_clockMaxDelta)
         {
-            timeDelta = m_qpcMaxDelta;
+            timeDelta = m_clockMaxDelta;
         }
 
-        // Convert QPC units into a canonical tick format. This cannot overflow due to the previous clamp.
-        timeDelta *= TicksPerSecond;
-        timeDelta /= m_qpcFrequency.QuadPart;
+        // Convert clock units into a canonical tick format. Split the multiply so that a 1 second
+        // delta of a GHz rate clock cannot overflow.
+        uint64_t frequency = m_clock.GetTicksPerSecond();
+        timeDelta = (timeDelta / frequency) * TicksPerSecond + ((timeDelta % frequency) * TicksPerSecond) / frequency;
 
-        UINT32 lastFrameCount = m_frameCount;
+        uint32_t lastFrameCount = m_frameCount;
 
         if (m_isFixedTimeStep)
         {
@@ -152,32 +235,41 @@ public:
             m_framesThisSecond++;
         }
 
-        if (m_qpcSecondCounter >= static_cast<UINT64>(m_qpcFrequency.QuadPart))
+        if (m_clockSecondCounter >= m_clock.GetTicksPerSecond())
         {
             m_framesPerSecond = m_framesThisSecond;
             m_framesThisSecond = 0;
-            m_qpcSecondCounter %= m_qpcFrequency.QuadPart;
+            m_clockSecondCounter %= m_clock.GetTicksPerSecond();
         }
     }
 
 private:
-    // Source timing data uses QPC units.
-    LARGE_INTEGER m_qpcFrequency;
-    LARGE_INTEGER m_qpcLastTime;
-    UINT64 m_qpcMaxDelta;
+    void ResetClock()
+    {
+        m_clockLastTime = m_clock.Now();
+
+        // Initialize max delta to a second so the minimum frame rate is limited to 1fps.
+        m_clockMaxDelta = m_clock.GetTicksPerSecond();
+    }
+
+    // Source timing data uses clock units.
+    StepClock m_clock;
+    uint64_t m_clockLastTime;
+    uint64_t m_clockMaxDelta;
+    uint64_t m_lastDeltaNanoseconds;
 
     // Derived timing data uses a canonical tick format.
-    UINT64 m_elapsedTicks;
-    UINT64 m_totalTicks;
-    UINT64 m_leftOverTicks;
+    uint64_t m_elapsedTicks;
+    uint64_t m_totalTicks;
+    uint64_t m_leftOverTicks;
 
     // Members for tracking the framerate.
-    UINT32 m_frameCount;
-    UINT32 m_framesPerSecond;
-    UINT32 m_framesThisSecond;
-    UINT64 m_qpcSecondCounter;
+    uint32_t m_frameCount;
+    uint32_t m_framesPerSecond;
+    uint32_t m_framesThisSecond;
+    uint64_t m_clockSecondCounter;
 
     // Members for configuring fixed timestep mode.
     bool m_isFixedTimeStep;
-    UINT64 m_targetElapsedTicks;
+    uint64_t m_targetElapsedTicks;
 };
@@ -0,0 +1,102 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#include "stdafx.h"
+#include "TimeHistogram.h"
+
+TimeHistogram::TimeHistogram()
+{
+    Reset();
+}
+
+void TimeHistogram::Reset()
+{
+    memset(m_counts, 0, sizeof(m_counts));
+    m_count = 0;
+    m_sum = 0;
+    m_min = UINT64_MAX;
+    m_max = 0;
+}
+
+//
+// Values below 2 * SubBucketCount index themselves. A larger value is shifted right until it fits in
+// [SubBucketCount, 2 * SubBucketCount), the shift picks the power of two range and the remaining bits
+// the linear bucket inside it.
+//
+uint32_t TimeHistogram::BucketIndex(uint64_t value)
+{
+    if (value < 2 * SubBucketCount)
+        return static_cast<uint32_t>(value);
+
+    uint32_t shift = 0;
+    while ((value >> shift) >= 2 * SubBucketCount)
+        shift++;
+
+    return SubBucketCount * (shift + 1) + static_cast<uint32_t>((value >> shift) - SubBucketCount);
+}
+
+uint64_t TimeHistogram::BucketUpperBound(uint32_t index)
+{
+    if (index < 2 * SubBucketCount)
+        return index;
+
+    uint32_t shift = index / SubBucketCount - 1;
+    uint64_t subBucket = index % SubBucketCount + SubBucketCount;
+
+    return ((subBucket + 1) << shift) - 1;
+}
+
+void TimeHistogram::Record(uint64_t nanoseconds)
+{
+    m_counts[BucketIndex(nanoseconds)]++;
+    m_count++;
+    m_sum += nanoseconds;
+    m_min = (nanoseconds < m_min) ? nanoseconds : m_min;
+    m_max = (nanoseconds > m_max) ? nanoseconds : m_max;
+}
+
+uint64_t TimeHistogram::GetPercentile(double percentile) const
+{
+    if (m_count == 0)
+        return 0;
+
+    // Rank of the value, 1 based, at least the first value.
+    double rank = ceil(percentile * 0.01 * static_cast<double>(m_count));
+    uint64_t target = (rank < 1.0) ? 1 : static_cast<uint64_t>(rank);
+
+    uint64_t seen = 0;
+    for (uint32_t ii = 0; ii < BucketCount; ii++)
+    {
+        seen += m_counts[ii];
+        if (seen >= target)
+        {
+            uint64_t value = BucketUpperBound(ii);
+            return (value < m_max) ? value : m_max;
+        }
+    }
+
+    return m_max;
+}
@@ -0,0 +1,68 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Intel Corporation
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of 
+// the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+// SOFTWARE.
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
+
+#pragma once
+
+//
+// Log-linear histogram of durations in nanoseconds, in the style of HdrHistogram.
+//
+// Values below 2 * SubBucketCount are counted exactly. Above that every power of two range is split into
+// SubBucketCount linear buckets, so any recorded value is known to within 1/SubBucketCount (1.6%) of
+// itself from 1ns to centuries, in a fixed 30KB table. Recording is a few shifts and an increment.
+//
+// Not thread safe, each histogram is meant to be fed from one thread.
+//
+class TimeHistogram
+{
+public:
+    static const uint32_t SubBucketBits = 6;
+    static const uint32_t SubBucketCount = 1u << SubBucketBits;
+    static const uint32_t BucketCount = SubBucketCount * (64 - SubBucketBits + 1);
+
+    TimeHistogram();
+
+    void Record(uint64_t nanoseconds);
+    void Reset();
+
+    uint64_t GetCount() const               { return m_count; }
+    uint64_t GetMin() const                 { return m_count ? m_min : 0; }
+    uint64_t GetMax() const                 { return m_max; }
+    double GetMean() const                  { return m_count ? static_cast<double>(m_sum) / static_cast<double>(m_count) : 0.0; }
+
+    // Smallest recorded value that at least 'percentile' percent of the recorded values do not exceed,
+    // rounded up to the top of its bucket and clamped to the maximum. 0 when nothing was recorded.
+    uint64_t GetPercentile(double percentile) const;
+
+private:
+    static uint32_t BucketIndex(uint64_t value);
+    static uint64_t BucketUpperBound(uint32_t index);
+
+    uint64_t m_counts[BucketCount];
+    uint64_t m_count;
+    uint64_t m_sum;
+    uint64_t m_min;
+    uint64_t m_max;
+};
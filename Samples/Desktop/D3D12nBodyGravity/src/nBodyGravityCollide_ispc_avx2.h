@@ -0,0 +1,76 @@
+//
+// E:\github\ISPC-DirectX-Graphics-Samples\Samples\Desktop\D3D12nBodyGravity\src\nBodyGravityCollide_ispc_avx2.h
+// (Header automatically generated by the ispc compiler.)
+// DO NOT EDIT THIS FILE.
+//
+
+#ifndef ISPC_E__GITHUB_ISPC_DIRECTX_GRAPHICS_SAMPLES_SAMPLES_DESKTOP_D3D12NBODYGRAVITY_SRC_NBODYGRAVITYCOLLIDE_ISPC_AVX2_H
+#define ISPC_E__GITHUB_ISPC_DIRECTX_GRAPHICS_SAMPLES_SAMPLES_DESKTOP_D3D12NBODYGRAVITY_SRC_NBODYGRAVITYCOLLIDE_ISPC_AVX2_H
+
+#include <stdint.h>
+
+
+
+#ifdef __cplusplus
+namespace ispc { /* namespace */
+#endif // __cplusplus
+
+#ifndef __ISPC_ALIGN__
+#if defined(__clang__) || !defined(_MSC_VER)
+// Clang, GCC, ICC
+#define __ISPC_ALIGN__(s) __attribute__((aligned(s)))
+#define __ISPC_ALIGNED_STRUCT__(s) struct __ISPC_ALIGN__(s)
+#else
+// Visual Studio
+#define __ISPC_ALIGN__(s) __declspec(align(s))
+#define __ISPC_ALIGNED_STRUCT__(s) __ISPC_ALIGN__(s) struct
+#endif
+#endif
+
+#ifndef __ISPC_STRUCT_Vec3__
+#define __ISPC_STRUCT_Vec3__
+struct Vec3 {
+    float x;
+    float y;
+    float z;
+};
+#endif
+
+#ifndef __ISPC_STRUCT_Planetesimal__
+#define __ISPC_STRUCT_Planetesimal__
+struct Planetesimal {
+    float x;
+    float y;
+    float z;
+    float radius;
+    float vx;
+    float vy;
+    float vz;
+    float massG;
+};
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////
+// Functions exported from ispc code
+///////////////////////////////////////////////////////////////////////////
+#if defined(__cplusplus) && (! defined(__ISPC_NO_EXTERN_C) || !__ISPC_NO_EXTERN_C )
+extern "C" {
+#endif // __cplusplus
+    extern void PlanetesimalAccumulate(const struct Planetesimal * bodies, uint32_t bodyStart, uint32_t bodyEnd, uint32_t bodyCount, float starMassG, float softeningSquared, struct Vec3 * accelerations);
+    extern void PlanetesimalIntegrate(struct Planetesimal * bodies, uint32_t bodyStart, uint32_t bodyEnd, const struct Vec3 * accelerations, float timeStep);
+    extern void CollisionFindPartners(const struct Planetesimal * bodies, uint32_t bodyStart, uint32_t bodyEnd, const uint32_t * bucketStarts, const uint32_t * sortedIndices, float invCellSize, uint32_t tableMask, uint32_t * partners);
+    extern void CollisionFindLargePartners(const struct Planetesimal * bodies, uint32_t bodyStart, uint32_t bodyEnd, const uint32_t * largeBodies, uint32_t largeCount, uint32_t * partners);
+    extern uint32_t CollisionFindPartnerDirect(const struct Planetesimal * bodies, uint32_t bodyCount, uint32_t body);
+    extern uint32_t CollisionCountSurvivors(const struct Planetesimal * bodies, uint32_t bodyStart, uint32_t bodyEnd);
+    extern uint32_t CollisionCompact(const struct Planetesimal * bodies, uint32_t bodyStart, uint32_t bodyEnd, struct Planetesimal * output, uint32_t outputStart);
+#if defined(__cplusplus) && (! defined(__ISPC_NO_EXTERN_C) || !__ISPC_NO_EXTERN_C )
+} /* end extern C */
+#endif // __cplusplus
+
+
+#ifdef __cplusplus
+} /* namespace */
+#endif // __cplusplus
+
+#endif // ISPC_E__GITHUB_ISPC_DIRECTX_GRAPHICS_SAMPLES_SAMPLES_DESKTOP_D3D12NBODYGRAVITY_SRC_NBODYGRAVITYCOLLIDE_ISPC_AVX2_H
@@ -0,0 +1,102 @@
+//
+// E:\github\ISPC-DirectX-Graphics-Samples\Samples\Desktop\D3D12nBodyGravity\src\nBodyGravityLod_ispc_avx512skx.h
+// (Header automatically generated by the ispc compiler.)
+// DO NOT EDIT THIS FILE.
+//
+
+#ifndef ISPC_E__GITHUB_ISPC_DIRECTX_GRAPHICS_SAMPLES_SAMPLES_DESKTOP_D3D12NBODYGRAVITY_SRC_NBODYGRAVITYLOD_ISPC_AVX512SKX_H
+#define ISPC_E__GITHUB_ISPC_DIRECTX_GRAPHICS_SAMPLES_SAMPLES_DESKTOP_D3D12NBODYGRAVITY_SRC_NBODYGRAVITYLOD_ISPC_AVX512SKX_H
+
+#include <stdint.h>
+
+
+
+#ifdef __cplusplus
+namespace ispc { /* namespace */
+#endif // __cplusplus
+
+#ifndef __ISPC_ALIGN__
+#if defined(__clang__) || !defined(_MSC_VER)
+// Clang, GCC, ICC
+#define __ISPC_ALIGN__(s) __attribute__((aligned(s)))
+#define __ISPC_ALIGNED_STRUCT__(s) struct __ISPC_ALIGN__(s)
+#else
+// Visual Studio
+#define __ISPC_ALIGN__(s) __declspec(align(s))
+#define __ISPC_ALIGNED_STRUCT__(s) __ISPC_ALIGN__(s) struct
+#endif
+#endif
+
+#ifndef __ISPC_STRUCT_Vec4__
+#define __ISPC_STRUCT_Vec4__
+struct Vec4 {
+    float x;
+    float y;
+    float z;
+    float w;
+};
+#endif
+
+#ifndef __ISPC_STRUCT_Particle__
+#define __ISPC_STRUCT_Particle__
+struct Particle {
+    struct Vec4 position;
+    struct Vec4 velocity;
+};
+#endif
+
+#ifndef __ISPC_STRUCT_RenderRecord__
+#define __ISPC_STRUCT_RenderRecord__
+struct RenderRecord {
+    uint16_t x;
+    uint16_t y;
+    uint16_t z;
+    uint16_t speed;
+};
+#endif
+
+#ifndef __ISPC_STRUCT_LodGrid__
+#define __ISPC_STRUCT_LodGrid__
+struct LodGrid {
+    float originX;
+    float originY;
+    float originZ;
+    float invCellSize;
+    int32_t gridSize;
+};
+#endif
+
+#ifndef __ISPC_STRUCT_LodCell__
+#define __ISPC_STRUCT_LodCell__
+struct LodCell {
+    float x;
+    float y;
+    float z;
+    float speed;
+    uint32_t count;
+};
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////
+// Functions exported from ispc code
+///////////////////////////////////////////////////////////////////////////
+#if defined(__cplusplus) && (! defined(__ISPC_NO_EXTERN_C) || !__ISPC_NO_EXTERN_C )
+extern "C" {
+#endif // __cplusplus
+    extern void LodBounds(const struct Particle * particles, uint32_t particleStart, uint32_t particleEnd, float * bounds);
+    extern void LodCountCells(const struct Particle * particles, uint32_t particleStart, uint32_t particleEnd, const struct LodGrid &grid, uint32_t * counts);
+    extern void LodSortCells(const struct Particle * particles, uint32_t particleStart, uint32_t particleEnd, const struct LodGrid &grid, uint32_t * cursors, uint32_t * sorted);
+    extern void LodSumCells(const struct Particle * particles, const uint32_t * sorted, const uint32_t * cellStarts, uint32_t cellStart, uint32_t cellEnd, struct LodCell * cells);
+    extern uint32_t LodCountNear(const struct Particle * particles, const uint32_t * sorted, uint32_t sortedStart, uint32_t sortedEnd, const float * planes, float radius);
+    extern uint32_t LodCompactNear(const struct Particle * particles, const uint32_t * sorted, uint32_t sortedStart, uint32_t sortedEnd, const float * planes, float radius, struct RenderRecord * renderRecords, uint32_t outputStart);
+#if defined(__cplusplus) && (! defined(__ISPC_NO_EXTERN_C) || !__ISPC_NO_EXTERN_C )
+} /* end extern C */
+#endif // __cplusplus
+
+
+#ifdef __cplusplus
+} /* namespace */
+#endif // __cplusplus
+
+#endif // ISPC_E__GITHUB_ISPC_DIRECTX_GRAPHICS_SAMPLES_SAMPLES_DESKTOP_D3D12NBODYGRAVITY_SRC_NBODYGRAVITYLOD_ISPC_AVX512SKX_H
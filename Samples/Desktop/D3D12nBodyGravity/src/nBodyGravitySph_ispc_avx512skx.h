@@ -0,0 +1,78 @@
+//
+// E:\github\ISPC-DirectX-Graphics-Samples\Samples\Desktop\D3D12nBodyGravity\src\nBodyGravitySph_ispc_avx512skx.h
+// (Header automatically generated by the ispc compiler.)
+// DO NOT EDIT THIS FILE.
+//
+
+#ifndef ISPC_E__GITHUB_ISPC_DIRECTX_GRAPHICS_SAMPLES_SAMPLES_DESKTOP_D3D12NBODYGRAVITY_SRC_NBODYGRAVITYSPH_ISPC_AVX512SKX_H
+#define ISPC_E__GITHUB_ISPC_DIRECTX_GRAPHICS_SAMPLES_SAMPLES_DESKTOP_D3D12NBODYGRAVITY_SRC_NBODYGRAVITYSPH_ISPC_AVX512SKX_H
+
+#include <stdint.h>
+
+
+
+#ifdef __cplusplus
+namespace ispc { /* namespace */
+#endif // __cplusplus
+
+#ifndef __ISPC_ALIGN__
+#if defined(__clang__) || !defined(_MSC_VER)
+// Clang, GCC, ICC
+#define __ISPC_ALIGN__(s) __attribute__((aligned(s)))
+#define __ISPC_ALIGNED_STRUCT__(s) struct __ISPC_ALIGN__(s)
+#else
+// Visual Studio
+#define __ISPC_ALIGN__(s) __declspec(align(s))
+#define __ISPC_ALIGNED_STRUCT__(s) __ISPC_ALIGN__(s) struct
+#endif
+#endif
+
+#ifndef __ISPC_STRUCT_Vec4__
+#define __ISPC_STRUCT_Vec4__
+struct Vec4 {
+    float x;
+    float y;
+    float z;
+    float w;
+};
+#endif
+
+#ifndef __ISPC_STRUCT_Vec3__
+#define __ISPC_STRUCT_Vec3__
+struct Vec3 {
+    float x;
+    float y;
+    float z;
+};
+#endif
+
+#ifndef __ISPC_STRUCT_Particle__
+#define __ISPC_STRUCT_Particle__
+struct Particle {
+    struct Vec4 position;
+    struct Vec4 velocity;
+};
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////
+// Functions exported from ispc code
+///////////////////////////////////////////////////////////////////////////
+#if defined(__cplusplus) && (! defined(__ISPC_NO_EXTERN_C) || !__ISPC_NO_EXTERN_C )
+extern "C" {
+#endif // __cplusplus
+    extern void SphGravity(const struct Particle * particles, uint32_t particleStart, uint32_t particleEnd, const struct Vec4 * sources, uint32_t sourceCount, float particleMassG, float softeningSquared, struct Vec3 * accelerations);
+    extern void SphFindNeighbours(const struct Particle * particles, uint32_t gasStart, uint32_t gasEnd, const float * smoothingLengths, const uint32_t * bucketStarts, const uint32_t * sortedIndices, float invCellSize, uint32_t tableMask, uint32_t * neighbours, uint32_t capacity, uint32_t * counts);
+    extern void SphDensity(const struct Particle * particles, uint32_t gasStart, uint32_t gasEnd, const float * smoothingLengths, const float * internalEnergies, const uint64_t * neighbourStarts, const uint32_t * neighbourCounts, const uint32_t * neighbours, float adiabaticIndex, float * densities, float * pressures, float * soundSpeeds);
+    extern void SphForces(const struct Particle * particles, uint32_t gasStart, uint32_t gasEnd, const float * smoothingLengths, const float * densities, const float * pressures, const float * soundSpeeds, const uint64_t * neighbourStarts, const uint32_t * neighbourCounts, const uint32_t * neighbours, float viscosityAlpha, float viscosityBeta, struct Vec3 * accelerations, float * energyRates);
+    extern void SphIntegrate(struct Particle * particles, uint32_t particleStart, uint32_t particleEnd, uint32_t gasCount, const struct Vec3 * gravity, const struct Vec3 * pressureAccelerations, const float * energyRates, const float * densities, float * internalEnergies, float * smoothingLengths, float smoothingFactor, float maxSmoothingLength, float timeStep);
+#if defined(__cplusplus) && (! defined(__ISPC_NO_EXTERN_C) || !__ISPC_NO_EXTERN_C )
+} /* end extern C */
+#endif // __cplusplus
+
+
+#ifdef __cplusplus
+} /* namespace */
+#endif // __cplusplus
+
+#endif // ISPC_E__GITHUB_ISPC_DIRECTX_GRAPHICS_SAMPLES_SAMPLES_DESKTOP_D3D12NBODYGRAVITY_SRC_NBODYGRAVITYSPH_ISPC_AVX512SKX_H
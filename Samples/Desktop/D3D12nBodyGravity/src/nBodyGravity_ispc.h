@@ -38,6 +38,15 @@ struct Vec4 {
 };
 #endif
 
+#ifndef __ISPC_STRUCT_Vec3__
+#define __ISPC_STRUCT_Vec3__
+struct Vec3 {
+    float x;
+    float y;
+    float z;
+};
+#endif
+
 #ifndef __ISPC_STRUCT_Particle__
 #define __ISPC_STRUCT_Particle__
 struct Particle {
@@ -46,6 +55,16 @@ struct Particle {
 };
 #endif
 
+#ifndef __ISPC_STRUCT_RenderRecord__
+#define __ISPC_STRUCT_RenderRecord__
+struct RenderRecord {
+    uint16_t x;
+    uint16_t y;
+    uint16_t z;
+    uint16_t speed;
+};
+#endif
+
 
 ///////////////////////////////////////////////////////////////////////////
 // Functions exported from ispc code
@@ -53,7 +72,9 @@ struct Particle {
 #if defined(__cplusplus) && (! defined(__ISPC_NO_EXTERN_C) || !__ISPC_NO_EXTERN_C )
 extern "C" {
 #endif // __cplusplus
-    extern void ProcessParticles(uint32_t particleStart, uint32_t particleCount, struct Particle * readParticles, struct Particle * writeParticles, uint32_t totalParticles);
+    extern void ProcessParticles(uint32_t particleStart, uint32_t particleCount, struct Particle * readParticles, struct Particle * writeParticles, uint32_t totalParticles, uint32_t unroll, uint32_t tileSize, struct Vec3 * partialAccels, struct RenderRecord * renderRecords);
+    extern void ProcessParticlesInner(uint32_t particleStart, uint32_t particleCount, struct Particle * readParticles, struct Particle * writeParticles, uint32_t totalParticles, struct RenderRecord * renderRecords);
+    extern void PackRenderRecords(const struct Particle * particles, uint32_t particleStart, uint32_t particleEnd, struct RenderRecord * renderRecords);
 #if defined(__cplusplus) && (! defined(__ISPC_NO_EXTERN_C) || !__ISPC_NO_EXTERN_C )
 } /* end extern C */
 #endif // __cplusplus